@@ -1,40 +1,193 @@
 #include "Activation.h"
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#define UNKNOWN_ACTIVATION_ERROR "Error: unknown activation: "
+#define UNNAMED_ACTIVATION_ERROR "Error: activation is not registered"
+
+typedef std::pair<std::string, Activation_Func> named_activation;
+
+
+/**
+ * @brief Returns a copy of a matrix with an element-wise functor applied.
+ */
+template <typename F>
+static Matrix applied (const Matrix& mat, F f)
+{
+  Matrix result = mat;
+  activation::apply (result, f);
+  return result;
+}
 
 
 Matrix activation::relu (const Matrix &mat)
 {
-  int rows_num = mat.get_rows();
-  int cols_num = mat.get_cols();
-  Matrix relu_mat = Matrix(rows_num, cols_num);
-  for (int i = 0; i < rows_num; i++)
+  return applied (mat, Relu ());
+}
+
+
+Matrix activation::leaky_relu (const Matrix& mat)
+{
+  return applied (mat, LeakyRelu ());
+}
+
+
+Matrix activation::sigmoid (const Matrix& mat)
+{
+  return applied (mat, Sigmoid ());
+}
+
+
+Matrix activation::tanh (const Matrix& mat)
+{
+  return applied (mat, Tanh ());
+}
+
+
+Matrix activation::gelu (const Matrix& mat)
+{
+  return applied (mat, Gelu ());
+}
+
+
+Matrix activation::silu (const Matrix& mat)
+{
+  return applied (mat, Silu ());
+}
+
+
+Matrix activation::identity (const Matrix& mat)
+{
+  return mat;
+}
+
+
+Matrix activation::softmax(const Matrix& mat)
+{
+  Matrix softmax_mat = mat;
+  softmax_inplace (softmax_mat);
+  return softmax_mat;
+}
+
+
+void activation::softmax_inplace (Matrix& mat)
+{
+  // every column is normalised on its own, so a batch stored as columns
+  // gets one distribution per sample; shifting by the column maximum keeps
+  // exp() from overflowing without changing the result
+  mat_index rows_num = mat.get_rows();
+  mat_index cols_num = mat.get_cols();
+  std::vector<mat_index> max_rows = mat.col_argmax();
+  std::vector<float> max_vals (cols_num);
+  float* data = mat.get_data();
+  for (mat_index j = 0; j < cols_num; ++j)
+  {
+    max_vals[j] = data[max_rows[j] * cols_num + j];
+  }
+  for (mat_index i = 0; i < rows_num; ++i)
+  {
+    for (mat_index j = 0; j < cols_num; ++j)
+    {
+      data[i * cols_num + j] = std::exp (data[i * cols_num + j] -
+                                         max_vals[j]);
+    }
+  }
+  Matrix sum_of_ex = mat.col_sums();
+  for (mat_index j = 0; j < cols_num; ++j)
   {
-    for (int j = 0; j < cols_num; j++)
+    sum_of_ex[j] = 1 / sum_of_ex[j];
+  }
+  for (mat_index i = 0; i < rows_num; ++i)
+  {
+    for (mat_index j = 0; j < cols_num; ++j)
     {
-      if (mat(i,j) >= 0)
-      {
-        relu_mat(i,j) = mat(i,j);
-      }
-      else
-      {
-        relu_mat(i,j) = 0;
-      }
+      data[i * cols_num + j] *= sum_of_ex[j];
     }
   }
-  return relu_mat;
 }
 
-Matrix activation::softmax(const Matrix& mat)
+
+activation::kind activation::kind_of (Activation_Func func)
+{
+  if (func == identity) return KIND_IDENTITY;
+  if (func == relu) return KIND_RELU;
+  if (func == leaky_relu) return KIND_LEAKY_RELU;
+  if (func == sigmoid) return KIND_SIGMOID;
+  if (func == tanh) return KIND_TANH;
+  if (func == gelu) return KIND_GELU;
+  if (func == silu) return KIND_SILU;
+  if (func == softmax) return KIND_SOFTMAX;
+  return KIND_CUSTOM;
+}
+
+
+/**
+ * @brief Process-wide name registry, seeded with the built-in activations.
+ */
+struct activation_registry
+{
+  std::mutex mutex;
+  std::vector<named_activation> names = {
+      {"identity", activation::identity},
+      {"relu", activation::relu},
+      {"leaky_relu", activation::leaky_relu},
+      {"sigmoid", activation::sigmoid},
+      {"tanh", activation::tanh},
+      {"gelu", activation::gelu},
+      {"silu", activation::silu},
+      {"softmax", activation::softmax}};
+
+  static activation_registry& get ()
+  {
+    static activation_registry registry;
+    return registry;
+  }
+};
+
+
+Activation_Func activation::find (const std::string& name)
 {
+  activation_registry& registry = activation_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  for (const named_activation& entry : registry.names)
+  {
+    if (entry.first == name)
+    {
+      return entry.second;
+    }
+  }
+  throw std::invalid_argument (UNKNOWN_ACTIVATION_ERROR + name);
+}
+
 
-  int rows_num = mat.get_rows();
-  int cols_num = mat.get_cols();
-  Matrix softmax_mat(rows_num, cols_num);
-  for (int i = 0; i < rows_num * cols_num ; ++i)
+std::string activation::name_of (Activation_Func func)
+{
+  activation_registry& registry = activation_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  for (const named_activation& entry : registry.names)
   {
-    softmax_mat[i] = std::exp (mat[i]);
+    if (entry.second == func)
+    {
+      return entry.first;
+    }
   }
-  float sum_of_ex = softmax_mat.sum();
-  float scalar = 1 / sum_of_ex;
+  throw std::invalid_argument (UNNAMED_ACTIVATION_ERROR);
+}
+
 
-  return scalar * softmax_mat;
-}
\ No newline at end of file
+void activation::register_activation (const std::string& name,
+                                      Activation_Func func)
+{
+  activation_registry& registry = activation_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  for (named_activation& entry : registry.names)
+  {
+    if (entry.first == name)
+    {
+      entry.second = func;
+      return;
+    }
+  }
+  registry.names.push_back (named_activation (name, func));
+}
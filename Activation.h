@@ -2,14 +2,153 @@
 #define ACTIVATION_H
 
 #include "Matrix.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#define LEAKY_RELU_SLOPE 0.01f
+
+/**   typedefs  */
+typedef Matrix (*Activation_Func)(const Matrix&);
 
 /**
  * @namespace activation
  * @brief Contains functions for common activation functions used in neural
  * networks.
+ *
+ * Every element-wise activation comes in two forms: a functor type with an
+ * inline float operator() that kernels take as a template parameter, so the
+ * compiler can inline it into their output loop (Dense does this for its
+ * epilogue), and an Activation_Func wrapper for code that holds activations
+ * by pointer. The wrappers can be looked up by name with find().
  */
 namespace activation
 {
+/**
+ * @brief Identifies the built-in activations, so kernels can dispatch to the
+ * inlinable functor behind an Activation_Func.
+ */
+enum kind
+{
+  KIND_CUSTOM, /**< Not a built-in activation. */
+  KIND_IDENTITY,
+  KIND_RELU,
+  KIND_LEAKY_RELU,
+  KIND_SIGMOID,
+  KIND_TANH,
+  KIND_GELU,
+  KIND_SILU,
+  KIND_SOFTMAX /**< Column-wise, so it has no element-wise functor. */
+};
+
+/**
+ * @brief e^x by range reduction and a degree-5 polynomial (the Cephes expf
+ * coefficients), within 2 ulp of std::exp.
+ *
+ * Branch free, so loops over it vectorize. x is clamped to [-87, 88], where
+ * the result is neither denormal nor infinite.
+ */
+inline float fast_exp (float x)
+{
+  x = std::min (std::max (x, -87.0f), 88.0f);
+  // n = round(x / ln 2); adding and removing 1.5 * 2^23 rounds to nearest
+  const float n = (x * 1.44269504088896341f + 12582912.0f) - 12582912.0f;
+  // r = x - n ln 2, with ln 2 split in two so the product is exact
+  const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  // scale by 2^n through the exponent bits
+  const int bits = ((int) n + 127) << 23;
+  float scale;
+  std::memcpy (&scale, &bits, sizeof (scale));
+  return p * scale;
+}
+
+/** @brief f(x) = x. */
+struct Identity
+{
+  float operator() (float x) const { return x; }
+};
+
+/** @brief f(x) = max(x, 0). */
+struct Relu
+{
+  float operator() (float x) const { return (x >= 0) ? x : 0; }
+};
+
+/** @brief f(x) = x for x >= 0, slope * x otherwise. */
+struct LeakyRelu
+{
+  float slope = LEAKY_RELU_SLOPE;
+  float operator() (float x) const { return (x >= 0) ? x : slope * x; }
+};
+
+/** @brief f(x) = 1 / (1 + e^-x), within about 1e-7 absolute. */
+struct Sigmoid
+{
+  float operator() (float x) const { return 1.0f / (1.0f + fast_exp (-x)); }
+};
+
+/** @brief f(x) = tanh(x) = 1 - 2 / (e^2x + 1), within about 2e-7 absolute. */
+struct Tanh
+{
+  float operator() (float x) const
+  {
+    return 1.0f - 2.0f / (fast_exp (2.0f * x) + 1.0f);
+  }
+};
+
+/**
+ * @brief GELU in its tanh form,
+ * f(x) = x / 2 * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 x^3))), which is
+ * within 1e-3 of the erf definition.
+ */
+struct Gelu
+{
+  float operator() (float x) const
+  {
+    const float u = 0.7978845608f * (x + 0.044715f * x * x * x);
+    return x * (1.0f - 1.0f / (fast_exp (2.0f * u) + 1.0f));
+  }
+};
+
+/** @brief f(x) = x * sigmoid(x). */
+struct Silu
+{
+  float operator() (float x) const { return x / (1.0f + fast_exp (-x)); }
+};
+
+/**
+ * @brief Applies an element-wise functor in place to n floats, in parallel
+ * for large n.
+ */
+template <typename F>
+void apply (float* data, std::size_t n, F f)
+{
+  parallel_for_elements (n, [data, f] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      data[i] = f (data[i]);
+    }
+  });
+}
+
+/**
+ * @brief Applies an element-wise functor in place to a matrix.
+ */
+template <typename F>
+void apply (Matrix& mat, F f)
+{
+  apply (mat.get_data (), (std::size_t) mat.get_rows () * mat.get_cols (), f);
+}
+
 /**
  * @brief Applies the Rectified Linear Unit (ReLU) activation function
  * element-wise to a matrix.
@@ -20,14 +159,82 @@ namespace activation
  */
 Matrix relu(const Matrix& mat);
 
+/**
+ * @brief Applies leaky ReLU with slope LEAKY_RELU_SLOPE element-wise; use
+ * the LeakyRelu functor for other slopes.
+ */
+Matrix leaky_relu(const Matrix& mat);
+
+/**
+ * @brief Applies the logistic sigmoid element-wise.
+ */
+Matrix sigmoid(const Matrix& mat);
+
+/**
+ * @brief Applies tanh element-wise.
+ */
+Matrix tanh(const Matrix& mat);
+
+/**
+ * @brief Applies GELU (tanh approximation) element-wise.
+ */
+Matrix gelu(const Matrix& mat);
+
+/**
+ * @brief Applies SiLU (swish) element-wise.
+ */
+Matrix silu(const Matrix& mat);
+
+/**
+ * @brief Returns the matrix unchanged, for layers without an activation.
+ */
+Matrix identity(const Matrix& mat);
+
 /**
  * @brief Applies the softmax activation function element-wise to a matrix.
  *
+ * Every column is normalised separately, so a batch of output vectors stored
+ * as columns yields one probability distribution per column.
+ *
  * @param mat The input matrix.
  * @return A new matrix with the softmax activation function applied to each
  * element.
  */
 Matrix softmax(const Matrix& mat);
+
+/**
+ * @brief Applies softmax to every column of a matrix in place.
+ */
+void softmax_inplace(Matrix& mat);
+
+/**
+ * @brief Returns which built-in activation a function is, or KIND_CUSTOM.
+ */
+kind kind_of(Activation_Func func);
+
+/**
+ * @brief Looks up an activation by the name a model file uses for it:
+ * "identity", "relu", "leaky_relu", "sigmoid", "tanh", "gelu", "silu",
+ * "softmax", or a name added with register_activation().
+ *
+ * @param name The activation name.
+ * @return The activation.
+ * @throw std::invalid_argument if no activation has that name.
+ */
+Activation_Func find(const std::string& name);
+
+/**
+ * @brief Returns the registered name of an activation.
+ *
+ * @throw std::invalid_argument if the activation isn't registered.
+ */
+std::string name_of(Activation_Func func);
+
+/**
+ * @brief Makes a custom activation available to find() under a name,
+ * replacing any activation registered under it before.
+ */
+void register_activation(const std::string& name, Activation_Func func);
 }
 
-#endif //ACTIVATION_H
\ No newline at end of file
+#endif //ACTIVATION_H
@@ -0,0 +1,397 @@
+#include "Autotune.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#define CPUINFO_PATH "/proc/cpuinfo"
+#define CPUINFO_MODEL_KEY "model name"
+#define UNKNOWN_CPU "unknown"
+#define CACHE_WRITE_ERROR "Error: Failed to write the tuning cache: "
+#define CACHE_WRITE_WARNING "Warning: the tuning is applied but not cached: "
+#define TUNE_INPUT_DENSITY 0.2
+
+typedef std::chrono::steady_clock tune_clock;
+
+static const int gemv_unrolls[] = {1, 2, 4};
+static const int batch_tiles[] = {DENSE_WHOLE_BATCH, 8, 16, 32, 64};
+static const int batch_chunks[] = {16, 32, 64, 128, 256};
+
+
+std::string cpu_model ()
+{
+  std::ifstream cpuinfo (CPUINFO_PATH);
+  std::string line;
+  while (std::getline (cpuinfo, line))
+  {
+    if (line.compare (0, sizeof (CPUINFO_MODEL_KEY) - 1,
+                      CPUINFO_MODEL_KEY) == 0)
+    {
+      std::size_t colon = line.find (':');
+      std::size_t start = line.find_first_not_of (" \t", colon + 1);
+      if (colon != std::string::npos && start != std::string::npos)
+      {
+        return line.substr (start);
+      }
+    }
+  }
+  return UNKNOWN_CPU;
+}
+
+
+std::string model_shape (const MlpNetwork& mlp)
+{
+  std::string shape = std::to_string (mlp.get_layer (0).get_weights ()
+                                          .get_cols ());
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    shape += "-" + std::to_string (mlp.get_layer (i).get_weights ()
+                                       .get_rows ());
+  }
+  return shape;
+}
+
+
+std::string tuning_cache_path ()
+{
+  const char* env = std::getenv (TUNING_CACHE_ENV_VAR);
+  return (env != nullptr && *env != '\0') ? env : TUNING_CACHE_FILE;
+}
+
+
+/**
+ * @brief Returns the best wall time of TUNE_REPEATS runs, after a warm-up.
+ */
+static double best_seconds (const std::function<void ()>& run)
+{
+  run ();
+  double best = 0;
+  for (int r = 0; r < TUNE_REPEATS; ++r)
+  {
+    tune_clock::time_point t0 = tune_clock::now ();
+    run ();
+    double sec = std::chrono::duration<double> (tune_clock::now () - t0)
+        .count ();
+    best = (r == 0 || sec < best) ? sec : best;
+  }
+  return best;
+}
+
+
+/**
+ * @brief Fills a matrix with about TUNE_INPUT_DENSITY nonzeros in [0, 1),
+ * like digit scans and the ReLU outputs that follow them.
+ */
+static Matrix random_input (mat_index rows, mat_index cols, std::mt19937& gen)
+{
+  std::uniform_real_distribution<float> value (0, 1);
+  std::bernoulli_distribution lit (TUNE_INPUT_DENSITY);
+  Matrix input (rows, cols);
+  for (mat_index i = 0; i < input.size (); ++i)
+  {
+    input[i] = lit (gen) ? value (gen) : 0;
+  }
+  return input;
+}
+
+
+/**
+ * @brief Returns how many calls of a layer make about TUNE_LAYER_WORK
+ * multiply-adds.
+ */
+static int layer_calls (const Dense& layer, mat_index batch)
+{
+  const mat_index work = layer.get_weights ().size () * batch;
+  return (int) std::max ((mat_index) 1, TUNE_LAYER_WORK / work);
+}
+
+
+/**
+ * @brief Times a layer with each candidate parameter set and returns the
+ * fastest.
+ */
+static dense_config fastest_layer (const Dense& layer, const Matrix& input,
+                                   const std::vector<dense_config>& configs)
+{
+  const int calls = layer_calls (layer, input.get_cols ());
+  dense_config best = configs.front ();
+  double best_sec = 0;
+  for (const dense_config& config : configs)
+  {
+    Dense candidate = layer; // shares the weights and packed layout
+    candidate.set_kernel_config (config);
+    double sec = best_seconds ([&candidate, &input, calls] ()
+    {
+      for (int c = 0; c < calls; ++c)
+      {
+        candidate (input);
+      }
+    });
+    if (&config == &configs.front () || sec < best_sec)
+    {
+      best = config;
+      best_sec = sec;
+    }
+  }
+  return best;
+}
+
+
+model_tuning autotune (const MlpNetwork& mlp, std::ostream* log)
+{
+  std::mt19937 gen (7);
+  const mat_index inputs = mlp.get_layer (0).get_weights ().get_cols ();
+  std::vector<Matrix> imgs;
+  for (int i = 0; i < TUNE_BATCH_IMAGES; ++i)
+  {
+    imgs.push_back (random_input (inputs, 1, gen));
+  }
+  MlpNetwork net = mlp; // shares the weights
+  model_tuning tuning;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    tuning.layers[i] = dense_config {DENSE_GEMV_UNROLL, DENSE_WHOLE_BATCH};
+    net.set_kernel_config (i, tuning.layers[i]);
+  }
+  const int pool_threads = ThreadPool::shared ().concurrency ();
+  tuning.batch = batch_config {BATCH_CHUNK, 0};
+
+  // chunk size on one thread, so its cache effects are not hidden by
+  // parallel slack
+  double best_sec = 0;
+  for (int chunk : batch_chunks)
+  {
+    net.set_batch_config (batch_config {chunk, 1});
+    double sec = best_seconds ([&net, &imgs] () { net.predict_batch (imgs); });
+    if (chunk == batch_chunks[0] || sec < best_sec)
+    {
+      tuning.batch.chunk = chunk;
+      best_sec = sec;
+    }
+  }
+  if (log != nullptr)
+  {
+    *log << "batch chunk: " << tuning.batch.chunk << "\n";
+  }
+
+  // every layer on its own inputs: a chunk of columns for the batch tile,
+  // one dense vector for the unroll
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    const Dense& layer = mlp.get_layer (i);
+    const mat_index cols = layer.get_weights ().get_cols ();
+    Matrix batch = random_input (cols, tuning.batch.chunk, gen);
+    std::vector<dense_config> tiles;
+    for (int tile : batch_tiles)
+    {
+      if (tile < tuning.batch.chunk)
+      {
+        tiles.push_back (dense_config {DENSE_GEMV_UNROLL, tile});
+      }
+    }
+    tuning.layers[i].batch_tile = fastest_layer (layer, batch, tiles)
+        .batch_tile;
+
+    Matrix vec (cols, 1);
+    std::uniform_real_distribution<float> value (0, 1);
+    for (mat_index j = 0; j < cols; ++j)
+    {
+      vec[j] = value (gen);
+    }
+    std::vector<dense_config> unrolls;
+    for (int unroll : gemv_unrolls)
+    {
+      unrolls.push_back (dense_config {unroll, tuning.layers[i].batch_tile});
+    }
+    tuning.layers[i].gemv_unroll = fastest_layer (layer, vec, unrolls)
+        .gemv_unroll;
+    net.set_kernel_config (i, tuning.layers[i]);
+    if (log != nullptr)
+    {
+      *log << "layer " << i << " (" << layer.get_weights ().get_rows ()
+           << "x" << cols << "): unroll " << tuning.layers[i].gemv_unroll
+           << ", batch tile " << tuning.layers[i].batch_tile << "\n";
+    }
+  }
+
+  // thread count: powers of two up to the pool, and the pool itself
+  for (int threads = 1; threads <= pool_threads;
+       threads = (threads * 2 <= pool_threads || threads == pool_threads)
+                 ? threads * 2 : pool_threads)
+  {
+    net.set_batch_config (batch_config {tuning.batch.chunk, threads});
+    double sec = best_seconds ([&net, &imgs] () { net.predict_batch (imgs); });
+    if (threads == 1 || sec < best_sec)
+    {
+      tuning.batch.threads = (threads == pool_threads) ? 0 : threads;
+      best_sec = sec;
+    }
+  }
+  if (log != nullptr)
+  {
+    *log << "threads: " << (tuning.batch.threads == 0 ? pool_threads
+                                                      : tuning.batch.threads)
+         << " of " << pool_threads << "\n";
+  }
+  return tuning;
+}
+
+
+void apply_tuning (MlpNetwork& mlp, const model_tuning& tuning)
+{
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    mlp.set_kernel_config (i, tuning.layers[i]);
+  }
+  mlp.set_batch_config (tuning.batch);
+}
+
+
+/**
+ * @brief Returns the key columns of a cache line.
+ */
+static std::string cache_key (const std::string& cpu, const std::string& shape,
+                              int threads)
+{
+  return cpu + "\t" + shape + "\t" + std::to_string (threads) + "\t";
+}
+
+
+bool find_tuning (const std::string& path, const std::string& cpu,
+                  const std::string& shape, int threads,
+                  model_tuning& tuning)
+{
+  const std::string key = cache_key (cpu, shape, threads);
+  std::ifstream cache (path);
+  std::string line;
+  while (std::getline (cache, line))
+  {
+    if (line.compare (0, key.size (), key) != 0)
+    {
+      continue;
+    }
+    std::istringstream values (line.substr (key.size ()));
+    model_tuning found;
+    for (int i = 0; i < MLP_SIZE; ++i)
+    {
+      values >> found.layers[i].gemv_unroll >> found.layers[i].batch_tile;
+    }
+    values >> found.batch.chunk >> found.batch.threads;
+    if (values)
+    {
+      tuning = found;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void store_tuning (const std::string& path, const std::string& cpu,
+                   const std::string& shape, int threads,
+                   const model_tuning& tuning)
+{
+  const std::string key = cache_key (cpu, shape, threads);
+  std::vector<std::string> lines;
+  {
+    std::ifstream cache (path);
+    std::string line;
+    while (std::getline (cache, line))
+    {
+      if (!line.empty () && line.compare (0, key.size (), key) != 0)
+      {
+        lines.push_back (line);
+      }
+    }
+  }
+  std::ostringstream entry;
+  entry << key;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    entry << tuning.layers[i].gemv_unroll << " "
+          << tuning.layers[i].batch_tile << " ";
+  }
+  entry << tuning.batch.chunk << " " << tuning.batch.threads;
+  lines.push_back (entry.str ());
+
+  // replace the file in one rename, so a concurrent reader never sees a
+  // partial cache
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out (tmp, std::ios::trunc);
+    for (const std::string& line : lines)
+    {
+      out << line << "\n";
+    }
+    if (!out)
+    {
+      throw std::runtime_error (CACHE_WRITE_ERROR + path);
+    }
+  }
+  if (std::rename (tmp.c_str (), path.c_str ()) != 0)
+  {
+    std::remove (tmp.c_str ());
+    throw std::runtime_error (CACHE_WRITE_ERROR + path);
+  }
+}
+
+
+/**
+ * @brief Tells whether every parameter of a tuning is valid for a network,
+ * e.g. for a cache entry written by hand or by an older build.
+ */
+static bool accepts_tuning (const MlpNetwork& mlp, const model_tuning& tuning)
+{
+  MlpNetwork probe (mlp);
+  try
+  {
+    apply_tuning (probe, tuning);
+  }
+  catch (const std::invalid_argument&)
+  {
+    return false;
+  }
+  return true;
+}
+
+
+bool tune_network (MlpNetwork& mlp, bool tune_if_missing,
+                   const std::string& path)
+{
+  const std::string cpu = cpu_model ();
+  const std::string shape = model_shape (mlp);
+  const int threads = ThreadPool::shared ().concurrency ();
+  model_tuning tuning;
+  if (!find_tuning (path, cpu, shape, threads, tuning)
+      || !accepts_tuning (mlp, tuning))
+  {
+    if (!tune_if_missing)
+    {
+      return false;
+    }
+    tuning = autotune (mlp);
+    try
+    {
+      store_tuning (path, cpu, shape, threads, tuning);
+    }
+    catch (const std::runtime_error&)
+    {
+      // the tuning is still good for this run; serving goes on without it
+      std::cerr << CACHE_WRITE_WARNING << path << std::endl;
+    }
+  }
+  apply_tuning (mlp, tuning);
+  return true;
+}
+
+
+bool tune_network (MlpNetwork& mlp)
+{
+  const char* env = std::getenv (AUTOTUNE_ENV_VAR);
+  return tune_network (mlp, env != nullptr && *env != '\0' && *env != '0');
+}
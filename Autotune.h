@@ -0,0 +1,116 @@
+// Autotune.h
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "MlpNetwork.h"
+#include <ostream>
+#include <string>
+
+#define TUNING_CACHE_ENV_VAR "MLP_TUNING_CACHE"
+#define AUTOTUNE_ENV_VAR "MLP_AUTOTUNE"
+#define TUNING_CACHE_FILE ".mlp_tuning"
+// each candidate is timed as the best of this many runs
+#define TUNE_REPEATS 5
+// multiply-adds per timed run of a layer kernel
+#define TUNE_LAYER_WORK (1 << 23)
+// synthetic images per timed run of predict_batch()
+#define TUNE_BATCH_IMAGES 2048
+
+/**
+ * @struct model_tuning
+ * @brief Kernel parameters chosen for one model on one machine.
+ * @var layers - the parameters of every layer
+ * @var batch - the predict_batch() parameters
+ */
+typedef struct model_tuning {
+	dense_config layers[MLP_SIZE];
+	batch_config batch;
+} model_tuning;
+
+/**
+ * @brief Returns the CPU model name from /proc/cpuinfo, or "unknown".
+ */
+std::string cpu_model ();
+
+/**
+ * @brief Returns the layer widths of a network, e.g. "784-128-64-20-10".
+ */
+std::string model_shape (const MlpNetwork& mlp);
+
+/**
+ * @brief Returns the tuning cache path: $MLP_TUNING_CACHE when set,
+ * TUNING_CACHE_FILE otherwise.
+ */
+std::string tuning_cache_path ();
+
+/**
+ * @brief Benchmarks the candidate kernel parameters on this machine and
+ * returns the fastest.
+ *
+ * The predict_batch() chunk size is chosen first, then every layer's batch
+ * tile at that chunk size and its single-vector unroll, and last the thread
+ * count. Candidates are timed on synthetic inputs of the model's shapes;
+ * the network itself is not changed. Takes a few seconds.
+ *
+ * @param mlp The network.
+ * @param log Receives one line per decision when not null.
+ * @return The chosen parameters.
+ */
+model_tuning autotune (const MlpNetwork& mlp, std::ostream* log = nullptr);
+
+/**
+ * @brief Sets every parameter of a tuning on a network.
+ */
+void apply_tuning (MlpNetwork& mlp, const model_tuning& tuning);
+
+/**
+ * @brief Looks up the tuning of a CPU model, model shape and pool size in a
+ * cache file.
+ *
+ * @param path The cache file; a missing file is an empty cache.
+ * @param cpu The CPU model, see cpu_model().
+ * @param shape The model shape, see model_shape().
+ * @param threads The pool size, ThreadPool::concurrency().
+ * @param tuning Receives the tuning when found.
+ * @return true if the cache holds an entry for the key.
+ */
+bool find_tuning (const std::string& path, const std::string& cpu,
+                  const std::string& shape, int threads,
+                  model_tuning& tuning);
+
+/**
+ * @brief Adds a tuning to a cache file, replacing an entry with the same
+ * key and keeping the others.
+ *
+ * The file is text, one tab-separated line per entry: CPU model, model
+ * shape, pool size, then the unroll and batch tile of every layer, the
+ * chunk size and the thread count.
+ *
+ * @throw std::runtime_error if the file cannot be written.
+ */
+void store_tuning (const std::string& path, const std::string& cpu,
+                   const std::string& shape, int threads,
+                   const model_tuning& tuning);
+
+/**
+ * @brief Applies the cached tuning of this machine and model, tuning and
+ * caching it first if there is none and tuning is allowed.
+ *
+ * An entry with a parameter the network rejects counts as a miss. A tuning
+ * that cannot be written to the cache is still applied, with a warning on
+ * std::cerr.
+ *
+ * @param mlp The network.
+ * @param tune_if_missing Whether to run autotune() on a cache miss.
+ * @param path The cache file.
+ * @return true if a tuning was applied.
+ */
+bool tune_network (MlpNetwork& mlp, bool tune_if_missing,
+                   const std::string& path = tuning_cache_path ());
+
+/**
+ * @brief tune_network() that tunes on a miss only when $MLP_AUTOTUNE is set.
+ */
+bool tune_network (MlpNetwork& mlp);
+
+#endif //AUTOTUNE_H
@@ -0,0 +1,230 @@
+#include "Cascade.h"
+#include "LowRank.h"
+#include "Trace.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#define CASCADE_MODEL_ERROR "Error: a cascade needs a fast and a full model"
+#define CASCADE_EMPTY_ERROR "Error: cascade calibration needs a non-empty " \
+                            "dataset"
+// layers factored in the default fast model
+#define CASCADE_FAST_LAYERS 2
+
+
+CascadeNetwork::CascadeNetwork (std::shared_ptr<const MlpNetwork> fast,
+                                std::shared_ptr<const MlpNetwork> full,
+                                float threshold) :
+_fast (std::move (fast)), _full (std::move (full)), _threshold (threshold),
+_fast_macs (0), _full_macs (0), _images (0), _escalations (0)
+{
+  if (!_fast || !_full)
+  {
+    throw std::invalid_argument (CASCADE_MODEL_ERROR);
+  }
+  _fast_macs = network_multiply_adds (*_fast);
+  _full_macs = network_multiply_adds (*_full);
+}
+
+
+digit CascadeNetwork::operator() (const Matrix& img) const
+{
+  TRACE_SPAN("cascade classify", "request");
+  _images.fetch_add (1, std::memory_order_relaxed);
+  Matrix vec = img;
+  digit result = (*_fast) (vec);
+  if (result.probability >= _threshold)
+  {
+    return result;
+  }
+  _escalations.fetch_add (1, std::memory_order_relaxed);
+  return (*_full) (vec);
+}
+
+
+std::vector<digit> CascadeNetwork::predict_batch
+    (const std::vector<Matrix>& imgs) const
+{
+  TRACE_SPAN("cascade predict_batch", "batch");
+  std::vector<digit> results = _fast->predict_batch (imgs);
+  std::vector<std::size_t> unsure;
+  for (std::size_t i = 0; i < results.size (); ++i)
+  {
+    if (!(results[i].probability >= _threshold))
+    {
+      unsure.push_back (i);
+    }
+  }
+  if (!unsure.empty ())
+  {
+    std::vector<Matrix> escalated;
+    escalated.reserve (unsure.size ());
+    for (std::size_t i : unsure)
+    {
+      escalated.push_back (imgs[i]);
+    }
+    std::vector<digit> full = _full->predict_batch (escalated);
+    for (std::size_t k = 0; k < unsure.size (); ++k)
+    {
+      results[unsure[k]] = full[k];
+    }
+  }
+  _images.fetch_add (imgs.size (), std::memory_order_relaxed);
+  _escalations.fetch_add (unsure.size (), std::memory_order_relaxed);
+  return results;
+}
+
+
+void CascadeNetwork::set_threshold (float threshold)
+{
+  _threshold = threshold;
+}
+
+
+float CascadeNetwork::get_threshold () const
+{
+  return _threshold;
+}
+
+
+cascade_stats CascadeNetwork::get_stats () const
+{
+  cascade_stats stats;
+  stats.images = _images.load (std::memory_order_relaxed);
+  stats.escalations = _escalations.load (std::memory_order_relaxed);
+  stats.escalation_rate = stats.images
+                          ? (double) stats.escalations / stats.images : 0;
+  stats.mean_multiply_adds = _fast_macs + stats.escalation_rate * _full_macs;
+  stats.relative_cost = stats.mean_multiply_adds / _full_macs;
+  return stats;
+}
+
+
+void CascadeNetwork::reset_stats ()
+{
+  _images = 0;
+  _escalations = 0;
+}
+
+
+MlpNetwork cascade_fast_model (const MlpNetwork& full, mat_index rank)
+{
+  std::vector<svd_factors> spectra = layer_spectra (full);
+  std::vector<mat_index> ranks (MLP_SIZE, FULL_RANK);
+  for (int i = 0; i < CASCADE_FAST_LAYERS; ++i)
+  {
+    ranks[i] = std::min (rank, spectra[i].s.get_rows ());
+  }
+  return low_rank_network (full, spectra, ranks);
+}
+
+
+/**
+ * @brief The two models' predictions on a labelled set.
+ */
+typedef struct cascade_predictions {
+	std::vector<digit> fast, full;
+	mat_index fast_macs, full_macs;
+} cascade_predictions;
+
+
+static cascade_predictions predict_both (const MlpNetwork& fast,
+                                         const MlpNetwork& full,
+                                         const IdxDataset& dataset)
+{
+  if (dataset.images.empty ())
+  {
+    throw std::invalid_argument (CASCADE_EMPTY_ERROR);
+  }
+  return cascade_predictions {fast.predict_batch (dataset.images),
+                              full.predict_batch (dataset.images),
+                              network_multiply_adds (fast),
+                              network_multiply_adds (full)};
+}
+
+
+/**
+ * @brief Scores one threshold against precomputed predictions.
+ */
+static cascade_calibration score (const cascade_predictions& p,
+                                  const IdxDataset& dataset, float threshold)
+{
+  const std::size_t n = dataset.labels.size ();
+  std::size_t correct = 0, fast_correct = 0, full_correct = 0, escalated = 0;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    const bool fast_ok = p.fast[i].value == (unsigned int) dataset.labels[i];
+    const bool full_ok = p.full[i].value == (unsigned int) dataset.labels[i];
+    const bool accept = p.fast[i].probability >= threshold;
+    fast_correct += fast_ok;
+    full_correct += full_ok;
+    escalated += !accept;
+    correct += accept ? fast_ok : full_ok;
+  }
+  cascade_calibration outcome;
+  outcome.threshold = threshold;
+  outcome.accuracy = (double) correct / n;
+  outcome.fast_accuracy = (double) fast_correct / n;
+  outcome.full_accuracy = (double) full_correct / n;
+  outcome.escalation_rate = (double) escalated / n;
+  outcome.relative_cost = (p.fast_macs + outcome.escalation_rate *
+                           p.full_macs) / p.full_macs;
+  return outcome;
+}
+
+
+std::vector<cascade_calibration> cascade_sweep (const MlpNetwork& fast,
+                                                const MlpNetwork& full,
+                                                const IdxDataset& dataset,
+                                                const std::vector<float>&
+                                                thresholds)
+{
+  TRACE_SPAN("cascade_sweep", "eval");
+  const cascade_predictions p = predict_both (fast, full, dataset);
+  std::vector<cascade_calibration> outcomes;
+  for (float threshold : thresholds)
+  {
+    outcomes.push_back (score (p, dataset, threshold));
+  }
+  return outcomes;
+}
+
+
+cascade_calibration calibrate_cascade (const MlpNetwork& fast,
+                                       const MlpNetwork& full,
+                                       const IdxDataset& dataset,
+                                       double target_accuracy)
+{
+  TRACE_SPAN("calibrate_cascade", "eval");
+  const cascade_predictions p = predict_both (fast, full, dataset);
+  const std::size_t n = dataset.labels.size ();
+  std::vector<std::size_t> order (n);
+  std::iota (order.begin (), order.end (), (std::size_t) 0);
+  std::sort (order.begin (), order.end (), [&p] (std::size_t a, std::size_t b)
+  {
+    return p.fast[a].probability > p.fast[b].probability;
+  });
+
+  // accepting the k most confident fast digits, the rest escalated;
+  // thresholds can only cut between distinct confidences
+  std::size_t correct = 0;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    correct += p.full[i].value == (unsigned int) dataset.labels[i];
+  }
+  float threshold = std::numeric_limits<float>::infinity ();
+  for (std::size_t k = 1; k <= n; ++k)
+  {
+    const std::size_t i = order[k - 1];
+    const unsigned int label = (unsigned int) dataset.labels[i];
+    correct += (p.fast[i].value == label);
+    correct -= (p.full[i].value == label);
+    const bool boundary = (k == n) || p.fast[order[k]].probability <
+                                      p.fast[i].probability;
+    if (boundary && (double) correct / n >= target_accuracy)
+    {
+      threshold = p.fast[i].probability;
+    }
+  }
+  return score (p, dataset, threshold);
+}
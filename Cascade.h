@@ -0,0 +1,167 @@
+// Cascade.h
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include "MlpNetwork.h"
+#include "IdxDataset.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// confidence the fast model's digit needs to be accepted by default
+#define CASCADE_THRESHOLD 0.9f
+// rank of the first two layers of the default fast model
+#define CASCADE_FAST_RANK 16
+// top-1 accuracy the cascade may give up against the full model by default
+#define CASCADE_ACCURACY_LOSS 0.005
+
+/**
+ * @struct cascade_stats
+ * @brief Counters of a CascadeNetwork.
+ * @var images - images classified
+ * @var escalations - images the full model had to classify
+ * @var escalation_rate - escalations / images
+ * @var mean_multiply_adds - effective multiply-adds per image: the fast
+ *      model's, plus the full model's for the escalated fraction
+ * @var relative_cost - mean_multiply_adds over the full model's
+ */
+typedef struct cascade_stats {
+	unsigned long long images, escalations;
+	double escalation_rate, mean_multiply_adds, relative_cost;
+} cascade_stats;
+
+/**
+ * @struct cascade_calibration
+ * @brief The outcome of a cascade threshold on a labelled set.
+ * @var threshold - the confidence threshold
+ * @var accuracy - top-1 accuracy of the cascade
+ * @var fast_accuracy - top-1 accuracy of the fast model alone
+ * @var full_accuracy - top-1 accuracy of the full model alone
+ * @var escalation_rate - fraction of images escalated
+ * @var relative_cost - multiply-adds per image over the full model's
+ */
+typedef struct cascade_calibration {
+	float threshold;
+	double accuracy, fast_accuracy, full_accuracy;
+	double escalation_rate, relative_cost;
+} cascade_calibration;
+
+/**
+ * @class CascadeNetwork
+ * @brief Classifies with a cheap model first and runs the full model only
+ * for the images the cheap one is unsure of.
+ *
+ * The fast model's digit is accepted when its probability reaches the
+ * threshold; otherwise the image is escalated and the full model's digit
+ * is returned. Choose the threshold with calibrate_cascade(). Both models
+ * are shared, not copied. Classification is thread-safe; the counters are
+ * relaxed atomics.
+ */
+class CascadeNetwork {
+
+ private:
+  std::shared_ptr<const MlpNetwork> _fast; /**< The first stage. */
+  std::shared_ptr<const MlpNetwork> _full; /**< The escalation stage. */
+  float _threshold; /**< Confidence to accept the fast digit. */
+  mat_index _fast_macs; /**< Multiply-adds of the fast model. */
+  mat_index _full_macs; /**< Multiply-adds of the full model. */
+  mutable std::atomic<unsigned long long> _images; /**< Images classified. */
+  mutable std::atomic<unsigned long long> _escalations; /**< Images the full
+ * model classified. */
+
+ public:
+/**
+ * @brief Constructs a cascade.
+ *
+ * @param fast The first stage, e.g. cascade_fast_model() of the full one.
+ * @param full The full model.
+ * @param threshold The confidence to accept the fast model's digit.
+ * @throw std::invalid_argument if a model is missing.
+ */
+  CascadeNetwork (std::shared_ptr<const MlpNetwork> fast,
+                  std::shared_ptr<const MlpNetwork> full,
+                  float threshold = CASCADE_THRESHOLD);
+
+/**
+ * @brief Classifies an image, escalating it if the fast model is unsure.
+ */
+  digit operator() (const Matrix& img) const;
+
+/**
+ * @brief Classifies a batch: the fast model runs on all of it, and the
+ * unsure images go through the full model as one smaller batch.
+ *
+ * @param imgs The input images.
+ * @return One classified digit per image, in order.
+ */
+  std::vector<digit> predict_batch (const std::vector<Matrix>& imgs) const;
+
+/**
+ * @brief Sets the confidence threshold; not concurrent with
+ * classification.
+ */
+  void set_threshold (float threshold);
+
+  float get_threshold () const;
+
+/**
+ * @brief Returns the counters.
+ */
+  cascade_stats get_stats () const;
+
+/**
+ * @brief Zeroes the counters.
+ */
+  void reset_stats ();
+};
+
+/**
+ * @brief Builds the default fast model from the full one: its first two
+ * layers, which hold nearly all of its multiply-adds, factored by
+ * truncated SVD at the given rank (see LowRank.h). It takes the same
+ * input as the full model and needs no separate training.
+ *
+ * @param full The full model.
+ * @param rank The rank of the first two layers.
+ * @return The fast model.
+ */
+MlpNetwork cascade_fast_model (const MlpNetwork& full,
+                               mat_index rank = CASCADE_FAST_RANK);
+
+/**
+ * @brief Returns the cascade's accuracy, escalation rate and cost on a
+ * labelled set at each of the given thresholds.
+ *
+ * @param fast The first stage.
+ * @param full The full model.
+ * @param dataset The labelled images.
+ * @param thresholds The thresholds to try.
+ * @return One outcome per threshold, in order.
+ */
+std::vector<cascade_calibration> cascade_sweep (const MlpNetwork& fast,
+                                                const MlpNetwork& full,
+                                                const IdxDataset& dataset,
+                                                const std::vector<float>&
+                                                thresholds);
+
+/**
+ * @brief Picks the lowest threshold, i.e. the fewest escalations, at which
+ * the cascade reaches a target top-1 accuracy on a labelled set.
+ *
+ * Every distinct fast-model confidence on the set is a candidate. If no
+ * threshold reaches the target, the threshold escalates every image
+ * (infinity), which gives the full model's accuracy.
+ *
+ * @param fast The first stage.
+ * @param full The full model.
+ * @param dataset The labelled images.
+ * @param target_accuracy The accuracy to reach, as a fraction.
+ * @return The chosen threshold and its outcome on the set.
+ * @throw std::invalid_argument if the dataset is empty.
+ */
+cascade_calibration calibrate_cascade (const MlpNetwork& fast,
+                                       const MlpNetwork& full,
+                                       const IdxDataset& dataset,
+                                       double target_accuracy);
+
+#endif //CASCADE_H
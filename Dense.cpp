@@ -1,40 +1,532 @@
 #include "Dense.h"
+#include "Trace.h"
+#include <algorithm>
+#include <memory>
+
+#define INPUT_SIZE_ERROR "Error: Dense input size does not match the weights"
+#define BYTE_INPUT_ERROR "Error: Dense byte input needs data and a positive " \
+                         "batch"
+#define FACTOR_SIZE_ERROR "Error: Dense factors need inner rows equal to " \
+                          "outer cols"
+#define KERNEL_CONFIG_ERROR "Error: Dense kernel config needs an unroll of " \
+                            "1, 2 or 4 and a non-negative batch tile"
 
 
 Dense::Dense (Matrix& weights, Matrix& bias, Activation_Func
-activation_func) : _weights(weights), _bias(bias), _activation_func
-(activation_func) {}
+activation_func) : Dense(share_matrix(weights), share_matrix(bias),
+activation_func) {}
+
+
+Dense::Dense (MatrixPtr weights, MatrixPtr bias, Activation_Func
+activation_func) : Dense(weights, bias, activation_func,
+derived_matrix(weights, DERIVED_PACKED, pack_weights),
+derived_matrix(weights, DERIVED_ROW_SUMS, sum_rows)) {}
+
+
+Dense::Dense (MatrixPtr weights, MatrixPtr bias, Activation_Func
+activation_func, MatrixPtr packed, MatrixPtr row_sums) : _weights(weights),
+_bias(bias), _activation_func(activation_func),
+_activation_kind(activation::kind_of(activation_func)), _packed(packed),
+_row_sums(row_sums), _weights_t(), _sparse_cutoff(SPARSE_DISABLED),
+_config{DENSE_GEMV_UNROLL, DENSE_WHOLE_BATCH}, _projection(), _product()
+{
+  _trace_name = trace::intern("dense " + std::to_string(_weights->get_rows())
+                              + "x" + std::to_string(_weights->get_cols()));
+}
+
+
+Dense::Dense (MatrixPtr outer, MatrixPtr inner, MatrixPtr bias,
+Activation_Func activation_func) : Dense(outer, bias, activation_func)
+{
+  if (inner->get_rows() != outer->get_cols())
+  {
+    throw std::length_error (FACTOR_SIZE_ERROR);
+  }
+  // the projection is a plain layer with no bias or activation, so it
+  // brings its own kernels, sparse path and byte input handling
+  _projection = std::make_shared<const Dense>(inner, share_matrix(
+      Matrix(inner->get_rows(), 1)), activation::identity);
+  _product = share_matrix(*outer * *inner);
+  _trace_name = trace::intern("dense " + std::to_string(outer->get_rows())
+                              + "x" + std::to_string(inner->get_cols())
+                              + " rank " + std::to_string(outer->get_cols()));
+}
+
+
+Dense Dense::clone () const
+{
+  // the layouts are built privately, once, rather than through the shared
+  // derived cache
+  Dense copy(share_matrix(*_weights), share_matrix(*_bias), _activation_func,
+             share_matrix(pack_weights(*_weights)),
+             share_matrix(sum_rows(*_weights)));
+  copy._config = _config;
+  if (_sparse_cutoff != SPARSE_DISABLED)
+  {
+    copy._sparse_cutoff = _sparse_cutoff;
+    copy._weights_t = share_matrix(*_weights_t);
+  }
+  if (_projection)
+  {
+    copy._projection = std::make_shared<const Dense>(_projection->clone());
+    copy._product = share_matrix(*_product);
+    copy._trace_name = _trace_name;
+  }
+  return copy;
+}
+
+
+Matrix Dense::pack_weights (const Matrix& weights)
+{
+  const mat_index rows = weights.get_rows();
+  const mat_index cols = weights.get_cols();
+  const mat_index panels = (rows + DENSE_PANEL_ROWS - 1) / DENSE_PANEL_ROWS;
+  Matrix packed(panels * cols, DENSE_PANEL_ROWS); // zero initialised
+  const float* w = weights.get_data();
+  float* pk = packed.get_data();
+  for (mat_index i = 0; i < rows; ++i)
+  {
+    const mat_index panel = i / DENSE_PANEL_ROWS;
+    const mat_index r = i % DENSE_PANEL_ROWS;
+    for (mat_index j = 0; j < cols; ++j)
+    {
+      pk[((std::size_t) panel * cols + j) * DENSE_PANEL_ROWS + r] =
+          w[(std::size_t) i * cols + j];
+    }
+  }
+  return packed;
+}
+
+
+void Dense::enable_sparse_input (float max_density)
+{
+  if (_projection)
+  {
+    // the raw input reaches the projection; the outer factor reads its
+    // dense output
+    Dense projection = *_projection;
+    projection.enable_sparse_input(max_density);
+    _projection = std::make_shared<const Dense>(std::move(projection));
+    return;
+  }
+  _sparse_cutoff = max_density;
+  if (max_density == SPARSE_DISABLED)
+  {
+    _weights_t.reset();
+    return;
+  }
+  _weights_t = derived_matrix(_weights, DERIVED_TRANSPOSED,
+                              transpose_weights);
+}
+
+
+Matrix Dense::sum_rows (const Matrix& weights)
+{
+  return weights.row_sums();
+}
 
 
-Matrix Dense::get_weights ()const
+Matrix Dense::transpose_weights (const Matrix& weights)
 {
-  return _weights;
+  Matrix transposed = weights;
+  transposed.transpose();
+  return transposed;
 }
 
 
-Matrix Dense::get_bias ()const
+MatrixPtr Dense::get_columns ()const
+{
+  return derived_matrix(get_weights_ptr(), DERIVED_TRANSPOSED,
+                        transpose_weights);
+}
+
+
+const Matrix& Dense::get_weights ()const
+{
+  return _product ? *_product : *_weights;
+}
+
+
+const Matrix& Dense::get_bias ()const
+{
+  return *_bias;
+}
+
+
+MatrixPtr Dense::get_weights_ptr ()const
+{
+  return _product ? _product : _weights;
+}
+
+
+MatrixPtr Dense::get_bias_ptr ()const
 {
   return _bias;
 }
 
 
+std::vector<MatrixPtr> Dense::get_buffers ()const
+{
+  std::vector<MatrixPtr> buffers = {_weights, _bias, _packed, _row_sums};
+  if (_weights_t)
+  {
+    buffers.push_back(_weights_t);
+  }
+  if (_projection)
+  {
+    buffers.push_back(_product);
+    std::vector<MatrixPtr> inner = _projection->get_buffers();
+    buffers.insert(buffers.end(), inner.begin(), inner.end());
+  }
+  return buffers;
+}
+
+
 Activation_Func Dense::get_activation ()const
 {
   return _activation_func;
 }
 
 
-Matrix Dense::operator() (const Matrix& input_vec)const
+float Dense::get_sparse_cutoff () const
 {
-  return Matrix(_activation_func((_weights * input_vec) + _bias));
+  return _projection ? _projection->get_sparse_cutoff() : _sparse_cutoff;
 }
 
 
+bool Dense::is_factored () const
+{
+  return (bool) _projection;
+}
 
 
+mat_index Dense::get_rank () const
+{
+  return _projection ? _weights->get_cols() : 0;
+}
 
 
+MatrixPtr Dense::get_outer_factor () const
+{
+  return _projection ? _weights : MatrixPtr();
+}
 
 
+std::shared_ptr<const Dense> Dense::get_projection () const
+{
+  return _projection;
+}
+
 
+mat_index Dense::multiply_adds () const
+{
+  return _weights->size() + (_projection ? _projection->multiply_adds() : 0);
+}
+
+
+void Dense::set_kernel_config (const dense_config& config)
+{
+  if ((config.gemv_unroll != 1 && config.gemv_unroll != 2 &&
+       config.gemv_unroll != 4) || config.batch_tile < 0)
+  {
+    throw std::invalid_argument (KERNEL_CONFIG_ERROR);
+  }
+  _config = config;
+  if (_projection)
+  {
+    Dense projection = *_projection;
+    projection.set_kernel_config(config);
+    _projection = std::make_shared<const Dense>(std::move(projection));
+  }
+}
+
+
+dense_config Dense::get_kernel_config () const
+{
+  return _config;
+}
+
+
+template <int Unroll, typename T, typename Epilogue>
+void Dense::packed_gemv (const Input<T>& in, float* out, Epilogue f) const
+{
+  const mat_index rows = _weights->get_rows();
+  const mat_index cols = _weights->get_cols();
+  const mat_index panels = (rows + DENSE_PANEL_ROWS - 1) / DENSE_PANEL_ROWS;
+  const T* input = in.data;
+  for (mat_index p = 0; p < panels; ++p)
+  {
+    const float* pk = _packed->get_data() +
+                      (std::size_t) p * cols * DENSE_PANEL_ROWS;
+    // one broadcast input times one contiguous panel column per step: the
+    // inner loop is a single vector multiply-add; Unroll independent
+    // accumulator sets overlap the latency of consecutive steps
+    float acc[Unroll][DENSE_PANEL_ROWS] = {{0}};
+    mat_index j = 0;
+    for (; j + Unroll <= cols; j += Unroll)
+    {
+      for (int u = 0; u < Unroll; ++u)
+      {
+        const float x = (float) input[j + u];
+        const float* col = pk + (std::size_t) (j + u) * DENSE_PANEL_ROWS;
+        for (mat_index r = 0; r < DENSE_PANEL_ROWS; ++r)
+        {
+          acc[u][r] += x * col[r];
+        }
+      }
+    }
+    for (; j < cols; ++j)
+    {
+      const float x = (float) input[j];
+      const float* col = pk + (std::size_t) j * DENSE_PANEL_ROWS;
+      for (mat_index r = 0; r < DENSE_PANEL_ROWS; ++r)
+      {
+        acc[0][r] += x * col[r];
+      }
+    }
+    for (int u = 1; u < Unroll; ++u)
+    {
+      for (mat_index r = 0; r < DENSE_PANEL_ROWS; ++r)
+      {
+        acc[0][r] += acc[u][r];
+      }
+    }
+    const mat_index first = p * DENSE_PANEL_ROWS;
+    const mat_index count = (rows - first < DENSE_PANEL_ROWS)
+                            ? rows - first : DENSE_PANEL_ROWS;
+    for (mat_index r = 0; r < count; ++r)
+    {
+      out[first + r] = f (in.scale * acc[0][r] + in.bias[first + r]);
+    }
+  }
+}
+
+
+template <typename T, typename Epilogue>
+void Dense::packed_gemm (const Input<T>& in, float* out, Epilogue f) const
+{
+  const mat_index rows = _weights->get_rows();
+  const mat_index cols = _weights->get_cols();
+  const mat_index panels = (rows + DENSE_PANEL_ROWS - 1) / DENSE_PANEL_ROWS;
+  const mat_index batch = in.batch;
+  const mat_index tile = (_config.batch_tile == DENSE_WHOLE_BATCH)
+                         ? batch : _config.batch_tile;
+  // a tile of batch columns of the input (cols x tile) is reused by every
+  // panel before the next tile is read
+  for (mat_index k0 = 0; k0 < batch; k0 += tile)
+  {
+    const mat_index k1 = (batch - k0 < tile) ? batch : k0 + tile;
+    for (mat_index p = 0; p < panels; ++p)
+    {
+      const float* pk = _packed->get_data() +
+                        (std::size_t) p * cols * DENSE_PANEL_ROWS;
+      const mat_index first = p * DENSE_PANEL_ROWS;
+      const mat_index count = (rows - first < DENSE_PANEL_ROWS)
+                              ? rows - first : DENSE_PANEL_ROWS;
+      // the panel's output rows (count x tile) stay in cache while every
+      // input row is streamed through them once
+      for (mat_index r = 0; r < count; ++r)
+      {
+        float* out_row = out + (std::size_t) (first + r) * batch;
+        std::fill(out_row + k0, out_row + k1, 0.0f);
+      }
+      for (mat_index j = 0; j < cols; ++j)
+      {
+        const T* in_row = in.data + (std::size_t) j * batch;
+        const float* col = pk + (std::size_t) j * DENSE_PANEL_ROWS;
+        for (mat_index r = 0; r < count; ++r)
+        {
+          const float w = col[r];
+          float* out_row = out + (std::size_t) (first + r) * batch;
+          for (mat_index k = k0; k < k1; ++k)
+          {
+            out_row[k] += w * (float) in_row[k];
+          }
+        }
+      }
+      // scale, bias and activation run on the panel while it is in cache
+      for (mat_index r = 0; r < count; ++r)
+      {
+        float* out_row = out + (std::size_t) (first + r) * batch;
+        const float b = in.bias[first + r];
+        for (mat_index k = k0; k < k1; ++k)
+        {
+          out_row[k] = f (in.scale * out_row[k] + b);
+        }
+      }
+    }
+  }
+}
 
+
+template <typename T, typename Epilogue>
+void Dense::sparse_gemv (const Input<T>& in, float* out, Epilogue f) const
+{
+  const mat_index rows = _weights->get_rows();
+  const mat_index cols = _weights->get_cols();
+  const float* wt = _weights_t->get_data();
+  std::fill(out, out + rows, 0.0f);
+  for (mat_index j = 0; j < cols; ++j)
+  {
+    const float x = (float) in.data[j];
+    if (x == 0)
+    {
+      continue;
+    }
+    // column j of the weights is contiguous in the transposed copy
+    const float* col = wt + (std::size_t) j * rows;
+    for (mat_index i = 0; i < rows; ++i)
+    {
+      out[i] += x * col[i];
+    }
+  }
+  for (mat_index i = 0; i < rows; ++i)
+  {
+    out[i] = f (in.scale * out[i] + in.bias[i]);
+  }
+}
+
+
+template <typename T, typename Epilogue>
+Matrix Dense::forward (const Input<T>& in, Epilogue f)const
+{
+  const T* input = in.data;
+  if (in.batch == 1)
+  {
+    Matrix output(_weights->get_rows(), 1);
+    bool sparse = false;
+    if (_sparse_cutoff != SPARSE_DISABLED)
+    {
+      const mat_index cols = _weights->get_cols();
+      mat_index nonzeros = 0;
+      for (mat_index j = 0; j < cols; ++j)
+      {
+        nonzeros += (input[j] != 0);
+      }
+      sparse = nonzeros <= _sparse_cutoff * cols;
+    }
+    if (sparse)
+    {
+      sparse_gemv(in, output.get_data(), f);
+    }
+    else if (_config.gemv_unroll == 4)
+    {
+      packed_gemv<4>(in, output.get_data(), f);
+    }
+    else if (_config.gemv_unroll == 2)
+    {
+      packed_gemv<2>(in, output.get_data(), f);
+    }
+    else
+    {
+      packed_gemv<1>(in, output.get_data(), f);
+    }
+    return output;
+  }
+  // a batch of column vectors; the bias is broadcast over all of them
+  Matrix output(_weights->get_rows(), in.batch);
+  packed_gemm(in, output.get_data(), f);
+  return output;
+}
+
+
+template <typename T>
+Matrix Dense::activate (const Input<T>& in)const
+{
+  TRACE_SPAN(_trace_name, "layer");
+  switch (_activation_kind)
+  {
+    case activation::KIND_IDENTITY:
+      return forward(in, activation::Identity());
+    case activation::KIND_RELU:
+      return forward(in, activation::Relu());
+    case activation::KIND_LEAKY_RELU:
+      return forward(in, activation::LeakyRelu());
+    case activation::KIND_SIGMOID:
+      return forward(in, activation::Sigmoid());
+    case activation::KIND_TANH:
+      return forward(in, activation::Tanh());
+    case activation::KIND_GELU:
+      return forward(in, activation::Gelu());
+    case activation::KIND_SILU:
+      return forward(in, activation::Silu());
+    case activation::KIND_SOFTMAX:
+    {
+      Matrix output = forward(in, activation::Identity());
+      TRACE_SPAN("softmax", "activation");
+      activation::softmax_inplace(output);
+      return output;
+    }
+    default:
+      return _activation_func (forward(in, activation::Identity()));
+  }
+}
+
+
+Matrix Dense::operator() (const Matrix& input_vec)const
+{
+  if (_projection)
+  {
+    // two thin products back to back: rank x cols, then rows x rank
+    Matrix inner = (*_projection)(input_vec);
+    return activate(Input<float>{inner.get_data(), inner.get_cols(), 1.0f,
+                                 _bias->get_data()});
+  }
+  if (input_vec.get_rows() != _weights->get_cols())
+  {
+    throw std::length_error (INPUT_SIZE_ERROR);
+  }
+  return activate(Input<float>{input_vec.get_data(), input_vec.get_cols(),
+                               1.0f, _bias->get_data()});
+}
+
+
+Matrix Dense::pre_activation (const Matrix& input_vec)const
+{
+  TRACE_SPAN(_trace_name, "layer");
+  if (_projection)
+  {
+    Matrix inner = (*_projection)(input_vec);
+    return forward(Input<float>{inner.get_data(), inner.get_cols(), 1.0f,
+                                _bias->get_data()}, activation::Identity());
+  }
+  if (input_vec.get_rows() != _weights->get_cols())
+  {
+    throw std::length_error (INPUT_SIZE_ERROR);
+  }
+  return forward(Input<float>{input_vec.get_data(), input_vec.get_cols(),
+                              1.0f, _bias->get_data()},
+                 activation::Identity());
+}
+
+
+Matrix Dense::operator() (const std::uint8_t* input, mat_index batch,
+                          const byte_normalization& norm)const
+{
+  if (input == nullptr || batch <= 0)
+  {
+    throw std::invalid_argument (BYTE_INPUT_ERROR);
+  }
+  if (_projection)
+  {
+    Matrix inner = (*_projection)(input, batch, norm);
+    return activate(Input<float>{inner.get_data(), inner.get_cols(), 1.0f,
+                                 _bias->get_data()});
+  }
+  if (norm.offset == 0)
+  {
+    return activate(Input<std::uint8_t>{input, batch, norm.scale,
+                                        _bias->get_data()});
+  }
+  // W (scale * x + offset) + b = scale * (W x) + (b + offset * row sums)
+  const mat_index rows = _weights->get_rows();
+  const float* b = _bias->get_data();
+  const float* sums = _row_sums->get_data();
+  std::vector<float> bias(rows);
+  for (mat_index i = 0; i < rows; ++i)
+  {
+    bias[i] = b[i] + norm.offset * sums[i];
+  }
+  return activate(Input<std::uint8_t>{input, batch, norm.scale,
+                                      bias.data()});
+}
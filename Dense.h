@@ -2,9 +2,52 @@
 #define DENSE_H
 
 #include "Activation.h"
+#include "SharedWeights.h"
+#include <cstdint>
+#include <memory>
 
-/**   typedefs  */
-typedef Matrix (*Activation_Func)(const Matrix&);
+#define SPARSE_DENSITY_CUTOFF 0.5f
+#define SPARSE_DISABLED 0.0f
+
+// output rows interleaved per column in the packed weights: one SIMD
+// register of accumulators (two for SSE/NEON-width targets)
+#if defined(__AVX512F__)
+#define DENSE_PANEL_ROWS 16
+#else
+#define DENSE_PANEL_ROWS 8
+#endif
+
+#define DENSE_GEMV_UNROLL 1
+#define DENSE_WHOLE_BATCH 0
+#define BYTE_INPUT_SCALE (1.0f / 255.0f)
+
+/**
+ * @struct dense_config
+ * @brief Runtime parameters of a Dense layer's kernels. The best values
+ * depend on the layer shape and the CPU (see Autotune.h); any valid values
+ * give the same outputs up to rounding.
+ * @var gemv_unroll - input columns per step of the single-vector kernel,
+ *      each with its own accumulators: 1, 2 or 4
+ * @var batch_tile - batch columns per pass of the batch kernel, so the
+ *      input tile stays in cache across all panels; DENSE_WHOLE_BATCH for
+ *      the whole batch
+ */
+typedef struct dense_config {
+	int gemv_unroll;
+	int batch_tile;
+} dense_config;
+
+/**
+ * @struct byte_normalization
+ * @brief How raw uint8 inputs map to the floats the weights were trained
+ * on: x = byte * scale + offset.
+ * @var scale - multiplies each byte; BYTE_INPUT_SCALE maps 0..255 to [0, 1]
+ * @var offset - added after scaling, e.g. -mean / std
+ */
+typedef struct byte_normalization {
+	float scale;
+	float offset;
+} byte_normalization;
 
 /**
  * @class Dense
@@ -16,10 +59,101 @@ typedef Matrix (*Activation_Func)(const Matrix&);
 class Dense{
 
  private:
-  Matrix _weights; /**< The weight matrix of the dense layer. */
-  Matrix _bias; /**< The bias matrix of the dense layer. */
+  MatrixPtr _weights; /**< The weight matrix of the dense layer. */
+  MatrixPtr _bias; /**< The bias matrix of the dense layer. */
   Activation_Func _activation_func; /**< The activation function of the
  * dense layer. */
+  activation::kind _activation_kind; /**< Which built-in activation
+ * _activation_func is, so the kernels can apply it inline. */
+  MatrixPtr _packed; /**< _weights repacked into panels of DENSE_PANEL_ROWS
+ * output rows: element (panel * cols + j, r) holds weight
+ * (panel * DENSE_PANEL_ROWS + r, j), zero padded past the last row. */
+  MatrixPtr _row_sums; /**< Row sums of _weights, which fold a byte input
+ * offset into the bias. */
+  MatrixPtr _weights_t; /**< Column-major copy of _weights (its transpose),
+ * kept only when the sparse input path is enabled. */
+  float _sparse_cutoff; /**< Largest input density (nonzeros / inputs) that
+ * takes the sparse path; SPARSE_DISABLED turns the path off. */
+  const char* _trace_name; /**< Span name of the layer, "dense RxC". */
+  dense_config _config; /**< Kernel parameters. */
+  std::shared_ptr<const Dense> _projection; /**< For a factored layer, the
+ * inner factor V (rank x cols) as a layer of its own; the kernels then
+ * multiply its output by _weights, the outer factor U (rows x rank). */
+  MatrixPtr _product; /**< For a factored layer, U * V, which get_weights()
+ * returns. */
+
+/**
+ * @struct Input
+ * @brief What the kernels read: batch input vectors of element type T
+ * stored as the columns of a (cols x batch) buffer, a factor applied to
+ * each weighted sum, and the bias added after it. Float inputs use a scale
+ * of 1 and _bias; byte inputs convert each element as it is loaded.
+ */
+  template <typename T>
+  struct Input {
+    const T* data;
+    mat_index batch;
+    float scale;
+    const float* bias;
+  };
+
+/**
+ * @brief Constructs a layer over given packed and row-sum layouts of the
+ * weights, which are used as they are.
+ */
+  Dense(MatrixPtr weights, MatrixPtr bias, Activation_Func activation_func,
+        MatrixPtr packed, MatrixPtr row_sums);
+
+/**
+ * @brief Returns the row sums of a weight matrix.
+ */
+  static Matrix sum_rows (const Matrix& weights);
+
+/**
+ * @brief Returns the panel-packed layout of a weight matrix.
+ */
+  static Matrix pack_weights (const Matrix& weights);
+
+/**
+ * @brief Returns the column-major copy (transpose) of a weight matrix.
+ */
+  static Matrix transpose_weights (const Matrix& weights);
+
+/**
+ * @brief Computes f(scale * (weights * input) + bias) for a single input
+ * vector from the packed weights, DENSE_PANEL_ROWS independent accumulators
+ * at a time, Unroll input columns per step.
+ */
+  template <int Unroll, typename T, typename Epilogue>
+  void packed_gemv (const Input<T>& in, float* out, Epilogue f)const;
+
+/**
+ * @brief Computes f(scale * (weights * input) + bias (broadcast)) for a
+ * batch of input vectors.
+ */
+  template <typename T, typename Epilogue>
+  void packed_gemm (const Input<T>& in, float* out, Epilogue f)const;
+
+/**
+ * @brief Computes f(scale * (weights * input) + bias) for a single input
+ * vector by accumulating only the columns of _weights_t whose input is
+ * nonzero.
+ */
+  template <typename T, typename Epilogue>
+  void sparse_gemv (const Input<T>& in, float* out, Epilogue f)const;
+
+/**
+ * @brief Runs the kernel that suits the input with the element-wise
+ * activation f applied to each output as it is stored.
+ */
+  template <typename T, typename Epilogue>
+  Matrix forward (const Input<T>& in, Epilogue f)const;
+
+/**
+ * @brief Runs forward() with the layer's activation.
+ */
+  template <typename T>
+  Matrix activate (const Input<T>& in)const;
 
 
  public:
@@ -28,6 +162,9 @@ class Dense{
  * @brief Constructs a Dense layer with the specified weights, bias, and
  * activation function.
  *
+ * The weights are repacked once, here, into the panel layout the forward
+ * kernels read; get_weights() still returns the original row-major matrix.
+ *
  * @param weights The weight matrix of the dense layer.
  * @param bias The bias matrix of the dense layer.
  * @param activation_func The activation function of the dense layer.
@@ -35,18 +172,102 @@ class Dense{
   Dense(Matrix& weights, Matrix& bias, Activation_Func activation_func);
 
 /**
- * @brief Returns the weight matrix of the dense layer.
+ * @brief Constructs a Dense layer over shared, immutable weights and bias.
+ *
+ * Nothing is copied: every layer built on the same buffers, in any thread,
+ * reads the same memory, and layers over the same weights also share one
+ * packed (and transposed) copy. Copying a Dense shares its buffers too.
+ *
+ * @param weights The weight matrix of the dense layer.
+ * @param bias The bias matrix of the dense layer.
+ * @param activation_func The activation function of the dense layer.
+ */
+  Dense(MatrixPtr weights, MatrixPtr bias, Activation_Func activation_func);
+
+/**
+ * @brief Constructs a factored (low-rank) layer computing
+ * activation(outer * (inner * input) + bias).
+ *
+ * A rows x cols layer of rank r then costs r * (rows + cols) multiply-adds
+ * per input instead of rows * cols: the two thin products run back to
+ * back. get_weights() returns the product outer * inner, computed once
+ * here, so code that reads a layer's weights sees the matrix it applies.
+ *
+ * @param outer The rows x r factor.
+ * @param inner The r x cols factor.
+ * @param bias The bias matrix of the dense layer.
+ * @param activation_func The activation function of the dense layer.
+ * @throw std::length_error if the factors' inner dimensions differ.
+ */
+  Dense(MatrixPtr outer, MatrixPtr inner, MatrixPtr bias,
+        Activation_Func activation_func);
+
+/**
+ * @brief Returns a deep copy of the layer that shares no buffers with it,
+ * e.g. to place a replica in memory local to the calling thread.
  *
- * @return The weight matrix.
+ * @return The copy.
  */
-  Matrix get_weights()const;
+  Dense clone()const;
+
+/**
+ * @brief Returns the weight matrix of the dense layer; for a factored
+ * layer, the product of its factors.
+ *
+ * @return A view of the weight matrix, valid while the layer lives.
+ */
+  const Matrix& get_weights()const;
 
 /**
  * @brief Returns the bias matrix of the dense layer.
  *
- * @return The bias matrix.
+ * @return A view of the bias matrix, valid while the layer lives.
+ */
+  const Matrix& get_bias()const;
+
+/**
+ * @brief Returns the shared weight buffer.
+ */
+  MatrixPtr get_weights_ptr()const;
+
+/**
+ * @brief Returns the shared bias buffer.
+ */
+  MatrixPtr get_bias_ptr()const;
+
+/**
+ * @brief Returns every shared buffer the layer holds (weights, bias and
+ * derived layouts), for memory accounting.
+ */
+  std::vector<MatrixPtr> get_buffers()const;
+
+/**
+ * @brief Tells whether the layer runs as two low-rank factors.
  */
-  Matrix get_bias()const;
+  bool is_factored()const;
+
+/**
+ * @brief Returns the rank of a factored layer, 0 for a full one.
+ */
+  mat_index get_rank()const;
+
+/**
+ * @brief Returns the outer factor (rows x rank) of a factored layer, or
+ * null for a full one.
+ */
+  MatrixPtr get_outer_factor()const;
+
+/**
+ * @brief Returns the inner factor of a factored layer as the layer the
+ * kernels run it as (rank x cols, zero bias, identity activation, with the
+ * sparse path and kernel parameters), or null for a full one.
+ */
+  std::shared_ptr<const Dense> get_projection()const;
+
+/**
+ * @brief Returns the multiply-adds the layer spends per input vector.
+ */
+  mat_index multiply_adds()const;
 
 /**
  * @brief Returns the activation function of the dense layer.
@@ -55,14 +276,90 @@ class Dense{
  */
   Activation_Func get_activation()const;
 
+/**
+ * @brief Enables the sparse-input kernel for single input vectors.
+ *
+ * Keeps a column-major copy of the weights. Every call then counts the
+ * nonzero inputs and, when at most max_density of them are nonzero, sums
+ * only the weight columns of the nonzero inputs instead of running the full
+ * matrix-vector product. Worth it for inputs that are mostly exact zeros,
+ * like the background pixels of an image feeding the first layer.
+ *
+ * @param max_density The density cutoff in (0, 1]; SPARSE_DISABLED turns
+ * the sparse path off and frees the copy.
+ */
+  void enable_sparse_input(float max_density = SPARSE_DENSITY_CUTOFF);
+
+/**
+ * @brief Returns the weights in column-major order (their transpose), so
+ * the weights of one input are contiguous.
+ *
+ * The copy is the one the sparse path uses, built once per weight buffer
+ * and shared; for a factored layer it is the transposed product.
+ */
+  MatrixPtr get_columns()const;
+
+/**
+ * @brief Returns the input density cutoff of the sparse path, or
+ * SPARSE_DISABLED.
+ */
+  float get_sparse_cutoff()const;
+
+/**
+ * @brief Sets the kernel parameters; copies of the layer made afterwards
+ * inherit them.
+ *
+ * @param config The parameters.
+ * @throw std::invalid_argument if a parameter is out of range.
+ */
+  void set_kernel_config(const dense_config& config);
+
+/**
+ * @brief Returns the kernel parameters.
+ */
+  dense_config get_kernel_config()const;
+
 /**
  * @brief Computes the output of the dense layer given an input vector.
  *
- * @param input_vec The input vector to the dense layer.
+ * @param input_vec The input vector to the dense layer, or a batch of input
+ * vectors stored as columns.
+ * Built-in element-wise activations are applied inside the kernels as each
+ * output is stored; others run on the kernels' output afterwards.
+ *
  * @return The output matrix computed by applying the weights, bias, and
  * activation function.
  */
   Matrix operator()(const Matrix& input_vec)const;
+
+/**
+ * @brief Computes weights * input + bias without the activation, e.g. to
+ * cache it and update it as the input changes.
+ *
+ * @param input_vec The input vector, or a batch of them stored as columns.
+ * @return The pre-activation outputs; get_activation() of them is
+ * operator()(input_vec).
+ */
+  Matrix pre_activation(const Matrix& input_vec)const;
+
+/**
+ * @brief Computes the output of the dense layer for raw byte inputs.
+ *
+ * Each byte is converted to float inside the kernels as it is loaded, so
+ * the input is read at a quarter of the bandwidth of a float matrix and no
+ * converted copy is made. The scale is applied once per weighted sum and
+ * the offset is folded into the bias (offset * the weights' row sums).
+ *
+ * @param input batch input vectors of get_weights().get_cols() bytes each,
+ * stored as the columns of a (cols x batch) row-major buffer; for one
+ * image, simply its pixels.
+ * @param batch The number of input vectors.
+ * @param norm The byte to float mapping.
+ * @return The (rows x batch) output matrix.
+ * @throw std::invalid_argument if input is null or batch is not positive.
+ */
+  Matrix operator()(const std::uint8_t* input, mat_index batch,
+                    const byte_normalization& norm)const;
 };
 
 
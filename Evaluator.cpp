@@ -0,0 +1,204 @@
+#include "Evaluator.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+
+#define EMPTY_DATASET_ERROR "Error: cannot evaluate on an empty dataset"
+#define LABEL_RANGE_ERROR "Error: dataset label out of the network's range"
+#define TOP_K_ERROR "Error: top-k must be between 1 and the number of classes"
+
+/**
+ * @brief Per-batch partial counts, merged into the report at the end.
+ */
+struct eval_counts
+{
+  unsigned long long top1 = 0, topk = 0;
+  double confidence = 0;
+  std::vector<unsigned long long> confusion; // classes x classes
+  std::vector<unsigned long long> bin_count, bin_correct;
+  std::vector<double> bin_confidence;
+
+  explicit eval_counts (int classes)
+      : confusion ((std::size_t) classes * classes, 0),
+        bin_count (EVAL_CALIBRATION_BINS, 0),
+        bin_correct (EVAL_CALIBRATION_BINS, 0),
+        bin_confidence (EVAL_CALIBRATION_BINS, 0) {}
+
+  void merge (const eval_counts& other)
+  {
+    top1 += other.top1;
+    topk += other.topk;
+    confidence += other.confidence;
+    for (std::size_t i = 0; i < confusion.size (); ++i)
+    {
+      confusion[i] += other.confusion[i];
+    }
+    for (int b = 0; b < EVAL_CALIBRATION_BINS; ++b)
+    {
+      bin_count[b] += other.bin_count[b];
+      bin_correct[b] += other.bin_correct[b];
+      bin_confidence[b] += other.bin_confidence[b];
+    }
+  }
+};
+
+
+eval_report evaluate (const MlpNetwork& mlp, const IdxDataset& dataset,
+                      int k, int batch)
+{
+  if (dataset.images.empty ())
+  {
+    throw std::invalid_argument (EMPTY_DATASET_ERROR);
+  }
+  const int classes = mlp.get_layer (MLP_SIZE - 1).get_weights ().get_rows ();
+  if (k < 1 || k > classes)
+  {
+    throw std::invalid_argument (TOP_K_ERROR);
+  }
+  for (int label : dataset.labels)
+  {
+    if (label < 0 || label >= classes)
+    {
+      throw std::invalid_argument (LABEL_RANGE_ERROR);
+    }
+  }
+
+  eval_counts total (classes);
+  std::mutex total_mutex;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now ();
+  ThreadPool::shared ().parallel_for (0, dataset.images.size (),
+                                      (std::size_t) batch,
+      [&] (std::size_t lo, std::size_t hi)
+  {
+    const int n = (int) (hi - lo);
+    // throws length_error on an image of the wrong size, e.g. an IDX set
+    // of another resolution
+    Matrix probs = mlp.forward (MlpNetwork::pack_batch (dataset.images, lo,
+                                                        hi));
+    std::vector<mat_index> predicted = probs.col_argmax ();
+
+    eval_counts local (classes);
+    Matrix column (classes, 1);
+    for (int c = 0; c < n; ++c)
+    {
+      const int label = dataset.labels[lo + c];
+      const float confidence = probs (predicted[c], c);
+      const bool correct = predicted[c] == label;
+      for (int r = 0; r < classes; ++r)
+      {
+        column[r] = probs (r, c);
+      }
+      for (mat_index candidate : column.top_k (k))
+      {
+        local.topk += (candidate == label);
+      }
+      local.top1 += correct;
+      local.confidence += confidence;
+      local.confusion[(std::size_t) label * classes + predicted[c]]++;
+      int bin = (int) (confidence * EVAL_CALIBRATION_BINS);
+      bin = std::min (std::max (bin, 0), EVAL_CALIBRATION_BINS - 1);
+      local.bin_count[bin]++;
+      local.bin_correct[bin] += correct;
+      local.bin_confidence[bin] += confidence;
+    }
+    std::lock_guard<std::mutex> lock (total_mutex);
+    total.merge (local);
+  });
+  double seconds = std::chrono::duration<double> (
+      std::chrono::steady_clock::now () - start).count ();
+
+  eval_report report;
+  const double images = (double) dataset.images.size ();
+  report.images = dataset.images.size ();
+  report.k = k;
+  report.top1_accuracy = total.top1 / images;
+  report.topk_accuracy = total.topk / images;
+  report.mean_confidence = total.confidence / images;
+  report.seconds = seconds;
+  report.images_per_sec = (seconds > 0) ? images / seconds : 0;
+
+  report.confusion.assign (classes,
+                           std::vector<unsigned long long> (classes, 0));
+  report.precision.assign (classes, 0);
+  report.recall.assign (classes, 0);
+  for (int t = 0; t < classes; ++t)
+  {
+    for (int p = 0; p < classes; ++p)
+    {
+      report.confusion[t][p] = total.confusion[(std::size_t) t * classes + p];
+    }
+  }
+  for (int c = 0; c < classes; ++c)
+  {
+    unsigned long long predicted = 0, actual = 0;
+    for (int o = 0; o < classes; ++o)
+    {
+      predicted += report.confusion[o][c];
+      actual += report.confusion[c][o];
+    }
+    report.precision[c] = predicted ? (double) report.confusion[c][c] /
+                                      predicted : 0;
+    report.recall[c] = actual ? (double) report.confusion[c][c] / actual : 0;
+  }
+
+  report.calibration_error = 0;
+  for (int b = 0; b < EVAL_CALIBRATION_BINS; ++b)
+  {
+    calibration_bin bin;
+    bin.count = total.bin_count[b];
+    bin.mean_confidence = bin.count ? total.bin_confidence[b] / bin.count : 0;
+    bin.accuracy = bin.count ? (double) total.bin_correct[b] / bin.count : 0;
+    report.calibration_error += bin.count / images *
+                                std::fabs (bin.accuracy - bin.mean_confidence);
+    report.bins.push_back (bin);
+  }
+  return report;
+}
+
+
+void print_report (const eval_report& report, std::ostream& out)
+{
+  const int classes = (int) report.confusion.size ();
+  out << std::fixed << std::setprecision (4)
+      << "images: " << report.images << "\n"
+      << "top-1 accuracy: " << report.top1_accuracy << "\n"
+      << "top-" << report.k << " accuracy: " << report.topk_accuracy << "\n"
+      << "mean confidence: " << report.mean_confidence << "\n"
+      << "expected calibration error: " << report.calibration_error << "\n"
+      << "throughput: " << std::setprecision (1) << report.images_per_sec
+      << " images/sec (" << std::setprecision (3) << report.seconds
+      << " s)\n\nconfusion matrix (rows: label, cols: prediction)\n     ";
+  for (int p = 0; p < classes; ++p)
+  {
+    out << std::setw (7) << p;
+  }
+  out << "\n";
+  for (int t = 0; t < classes; ++t)
+  {
+    out << std::setw (5) << t;
+    for (int p = 0; p < classes; ++p)
+    {
+      out << std::setw (7) << report.confusion[t][p];
+    }
+    out << "\n";
+  }
+  out << "\nclass  precision  recall\n" << std::setprecision (4);
+  for (int c = 0; c < classes; ++c)
+  {
+    out << std::setw (5) << c << std::setw (11) << report.precision[c]
+        << std::setw (8) << report.recall[c] << "\n";
+  }
+  out << "\nconfidence bin  count  mean conf  accuracy\n";
+  for (int b = 0; b < (int) report.bins.size (); ++b)
+  {
+    const calibration_bin& bin = report.bins[b];
+    out << std::setprecision (1) << "  [" << (double) b / report.bins.size ()
+        << ", " << (double) (b + 1) / report.bins.size () << ")"
+        << std::setw (8) << bin.count << std::setprecision (4)
+        << std::setw (11) << bin.mean_confidence << std::setw (10)
+        << bin.accuracy << "\n";
+  }
+  out.unsetf (std::ios::fixed);
+}
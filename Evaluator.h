@@ -0,0 +1,82 @@
+// Evaluator.h
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include "MlpNetwork.h"
+#include "IdxDataset.h"
+#include <ostream>
+#include <vector>
+
+#define EVAL_TOP_K 3
+#define EVAL_BATCH 256
+#define EVAL_CALIBRATION_BINS 10
+
+/**
+ * @struct calibration_bin
+ * @brief Predictions whose confidence fell into one probability interval.
+ * @var count - number of predictions in the bin
+ * @var mean_confidence - their mean digit.probability
+ * @var accuracy - the fraction of them that were correct
+ */
+typedef struct calibration_bin {
+	unsigned long long count;
+	double mean_confidence, accuracy;
+} calibration_bin;
+
+/**
+ * @struct eval_report
+ * @brief Accuracy, calibration and throughput of a network on a dataset.
+ * @var images - number of evaluated images
+ * @var k - the k of the top-k accuracy
+ * @var top1_accuracy - fraction of images whose most probable digit is right
+ * @var topk_accuracy - fraction whose label is among the k most probable
+ * @var confusion - confusion[label][prediction] counts
+ * @var precision - per predicted class, correct / predicted (0 if never
+ *      predicted)
+ * @var recall - per true class, correct / occurrences (0 if absent)
+ * @var mean_confidence - mean digit.probability over all images
+ * @var calibration_error - expected calibration error: the count-weighted
+ *      mean of |accuracy - mean_confidence| over the bins
+ * @var bins - EVAL_CALIBRATION_BINS equal-width confidence bins
+ * @var seconds - wall time of the evaluation
+ * @var images_per_sec - end-to-end throughput
+ */
+typedef struct eval_report {
+	std::size_t images;
+	int k;
+	double top1_accuracy, topk_accuracy;
+	std::vector<std::vector<unsigned long long> > confusion;
+	std::vector<double> precision, recall;
+	double mean_confidence, calibration_error;
+	std::vector<calibration_bin> bins;
+	double seconds, images_per_sec;
+} eval_report;
+
+/**
+ * @brief Evaluates a network on a labelled dataset.
+ *
+ * The dataset is split into batches of batch images that run in parallel on
+ * the shared thread pool, each one as a single batched forward pass.
+ *
+ * @param mlp The network to evaluate.
+ * @param dataset The labelled images.
+ * @param k The k of the top-k accuracy, in [1, number of classes].
+ * @param batch Number of images per forward pass.
+ * @return The report.
+ * @throw std::invalid_argument if the dataset is empty, a label is out of
+ * range or k is not in [1, number of classes].
+ * @throw std::length_error if an image does not have the network's input
+ * size.
+ */
+eval_report evaluate (const MlpNetwork& mlp, const IdxDataset& dataset,
+                      int k = EVAL_TOP_K, int batch = EVAL_BATCH);
+
+/**
+ * @brief Prints a report in human-readable form.
+ *
+ * @param report The report.
+ * @param out The stream to print to.
+ */
+void print_report (const eval_report& report, std::ostream& out);
+
+#endif //EVALUATOR_H
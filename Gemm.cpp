@@ -0,0 +1,332 @@
+#include "Gemm.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <memory>
+
+#define STRASSEN_PRODUCTS 7
+#define KERNEL_ROWS 4
+
+
+/**
+ * @brief C += A * B on a block, GEMM_BLOCK_DEPTH x GEMM_BLOCK_COLS slices
+ * of B at a time, KERNEL_ROWS rows of C per pass over a slice row so every
+ * loaded B element feeds KERNEL_ROWS multiply-adds.
+ */
+static void gemm_kernel (gemm_dim m, gemm_dim n, gemm_dim k,
+                         const float* a, std::size_t lda,
+                         const float* b, std::size_t ldb, float* c,
+                         std::size_t ldc)
+{
+  for (gemm_dim jj = 0; jj < n; jj += GEMM_BLOCK_COLS)
+  {
+    const gemm_dim nc = std::min ((gemm_dim) GEMM_BLOCK_COLS, n - jj);
+    for (gemm_dim pp = 0; pp < k; pp += GEMM_BLOCK_DEPTH)
+    {
+      const gemm_dim kc = std::min ((gemm_dim) GEMM_BLOCK_DEPTH, k - pp);
+      gemm_dim i = 0;
+      for (; i + KERNEL_ROWS <= m; i += KERNEL_ROWS)
+      {
+        float* c0 = c + i * ldc + jj;
+        float* c1 = c0 + ldc;
+        float* c2 = c1 + ldc;
+        float* c3 = c2 + ldc;
+        const float* a0 = a + i * lda + pp;
+        for (gemm_dim p = 0; p < kc; ++p)
+        {
+          const float x0 = a0[p];
+          const float x1 = a0[lda + p];
+          const float x2 = a0[2 * lda + p];
+          const float x3 = a0[3 * lda + p];
+          const float* brow = b + (pp + p) * ldb + jj;
+          for (gemm_dim j = 0; j < nc; ++j)
+          {
+            const float y = brow[j];
+            c0[j] += x0 * y;
+            c1[j] += x1 * y;
+            c2[j] += x2 * y;
+            c3[j] += x3 * y;
+          }
+        }
+      }
+      for (; i < m; ++i)
+      {
+        float* crow = c + i * ldc + jj;
+        for (gemm_dim p = 0; p < kc; ++p)
+        {
+          const float x = a[i * lda + pp + p];
+          const float* brow = b + (pp + p) * ldb + jj;
+          for (gemm_dim j = 0; j < nc; ++j)
+          {
+            crow[j] += x * brow[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+
+void gemm_classic (gemm_dim m, gemm_dim n, gemm_dim k,
+                   const float* a, std::size_t lda,
+                   const float* b, std::size_t ldb, float* c,
+                   std::size_t ldc)
+{
+  ThreadPool::shared ().parallel_for (0, m, GEMM_ROW_GRAIN,
+      [=] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      std::fill (c + i * ldc, c + i * ldc + n, 0.0f);
+    }
+    gemm_kernel ((gemm_dim) (hi - lo), n, k, a + lo * lda, lda, b, ldb,
+                 c + lo * ldc, ldc);
+  });
+}
+
+
+/**
+ * @brief out = x + y (sign 1) or x - y (sign -1) on rows x cols blocks.
+ */
+static void combine (gemm_dim rows, gemm_dim cols,
+                     const float* x, std::size_t ldx,
+                     const float* y, std::size_t ldy, float sign, float* out,
+                     std::size_t ldo)
+{
+  for (gemm_dim i = 0; i < rows; ++i)
+  {
+    const float* xr = x + i * ldx;
+    const float* yr = y + i * ldy;
+    float* orow = out + i * ldo;
+    for (gemm_dim j = 0; j < cols; ++j)
+    {
+      orow[j] = xr[j] + sign * yr[j];
+    }
+  }
+}
+
+
+/**
+ * @brief out += sign * x on rows x cols blocks.
+ */
+static void accumulate (gemm_dim rows, gemm_dim cols,
+                        const float* x, std::size_t ldx,
+                        float sign, float* out, std::size_t ldo)
+{
+  combine (rows, cols, out, ldo, x, ldx, sign, out, ldo);
+}
+
+
+/**
+ * @brief Whether the top recursion level runs its products in parallel;
+ * fixed per process, so arena sizes computed anywhere agree.
+ */
+static bool parallel_products ()
+{
+  return ThreadPool::shared ().concurrency () > 1;
+}
+
+
+static bool strassen_leaf (gemm_dim m, gemm_dim n, gemm_dim k, int crossover)
+{
+  return m <= crossover || n <= crossover || k <= crossover ||
+         m < 2 || n < 2 || k < 2;
+}
+
+
+/**
+ * @brief Scratch of one level: S1..S4 (mh x kh), T1..T4 (kh x nh) and the
+ * three products that have no home in C (mh x nh).
+ */
+static std::size_t level_floats (gemm_dim mh, gemm_dim nh, gemm_dim kh)
+{
+  return 4 * (std::size_t) mh * kh + 4 * (std::size_t) kh * nh +
+         3 * (std::size_t) mh * nh;
+}
+
+
+static std::size_t scratch_floats (gemm_dim m, gemm_dim n, gemm_dim k,
+                                   int crossover,
+                                   bool parallel)
+{
+  if (strassen_leaf (m, n, k, crossover))
+  {
+    return 0;
+  }
+  const gemm_dim mh = m / 2, nh = n / 2, kh = k / 2;
+  const std::size_t child = scratch_floats (mh, nh, kh, crossover, false);
+  return level_floats (mh, nh, kh) +
+         (parallel ? STRASSEN_PRODUCTS : 1) * child;
+}
+
+
+std::size_t strassen_scratch_size (gemm_dim m, gemm_dim n, gemm_dim k,
+                                   int crossover)
+{
+  return scratch_floats (m, n, k, crossover, parallel_products ());
+}
+
+
+static void strassen (gemm_dim m, gemm_dim n, gemm_dim k,
+                      const float* a, std::size_t lda,
+                      const float* b, std::size_t ldb, float* c,
+                      std::size_t ldc, int crossover, float* scratch,
+                      bool parallel)
+{
+  if (strassen_leaf (m, n, k, crossover))
+  {
+    gemm_classic (m, n, k, a, lda, b, ldb, c, ldc);
+    return;
+  }
+  const gemm_dim mh = m / 2, nh = n / 2, kh = k / 2;
+  const float* a11 = a;
+  const float* a12 = a + kh;
+  const float* a21 = a + mh * lda;
+  const float* a22 = a21 + kh;
+  const float* b11 = b;
+  const float* b12 = b + nh;
+  const float* b21 = b + kh * ldb;
+  const float* b22 = b21 + nh;
+  float* c11 = c;
+  float* c12 = c + nh;
+  float* c21 = c + mh * ldc;
+  float* c22 = c21 + nh;
+
+  const std::size_t ak = (std::size_t) mh * kh;
+  const std::size_t bk = (std::size_t) kh * nh;
+  const std::size_t cn = (std::size_t) mh * nh;
+  float* s1 = scratch;
+  float* s2 = s1 + ak;
+  float* s3 = s2 + ak;
+  float* s4 = s3 + ak;
+  float* t1 = s4 + ak;
+  float* t2 = t1 + bk;
+  float* t3 = t2 + bk;
+  float* t4 = t3 + bk;
+  float* p2 = t4 + bk;
+  float* p3 = p2 + cn;
+  float* p4 = p3 + cn;
+  float* child = p4 + cn;
+  const std::size_t child_floats = scratch_floats (mh, nh, kh, crossover,
+                                                   false);
+
+  // Winograd's form: 8 additions on the operands...
+  combine (mh, kh, a21, lda, a22, lda, 1, s1, kh);
+  combine (mh, kh, s1, kh, a11, lda, -1, s2, kh);
+  combine (mh, kh, a11, lda, a21, lda, -1, s3, kh);
+  combine (mh, kh, a12, lda, s2, kh, -1, s4, kh);
+  combine (kh, nh, b12, ldb, b11, ldb, -1, t1, nh);
+  combine (kh, nh, b22, ldb, t1, nh, -1, t2, nh);
+  combine (kh, nh, b22, ldb, b12, ldb, -1, t3, nh);
+  combine (kh, nh, t2, nh, b21, ldb, -1, t4, nh);
+
+  // ...seven products, four of them straight into a quadrant of C...
+  struct product
+  {
+    const float* x; std::size_t ldx;
+    const float* y; std::size_t ldy;
+    float* out; std::size_t ldo;
+  };
+  const product products[STRASSEN_PRODUCTS] = {
+      {a11, lda, b11, ldb, c11, ldc}, // P1
+      {a12, lda, b21, ldb, p2, (std::size_t) nh}, // P2
+      {s4, (std::size_t) kh, b22, ldb, p3, (std::size_t) nh}, // P3
+      {a22, lda, t4, (std::size_t) nh, p4, (std::size_t) nh}, // P4
+      {s1, (std::size_t) kh, t1, (std::size_t) nh, c22, ldc}, // P5
+      {s2, (std::size_t) kh, t2, (std::size_t) nh, c12, ldc}, // P6
+      {s3, (std::size_t) kh, t3, (std::size_t) nh, c21, ldc}}; // P7
+  auto run = [&] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      const product& p = products[i];
+      strassen (mh, nh, kh, p.x, p.ldx, p.y, p.ldy, p.out, p.ldo, crossover,
+                child + (parallel ? i * child_floats : 0), false);
+    }
+  };
+  if (parallel)
+  {
+    ThreadPool::shared ().parallel_for (0, STRASSEN_PRODUCTS, 1, run);
+  }
+  else
+  {
+    run (0, STRASSEN_PRODUCTS);
+  }
+
+  // ...and 7 additions, ordered so each quadrant is overwritten only once
+  // nothing else reads its old value
+  accumulate (mh, nh, c11, ldc, 1, c12, ldc); // U2 = P1 + P6
+  accumulate (mh, nh, c12, ldc, 1, c21, ldc); // U3 = U2 + P7
+  accumulate (mh, nh, c22, ldc, 1, c12, ldc); // U4 = U2 + P5
+  accumulate (mh, nh, c21, ldc, 1, c22, ldc); // C22 = U3 + P5
+  accumulate (mh, nh, p3, nh, 1, c12, ldc); // C12 = U4 + P3
+  accumulate (mh, nh, p4, nh, -1, c21, ldc); // C21 = U3 - P4
+  accumulate (mh, nh, p2, nh, 1, c11, ldc); // C11 = P1 + P2
+
+  // peel what the even sub-problem left out
+  const gemm_dim me = 2 * mh, ne = 2 * nh, ke = 2 * kh;
+  if (k > ke)
+  {
+    // the last column of A times the last row of B
+    const float* acol = a + ke;
+    const float* brow = b + ke * ldb;
+    for (gemm_dim i = 0; i < me; ++i)
+    {
+      const float x = acol[i * lda];
+      float* crow = c + i * ldc;
+      for (gemm_dim j = 0; j < ne; ++j)
+      {
+        crow[j] += x * brow[j];
+      }
+    }
+  }
+  if (n > ne)
+  {
+    gemm_classic (m, 1, k, a, lda, b + ne, ldb, c + ne, ldc);
+  }
+  if (m > me)
+  {
+    gemm_classic (1, ne, k, a + me * lda, lda, b, ldb, c + me * ldc, ldc);
+  }
+}
+
+
+void gemm_strassen (gemm_dim m, gemm_dim n, gemm_dim k,
+                    const float* a, std::size_t lda,
+                    const float* b, std::size_t ldb, float* c,
+                    std::size_t ldc, int crossover, float* scratch)
+{
+  if (crossover < 1)
+  {
+    crossover = 1;
+  }
+  const bool parallel = parallel_products ();
+  std::unique_ptr<float[]> arena;
+  if (scratch == nullptr)
+  {
+    arena.reset (new float[scratch_floats (m, n, k, crossover, parallel)
+                           + 1]);
+    scratch = arena.get ();
+  }
+  strassen (m, n, k, a, lda, b, ldb, c, ldc, crossover, scratch, parallel);
+}
+
+
+void gemm (gemm_dim m, gemm_dim n, gemm_dim k,
+           const float* a, std::size_t lda,
+           const float* b, std::size_t ldb, float* c, std::size_t ldc,
+           gemm_algorithm algorithm)
+{
+  if (algorithm == GEMM_AUTO)
+  {
+    algorithm = (m >= STRASSEN_AUTO_MIN_DIM && n >= STRASSEN_AUTO_MIN_DIM &&
+                 k >= STRASSEN_AUTO_MIN_DIM) ? GEMM_STRASSEN : GEMM_CLASSIC;
+  }
+  if (algorithm == GEMM_STRASSEN)
+  {
+    gemm_strassen (m, n, k, a, lda, b, ldb, c, ldc);
+  }
+  else
+  {
+    gemm_classic (m, n, k, a, lda, b, ldb, c, ldc);
+  }
+}
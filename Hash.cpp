@@ -0,0 +1,108 @@
+#include "Hash.h"
+#include <cstring>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+
+static inline std::uint64_t rotl64 (std::uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+
+static inline std::uint64_t read64 (const unsigned char* p)
+{
+  std::uint64_t v;
+  std::memcpy (&v, p, sizeof (v)); // little-endian hosts only, like the
+                                   // raw float files this project reads
+  return v;
+}
+
+
+static inline std::uint32_t read32 (const unsigned char* p)
+{
+  std::uint32_t v;
+  std::memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+
+static inline std::uint64_t round64 (std::uint64_t acc, std::uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = rotl64 (acc, 31);
+  return acc * PRIME64_1;
+}
+
+
+static inline std::uint64_t merge_round64 (std::uint64_t acc,
+                                           std::uint64_t val)
+{
+  acc ^= round64 (0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+std::uint64_t xxhash64 (const void* data, std::size_t len, std::uint64_t seed)
+{
+  const unsigned char* p = (const unsigned char*) data;
+  const unsigned char* end = p + len;
+  std::uint64_t h;
+
+  if (len >= 32)
+  {
+    std::uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    std::uint64_t v2 = seed + PRIME64_2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - PRIME64_1;
+    const unsigned char* limit = end - 32;
+    do
+    {
+      v1 = round64 (v1, read64 (p));
+      v2 = round64 (v2, read64 (p + 8));
+      v3 = round64 (v3, read64 (p + 16));
+      v4 = round64 (v4, read64 (p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = rotl64 (v1, 1) + rotl64 (v2, 7) + rotl64 (v3, 12) + rotl64 (v4, 18);
+    h = merge_round64 (h, v1);
+    h = merge_round64 (h, v2);
+    h = merge_round64 (h, v3);
+    h = merge_round64 (h, v4);
+  }
+  else
+  {
+    h = seed + PRIME64_5;
+  }
+  h += (std::uint64_t) len;
+
+  while (p + 8 <= end)
+  {
+    h ^= round64 (0, read64 (p));
+    h = rotl64 (h, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end)
+  {
+    h ^= (std::uint64_t) read32 (p) * PRIME64_1;
+    h = rotl64 (h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  while (p < end)
+  {
+    h ^= (*p) * PRIME64_5;
+    h = rotl64 (h, 11) * PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
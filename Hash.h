@@ -0,0 +1,23 @@
+// Hash.h
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Computes the 64-bit xxHash (XXH64) of a byte buffer.
+ *
+ * Processes 32 bytes per round in four independent lanes, which keeps it
+ * well above memory bandwidth for image-sized inputs. The output matches the
+ * reference XXH64 implementation.
+ *
+ * @param data The bytes to hash.
+ * @param len The number of bytes.
+ * @param seed The hash seed.
+ * @return The 64-bit hash.
+ */
+std::uint64_t xxhash64 (const void* data, std::size_t len,
+                        std::uint64_t seed = 0);
+
+#endif //HASH_H
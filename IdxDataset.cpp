@@ -0,0 +1,198 @@
+#include "IdxDataset.h"
+#include "NpyIO.h"
+#include "Trace.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#define IDX_TYPE_UBYTE 0x08
+#define IDX_TYPE_FLOAT 0x0D
+#define IDX_IMAGE_DIMS 3
+#define IDX_LABEL_DIMS 1
+#define IDX_OPEN_ERROR "Error: failed to open IDX file: "
+#define IDX_FORMAT_ERROR "Error: malformed IDX file: "
+#define IDX_COUNT_ERROR "Error: IDX image and label counts differ"
+#define NPY_LABEL_ERROR "Error: label is not a non-negative integer in: "
+#define NPY_BYTE_DESCR "u1"
+
+/**
+ * @brief Reads a big-endian 32-bit unsigned integer.
+ */
+static std::uint32_t read_be32 (std::istream& in)
+{
+  unsigned char b[4] = {0};
+  in.read ((char*) b, sizeof (b));
+  return ((std::uint32_t) b[0] << 24) | ((std::uint32_t) b[1] << 16) |
+         ((std::uint32_t) b[2] << 8) | (std::uint32_t) b[3];
+}
+
+
+/**
+ * @brief Opens an IDX file and parses its header.
+ *
+ * @param path The file path.
+ * @param file Receives the opened stream, positioned after the header.
+ * @param type Receives the element type code.
+ * @return The dimension sizes.
+ */
+static std::vector<std::uint32_t> open_idx (const std::string& path,
+                                            std::ifstream& file,
+                                            unsigned char& type)
+{
+  file.open (path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error (IDX_OPEN_ERROR + path);
+  }
+  unsigned char magic[4] = {0};
+  file.read ((char*) magic, sizeof (magic));
+  if (!file || magic[0] != 0 || magic[1] != 0)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + path);
+  }
+  type = magic[2];
+  std::vector<std::uint32_t> dims (magic[3]);
+  for (std::uint32_t& d : dims)
+  {
+    d = read_be32 (file);
+  }
+  if (!file)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + path);
+  }
+  return dims;
+}
+
+
+/**
+ * @brief Loads a dataset from a pair of .npy arrays.
+ */
+static IdxDataset load_npy_dataset (const std::string& images_path,
+                                    const std::string& labels_path,
+                                    float pixel_scale)
+{
+  npy_header images_header, labels_header;
+  Matrix images = load_npy (images_path, &images_header);
+  Matrix labels = load_npy (labels_path, &labels_header);
+  if (images_header.shape.size () < 2)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + images_path);
+  }
+  if (labels.get_cols () != 1)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + labels_path);
+  }
+  if (images.get_rows () != labels.get_rows ())
+  {
+    throw std::runtime_error (IDX_COUNT_ERROR);
+  }
+  // each image has the shape of the array without its leading dimension
+  const matrix_dims dims = npy_matrix_dims (std::vector<mat_index> (
+      images_header.shape.begin () + 1, images_header.shape.end ()));
+  const float scale = (images_header.descr.substr (1) == NPY_BYTE_DESCR)
+                      ? pixel_scale : 1.0f;
+
+  IdxDataset dataset;
+  dataset.images.reserve ((std::size_t) images.get_rows ());
+  dataset.labels.reserve ((std::size_t) images.get_rows ());
+  for (mat_index n = 0; n < images.get_rows (); ++n)
+  {
+    Matrix img (dims.rows, dims.cols);
+    const float* src = images.get_data () +
+                       (std::size_t) n * images.get_cols ();
+    float* dst = img.get_data ();
+    for (mat_index i = 0; i < img.size (); ++i)
+    {
+      dst[i] = src[i] * scale;
+    }
+    dataset.images.push_back (img);
+    // labels stored as floats must hold whole class numbers
+    const float label = labels[n];
+    if (!(label >= 0) || label > (float) std::numeric_limits<int>::max () ||
+        label != std::floor (label))
+    {
+      throw std::runtime_error (NPY_LABEL_ERROR + labels_path);
+    }
+    dataset.labels.push_back ((int) label);
+  }
+  return dataset;
+}
+
+
+IdxDataset loadIdxDataset (const std::string& images_path,
+                           const std::string& labels_path,
+                           float pixel_scale)
+{
+  TRACE_SPAN("loadIdxDataset", "io");
+  if (has_extension (images_path, NPY_EXTENSION))
+  {
+    return load_npy_dataset (images_path, labels_path, pixel_scale);
+  }
+  std::ifstream images_file, labels_file;
+  unsigned char images_type = 0, labels_type = 0;
+  std::vector<std::uint32_t> images_dims = open_idx (images_path, images_file,
+                                                     images_type);
+  std::vector<std::uint32_t> labels_dims = open_idx (labels_path, labels_file,
+                                                     labels_type);
+  if (images_dims.size () != IDX_IMAGE_DIMS ||
+      (images_type != IDX_TYPE_UBYTE && images_type != IDX_TYPE_FLOAT) ||
+      images_dims[1] == 0 || images_dims[2] == 0)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + images_path);
+  }
+  if (labels_dims.size () != IDX_LABEL_DIMS || labels_type != IDX_TYPE_UBYTE)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + labels_path);
+  }
+  if (images_dims[0] != labels_dims[0])
+  {
+    throw std::runtime_error (IDX_COUNT_ERROR);
+  }
+
+  const std::size_t count = images_dims[0];
+  const int rows = (int) images_dims[1];
+  const int cols = (int) images_dims[2];
+  const std::size_t pixels = (std::size_t) rows * cols;
+  const std::size_t elem_size = (images_type == IDX_TYPE_UBYTE) ? 1 : 4;
+  std::vector<unsigned char> raw (pixels * elem_size);
+
+  IdxDataset dataset;
+  dataset.images.reserve (count);
+  for (std::size_t n = 0; n < count; ++n)
+  {
+    images_file.read ((char*) raw.data (), raw.size ());
+    if (!images_file)
+    {
+      throw std::runtime_error (IDX_FORMAT_ERROR + images_path);
+    }
+    Matrix img (rows, cols);
+    float* dst = img.get_data ();
+    for (std::size_t i = 0; i < pixels; ++i)
+    {
+      if (images_type == IDX_TYPE_UBYTE)
+      {
+        dst[i] = raw[i] * pixel_scale;
+      }
+      else
+      {
+        const unsigned char* b = &raw[i * 4];
+        std::uint32_t bits = ((std::uint32_t) b[0] << 24) |
+                             ((std::uint32_t) b[1] << 16) |
+                             ((std::uint32_t) b[2] << 8) | (std::uint32_t) b[3];
+        std::memcpy (&dst[i], &bits, sizeof (float));
+      }
+    }
+    dataset.images.push_back (img);
+  }
+
+  std::vector<unsigned char> labels (count);
+  labels_file.read ((char*) labels.data (), labels.size ());
+  if (!labels_file)
+  {
+    throw std::runtime_error (IDX_FORMAT_ERROR + labels_path);
+  }
+  dataset.labels.assign (labels.begin (), labels.end ());
+  return dataset;
+}
@@ -0,0 +1,47 @@
+// IdxDataset.h
+#ifndef IDXDATASET_H
+#define IDXDATASET_H
+
+#include "Matrix.h"
+#include <string>
+#include <vector>
+
+#define IDX_PIXEL_SCALE (1.0f / 255.0f)
+
+/**
+ * @struct IdxDataset
+ * @brief A labelled image set loaded from a pair of IDX files (the MNIST
+ * distribution format).
+ * @var images - the images, each rows x cols
+ * @var labels - labels[i] is the class of images[i]
+ */
+typedef struct IdxDataset {
+	std::vector<Matrix> images;
+	std::vector<int> labels;
+} IdxDataset;
+
+/**
+ * @brief Loads an IDX image file and its IDX label file.
+ *
+ * The image file must be three-dimensional (count x rows x cols) of
+ * unsigned bytes or big-endian float32, the label file one-dimensional
+ * unsigned bytes with the same count. Byte pixels are multiplied by
+ * pixel_scale; float pixels are taken as they are.
+ *
+ * An image path ending in .npy loads both files as numpy arrays instead: the
+ * images of shape (count, ...), each taking the remaining dimensions, and
+ * the labels of shape (count), whole non-negative numbers of any dtype. uint8
+ * pixels are multiplied by pixel_scale, others are taken as they are.
+ *
+ * @param images_path Path of the IDX image file.
+ * @param labels_path Path of the IDX label file.
+ * @param pixel_scale Factor applied to byte pixels.
+ * @return The dataset.
+ * @throw std::runtime_error if a file can't be read or is malformed, the
+ * counts differ or an .npy label is not a non-negative integer.
+ */
+IdxDataset loadIdxDataset (const std::string& images_path,
+                           const std::string& labels_path,
+                           float pixel_scale = IDX_PIXEL_SCALE);
+
+#endif //IDXDATASET_H
@@ -0,0 +1,223 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#define HALF_SUB_BUCKETS (1 << (HISTOGRAM_SUB_BUCKET_BITS - 1))
+#define HISTOGRAM_BUCKETS \
+    ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 2) * HALF_SUB_BUCKETS)
+#define HISTOGRAM_LARGEST ((std::uint64_t (1) << HISTOGRAM_MAX_BITS) - 1)
+// percentile lines per halving of the distance to 100% in .hgrm output
+#define HGRM_TICKS_PER_HALF 5
+#define HGRM_MAX_HALVINGS 24
+
+
+LatencyHistogram::LatencyHistogram () :
+_counts (HISTOGRAM_BUCKETS, 0), _total (0), _min (0), _max (0), _sum (0)
+{
+}
+
+
+std::size_t LatencyHistogram::index_of (std::uint64_t value)
+{
+  value = std::min (value, HISTOGRAM_LARGEST);
+  int msb = 0;
+  while ((value >> (msb + 1)) != 0)
+  {
+    ++msb;
+  }
+  // values below 2^HISTOGRAM_SUB_BUCKET_BITS index themselves; above, each
+  // power of two adds HALF_SUB_BUCKETS buckets
+  const int shift = std::max (0, msb - (HISTOGRAM_SUB_BUCKET_BITS - 1));
+  return (std::size_t) shift * HALF_SUB_BUCKETS +
+         (std::size_t) (value >> shift);
+}
+
+
+std::uint64_t LatencyHistogram::highest_in (std::size_t index)
+{
+  int shift = 0;
+  if (index >= 2 * HALF_SUB_BUCKETS)
+  {
+    shift = (int) (index / HALF_SUB_BUCKETS) - 1;
+  }
+  const std::uint64_t sub = index - (std::size_t) shift * HALF_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+
+void LatencyHistogram::add (std::uint64_t value, std::uint64_t count)
+{
+  _counts[index_of (value)] += count;
+  _min = (_total == 0) ? value : std::min (_min, value);
+  _max = std::max (_max, value);
+  _sum += (double) value * (double) count;
+  _total += count;
+}
+
+
+void LatencyHistogram::add_corrected (std::uint64_t value,
+                                      std::uint64_t count,
+                                      std::uint64_t expected_interval)
+{
+  add (value, count);
+  if (expected_interval == 0)
+  {
+    return;
+  }
+  for (std::uint64_t missed = value - std::min (value, expected_interval);
+       missed >= expected_interval; missed -= expected_interval)
+  {
+    add (missed, count);
+  }
+}
+
+
+void LatencyHistogram::record (std::uint64_t value)
+{
+  add (value, 1);
+}
+
+
+void LatencyHistogram::record_corrected (std::uint64_t value,
+                                         std::uint64_t expected_interval)
+{
+  add_corrected (value, 1, expected_interval);
+}
+
+
+LatencyHistogram LatencyHistogram::corrected (std::uint64_t expected_interval)
+const
+{
+  LatencyHistogram copy;
+  for (std::size_t i = 0; i < _counts.size (); ++i)
+  {
+    if (_counts[i] != 0)
+    {
+      // a bucket's values are equivalent to its clipped top
+      const std::uint64_t value = std::min (std::max (highest_in (i), _min),
+                                            _max);
+      copy.add_corrected (value, _counts[i], expected_interval);
+    }
+  }
+  return copy;
+}
+
+
+void LatencyHistogram::merge (const LatencyHistogram& other)
+{
+  if (other._total == 0)
+  {
+    return;
+  }
+  for (std::size_t i = 0; i < _counts.size (); ++i)
+  {
+    _counts[i] += other._counts[i];
+  }
+  _min = (_total == 0) ? other._min : std::min (_min, other._min);
+  _max = std::max (_max, other._max);
+  _sum += other._sum;
+  _total += other._total;
+}
+
+
+void LatencyHistogram::reset ()
+{
+  std::fill (_counts.begin (), _counts.end (), 0);
+  _total = 0;
+  _min = 0;
+  _max = 0;
+  _sum = 0;
+}
+
+
+std::uint64_t LatencyHistogram::count () const
+{
+  return _total;
+}
+
+
+std::uint64_t LatencyHistogram::min () const
+{
+  return _min;
+}
+
+
+std::uint64_t LatencyHistogram::max () const
+{
+  return _max;
+}
+
+
+double LatencyHistogram::mean () const
+{
+  return (_total == 0) ? 0 : _sum / (double) _total;
+}
+
+
+std::uint64_t LatencyHistogram::percentile (double percentile) const
+{
+  if (_total == 0)
+  {
+    return 0;
+  }
+  percentile = std::min (std::max (percentile, 0.0), 100.0);
+  std::uint64_t target = (std::uint64_t) std::ceil (percentile / 100 *
+                                                    (double) _total);
+  target = std::max (target, (std::uint64_t) 1);
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < _counts.size (); ++i)
+  {
+    seen += _counts[i];
+    if (seen >= target)
+    {
+      return std::min (std::max (highest_in (i), _min), _max);
+    }
+  }
+  return _max;
+}
+
+
+void LatencyHistogram::print_distribution (std::ostream& out,
+                                           double scale) const
+{
+  const std::ios::fmtflags flags = out.flags ();
+  const std::streamsize precision = out.precision ();
+  out << std::setw (12) << "Value" << std::setw (15) << "Percentile"
+      << std::setw (11) << "TotalCount" << std::setw (17)
+      << "1/(1-Percentile)" << "\n\n" << std::fixed;
+  std::uint64_t seen = 0;
+  std::size_t next = 0;
+  const double step = 1.0 / HGRM_TICKS_PER_HALF;
+  for (int half = 0; half < HGRM_MAX_HALVINGS && _total > 0; ++half)
+  {
+    const double remaining = 100.0 / std::pow (2.0, half);
+    for (int tick = 0; tick < HGRM_TICKS_PER_HALF; ++tick)
+    {
+      const double pct = 100 - remaining * (1 - 0.5 * tick * step);
+      const std::uint64_t value = percentile (pct);
+      const std::size_t last = index_of (value);
+      while (next <= last)
+      {
+        seen += _counts[next++];
+      }
+      out << std::setprecision (3) << std::setw (12) << value / scale
+          << std::setprecision (12) << std::setw (15) << pct / 100
+          << std::setw (11) << seen << std::setprecision (2)
+          << std::setw (17) << 100 / (100 - pct) << "\n";
+      if (seen >= _total)
+      {
+        half = HGRM_MAX_HALVINGS;
+        break;
+      }
+    }
+  }
+  out << std::setprecision (3) << std::setw (12) << _max / scale
+      << std::setprecision (12) << std::setw (15) << 1.0 << std::setw (11)
+      << _total << "\n"
+      << "#[Mean    = " << std::setprecision (3) << mean () / scale
+      << ", Max = " << _max / scale << "]\n"
+      << "#[Total count = " << _total << "]\n";
+  out.flags (flags);
+  out.precision (precision);
+}
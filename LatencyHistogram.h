@@ -0,0 +1,151 @@
+// LatencyHistogram.h
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// each power-of-two range is split into 2^(HISTOGRAM_SUB_BUCKET_BITS - 1)
+// linear sub-buckets: 1024, i.e. at least three significant digits
+#define HISTOGRAM_SUB_BUCKET_BITS 11
+// values from 0 to 2^HISTOGRAM_MAX_BITS - 1 ns (about 18 minutes) are kept
+// exactly to that precision; larger ones count as the largest
+#define HISTOGRAM_MAX_BITS 40
+
+/**
+ * @class LatencyHistogram
+ * @brief HDR-style histogram of non-negative integer values, normally
+ * latencies in nanoseconds.
+ *
+ * Buckets are log-linear: values below 2^HISTOGRAM_SUB_BUCKET_BITS have a
+ * bucket each, and every further power-of-two range has the same number of
+ * equal-width buckets, so any recorded value is reported with a relative
+ * error below 2^-(HISTOGRAM_SUB_BUCKET_BITS - 1) whatever its magnitude.
+ * Recording is a shift and an increment, with no allocation, so per-thread
+ * histograms can record every request and be merged afterwards.
+ */
+class LatencyHistogram {
+
+ private:
+  std::vector<std::uint64_t> _counts; /**< Count of every bucket. */
+  std::uint64_t _total; /**< Number of recorded values. */
+  std::uint64_t _min; /**< Smallest recorded value. */
+  std::uint64_t _max; /**< Largest recorded value. */
+  double _sum; /**< Sum of the recorded values, for the mean. */
+
+/**
+ * @brief Returns the bucket of a value.
+ */
+  static std::size_t index_of (std::uint64_t value);
+
+/**
+ * @brief Returns the largest value that falls in a bucket.
+ */
+  static std::uint64_t highest_in (std::size_t index);
+
+/**
+ * @brief Records count occurrences of a value.
+ */
+  void add (std::uint64_t value, std::uint64_t count);
+
+/**
+ * @brief Records count occurrences of a value with the coordinated
+ * omission correction of record_corrected().
+ */
+  void add_corrected (std::uint64_t value, std::uint64_t count,
+                      std::uint64_t expected_interval);
+
+ public:
+/**
+ * @brief Constructs an empty histogram.
+ */
+  LatencyHistogram ();
+
+/**
+ * @brief Records one value.
+ */
+  void record (std::uint64_t value);
+
+/**
+ * @brief Records a value measured by a client that meant to issue requests
+ * every expected_interval, correcting for coordinated omission.
+ *
+ * A value longer than the interval means the requests that should have
+ * been issued while it ran were delayed; they are recorded too, with the
+ * latencies they would have seen: value - interval, value - 2 interval, and
+ * so on down to the interval.
+ *
+ * @param value The measured value.
+ * @param expected_interval The intended gap between requests; 0 records
+ * the value alone.
+ */
+  void record_corrected (std::uint64_t value,
+                         std::uint64_t expected_interval);
+
+/**
+ * @brief Returns a copy corrected for coordinated omission after the fact,
+ * as if every value had been recorded with record_corrected().
+ *
+ * Meant for closed-loop measurements, where the intended gap between a
+ * client's requests is about the typical service time: a request that
+ * stalls also holds back every request the client would have issued
+ * meanwhile.
+ *
+ * @param expected_interval The intended gap between requests.
+ * @return The corrected histogram.
+ */
+  LatencyHistogram corrected (std::uint64_t expected_interval) const;
+
+/**
+ * @brief Adds every value of another histogram.
+ */
+  void merge (const LatencyHistogram& other);
+
+/**
+ * @brief Forgets every recorded value.
+ */
+  void reset ();
+
+/**
+ * @brief Returns the number of recorded values.
+ */
+  std::uint64_t count () const;
+
+/**
+ * @brief Returns the smallest recorded value, 0 when empty.
+ */
+  std::uint64_t min () const;
+
+/**
+ * @brief Returns the largest recorded value, 0 when empty.
+ */
+  std::uint64_t max () const;
+
+/**
+ * @brief Returns the mean of the recorded values, 0 when empty.
+ */
+  double mean () const;
+
+/**
+ * @brief Returns the value below or at which the given percentage of the
+ * recorded values fall, to the histogram's precision.
+ *
+ * @param percentile In [0, 100]; 100 returns max().
+ * @return The value, 0 when empty.
+ */
+  std::uint64_t percentile (double percentile) const;
+
+/**
+ * @brief Prints the percentile distribution in the HdrHistogram .hgrm text
+ * format (value, percentile, total count, 1 / (1 - percentile)), which the
+ * usual plotting tools read.
+ *
+ * @param out The stream.
+ * @param scale Values are divided by this when printed, e.g. 1000 for
+ * nanoseconds printed as microseconds.
+ */
+  void print_distribution (std::ostream& out, double scale = 1) const;
+};
+
+#endif //LATENCYHISTOGRAM_H
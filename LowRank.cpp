@@ -0,0 +1,206 @@
+#include "LowRank.h"
+#include "Evaluator.h"
+#include <algorithm>
+#include <numeric>
+
+#define ENERGY_RANGE_ERROR "Error: energy must be in (0, 1]"
+#define RANK_COUNT_ERROR "Error: expected one rank per layer"
+
+
+std::vector<svd_factors> layer_spectra (const MlpNetwork& mlp)
+{
+  std::vector<svd_factors> spectra;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    const Matrix& w = mlp.get_layer (i).get_weights ();
+    spectra.push_back (w.truncated_svd (std::min (w.get_rows (),
+                                                  w.get_cols ())));
+  }
+  return spectra;
+}
+
+
+mat_index max_useful_rank (const Matrix& weights)
+{
+  const mat_index rows = weights.get_rows ();
+  const mat_index cols = weights.get_cols ();
+  return (rows * cols - 1) / (rows + cols);
+}
+
+
+double retained_energy (const svd_factors& svd, mat_index rank)
+{
+  double kept = 0;
+  double total = 0;
+  for (mat_index r = 0; r < svd.s.get_rows (); ++r)
+  {
+    const double sq = (double) svd.s[r] * svd.s[r];
+    total += sq;
+    kept += (r < rank) ? sq : 0;
+  }
+  return (total == 0) ? 1 : kept / total;
+}
+
+
+mat_index rank_for_energy (const svd_factors& svd, double energy)
+{
+  if (energy <= 0 || energy > 1)
+  {
+    throw std::invalid_argument (ENERGY_RANGE_ERROR);
+  }
+  const mat_index full = svd.s.get_rows ();
+  double total = 0;
+  for (mat_index r = 0; r < full; ++r)
+  {
+    total += (double) svd.s[r] * svd.s[r];
+  }
+  double kept = 0;
+  for (mat_index r = 0; r < full; ++r)
+  {
+    kept += (double) svd.s[r] * svd.s[r];
+    if (kept >= energy * total)
+    {
+      return r + 1;
+    }
+  }
+  return full;
+}
+
+
+Dense low_rank_layer (const Dense& layer, const svd_factors& svd,
+                      mat_index rank)
+{
+  const mat_index rows = svd.u.get_rows ();
+  const mat_index cols = svd.vt.get_cols ();
+  Matrix outer (rows, rank);
+  Matrix inner (rank, cols);
+  for (mat_index i = 0; i < rows; ++i)
+  {
+    for (mat_index r = 0; r < rank; ++r)
+    {
+      outer (i, r) = svd.u (i, r) * svd.s[r];
+    }
+  }
+  std::copy (svd.vt.get_data (), svd.vt.get_data () + rank * cols,
+             inner.get_data ());
+  Dense factored (share_matrix (std::move (outer)),
+                  share_matrix (std::move (inner)), layer.get_bias_ptr (),
+                  layer.get_activation ());
+  if (layer.get_sparse_cutoff () != SPARSE_DISABLED)
+  {
+    factored.enable_sparse_input (layer.get_sparse_cutoff ());
+  }
+  factored.set_kernel_config (layer.get_kernel_config ());
+  return factored;
+}
+
+
+MlpNetwork low_rank_network (const MlpNetwork& mlp,
+                             const std::vector<svd_factors>& spectra,
+                             const std::vector<mat_index>& ranks)
+{
+  if (spectra.size () != MLP_SIZE || ranks.size () != MLP_SIZE)
+  {
+    throw std::invalid_argument (RANK_COUNT_ERROR);
+  }
+  MlpNetwork compressed = mlp;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    const Dense& layer = mlp.get_layer (i);
+    if (ranks[i] != FULL_RANK &&
+        ranks[i] <= max_useful_rank (layer.get_weights ()))
+    {
+      compressed.set_layer (i, low_rank_layer (layer, spectra[i], ranks[i]));
+    }
+  }
+  return compressed;
+}
+
+
+std::vector<mat_index> ranks_for_energy (const MlpNetwork& mlp,
+                                         const std::vector<svd_factors>&
+                                         spectra, double energy)
+{
+  std::vector<mat_index> ranks (MLP_SIZE, FULL_RANK);
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    const mat_index rank = rank_for_energy (spectra[i], energy);
+    if (rank <= max_useful_rank (mlp.get_layer (i).get_weights ()))
+    {
+      ranks[i] = rank;
+    }
+  }
+  return ranks;
+}
+
+
+std::vector<mat_index> ranks_for_accuracy (const MlpNetwork& mlp,
+                                           const std::vector<svd_factors>&
+                                           spectra,
+                                           const IdxDataset& dataset,
+                                           double max_loss,
+                                           std::ostream* log)
+{
+  const double floor = evaluate (mlp, dataset).top1_accuracy - max_loss;
+  std::vector<int> order (MLP_SIZE);
+  std::iota (order.begin (), order.end (), 0);
+  std::stable_sort (order.begin (), order.end (), [&mlp] (int a, int b)
+  {
+    return mlp.get_layer (a).multiply_adds () >
+           mlp.get_layer (b).multiply_adds ();
+  });
+
+  std::vector<mat_index> ranks (MLP_SIZE, FULL_RANK);
+  for (int i : order)
+  {
+    // accuracy grows with the rank (up to noise), so bisect for the
+    // smallest rank that stays above the floor
+    auto accuracy = [&] (mat_index rank)
+    {
+      std::vector<mat_index> trial = ranks;
+      trial[i] = rank;
+      return evaluate (low_rank_network (mlp, spectra, trial), dataset)
+          .top1_accuracy;
+    };
+    mat_index lo = 1;
+    mat_index hi = max_useful_rank (mlp.get_layer (i).get_weights ());
+    if (hi < 1 || accuracy (hi) < floor)
+    {
+      hi = FULL_RANK;
+    }
+    else
+    {
+      while (lo < hi)
+      {
+        const mat_index mid = lo + (hi - lo) / 2;
+        if (accuracy (mid) >= floor)
+        {
+          hi = mid;
+        }
+        else
+        {
+          lo = mid + 1;
+        }
+      }
+    }
+    ranks[i] = hi;
+    if (log != nullptr)
+    {
+      *log << "layer " << i << ": "
+           << (hi == FULL_RANK ? std::string ("full") : std::to_string (hi))
+           << "\n";
+    }
+  }
+  return ranks;
+}
+
+
+mat_index network_multiply_adds (const MlpNetwork& mlp)
+{
+  mat_index total = 0;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    total += mlp.get_layer (i).multiply_adds ();
+  }
+  return total;
+}
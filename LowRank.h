@@ -0,0 +1,114 @@
+// LowRank.h
+#ifndef LOWRANK_H
+#define LOWRANK_H
+
+#include "MlpNetwork.h"
+#include "IdxDataset.h"
+#include <ostream>
+#include <vector>
+
+// fraction of a layer's squared singular values kept by default
+#define LOW_RANK_ENERGY 0.95
+// top-1 accuracy a compression may give up by default
+#define LOW_RANK_ACCURACY_LOSS 0.005
+// rank of a layer that is left unfactored
+#define FULL_RANK 0
+
+/**
+ * @brief Computes the exact singular value decomposition of every layer's
+ * weights (Matrix::truncated_svd at full rank), from which factorizations
+ * of any rank are then cut.
+ *
+ * @param mlp The network.
+ * @return MLP_SIZE decompositions, in layer order.
+ */
+std::vector<svd_factors> layer_spectra (const MlpNetwork& mlp);
+
+/**
+ * @brief Returns the largest rank at which a factored rows x cols layer
+ * still needs fewer multiply-adds than the full one: r * (rows + cols) <
+ * rows * cols.
+ */
+mat_index max_useful_rank (const Matrix& weights);
+
+/**
+ * @brief Returns the fraction of a matrix's energy (sum of squared singular
+ * values, its squared Frobenius norm) that the first rank triplets keep.
+ *
+ * @param svd A full decomposition, see layer_spectra().
+ * @param rank The rank.
+ */
+double retained_energy (const svd_factors& svd, mat_index rank);
+
+/**
+ * @brief Returns the smallest rank that keeps at least the given fraction
+ * of the energy.
+ *
+ * @param svd A full decomposition.
+ * @param energy The fraction, in (0, 1].
+ */
+mat_index rank_for_energy (const svd_factors& svd, double energy);
+
+/**
+ * @brief Builds the factored approximation of a layer from the leading
+ * rank singular triplets: U diag(s) as the outer factor and V^T as the
+ * inner one. The bias, activation, sparse-input cutoff and kernel
+ * parameters are kept.
+ *
+ * @param layer The layer.
+ * @param svd The decomposition of its weights.
+ * @param rank The rank, in [1, svd.s.get_rows()].
+ * @return The factored layer.
+ */
+Dense low_rank_layer (const Dense& layer, const svd_factors& svd,
+                      mat_index rank);
+
+/**
+ * @brief Returns a copy of a network with some layers factored.
+ *
+ * @param mlp The network; its unfactored layers are shared, not copied.
+ * @param spectra The decompositions of its layers, see layer_spectra().
+ * @param ranks One rank per layer; FULL_RANK, or a rank that saves no
+ * multiply-adds, keeps the layer as it is.
+ * @return The compressed network.
+ */
+MlpNetwork low_rank_network (const MlpNetwork& mlp,
+                             const std::vector<svd_factors>& spectra,
+                             const std::vector<mat_index>& ranks);
+
+/**
+ * @brief Chooses, per layer, the smallest rank that keeps the given energy
+ * fraction, or FULL_RANK where that rank would save nothing.
+ */
+std::vector<mat_index> ranks_for_energy (const MlpNetwork& mlp,
+                                         const std::vector<svd_factors>&
+                                         spectra, double energy);
+
+/**
+ * @brief Chooses ranks that keep top-1 accuracy on a labelled set within
+ * max_loss of the uncompressed network's.
+ *
+ * Layers are taken greedily, most multiply-adds first; each gets the
+ * smallest rank, found by bisection with the ranks chosen so far in place,
+ * that stays within the budget, or FULL_RANK if none does.
+ *
+ * @param mlp The network.
+ * @param spectra The decompositions of its layers.
+ * @param dataset The labelled images.
+ * @param max_loss The accuracy that may be lost, as a fraction.
+ * @param log Receives one line per layer when not null.
+ * @return One rank per layer.
+ */
+std::vector<mat_index> ranks_for_accuracy (const MlpNetwork& mlp,
+                                           const std::vector<svd_factors>&
+                                           spectra,
+                                           const IdxDataset& dataset,
+                                           double max_loss,
+                                           std::ostream* log = nullptr);
+
+/**
+ * @brief Returns the multiply-adds a network spends per image.
+ */
+mat_index network_multiply_adds (const MlpNetwork& mlp);
+
+#endif //LOWRANK_H
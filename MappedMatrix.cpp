@@ -0,0 +1,347 @@
+#include "MappedMatrix.h"
+#include "Gemm.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAPPED_OPEN_ERROR "Error: Failed to open the matrix file: "
+#define MAPPED_MAP_ERROR "Error: Failed to map the matrix file: "
+#define MAPPED_FILE_SIZE_ERROR "Error: Matrix file size does not match " \
+                               "the expected matrix size: "
+#define MAPPED_OFFSET_ERROR "Error: Mapped matrix offset must be float " \
+                            "aligned"
+#define MAPPED_DIMS_ERROR "Error: Mapped matrix dimensions must be positive"
+#define MAPPED_READ_ONLY_ERROR "Error: Mapped matrix is read-only"
+#define MAPPED_RANGE_ERROR "Error: Mapped matrix rows out of range"
+#define MAPPED_ALIAS_ERROR "Error: Mapped operation output aliases an input"
+
+
+/**
+ * @brief Throws unless a matrix accepts writes.
+ */
+static void require_writable (const MappedMatrix& mat)
+{
+  if (!mat.writable ())
+  {
+    throw std::logic_error (MAPPED_READ_ONLY_ERROR);
+  }
+}
+
+
+MappedMatrix::MappedMatrix (const std::string& path, mat_index rows,
+                            mat_index cols, mapped_mode mode) :
+MappedMatrix (path, rows, cols, 0, mode)
+{
+}
+
+
+MappedMatrix::MappedMatrix (const std::string& path, mat_index rows,
+                            mat_index cols, std::size_t offset,
+                            mapped_mode mode) :
+_dims {rows, cols}, _data (nullptr), _map (nullptr), _bytes (0),
+_writable (mode != MAPPED_READ_ONLY)
+{
+  if (rows <= 0 || cols <= 0)
+  {
+    throw std::length_error (MAPPED_DIMS_ERROR);
+  }
+  if (offset % alignof (float) != 0)
+  {
+    throw std::invalid_argument (MAPPED_OFFSET_ERROR);
+  }
+  // the mapping starts at the beginning of the file, which is page
+  // aligned, and covers whatever precedes the matrix
+  _bytes = offset + (std::size_t) rows * (std::size_t) cols * sizeof (float);
+  int flags = _writable ? O_RDWR : O_RDONLY;
+  if (mode == MAPPED_CREATE)
+  {
+    flags |= O_CREAT;
+    flags |= (offset == 0) ? O_TRUNC : 0;
+  }
+  const int fd = ::open (path.c_str (), flags, 0644);
+  if (fd < 0)
+  {
+    throw std::runtime_error (MAPPED_OPEN_ERROR + path);
+  }
+  struct stat info;
+  bool sized = (mode == MAPPED_CREATE)
+               ? ::ftruncate (fd, (off_t) _bytes) == 0
+               : ::fstat (fd, &info) == 0 &&
+                 ((std::size_t) info.st_size == _bytes ||
+                  (offset != 0 && (std::size_t) info.st_size > _bytes));
+  if (!sized)
+  {
+    ::close (fd);
+    throw std::runtime_error (MAPPED_FILE_SIZE_ERROR + path);
+  }
+  void* map = ::mmap (nullptr, _bytes,
+                      _writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fd, 0);
+  // the mapping keeps the file referenced after the descriptor is closed
+  ::close (fd);
+  if (map == MAP_FAILED)
+  {
+    throw std::runtime_error (MAPPED_MAP_ERROR + path);
+  }
+  _map = map;
+  _data = reinterpret_cast<float*> (static_cast<char*> (map) + offset);
+}
+
+
+MappedMatrix::MappedMatrix (MappedMatrix&& other) noexcept :
+_dims (other._dims), _data (other._data), _map (other._map),
+_bytes (other._bytes), _writable (other._writable)
+{
+  other._data = nullptr;
+  other._map = nullptr;
+  other._bytes = 0;
+}
+
+
+MappedMatrix::~MappedMatrix ()
+{
+  if (_map != nullptr)
+  {
+    ::munmap (_map, _bytes);
+  }
+}
+
+
+mat_index MappedMatrix::get_rows () const
+{
+  return _dims.rows;
+}
+
+
+mat_index MappedMatrix::get_cols () const
+{
+  return _dims.cols;
+}
+
+
+mat_index MappedMatrix::size () const
+{
+  return _dims.rows * _dims.cols;
+}
+
+
+bool MappedMatrix::writable () const
+{
+  return _writable;
+}
+
+
+float* MappedMatrix::get_data ()
+{
+  require_writable (*this);
+  return _data;
+}
+
+
+const float* MappedMatrix::get_data () const
+{
+  return _data;
+}
+
+
+const float* MappedMatrix::row (mat_index i) const
+{
+  if (i < 0 || i >= _dims.rows)
+  {
+    throw std::out_of_range (MAPPED_RANGE_ERROR);
+  }
+  return _data + (std::size_t) i * _dims.cols;
+}
+
+
+/**
+ * @brief Runs madvise on the pages that hold a block of rows, clipped to
+ * the matrix and aligned to pages.
+ */
+static void advise_rows (float* data, matrix_dims dims, mat_index first,
+                         mat_index count, int advice, bool flush)
+{
+  first = std::max (first, (mat_index) 0);
+  const mat_index last = std::min (first + count, dims.rows);
+  if (data == nullptr || first >= last)
+  {
+    return;
+  }
+  static const std::size_t page = (std::size_t) ::sysconf (_SC_PAGESIZE);
+  const std::size_t row_bytes = (std::size_t) dims.cols * sizeof (float);
+  // pages are counted from address 0, since the data need not start on a
+  // page boundary (a matrix after a file header); the mapping itself does,
+  // so the first page is always mapped
+  const std::uintptr_t start = reinterpret_cast<std::uintptr_t> (data);
+  const std::uintptr_t lo = (start + (std::size_t) first * row_bytes) /
+                            page * page;
+  std::uintptr_t hi = start + (std::size_t) last * row_bytes;
+  if (advice == MADV_DONTNEED)
+  {
+    // keep the page shared with the next block, which may be prefetched
+    hi = hi / page * page;
+  }
+  if (hi <= lo)
+  {
+    return;
+  }
+  if (flush)
+  {
+    ::msync (reinterpret_cast<void*> (lo), hi - lo, MS_ASYNC);
+  }
+  // advice is only a hint; a failure changes nothing observable
+  ::madvise (reinterpret_cast<void*> (lo), hi - lo, advice);
+}
+
+
+void MappedMatrix::prefetch (mat_index first, mat_index count) const
+{
+  advise_rows (_data, _dims, first, count, MADV_WILLNEED, false);
+}
+
+
+void MappedMatrix::release (mat_index first, mat_index count) const
+{
+  // dropping pages of a shared file mapping keeps dirty data in the page
+  // cache, so modified rows are written back rather than lost
+  advise_rows (_data, _dims, first, count, MADV_DONTNEED, _writable);
+}
+
+
+Matrix MappedMatrix::load (mat_index first, mat_index count) const
+{
+  if (first < 0 || count <= 0 || first + count > _dims.rows)
+  {
+    throw std::out_of_range (MAPPED_RANGE_ERROR);
+  }
+  Matrix rows (count, _dims.cols);
+  std::memcpy (rows.get_data (), row (first),
+               (std::size_t) rows.size () * sizeof (float));
+  return rows;
+}
+
+
+void MappedMatrix::store (mat_index first, const Matrix& rows)
+{
+  require_writable (*this);
+  if (rows.get_cols () != _dims.cols)
+  {
+    throw std::length_error (MAPPED_SIZE_ERROR);
+  }
+  if (first < 0 || first + rows.get_rows () > _dims.rows)
+  {
+    throw std::out_of_range (MAPPED_RANGE_ERROR);
+  }
+  std::memcpy (_data + (std::size_t) first * _dims.cols, rows.get_data (),
+               (std::size_t) rows.size () * sizeof (float));
+}
+
+
+void MappedMatrix::sync () const
+{
+  if (_map != nullptr && _writable)
+  {
+    ::msync (_map, _bytes, MS_SYNC);
+  }
+}
+
+
+void for_each_panel (const MappedMatrix& mat,
+                     const std::function<void (mat_index, mat_index)>& panel)
+{
+  const mat_index rows = mat.get_rows ();
+  mat.prefetch (0, MAPPED_TILE_ROWS);
+  for (mat_index first = 0; first < rows; first += MAPPED_TILE_ROWS)
+  {
+    const mat_index count = std::min ((mat_index) MAPPED_TILE_ROWS,
+                                      rows - first);
+    mat.prefetch (first + count, MAPPED_TILE_ROWS);
+    panel (first, count);
+    mat.release (first, count);
+  }
+}
+
+
+void mapped_gemm (const MappedMatrix& a, const MappedMatrix& b,
+                  MappedMatrix& c)
+{
+  if (a.get_cols () != b.get_rows () || c.get_rows () != a.get_rows () ||
+      c.get_cols () != b.get_cols ())
+  {
+    throw std::length_error (MAPPED_SIZE_ERROR);
+  }
+  require_writable (c);
+  if (&c == &a || &c == &b)
+  {
+    throw std::invalid_argument (MAPPED_ALIAS_ERROR);
+  }
+  const mat_index k = a.get_cols ();
+  const mat_index n = b.get_cols ();
+  const float* pa = a.get_data ();
+  const float* pb = b.get_data ();
+  float* pc = c.get_data ();
+  for_each_panel (a, [&c, k, n, pa, pb, pc] (mat_index first,
+                                             mat_index count)
+  {
+    for (mat_index jj = 0; jj < n; jj += MAPPED_TILE_COLS)
+    {
+      const mat_index cols = std::min ((mat_index) MAPPED_TILE_COLS, n - jj);
+      gemm_classic (count, cols, k, pa + (std::size_t) first * k,
+                    (std::size_t) k, pb + jj, (std::size_t) n,
+                    pc + (std::size_t) first * n + jj, (std::size_t) n);
+    }
+    c.release (first, count);
+  });
+}
+
+
+void mapped_transpose (const MappedMatrix& in, MappedMatrix& out)
+{
+  if (in.get_rows () != out.get_cols () || in.get_cols () != out.get_rows ())
+  {
+    throw std::length_error (MAPPED_SIZE_ERROR);
+  }
+  require_writable (out);
+  if (&in == &out)
+  {
+    throw std::invalid_argument (MAPPED_ALIAS_ERROR);
+  }
+  const mat_index rows = in.get_rows ();
+  const mat_index cols = in.get_cols ();
+  const float* src = in.get_data ();
+  float* dst = out.get_data ();
+  for_each_panel (in, [rows, cols, src, dst] (mat_index first,
+                                              mat_index count)
+  {
+    // the panel's columns become a rows-wide strip of every output row;
+    // blocks of columns are spread over the pool
+    ThreadPool::shared ().parallel_for (0, (std::size_t) cols,
+                                        MAPPED_TRANSPOSE_BLOCK,
+        [=] (std::size_t lo, std::size_t hi)
+    {
+      for (std::size_t j0 = lo; j0 < hi; j0 += MAPPED_TRANSPOSE_BLOCK)
+      {
+        const std::size_t j1 = std::min (hi, j0 + MAPPED_TRANSPOSE_BLOCK);
+        for (mat_index i0 = first; i0 < first + count;
+             i0 += MAPPED_TRANSPOSE_BLOCK)
+        {
+          const mat_index i1 = std::min (first + count,
+                                         i0 + MAPPED_TRANSPOSE_BLOCK);
+          for (std::size_t j = j0; j < j1; ++j)
+          {
+            float* out_row = dst + j * (std::size_t) rows;
+            for (mat_index i = i0; i < i1; ++i)
+            {
+              out_row[i] = src[(std::size_t) i * cols + j];
+            }
+          }
+        }
+      }
+    });
+  });
+}
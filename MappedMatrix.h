@@ -0,0 +1,297 @@
+// MappedMatrix.h
+#ifndef MAPPEDMATRIX_H
+#define MAPPEDMATRIX_H
+
+#include "Matrix.h"
+#include <functional>
+#include <string>
+
+// rows of every operand streamed per tile by the mapped operations
+#define MAPPED_TILE_ROWS 256
+// columns of B (and C) per tile of mapped_gemm()
+#define MAPPED_TILE_COLS 1024
+// square sub-tile of mapped_transpose(), sized to stay in L1
+#define MAPPED_TRANSPOSE_BLOCK 32
+
+#define MAPPED_SIZE_ERROR "Error: Mapped matrix sizes are incompatible for " \
+                          "the operation"
+
+/**
+ * @brief How a matrix file is mapped.
+ */
+enum mapped_mode
+{
+  MAPPED_READ_ONLY, /**< Existing file, read-only pages. */
+  MAPPED_READ_WRITE, /**< Existing file, writes go back to it. */
+  MAPPED_CREATE /**< New (or truncated) zero-filled file, read-write. */
+};
+
+/**
+ * @class MappedMatrix
+ * @brief A rows x cols float matrix stored in a file and mapped into memory
+ * instead of loaded.
+ *
+ * The file is the same raw row-major float32 layout readFileToMatrix()
+ * reads, so weight files and datasets can be mapped as they are. Pages are
+ * read in on first access and can be dropped again by the kernel, so the
+ * matrix may be larger than RAM; the mapped_* operations below walk it in
+ * tiles of MAPPED_TILE_ROWS rows, asking for the next tile before working on
+ * the current one and releasing tiles they are done with.
+ */
+class MappedMatrix {
+
+ private:
+  matrix_dims _dims; /**< The dimensions of the matrix. */
+  float* _data; /**< The first element, offset bytes into the mapping. */
+  void* _map; /**< The mapping, from the start of the file. */
+  std::size_t _bytes; /**< Length of the mapping. */
+  bool _writable; /**< Whether the mapping is shared read-write. */
+
+ public:
+/**
+ * @brief Maps a matrix file.
+ *
+ * @param path The file.
+ * @param rows The number of rows.
+ * @param cols The number of columns.
+ * @param mode How to open it; with MAPPED_CREATE the file is created (or
+ * truncated) and sized to rows * cols zeros.
+ * @throw std::length_error if a dimension is not positive.
+ * @throw std::runtime_error if the file cannot be opened or mapped, or its
+ * size does not match the dimensions.
+ */
+  MappedMatrix (const std::string& path, mat_index rows, mat_index cols,
+                mapped_mode mode = MAPPED_READ_ONLY);
+
+/**
+ * @brief Maps a matrix stored at a byte offset of a file, e.g. after the
+ * header of an .npy file or inside an .npz archive (see NpyIO.h).
+ *
+ * @param path The file.
+ * @param rows The number of rows.
+ * @param cols The number of columns.
+ * @param offset Where the matrix starts; the file may continue past it.
+ * @param mode How to open it; with MAPPED_CREATE the file is created if
+ * need be and sized to offset + rows * cols floats, keeping its first
+ * offset bytes.
+ * @throw std::length_error if a dimension is not positive.
+ * @throw std::invalid_argument if offset is not a multiple of the float
+ * alignment.
+ * @throw std::runtime_error if the file cannot be opened or mapped, or its
+ * size does not match.
+ */
+  MappedMatrix (const std::string& path, mat_index rows, mat_index cols,
+                std::size_t offset, mapped_mode mode = MAPPED_READ_ONLY);
+
+/**
+ * @brief Move constructor; the other matrix is left unmapped.
+ */
+  MappedMatrix (MappedMatrix&& other) noexcept;
+
+/**
+ * @brief Unmaps the file. Writes reach the file even without sync().
+ */
+  ~MappedMatrix ();
+
+  MappedMatrix (const MappedMatrix&) = delete;
+  MappedMatrix& operator= (const MappedMatrix&) = delete;
+
+/**
+ * @brief Returns the number of rows.
+ */
+  mat_index get_rows () const;
+
+/**
+ * @brief Returns the number of columns.
+ */
+  mat_index get_cols () const;
+
+/**
+ * @brief Returns the number of elements, get_rows() * get_cols().
+ */
+  mat_index size () const;
+
+/**
+ * @brief Returns whether the mapping accepts writes.
+ */
+  bool writable () const;
+
+/**
+ * @brief Returns the mapped row-major element buffer.
+ *
+ * @throw std::logic_error if the matrix was mapped MAPPED_READ_ONLY.
+ */
+  float* get_data ();
+
+/**
+ * @brief Returns the mapped row-major element buffer (const version).
+ */
+  const float* get_data () const;
+
+/**
+ * @brief Returns the first element of a row.
+ *
+ * @param i The row index.
+ * @throw std::out_of_range if i is out of range.
+ */
+  const float* row (mat_index i) const;
+
+/**
+ * @brief Asks the kernel to start reading a block of rows in the
+ * background.
+ *
+ * @param first The first row; the block is clipped to the matrix.
+ * @param count The number of rows.
+ */
+  void prefetch (mat_index first, mat_index count) const;
+
+/**
+ * @brief Tells the kernel a block of rows will not be needed soon, so its
+ * pages can be reclaimed first. Pending writes are scheduled, not lost.
+ *
+ * @param first The first row; the block is clipped to the matrix.
+ * @param count The number of rows.
+ */
+  void release (mat_index first, mat_index count) const;
+
+/**
+ * @brief Copies a block of rows into memory.
+ *
+ * @param first The first row.
+ * @param count The number of rows.
+ * @return A count x get_cols() matrix.
+ * @throw std::out_of_range if the block is out of range.
+ */
+  Matrix load (mat_index first, mat_index count) const;
+
+/**
+ * @brief Copies a matrix over a block of rows.
+ *
+ * @param first The first row.
+ * @param rows A matrix with get_cols() columns.
+ * @throw std::out_of_range if the block is out of range.
+ * @throw std::length_error if the column counts differ.
+ */
+  void store (mat_index first, const Matrix& rows);
+
+/**
+ * @brief Writes every modified page back to the file and waits for it.
+ */
+  void sync () const;
+};
+
+/**
+ * @brief Computes C = A * B tile by tile.
+ *
+ * Every MAPPED_TILE_ROWS-row panel of A is multiplied by the
+ * MAPPED_TILE_COLS-column panels of B straight from the mappings with
+ * gemm_classic(), writing into the mapped C; the next A panel is prefetched
+ * while the current one is multiplied, and finished A and C panels are
+ * released. B is re-read once per A panel, so give the larger operand as A.
+ *
+ * @param a An m x k matrix.
+ * @param b A k x n matrix.
+ * @param c A writable m x n matrix, distinct from a and b.
+ * @throw std::length_error if the dimensions do not match.
+ * @throw std::logic_error if c is read-only.
+ * @throw std::invalid_argument if c is a or b.
+ */
+void mapped_gemm (const MappedMatrix& a, const MappedMatrix& b,
+                  MappedMatrix& c);
+
+/**
+ * @brief Writes the transpose of a matrix into another, a
+ * MAPPED_TILE_ROWS-row panel of the input at a time.
+ *
+ * @param in An m x n matrix.
+ * @param out A writable n x m matrix, distinct from in.
+ * @throw std::length_error if the dimensions do not match.
+ * @throw std::logic_error if out is read-only.
+ * @throw std::invalid_argument if out is in.
+ */
+void mapped_transpose (const MappedMatrix& in, MappedMatrix& out);
+
+/**
+ * @brief Runs a function over consecutive row panels of a matrix, with the
+ * next panel prefetched and the previous one released.
+ *
+ * Shared by the element-wise operations; exposed for custom streaming
+ * passes.
+ *
+ * @param mat The matrix to walk.
+ * @param panel Called with (first row, row count) for every panel in order.
+ */
+void for_each_panel (const MappedMatrix& mat,
+                     const std::function<void (mat_index, mat_index)>& panel);
+
+/**
+ * @brief out = f(in) element-wise; out may be in itself.
+ *
+ * @param in The input matrix.
+ * @param out A writable matrix of the same dimensions.
+ * @param f A float (float) function object.
+ * @throw std::length_error if the dimensions differ.
+ * @throw std::logic_error if out is read-only.
+ */
+template <typename F>
+void mapped_apply (const MappedMatrix& in, MappedMatrix& out, F f)
+{
+  if (in.get_rows () != out.get_rows () || in.get_cols () != out.get_cols ())
+  {
+    throw std::length_error (MAPPED_SIZE_ERROR);
+  }
+  const float* src = in.get_data ();
+  float* dst = out.get_data ();
+  const mat_index cols = in.get_cols ();
+  for_each_panel (in, [&out, src, dst, cols, &f] (mat_index first,
+                                                    mat_index count)
+  {
+    const std::size_t lo = (std::size_t) first * cols;
+    const std::size_t hi = lo + (std::size_t) count * cols;
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      dst[i] = f (src[i]);
+    }
+    out.release (first, count);
+  });
+}
+
+/**
+ * @brief out = f(a, b) element-wise; out may be a or b.
+ *
+ * @param a The first input matrix.
+ * @param b The second input matrix, of the same dimensions.
+ * @param out A writable matrix of the same dimensions.
+ * @param f A float (float, float) function object.
+ * @throw std::length_error if the dimensions differ.
+ * @throw std::logic_error if out is read-only.
+ */
+template <typename F>
+void mapped_zip (const MappedMatrix& a, const MappedMatrix& b,
+                 MappedMatrix& out, F f)
+{
+  if (a.get_rows () != b.get_rows () || a.get_cols () != b.get_cols () ||
+      a.get_rows () != out.get_rows () || a.get_cols () != out.get_cols ())
+  {
+    throw std::length_error (MAPPED_SIZE_ERROR);
+  }
+  const float* x = a.get_data ();
+  const float* y = b.get_data ();
+  float* dst = out.get_data ();
+  const mat_index cols = a.get_cols ();
+  for_each_panel (a, [&b, &out, x, y, dst, cols, &f] (mat_index first,
+                                                      mat_index count)
+  {
+    b.prefetch (first + count, MAPPED_TILE_ROWS);
+    const std::size_t lo = (std::size_t) first * cols;
+    const std::size_t hi = lo + (std::size_t) count * cols;
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      dst[i] = f (x[i], y[i]);
+    }
+    b.release (first, count);
+    out.release (first, count);
+  });
+}
+
+#endif //MAPPEDMATRIX_H
@@ -1,15 +1,31 @@
 #include "Matrix.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
 
 
 #define ONE 1
 #define BIG_ENOUGH 0.1
 #define VERY_SMALL_NUMBER 1e-3
 #define PIVOT_ROW_NOT_FOUND (-1)
+#define REDUCTION_LANES 8
+#define PAIRWISE_BLOCK 256
+#define REDUCTION_PARALLEL_THRESHOLD (1 << 18)
+#define REDUCTION_GRAIN (1 << 16)
+#define SVD_SEED 5489
+#define SVD_JACOBI_TOLERANCE 1e-12
+#define SVD_JACOBI_MAX_SWEEPS 60
 
 
 #define SIZE_ERROR "Error: Matrix sizes are incompatible for the operation"
 #define OUT_OF_RANGE_ERROR "Error: Index out of range"
 #define STREAM_ERROR "Error: Insufficient data for matrix elements."
+#define TOP_K_ERROR "Error: top_k needs 0 < k <= number of elements"
+#define SVD_RANK_ERROR "Error: truncated_svd needs 0 < rank <= min(rows, " \
+                       "cols)"
 
 // Helper function declarations
 /**
@@ -26,7 +42,8 @@
  * @param lead The lead column index.
  * @return The row index of the pivot row, or -1 if not found.
  */
-int find_pivot_row(const Matrix& rref_mat, int current_row, int lead);
+mat_index find_pivot_row(const Matrix& rref_mat, mat_index current_row,
+                         mat_index lead);
 
 /**
  * @brief Swaps two rows in the matrix.
@@ -37,7 +54,7 @@ int find_pivot_row(const Matrix& rref_mat, int current_row, int lead);
  * @param row1 The index of the first row.
  * @param row2 The index of the second row.
  */
-void swap_rows(Matrix& rref_mat, int row1, int row2);
+void swap_rows(Matrix& rref_mat, mat_index row1, mat_index row2);
 
 /**
  * @brief Divides a row in the matrix by a divisor.
@@ -49,7 +66,7 @@ void swap_rows(Matrix& rref_mat, int row1, int row2);
  * @param row The index of the row to be divided.
  * @param divisor The value by which the row will be divided.
  */
-void divide_row(Matrix& rref_mat, int row, float divisor);
+void divide_row(Matrix& rref_mat, mat_index row, float divisor);
 
 /**
  * @brief Eliminates rows below and above the pivot row.
@@ -61,7 +78,7 @@ void divide_row(Matrix& rref_mat, int row, float divisor);
  * @param pivot_row The index of the pivot row.
  * @param lead The lead column index.
  */
-void eliminate_rows(Matrix& rref_mat, int pivot_row, int lead);
+void eliminate_rows(Matrix& rref_mat, mat_index pivot_row, mat_index lead);
 
 /**
  * @brief Rounds small values in the matrix to zero.
@@ -74,7 +91,82 @@ void eliminate_rows(Matrix& rref_mat, int pivot_row, int lead);
 void round_small_values(Matrix& rref_mat);
 
 
-Matrix::Matrix (int rows, int cols) : mat_dims {rows,cols} //CONSTRUCTOR
+/**
+ * @brief Sums n floats by pairwise (cascade) summation.
+ *
+ * Leaves of up to PAIRWISE_BLOCK elements are summed with
+ * REDUCTION_LANES independent accumulators, which the compiler maps onto
+ * SIMD registers; leaves are then combined as a balanced tree, so the
+ * rounding error grows with log(n) instead of n.
+ *
+ * @param x The elements.
+ * @param n The number of elements.
+ * @return The sum.
+ */
+static float pairwise_sum (const float* x, std::size_t n);
+
+/**
+ * @brief Returns the largest absolute value among n floats.
+ */
+static float max_abs (const float* x, std::size_t n);
+
+/**
+ * @brief Sums (x[i] * inv_scale)^2 over n floats by pairwise summation.
+ */
+static float pairwise_scaled_sum_sq (const float* x, std::size_t n,
+                                     float inv_scale);
+
+/**
+ * @brief Returns the index of the first maximal element among n floats,
+ * scanning REDUCTION_LANES interleaved lanes at once.
+ */
+static std::size_t lane_argmax (const float* x, std::size_t n);
+
+/**
+ * @brief Orthonormalizes count columns of length rows, stored one after
+ * another, by modified Gram-Schmidt run twice (which keeps them orthogonal
+ * to working precision). A column that vanishes is left zero.
+ */
+static void orthonormalize (std::vector<double>& cols, mat_index rows,
+                            mat_index count);
+
+/**
+ * @brief Orthogonalizes count columns of length rows, stored one after
+ * another, by one-sided Jacobi rotations, applying every rotation to the
+ * count x count column-major matrix rot as well.
+ */
+static void jacobi_orthogonalize (std::vector<double>& cols, mat_index rows,
+                                  mat_index count, std::vector<double>& rot);
+
+/**
+ * @brief Returns how many rows of the given width make up one parallel
+ * chunk of about REDUCTION_GRAIN elements.
+ */
+static std::size_t rows_grain (std::size_t cols)
+{
+  return std::max ((std::size_t) 1, (std::size_t) REDUCTION_GRAIN / cols);
+}
+
+/**
+ * @brief Runs a per-chunk reduction over n elements, in parallel on the
+ * shared pool once n reaches REDUCTION_PARALLEL_THRESHOLD.
+ *
+ * Chunks have the fixed size REDUCTION_GRAIN whatever the thread count, so
+ * the combined result is bitwise reproducible across machines.
+ *
+ * @param n The number of elements.
+ * @param chunk_fn Reduces [lo, hi) and returns the partial result.
+ * @return One partial per chunk, in index order.
+ */
+template <typename T>
+static std::vector<T> chunked_reduce (std::size_t n,
+                                      const std::function<T (std::size_t,
+                                                             std::size_t)>&
+                                      chunk_fn);
+
+
+Matrix::Matrix (mat_index rows, mat_index cols) :
+mat_dims {rows,cols} //CONSTRUCTOR
 {
   if (rows <= 0 || cols <= 0)
   {
@@ -92,13 +184,21 @@ mat_dims ({other_mat.mat_dims.rows, other_mat.mat_dims.cols})
 // COPY CONSTRUCTOR
 {
   mat_data = new float [mat_dims.rows * mat_dims.cols]();
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols; ++i) // deep copy
+  for (mat_index i = 0; i < mat_dims.rows * mat_dims.cols; ++i) // deep copy
   {
     mat_data[i] = other_mat.mat_data[i];
   }
 }
 
 
+Matrix::Matrix (Matrix&& other_mat) noexcept :
+mat_dims (other_mat.mat_dims), mat_data (other_mat.mat_data) // MOVE CONSTRUCTOR
+{
+  other_mat.mat_dims = {0, 0};
+  other_mat.mat_data = nullptr;
+}
+
+
 Matrix::~Matrix () // DESTRUCTOR
 {
   delete[] mat_data;
@@ -106,18 +206,27 @@ Matrix::~Matrix () // DESTRUCTOR
 }
 
 
-int Matrix::get_rows ()const {return mat_dims.rows;}
+mat_index Matrix::get_rows ()const {return mat_dims.rows;}
+
+
+mat_index Matrix::get_cols ()const {return mat_dims.cols;}
+
 
+mat_index Matrix::size ()const {return mat_dims.rows * mat_dims.cols;}
 
-int Matrix::get_cols ()const {return mat_dims.cols;}
+
+float* Matrix::get_data () {return mat_data;}
+
+
+const float* Matrix::get_data ()const {return mat_data;}
 
 
 Matrix& Matrix::transpose()
 {
   Matrix old_mat = (*this); // copy constructor
-  for (int i = 0; i < mat_dims.cols; ++i)
+  for (mat_index i = 0; i < mat_dims.cols; ++i)
   {
-    for (int j = 0; j < mat_dims.rows; ++j)
+    for (mat_index j = 0; j < mat_dims.rows; ++j)
     {
       mat_data[i * mat_dims.rows + j] =
           old_mat.mat_data[ j * mat_dims.cols + i];
@@ -137,9 +246,9 @@ Matrix& Matrix::vectorize ()
 
 void Matrix::plain_print () const
 {
-  for (int i = 0; i < mat_dims.rows; ++i)
+  for (mat_index i = 0; i < mat_dims.rows; ++i)
   {
-    for (int j = 0; j < mat_dims.cols; ++j)
+    for (mat_index j = 0; j < mat_dims.cols; ++j)
     {
       std::cout << mat_data[i * mat_dims.cols + j] << " ";
     }
@@ -157,30 +266,58 @@ Matrix Matrix::dot (const Matrix &other_mat) const
     throw std::length_error (SIZE_ERROR);
   }
   Matrix dot_mat(mat_dims.rows, mat_dims.cols);
-  for (int i = 0; i < mat_dims.cols * mat_dims.rows; i++)
+  const float* a = mat_data;
+  const float* b = other_mat.mat_data;
+  float* out = dot_mat.mat_data;
+  parallel_for_elements ((std::size_t) mat_dims.rows * mat_dims.cols,
+                         [a, b, out] (std::size_t lo, std::size_t hi)
   {
-    dot_mat.mat_data[i] = (this->mat_data[i] * other_mat.mat_data[i]);
-  }
+    for (std::size_t i = lo; i < hi; i++)
+    {
+      out[i] = a[i] * b[i];
+    }
+  });
   return dot_mat;
 }
 
 
 float Matrix::norm () const
 {
-  float sum_of_power_elem = 0;
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols; i++)
+  // two passes: find the largest magnitude, then sum squares scaled by it,
+  // so neither huge (overflow to inf) nor tiny (underflow to 0) elements
+  // break the result
+  std::size_t n = (std::size_t) mat_dims.rows * mat_dims.cols;
+  const float* x = mat_data;
+  std::vector<float> maxima = chunked_reduce<float> (n,
+      [x] (std::size_t lo, std::size_t hi) { return max_abs (x + lo, hi - lo); });
+  float scale = *std::max_element (maxima.begin (), maxima.end ());
+  if (scale == 0 || std::isinf (scale) || std::isnan (scale))
   {
-    sum_of_power_elem += mat_data[i] * mat_data[i];
+    return scale;
   }
-  return std::sqrt(sum_of_power_elem);
+  // scale by a power of two, which is exact; the reciprocal of a subnormal
+  // scale would overflow, so its exponent is capped at the smallest one
+  // whose reciprocal is a float
+  int exp = 0;
+  std::frexp (scale, &exp);
+  exp = std::max (exp, std::numeric_limits<float>::min_exponent);
+  const float inv_scale = std::ldexp (1.0f, -exp);
+  std::vector<float> partials = chunked_reduce<float> (n,
+      [x, inv_scale] (std::size_t lo, std::size_t hi)
+      {
+        return pairwise_scaled_sum_sq (x + lo, hi - lo, inv_scale);
+      });
+  return std::ldexp (std::sqrt (pairwise_sum (partials.data (),
+                                             partials.size ())), exp);
 }
 
 
-int find_pivot_row(const Matrix& rref_mat, int current_row, int lead)
+mat_index find_pivot_row(const Matrix& rref_mat, mat_index current_row,
+                         mat_index lead)
 {
-  int rows = rref_mat.get_rows();
+  mat_index rows = rref_mat.get_rows();
 
-  for (int r = current_row; r < rows; ++r)
+  for (mat_index r = current_row; r < rows; ++r)
   {
     if (rref_mat(r, lead) != 0)
     {
@@ -192,11 +329,11 @@ int find_pivot_row(const Matrix& rref_mat, int current_row, int lead)
 }
 
 
-void swap_rows(Matrix& rref_mat, int row1, int row2)
+void swap_rows(Matrix& rref_mat, mat_index row1, mat_index row2)
 {
-  int cols = rref_mat.get_cols();
+  mat_index cols = rref_mat.get_cols();
 
-  for (int c = 0; c < cols; ++c)
+  for (mat_index c = 0; c < cols; ++c)
   {
     float temp = rref_mat(row1, c);
     rref_mat(row1, c) = rref_mat(row2, c);
@@ -205,27 +342,27 @@ void swap_rows(Matrix& rref_mat, int row1, int row2)
 }
 
 
-void divide_row(Matrix& rref_mat, int row, float divisor)
+void divide_row(Matrix& rref_mat, mat_index row, float divisor)
 {
-  int cols = rref_mat.get_cols();
+  mat_index cols = rref_mat.get_cols();
 
-  for (int c = 0; c < cols; ++c)
+  for (mat_index c = 0; c < cols; ++c)
   {
     rref_mat(row, c) /= divisor;
   }
 }
 
-void eliminate_rows(Matrix& rref_mat, int pivot_row, int lead)
+void eliminate_rows(Matrix& rref_mat, mat_index pivot_row, mat_index lead)
 {
-  int rows = rref_mat.get_rows();
-  int cols = rref_mat.get_cols();
+  mat_index rows = rref_mat.get_rows();
+  mat_index cols = rref_mat.get_cols();
 
-  for (int r = 0; r < rows; ++r)
+  for (mat_index r = 0; r < rows; ++r)
   {
     if (r != pivot_row)
     {
       float factor = rref_mat(r, lead);
-      for (int c = 0; c < cols; ++c)
+      for (mat_index c = 0; c < cols; ++c)
       {
         rref_mat(r, c) -= factor * rref_mat(pivot_row, c);
       }
@@ -235,11 +372,11 @@ void eliminate_rows(Matrix& rref_mat, int pivot_row, int lead)
 
 void round_small_values(Matrix& rref_mat)
 {
-  int rows = rref_mat.get_rows();
-  int cols = rref_mat.get_cols();
-  for (int r = 0; r < rows; ++r)
+  mat_index rows = rref_mat.get_rows();
+  mat_index cols = rref_mat.get_cols();
+  for (mat_index r = 0; r < rows; ++r)
   {
-    for (int c = 0; c < cols; ++c)
+    for (mat_index c = 0; c < cols; ++c)
     {
       if (fabs((double)rref_mat(r, c)) < VERY_SMALL_NUMBER)
       {
@@ -253,17 +390,17 @@ void round_small_values(Matrix& rref_mat)
 Matrix Matrix::rref() const
 {
   Matrix rref_mat(*this);  // Create a copy of the *this matrix
-  int rows = rref_mat.get_rows();
-  int cols = rref_mat.get_cols();
+  mat_index rows = rref_mat.get_rows();
+  mat_index cols = rref_mat.get_cols();
 
-  int lead = 0;
-  for (int r = 0; r < rows; ++r)
+  mat_index lead = 0;
+  for (mat_index r = 0; r < rows; ++r)
   {
     if (lead >= cols)
     {
       return rref_mat;
     }
-    int pivot_row = find_pivot_row (rref_mat, r, lead);
+    mat_index pivot_row = find_pivot_row (rref_mat, r, lead);
     if (pivot_row == -1)
     {
       lead++;
@@ -285,30 +422,342 @@ Matrix Matrix::rref() const
 }
 
 
-int Matrix::argmax () const
+mat_index Matrix::argmax () const
 {
-  float max_num = mat_data[0];
-  int max_num_ind = 0;
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols; ++i)
+  std::size_t n = (std::size_t) mat_dims.rows * mat_dims.cols;
+  const float* x = mat_data;
+  std::vector<std::size_t> candidates = chunked_reduce<std::size_t> (n,
+      [x] (std::size_t lo, std::size_t hi) { return lo + lane_argmax (x + lo,
+                                                                   hi - lo); });
+  // chunks are in index order, so keeping the first strict maximum keeps
+  // the lowest index among ties
+  std::size_t max_num_ind = candidates[0];
+  for (std::size_t c = 1; c < candidates.size (); ++c)
   {
-    if (mat_data[i] > max_num) // only if bigger
+    if (x[candidates[c]] > x[max_num_ind]) // only if bigger
     {
-      max_num = mat_data[i];
-      max_num_ind = i;
+      max_num_ind = candidates[c];
     }
   }
-  return max_num_ind;
+  return (mat_index) max_num_ind;
 }
 
 
 float Matrix::sum () const
 {
-  float sum = 0;
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols; i++)
+  std::size_t n = (std::size_t) mat_dims.rows * mat_dims.cols;
+  const float* x = mat_data;
+  std::vector<float> partials = chunked_reduce<float> (n,
+      [x] (std::size_t lo, std::size_t hi) { return pairwise_sum (x + lo,
+                                                                  hi - lo); });
+  return pairwise_sum (partials.data (), partials.size ());
+}
+
+
+Matrix Matrix::row_sums () const
+{
+  Matrix sums (mat_dims.rows, ONE);
+  const float* x = mat_data;
+  float* out = sums.mat_data;
+  std::size_t cols = mat_dims.cols;
+  ThreadPool::shared ().parallel_for (0, mat_dims.rows, rows_grain (cols),
+      [x, out, cols] (std::size_t lo, std::size_t hi)
   {
-    sum += mat_data[i];
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      out[i] = pairwise_sum (x + i * cols, cols);
+    }
+  });
+  return sums;
+}
+
+
+Matrix Matrix::col_sums () const
+{
+  // summing down columns of a row-major matrix: add whole rows into column
+  // accumulators (contiguous, vectorizable), one block of rows at a time,
+  // then combine the block partials pairwise
+  std::size_t rows = mat_dims.rows;
+  std::size_t cols = mat_dims.cols;
+  std::size_t blocks = (rows + PAIRWISE_BLOCK - 1) / PAIRWISE_BLOCK;
+  std::vector<float> partials (blocks * cols, 0);
+  const float* x = mat_data;
+  float* part = partials.data ();
+  ThreadPool::shared ().parallel_for (0, blocks,
+      std::max ((std::size_t) 1, REDUCTION_GRAIN / (PAIRWISE_BLOCK * cols)),
+      [x, part, rows, cols] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t b = lo; b < hi; ++b)
+    {
+      float* acc = part + b * cols;
+      std::size_t end = std::min (rows, (b + 1) * PAIRWISE_BLOCK);
+      for (std::size_t i = b * PAIRWISE_BLOCK; i < end; ++i)
+      {
+        const float* row = x + i * cols;
+        for (std::size_t j = 0; j < cols; ++j)
+        {
+          acc[j] += row[j];
+        }
+      }
+    }
+  });
+  Matrix sums (ONE, mat_dims.cols);
+  std::vector<float> column (blocks);
+  for (std::size_t j = 0; j < cols; ++j)
+  {
+    for (std::size_t b = 0; b < blocks; ++b)
+    {
+      column[b] = partials[b * cols + j];
+    }
+    sums.mat_data[j] = pairwise_sum (column.data (), blocks);
   }
-  return sum;
+  return sums;
+}
+
+
+std::vector<mat_index> Matrix::row_argmax () const
+{
+  std::vector<mat_index> result (mat_dims.rows);
+  const float* x = mat_data;
+  std::size_t cols = mat_dims.cols;
+  mat_index* out = result.data ();
+  ThreadPool::shared ().parallel_for (0, mat_dims.rows, rows_grain (cols),
+      [x, out, cols] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      out[i] = (mat_index) lane_argmax (x + i * cols, cols);
+    }
+  });
+  return result;
+}
+
+
+std::vector<mat_index> Matrix::col_argmax () const
+{
+  std::size_t rows = mat_dims.rows;
+  std::size_t cols = mat_dims.cols;
+  std::vector<mat_index> result (cols, 0);
+  const float* x = mat_data;
+  mat_index* out = result.data ();
+  // each chunk owns a range of columns and walks down them row by row,
+  // comparing contiguous row segments against running maxima
+  ThreadPool::shared ().parallel_for (0, cols,
+      std::max ((std::size_t) FLOATS_PER_CACHE_LINE,
+                (std::size_t) REDUCTION_GRAIN / rows),
+      [x, out, rows, cols] (std::size_t lo, std::size_t hi)
+  {
+    std::vector<float> best (x + lo, x + hi);
+    for (std::size_t i = 1; i < rows; ++i)
+    {
+      const float* row = x + i * cols;
+      for (std::size_t j = lo; j < hi; ++j)
+      {
+        if (row[j] > best[j - lo]) // only if bigger
+        {
+          best[j - lo] = row[j];
+          out[j] = (mat_index) i;
+        }
+      }
+    }
+  });
+  return result;
+}
+
+
+std::vector<mat_index> Matrix::top_k (mat_index k) const
+{
+  std::size_t n = (std::size_t) mat_dims.rows * mat_dims.cols;
+  if (k <= 0 || (std::size_t) k > n)
+  {
+    throw std::out_of_range (TOP_K_ERROR);
+  }
+  const float* x = mat_data;
+  // "greater" on (value, -index): the heap top is the weakest kept element,
+  // and among equal values the higher index counts as weaker
+  auto weaker = [x] (std::size_t a, std::size_t b)
+  {
+    return x[a] > x[b] || (x[a] == x[b] && a < b);
+  };
+  auto select = [x, k, weaker] (const std::size_t* idx, std::size_t count,
+                                std::vector<std::size_t>& kept)
+  {
+    std::priority_queue<std::size_t, std::vector<std::size_t>,
+                        decltype (weaker)> heap (weaker);
+    for (std::size_t c = 0; c < count; ++c)
+    {
+      if ((mat_index) heap.size () < k)
+      {
+        heap.push (idx[c]);
+      }
+      else if (weaker (idx[c], heap.top ()))
+      {
+        heap.pop ();
+        heap.push (idx[c]);
+      }
+    }
+    while (!heap.empty ())
+    {
+      kept.push_back (heap.top ());
+      heap.pop ();
+    }
+  };
+
+  // each chunk keeps its own k best, the winners are merged at the end:
+  // O(n log k) work without ever sorting the whole matrix
+  std::size_t chunks = (n < REDUCTION_PARALLEL_THRESHOLD)
+                       ? 1 : (n + REDUCTION_GRAIN - 1) / REDUCTION_GRAIN;
+  std::size_t grain = (chunks == 1) ? n : REDUCTION_GRAIN;
+  std::vector<std::vector<std::size_t> > winners (chunks);
+  ThreadPool::shared ().parallel_for (0, chunks, 1,
+      [&winners, &select, grain, n] (std::size_t lo, std::size_t hi)
+  {
+    std::vector<std::size_t> idx;
+    for (std::size_t c = lo; c < hi; ++c)
+    {
+      std::size_t first = c * grain;
+      std::size_t last = std::min (n, first + grain);
+      idx.resize (last - first);
+      for (std::size_t i = first; i < last; ++i)
+      {
+        idx[i - first] = i;
+      }
+      select (idx.data (), idx.size (), winners[c]);
+    }
+  });
+  std::vector<std::size_t> merged;
+  for (const std::vector<std::size_t>& w : winners)
+  {
+    merged.insert (merged.end (), w.begin (), w.end ());
+  }
+  std::vector<std::size_t> best;
+  select (merged.data (), merged.size (), best);
+  // the heap drains weakest first
+  std::vector<mat_index> result (best.rbegin (), best.rend ());
+  return result;
+}
+
+
+svd_factors Matrix::truncated_svd (mat_index rank, mat_index oversample,
+                                   int power_iters) const
+{
+  const mat_index m = mat_dims.rows;
+  const mat_index n = mat_dims.cols;
+  if (rank <= 0 || rank > std::min (m, n))
+  {
+    throw std::out_of_range (SVD_RANK_ERROR);
+  }
+  const mat_index k = std::min (rank + std::max (oversample, (mat_index) 0),
+                                std::min (m, n));
+  const float* a = mat_data;
+  // y = a * x for k columns x of length n; z = a^T * y for columns of m
+  auto times = [a, m, n, k] (const std::vector<double>& x)
+  {
+    std::vector<double> y ((std::size_t) m * k, 0.0);
+    for (mat_index c = 0; c < k; ++c)
+    {
+      for (mat_index i = 0; i < m; ++i)
+      {
+        const float* row = a + (std::size_t) i * n;
+        const double* xc = x.data () + (std::size_t) c * n;
+        double acc = 0;
+        for (mat_index j = 0; j < n; ++j)
+        {
+          acc += row[j] * xc[j];
+        }
+        y[(std::size_t) c * m + i] = acc;
+      }
+    }
+    return y;
+  };
+  auto times_t = [a, m, n, k] (const std::vector<double>& y)
+  {
+    std::vector<double> z ((std::size_t) n * k, 0.0);
+    for (mat_index c = 0; c < k; ++c)
+    {
+      for (mat_index i = 0; i < m; ++i)
+      {
+        const float* row = a + (std::size_t) i * n;
+        const double yi = y[(std::size_t) c * m + i];
+        double* zc = z.data () + (std::size_t) c * n;
+        for (mat_index j = 0; j < n; ++j)
+        {
+          zc[j] += yi * row[j];
+        }
+      }
+    }
+    return z;
+  };
+
+  // q: an orthonormal basis of (nearly) the top-k column space
+  std::mt19937 gen (SVD_SEED);
+  std::normal_distribution<double> gauss;
+  std::vector<double> omega ((std::size_t) n * k);
+  for (double& x : omega)
+  {
+    x = gauss (gen);
+  }
+  std::vector<double> q = times (omega);
+  orthonormalize (q, m, k);
+  for (int it = 0; it < power_iters; ++it)
+  {
+    std::vector<double> z = times_t (q);
+    orthonormalize (z, n, k);
+    q = times (z);
+    orthonormalize (q, m, k);
+  }
+
+  // b^T = a^T q (n x k) = v * diag(s) * w^T; rotating its columns until
+  // they are orthogonal gives v * diag(s) and w, and then a ~ (q w) s v^T
+  std::vector<double> bt = times_t (q);
+  std::vector<double> w ((std::size_t) k * k, 0.0);
+  for (mat_index c = 0; c < k; ++c)
+  {
+    w[(std::size_t) c * k + c] = 1;
+  }
+  jacobi_orthogonalize (bt, n, k, w);
+  std::vector<double> sigma (k);
+  std::vector<mat_index> order (k);
+  for (mat_index c = 0; c < k; ++c)
+  {
+    const double* col = bt.data () + (std::size_t) c * n;
+    double sq = 0;
+    for (mat_index j = 0; j < n; ++j)
+    {
+      sq += col[j] * col[j];
+    }
+    sigma[c] = std::sqrt (sq);
+    order[c] = c;
+  }
+  std::stable_sort (order.begin (), order.end (),
+                    [&sigma] (mat_index x, mat_index y)
+                    {
+                      return sigma[x] > sigma[y];
+                    });
+
+  svd_factors svd {Matrix (m, rank), Matrix (rank, 1), Matrix (rank, n)};
+  for (mat_index r = 0; r < rank; ++r)
+  {
+    const mat_index c = order[r];
+    svd.s[r] = (float) sigma[c];
+    const double* wc = w.data () + (std::size_t) c * k;
+    for (mat_index i = 0; i < m; ++i)
+    {
+      double acc = 0;
+      for (mat_index l = 0; l < k; ++l)
+      {
+        acc += q[(std::size_t) l * m + i] * wc[l];
+      }
+      svd.u (i, r) = (float) acc;
+    }
+    const double* vc = bt.data () + (std::size_t) c * n;
+    const double inv = (sigma[c] > 0) ? 1 / sigma[c] : 0;
+    for (mat_index j = 0; j < n; ++j)
+    {
+      svd.vt (r, j) = (float) (vc[j] * inv);
+    }
+  }
+  return svd;
 }
 
 
@@ -321,11 +770,17 @@ Matrix Matrix::operator+ (const Matrix &other_mat) const
     throw std::length_error (SIZE_ERROR);
   }
   Matrix addition_mat (mat_dims.rows,mat_dims.cols);
-    for (int i = 0; i < mat_dims.rows * mat_dims.cols; ++i)
+  const float* a = mat_data;
+  const float* b = other_mat.mat_data;
+  float* out = addition_mat.mat_data;
+  parallel_for_elements ((std::size_t) mat_dims.rows * mat_dims.cols,
+                         [a, b, out] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
     {
-      float sum_of_two_mat = mat_data[i] + other_mat.mat_data[i];
-      addition_mat.mat_data[i] = sum_of_two_mat;
-    } 
+      out[i] = a[i] + b[i];
+    }
+  });
   return addition_mat;
 }
 
@@ -338,9 +793,87 @@ Matrix& Matrix::operator+= (const Matrix &other_mat)
   {
     throw std::length_error (SIZE_ERROR);
   }
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols ; ++i)
+  float* a = mat_data;
+  const float* b = other_mat.mat_data;
+  parallel_for_elements ((std::size_t) mat_dims.rows * mat_dims.cols,
+                         [a, b] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      a[i] += b[i];
+    }
+  });
+  return *this;
+}
+
+
+Matrix& Matrix::add_col_vector (const Matrix &col_vec)
+{
+  if (col_vec.mat_dims.rows != mat_dims.rows || col_vec.mat_dims.cols != ONE)
+  {
+    throw std::length_error (SIZE_ERROR);
+  }
+  float* a = mat_data;
+  const float* v = col_vec.mat_data;
+  std::size_t cols = mat_dims.cols;
+  // whole rows per chunk: every element of row i gets v[i]
+  std::size_t grain = std::max ((std::size_t) 1,
+                                (std::size_t) ELEMENTWISE_GRAIN / cols);
+  std::function<void (std::size_t, std::size_t)> rows_kernel =
+      [a, v, cols] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      float* row = a + i * cols;
+      const float bias = v[i];
+      for (std::size_t j = 0; j < cols; ++j)
+      {
+        row[j] += bias;
+      }
+    }
+  };
+  if ((std::size_t) mat_dims.rows * cols < ELEMENTWISE_PARALLEL_THRESHOLD)
+  {
+    rows_kernel (0, mat_dims.rows);
+  }
+  else
+  {
+    ThreadPool::shared ().parallel_for (0, mat_dims.rows, grain, rows_kernel);
+  }
+  return *this;
+}
+
+
+Matrix& Matrix::add_row_vector (const Matrix &row_vec)
+{
+  if (row_vec.mat_dims.rows != ONE || row_vec.mat_dims.cols != mat_dims.cols)
+  {
+    throw std::length_error (SIZE_ERROR);
+  }
+  float* a = mat_data;
+  const float* v = row_vec.mat_data;
+  std::size_t cols = mat_dims.cols;
+  std::size_t grain = std::max ((std::size_t) 1,
+                                (std::size_t) ELEMENTWISE_GRAIN / cols);
+  std::function<void (std::size_t, std::size_t)> rows_kernel =
+      [a, v, cols] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t i = lo; i < hi; ++i)
+    {
+      float* row = a + i * cols;
+      for (std::size_t j = 0; j < cols; ++j)
+      {
+        row[j] += v[j];
+      }
+    }
+  };
+  if ((std::size_t) mat_dims.rows * cols < ELEMENTWISE_PARALLEL_THRESHOLD)
+  {
+    rows_kernel (0, mat_dims.rows);
+  }
+  else
   {
-    mat_data [i] += other_mat.mat_data[i];
+    ThreadPool::shared ().parallel_for (0, mat_dims.rows, grain, rows_kernel);
   }
   return *this;
 }
@@ -352,11 +885,18 @@ Matrix& Matrix::operator= (const Matrix &other_mat)
   {
     return *this;
   }
-  delete[] mat_data;
-  mat_data = nullptr;
-  mat_data = new float [other_mat.mat_dims.rows * other_mat.mat_dims.cols];
+  // reuse the current buffer when the element count matches, so matrices
+  // that are assigned over and over (queue slots, per-layer scratch) never
+  // hit the allocator
+  if (mat_dims.rows * mat_dims.cols !=
+      other_mat.mat_dims.rows * other_mat.mat_dims.cols)
+  {
+    delete[] mat_data;
+    mat_data = nullptr;
+    mat_data = new float [other_mat.mat_dims.rows * other_mat.mat_dims.cols];
+  }
   mat_dims = {other_mat.mat_dims.rows, other_mat.mat_dims.cols};
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols; ++i)
+  for (mat_index i = 0; i < mat_dims.rows * mat_dims.cols; ++i)
   {
     mat_data[i] = other_mat.mat_data[i];
   }
@@ -364,7 +904,22 @@ Matrix& Matrix::operator= (const Matrix &other_mat)
 }
 
 
-float& Matrix::operator() (const int i, const int j)
+Matrix& Matrix::operator= (Matrix &&other_mat) noexcept
+{
+  if (&other_mat == this)
+  {
+    return *this;
+  }
+  delete[] mat_data;
+  mat_data = other_mat.mat_data;
+  mat_dims = other_mat.mat_dims;
+  other_mat.mat_data = nullptr;
+  other_mat.mat_dims = {0, 0};
+  return *this;
+}
+
+
+float& Matrix::operator() (const mat_index i, const mat_index j)
 {
   if (i >= mat_dims.rows || i < 0 || j >= mat_dims.cols || j < 0)
   {
@@ -374,7 +929,7 @@ float& Matrix::operator() (const int i, const int j)
 }
 
 
-const float& Matrix::operator() (const int i, const int j)const
+const float& Matrix::operator() (const mat_index i, const mat_index j)const
 {
   if (i >= mat_dims.rows || i < 0 || j >= mat_dims.cols || j < 0)
   {
@@ -384,7 +939,7 @@ const float& Matrix::operator() (const int i, const int j)const
 }
 
 
-float& Matrix::operator[](int k)
+float& Matrix::operator[](mat_index k)
 {
   if (k >= mat_dims.rows * mat_dims.cols || k < 0)
   {
@@ -394,7 +949,7 @@ float& Matrix::operator[](int k)
 }
 
 
-const float& Matrix::operator[](int k) const
+const float& Matrix::operator[](mat_index k) const
 {
   if (k >= mat_dims.rows * mat_dims.cols || k < 0)
   {
@@ -405,6 +960,13 @@ const float& Matrix::operator[](int k) const
 
 
 Matrix operator* (const Matrix& r_mat, const Matrix& l_mat)
+{
+  return multiply (r_mat, l_mat);
+}
+
+
+Matrix multiply (const Matrix& r_mat, const Matrix& l_mat,
+                 gemm_algorithm algorithm)
 {
   // check if the other matrix can be multiply by this matrix
   if (r_mat.mat_dims.cols !=l_mat.mat_dims.rows)
@@ -412,49 +974,42 @@ Matrix operator* (const Matrix& r_mat, const Matrix& l_mat)
     throw std::length_error (SIZE_ERROR);
   }
   Matrix multi_mat (r_mat.mat_dims.rows, l_mat.mat_dims.cols);
-  for (int i = 0; i < multi_mat.mat_dims.rows ; i++)
-  {
-    for (int j = 0; j < multi_mat.mat_dims.cols; j++)
-    {
-      float element = 0;
-      for (int k = 0; k < r_mat.mat_dims.cols; k++)
-      {
-        element += (r_mat(i,k) * l_mat(k, j));
-      }
-      multi_mat(i, j) = element;
-    }
-  }
+  gemm (r_mat.mat_dims.rows, l_mat.mat_dims.cols, r_mat.mat_dims.cols,
+        r_mat.mat_data, r_mat.mat_dims.cols, l_mat.mat_data,
+        l_mat.mat_dims.cols, multi_mat.mat_data, multi_mat.mat_dims.cols,
+        algorithm);
   return multi_mat;
 }
 
 
 Matrix Matrix::operator* (float c)
 {
-  Matrix new_mat = (*this);
-  for (int i = 0; i < mat_dims.rows * mat_dims.cols ; i++)
-  {
-    new_mat[i] *= c;
-  }
-  return new_mat;
+  return c * (*this);
 }
 
 
 Matrix operator* (float c, const Matrix& mat)
 {
-  Matrix new_mat = mat;
-  for (int i = 0; i < new_mat.get_rows() * new_mat.get_cols() ; i++)
+  Matrix new_mat (mat.mat_dims.rows, mat.mat_dims.cols);
+  const float* a = mat.mat_data;
+  float* out = new_mat.mat_data;
+  parallel_for_elements ((std::size_t) mat.mat_dims.rows * mat.mat_dims.cols,
+                         [a, out, c] (std::size_t lo, std::size_t hi)
   {
-    new_mat[i] *= c;
-  }
+    for (std::size_t i = lo; i < hi; i++)
+    {
+      out[i] = c * a[i];
+    }
+  });
   return new_mat;
 }
 
 
 ostream& operator<<(ostream& s, const Matrix& mat)
 {
-  for (int i = 0 ; i < mat.mat_dims.rows ; i++)
+  for (mat_index i = 0 ; i < mat.mat_dims.rows ; i++)
   {
-    for (int j = 0; j < mat.mat_dims.cols ; j++)
+    for (mat_index j = 0; j < mat.mat_dims.cols ; j++)
     {
       if (mat(i,j) > BIG_ENOUGH)
       {
@@ -473,9 +1028,9 @@ ostream& operator<<(ostream& s, const Matrix& mat)
 
 istream& operator>>(istream& input_s, Matrix& mat)
 {
-  for (int i = 0; i < mat.mat_dims.rows ; i++)
+  for (mat_index i = 0; i < mat.mat_dims.rows ; i++)
   {
-    for (int j = 0; j < mat.mat_dims.cols; j++)
+    for (mat_index j = 0; j < mat.mat_dims.cols; j++)
     {
       if (input_s.eof()) // input stream too small
       {
@@ -488,3 +1043,253 @@ istream& operator>>(istream& input_s, Matrix& mat)
 }
 
 
+
+
+
+static float pairwise_sum (const float* x, std::size_t n)
+{
+  if (n <= PAIRWISE_BLOCK)
+  {
+    float acc[REDUCTION_LANES] = {0};
+    std::size_t i = 0;
+    for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES)
+    {
+      for (int l = 0; l < REDUCTION_LANES; ++l)
+      {
+        acc[l] += x[i + l];
+      }
+    }
+    float tail = 0;
+    for (; i < n; ++i)
+    {
+      tail += x[i];
+    }
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+           ((acc[4] + acc[5]) + (acc[6] + acc[7])) + tail;
+  }
+  std::size_t half = (n / 2 + REDUCTION_LANES - 1) / REDUCTION_LANES
+                     * REDUCTION_LANES;
+  return pairwise_sum (x, half) + pairwise_sum (x + half, n - half);
+}
+
+
+static float pairwise_scaled_sum_sq (const float* x, std::size_t n,
+                                     float inv_scale)
+{
+  if (n <= PAIRWISE_BLOCK)
+  {
+    float acc[REDUCTION_LANES] = {0};
+    std::size_t i = 0;
+    for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES)
+    {
+      for (int l = 0; l < REDUCTION_LANES; ++l)
+      {
+        float v = x[i + l] * inv_scale;
+        acc[l] += v * v;
+      }
+    }
+    float tail = 0;
+    for (; i < n; ++i)
+    {
+      float v = x[i] * inv_scale;
+      tail += v * v;
+    }
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+           ((acc[4] + acc[5]) + (acc[6] + acc[7])) + tail;
+  }
+  std::size_t half = (n / 2 + REDUCTION_LANES - 1) / REDUCTION_LANES
+                     * REDUCTION_LANES;
+  return pairwise_scaled_sum_sq (x, half, inv_scale) +
+         pairwise_scaled_sum_sq (x + half, n - half, inv_scale);
+}
+
+
+static float max_abs (const float* x, std::size_t n)
+{
+  float acc[REDUCTION_LANES] = {0};
+  std::size_t i = 0;
+  for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES)
+  {
+    for (int l = 0; l < REDUCTION_LANES; ++l)
+    {
+      acc[l] = std::max (acc[l], std::fabs (x[i + l]));
+    }
+  }
+  float result = *std::max_element (acc, acc + REDUCTION_LANES);
+  for (; i < n; ++i)
+  {
+    result = std::max (result, std::fabs (x[i]));
+  }
+  return result;
+}
+
+
+static std::size_t lane_argmax (const float* x, std::size_t n)
+{
+  if (n < 2 * REDUCTION_LANES)
+  {
+    std::size_t best = 0;
+    for (std::size_t i = 1; i < n; ++i)
+    {
+      if (x[i] > x[best]) // only if bigger
+      {
+        best = i;
+      }
+    }
+    return best;
+  }
+  // lane l tracks the first maximum among indices congruent to l
+  float best_val[REDUCTION_LANES];
+  std::size_t best_ind[REDUCTION_LANES];
+  for (int l = 0; l < REDUCTION_LANES; ++l)
+  {
+    best_val[l] = x[l];
+    best_ind[l] = l;
+  }
+  std::size_t i = REDUCTION_LANES;
+  for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES)
+  {
+    for (int l = 0; l < REDUCTION_LANES; ++l)
+    {
+      bool bigger = x[i + l] > best_val[l];
+      best_val[l] = bigger ? x[i + l] : best_val[l];
+      best_ind[l] = bigger ? i + l : best_ind[l];
+    }
+  }
+  std::size_t best = best_ind[0];
+  for (int l = 1; l < REDUCTION_LANES; ++l)
+  {
+    if (best_val[l] > x[best] ||
+        (best_val[l] == x[best] && best_ind[l] < best))
+    {
+      best = best_ind[l];
+    }
+  }
+  for (; i < n; ++i)
+  {
+    if (x[i] > x[best])
+    {
+      best = i;
+    }
+  }
+  return best;
+}
+
+
+template <typename T>
+static std::vector<T> chunked_reduce (std::size_t n,
+                                      const std::function<T (std::size_t,
+                                                             std::size_t)>&
+                                      chunk_fn)
+{
+  if (n < REDUCTION_PARALLEL_THRESHOLD)
+  {
+    return std::vector<T> (1, chunk_fn (0, n));
+  }
+  std::size_t chunks = (n + REDUCTION_GRAIN - 1) / REDUCTION_GRAIN;
+  std::vector<T> partials (chunks);
+  T* out = partials.data ();
+  ThreadPool::shared ().parallel_for (0, n, REDUCTION_GRAIN,
+      [out, &chunk_fn] (std::size_t lo, std::size_t hi)
+  {
+    out[lo / REDUCTION_GRAIN] = chunk_fn (lo, hi);
+  });
+  return partials;
+}
+
+
+static void orthonormalize (std::vector<double>& cols, mat_index rows,
+                            mat_index count)
+{
+  for (mat_index c = 0; c < count; ++c)
+  {
+    double* col = cols.data () + (std::size_t) c * rows;
+    double original = 0;
+    for (mat_index i = 0; i < rows; ++i)
+    {
+      original += col[i] * col[i];
+    }
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      for (mat_index p = 0; p < c; ++p)
+      {
+        const double* prev = cols.data () + (std::size_t) p * rows;
+        double proj = 0;
+        for (mat_index i = 0; i < rows; ++i)
+        {
+          proj += prev[i] * col[i];
+        }
+        for (mat_index i = 0; i < rows; ++i)
+        {
+          col[i] -= proj * prev[i];
+        }
+      }
+    }
+    double sq = 0;
+    for (mat_index i = 0; i < rows; ++i)
+    {
+      sq += col[i] * col[i];
+    }
+    // what is left of a column in the span of the previous ones is noise
+    const bool vanished = sq <= original * SVD_JACOBI_TOLERANCE;
+    const double inv = vanished ? 0 : 1 / std::sqrt (sq);
+    for (mat_index i = 0; i < rows; ++i)
+    {
+      col[i] *= inv;
+    }
+  }
+}
+
+
+static void jacobi_orthogonalize (std::vector<double>& cols, mat_index rows,
+                                  mat_index count, std::vector<double>& rot)
+{
+  for (int sweep = 0; sweep < SVD_JACOBI_MAX_SWEEPS; ++sweep)
+  {
+    bool rotated = false;
+    for (mat_index p = 0; p + 1 < count; ++p)
+    {
+      for (mat_index r = p + 1; r < count; ++r)
+      {
+        double* x = cols.data () + (std::size_t) p * rows;
+        double* y = cols.data () + (std::size_t) r * rows;
+        double xx = 0, yy = 0, xy = 0;
+        for (mat_index i = 0; i < rows; ++i)
+        {
+          xx += x[i] * x[i];
+          yy += y[i] * y[i];
+          xy += x[i] * y[i];
+        }
+        if (std::fabs (xy) <= SVD_JACOBI_TOLERANCE * std::sqrt (xx * yy))
+        {
+          continue;
+        }
+        rotated = true;
+        // the rotation that zeroes the off-diagonal of [[xx xy] [xy yy]]
+        const double zeta = (yy - xx) / (2 * xy);
+        const double t = std::copysign (1.0, zeta) /
+                         (std::fabs (zeta) + std::sqrt (1 + zeta * zeta));
+        const double cs = 1 / std::sqrt (1 + t * t);
+        const double sn = cs * t;
+        for (mat_index i = 0; i < rows; ++i)
+        {
+          const double xi = x[i];
+          x[i] = cs * xi - sn * y[i];
+          y[i] = sn * xi + cs * y[i];
+        }
+        double* u = rot.data () + (std::size_t) p * count;
+        double* v = rot.data () + (std::size_t) r * count;
+        for (mat_index i = 0; i < count; ++i)
+        {
+          const double ui = u[i];
+          u[i] = cs * ui - sn * v[i];
+          v[i] = sn * ui + cs * v[i];
+        }
+      }
+    }
+    if (!rotated)
+    {
+      return;
+    }
+  }
+}
@@ -1,25 +1,39 @@
 // Matrix.h
 #ifndef MATRIX_H
 #define MATRIX_H
+#include "Gemm.h"
+#include <cstdint>
 #include <iostream>
 #include <cmath>
 #include <stdexcept>
+#include <vector>
 
 using std::ostream;
 using std::istream;
 using std::cout;
 using std::cin;
 
+/**   typedefs  */
+typedef std::int64_t mat_index; /**< Dimensions, element counts and
+ * indices; 64-bit so matrices past 2^31 elements index correctly. */
+
 /**
  * @struct matrix_dims
  * @brief Matrix dimensions container. Used in MlpNetwork.h and main.cpp
  */
 typedef struct matrix_dims
 {
-	int rows, cols;
+	mat_index rows, cols;
 } matrix_dims;
 
 
+// columns sampled beyond the requested rank, and power iterations, of the
+// randomized SVD; with rank + oversample >= min(rows, cols) it is exact
+#define SVD_OVERSAMPLE 10
+#define SVD_POWER_ITERATIONS 2
+
+struct svd_factors;
+
 /**
 * @class Matrix
 * @brief Represents a mathematical matrix.
@@ -43,7 +57,7 @@ class Matrix {
 * @param rows The number of rows in the matrix.
 * @param cols The number of columns in the matrix.
 */
-  Matrix(int rows, int cols);
+  Matrix(mat_index rows, mat_index cols);
 
 /**
 * @brief Default constructor. Constructs an empty matrix with zero rows and
@@ -59,6 +73,14 @@ class Matrix {
 */
   Matrix(const Matrix& other_mat);
 
+/**
+* @brief Move constructor. Takes over the buffer of another matrix, which is
+* left empty (zero rows and columns) and may only be destroyed or assigned.
+*
+* @param other_mat The matrix to be moved from.
+*/
+  Matrix(Matrix&& other_mat) noexcept;
+
 /**
 * @brief Destructor. Frees the dynamically allocated memory used by the
 * matrix.
@@ -70,14 +92,33 @@ class Matrix {
 *
 * @return The number of rows.
 */
-  int get_rows() const;
+  mat_index get_rows() const;
 
 /**
 * @brief Returns the number of columns in the matrix.
 *
 * @return The number of columns.
 */
-  int get_cols() const;
+  mat_index get_cols() const;
+
+/**
+* @brief Returns the underlying row-major element buffer.
+*
+* @return A pointer to the first of get_rows() * get_cols() elements.
+*/
+  float* get_data();
+
+/**
+* @brief Returns the underlying row-major element buffer (const version).
+*
+* @return A const pointer to the first of get_rows() * get_cols() elements.
+*/
+  const float* get_data() const;
+
+/**
+* @brief Returns the number of elements, get_rows() * get_cols().
+*/
+  mat_index size() const;
 
   // operators:
 
@@ -98,6 +139,15 @@ class Matrix {
 */
   Matrix& operator=(const Matrix& other_mat);
 
+/**
+* @brief Move assignment. Takes over the buffer of another matrix, which is
+* left empty.
+*
+* @param other_mat The matrix to be moved from.
+* @return A reference to the current matrix after the assignment.
+*/
+  Matrix& operator=(Matrix&& other_mat) noexcept;
+
 /**
 * @brief Adds the values of another matrix to the current matrix.
 *
@@ -114,7 +164,7 @@ class Matrix {
 * @param j The column index.
 * @return A reference to the element at the specified position.
 */
-  float& operator()( int i,  int j);
+  float& operator()(mat_index i, mat_index j);
 
 /**
 * @brief Accesses the element at the specified row and column using
@@ -124,7 +174,7 @@ class Matrix {
 * @param j The column index.
 * @return A const reference to the element at the specified position.
 */
-  const float& operator()(int i, int j) const;
+  const float& operator()(mat_index i, mat_index j) const;
 
 /**
 * @brief Accesses the element at the specified index using square bracket
@@ -133,7 +183,7 @@ class Matrix {
 * @param i The index.
 * @return A reference to the element at the specified index.
 */
-  float& operator[](int i);
+  float& operator[](mat_index i);
 
 /**
 * @brief Accesses the element at the specified index using square bracket
@@ -142,7 +192,7 @@ class Matrix {
 * @param i The index.
 * @return A const reference to the element at the specified index.
 */
-  const float& operator[](int i) const;
+  const float& operator[](mat_index i) const;
 
 /**
 * @brief Multiplies the matrix by a scalar value and returns the result.
@@ -155,6 +205,23 @@ class Matrix {
 
   // functions:
 
+/**
+* @brief Adds a column vector to every column of the matrix, in place
+* (e.g. a bias vector to every sample of a batch).
+*
+* @param col_vec A get_rows() x 1 matrix.
+* @return A reference to the current matrix after the addition.
+*/
+  Matrix& add_col_vector(const Matrix& col_vec);
+
+/**
+* @brief Adds a row vector to every row of the matrix, in place.
+*
+* @param row_vec A 1 x get_cols() matrix.
+* @return A reference to the current matrix after the addition.
+*/
+  Matrix& add_row_vector(const Matrix& row_vec);
+
 /**
 * @brief Transposes the matrix in-place.
 *
@@ -188,6 +255,10 @@ class Matrix {
 /**
 * @brief Computes the norm (magnitude) of the matrix.
 *
+* The squares are summed after scaling by the largest magnitude, so the
+* result neither overflows nor underflows when the norm itself is
+* representable.
+*
 * @return The norm of the matrix as a floating-point value.
 */
   float norm()const;
@@ -202,17 +273,88 @@ class Matrix {
 /**
 * @brief Returns the index of the maximum element in the matrix.
 *
+* Ties resolve to the lowest index.
+*
 * @return The index of the maximum element.
 */
-  int argmax()const;
+  mat_index argmax()const;
 
 /**
 * @brief Computes the sum of all elements in the matrix.
 *
+* Uses pairwise summation over multiple SIMD-friendly accumulators, so the
+* rounding error grows with log(n) rather than n, and runs on the shared
+* thread pool for large matrices. The result does not depend on the number
+* of threads.
+*
 * @return The sum of all elements as a floating-point value.
 */
   float sum()const;
 
+/**
+* @brief Computes the sum of every row.
+*
+* @return A get_rows() x 1 matrix of row sums.
+*/
+  Matrix row_sums()const;
+
+/**
+* @brief Computes the sum of every column (e.g. per-sample totals of a batch
+* stored as columns).
+*
+* @return A 1 x get_cols() matrix of column sums.
+*/
+  Matrix col_sums()const;
+
+/**
+* @brief Returns the column index of the maximum element of every row.
+*
+* @return get_rows() indices; ties resolve to the lowest index.
+*/
+  std::vector<mat_index> row_argmax()const;
+
+/**
+* @brief Returns the row index of the maximum element of every column (e.g.
+* the predicted class of every sample of a batch stored as columns).
+*
+* @return get_cols() indices; ties resolve to the lowest index.
+*/
+  std::vector<mat_index> col_argmax()const;
+
+/**
+* @brief Returns the indices of the k largest elements, largest first.
+*
+* Uses a bounded heap per chunk, O(n log k), without sorting the matrix.
+* Ties resolve to the lowest index.
+*
+* @param k The number of indices to return, in [1, get_rows() * get_cols()].
+* @return The k indices, ordered by decreasing value.
+* @throw std::out_of_range if k is out of range.
+*/
+  std::vector<mat_index> top_k(mat_index k)const;
+
+/**
+* @brief Computes a truncated singular value decomposition,
+* *this ~ u * diag(s) * vt, by randomized range finding.
+*
+* The column space is sampled with rank + oversample Gaussian vectors,
+* refined by power_iters power iterations (each re-orthonormalized), and
+* the small projected matrix is decomposed exactly by one-sided Jacobi
+* rotations. Computed in double precision with a fixed seed, so the result
+* is deterministic.
+*
+* @param rank The number of singular triplets, in [1, min(rows, cols)].
+* @param oversample Extra sampled columns; more sharpen the trailing
+* triplets.
+* @param power_iters Power iterations; more help when the spectrum decays
+* slowly.
+* @return The factors, singular values largest first.
+* @throw std::out_of_range if rank is out of range.
+*/
+  svd_factors truncated_svd(mat_index rank,
+                            mat_index oversample = SVD_OVERSAMPLE,
+                            int power_iters = SVD_POWER_ITERATIONS)const;
+
   // friends:
 
 /**
@@ -224,6 +366,21 @@ class Matrix {
 */
   friend Matrix operator* (const Matrix &r_mat, const Matrix &l_mat);
 
+/**
+* @brief Multiplies two matrices with a chosen algorithm.
+*
+* operator* is multiply with GEMM_AUTO, which switches to Strassen-Winograd
+* once every dimension reaches STRASSEN_AUTO_MIN_DIM; see gemm_strassen()
+* for its numerical error.
+*
+* @param r_mat The right-hand side matrix.
+* @param l_mat The left-hand side matrix.
+* @param algorithm The product algorithm.
+* @return A new matrix that is the result of the multiplication.
+*/
+  friend Matrix multiply (const Matrix &r_mat, const Matrix &l_mat,
+                          gemm_algorithm algorithm);
+
 /**
 * @brief Multiplies a scalar value by a matrix and returns the result.
 *
@@ -253,5 +410,21 @@ class Matrix {
 
 };
 
+Matrix multiply (const Matrix &r_mat, const Matrix &l_mat,
+                 gemm_algorithm algorithm = GEMM_AUTO);
+
+/**
+ * @struct svd_factors
+ * @brief A (truncated) singular value decomposition u * diag(s) * vt.
+ * @var u - rows x rank, orthonormal columns
+ * @var s - rank x 1 singular values, largest first
+ * @var vt - rank x cols, orthonormal rows
+ */
+typedef struct svd_factors {
+	Matrix u;
+	Matrix s;
+	Matrix vt;
+} svd_factors;
+
 
 #endif //MATRIX_H
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "MlpEnsemble.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <cstring>
+
+#define EMPTY_ENSEMBLE_ERROR "Error: an ensemble needs at least one model"
+#define ENSEMBLE_WEIGHTS_ERROR "Error: ensemble weights must be one \
+non-negative weight per model with a positive sum"
+#define ENSEMBLE_SHAPE_ERROR "Error: ensemble models disagree on input or \
+output size"
+
+
+MlpEnsemble::MlpEnsemble (const std::vector<MlpNetwork>& models,
+                          const std::vector<float>& weights,
+                          bool stack_first_layers)
+    : _models (models)
+{
+  if (_models.empty())
+  {
+    throw std::invalid_argument (EMPTY_ENSEMBLE_ERROR);
+  }
+  const int model_count = (int) _models.size();
+  const mat_index inputs = _models[0].get_layer(0).get_weights().get_cols();
+  const mat_index classes = _models[0].get_layer(MLP_SIZE - 1).get_weights()
+      .get_rows();
+  for (const MlpNetwork& model : _models)
+  {
+    if (model.get_layer(0).get_weights().get_cols() != inputs ||
+        model.get_layer(MLP_SIZE - 1).get_weights().get_rows() != classes)
+    {
+      throw std::invalid_argument (ENSEMBLE_SHAPE_ERROR);
+    }
+  }
+
+  _weights = weights.empty() ? std::vector<float> (model_count, 1.0f)
+                             : weights;
+  if ((int) _weights.size() != model_count)
+  {
+    throw std::invalid_argument (ENSEMBLE_WEIGHTS_ERROR);
+  }
+  float total = 0;
+  for (float w : _weights)
+  {
+    if (!(w >= 0))
+    {
+      throw std::invalid_argument (ENSEMBLE_WEIGHTS_ERROR);
+    }
+    total += w;
+  }
+  if (!(total > 0))
+  {
+    throw std::invalid_argument (ENSEMBLE_WEIGHTS_ERROR);
+  }
+  for (float& w : _weights)
+  {
+    w /= total;
+  }
+
+  // one stacked layer applies one activation to every member's rows, so
+  // members whose first layers differ in activation run separately
+  const Activation_Func first_func = _models[0].get_layer(0).get_activation();
+  const activation::kind first_kind = activation::kind_of(first_func);
+  for (const MlpNetwork& model : _models)
+  {
+    const Activation_Func func = model.get_layer(0).get_activation();
+    const activation::kind kind = activation::kind_of(func);
+    // custom activations share one kind, so those must be the same function
+    if (kind != first_kind ||
+        (kind == activation::KIND_CUSTOM && func != first_func))
+    {
+      stack_first_layers = false;
+    }
+  }
+  if (stack_first_layers && model_count > 1)
+  {
+    // every first layer reads the same 784 inputs, so their weight rows can
+    // be concatenated into one taller layer over the same batch
+    mat_index rows = 0;
+    for (const MlpNetwork& model : _models)
+    {
+      _stack_offsets.push_back(rows);
+      rows += model.get_layer(0).get_weights().get_rows();
+    }
+    Matrix weights_stack (rows, inputs);
+    Matrix bias_stack (rows, 1);
+    for (int m = 0; m < model_count; ++m)
+    {
+      const Dense& layer = _models[m].get_layer(0);
+      const Matrix& w = layer.get_weights();
+      std::memcpy(weights_stack.get_data()
+                  + (std::size_t) _stack_offsets[m] * inputs,
+                  w.get_data(),
+                  (std::size_t) w.get_rows() * inputs * sizeof (float));
+      std::memcpy(bias_stack.get_data() + _stack_offsets[m],
+                  layer.get_bias().get_data(), w.get_rows() * sizeof (float));
+    }
+    _stacked.reset(new Dense (share_matrix(std::move(weights_stack)),
+                              share_matrix(std::move(bias_stack)),
+                              _models[0].get_layer(0).get_activation()));
+    _stacked->enable_sparse_input(_models[0].get_layer(0)
+                                  .get_sparse_cutoff());
+  }
+}
+
+
+int MlpEnsemble::size () const
+{
+  return (int) _models.size();
+}
+
+
+Matrix MlpEnsemble::forward (const Matrix& batch,
+                             ensemble_combine combine) const
+{
+  TRACE_SPAN("ensemble forward", "network");
+  const int model_count = (int) _models.size();
+  const mat_index inputs = _models[0].get_layer(0).get_weights().get_cols();
+  Matrix vec = batch;
+  if (vec.get_rows() != inputs)
+  {
+    vec.vectorize();
+  }
+
+  Matrix stacked_out;
+  if (_stacked)
+  {
+    stacked_out = (*_stacked)(vec);
+  }
+  std::vector<Matrix> outputs (model_count);
+  ThreadPool::shared().parallel_for (0, model_count, 1,
+      [this, &vec, &stacked_out, &outputs] (std::size_t lo, std::size_t hi)
+  {
+    for (std::size_t m = lo; m < hi; ++m)
+    {
+      TRACE_SPAN("ensemble member", "network");
+      const MlpNetwork& model = _models[m];
+      if (!_stacked)
+      {
+        outputs[m] = model.forward(vec);
+        continue;
+      }
+      // the model's first-layer output is a contiguous band of rows
+      mat_index rows = model.get_layer(0).get_weights().get_rows();
+      mat_index cols = stacked_out.get_cols();
+      Matrix hidden (rows, cols);
+      std::memcpy(hidden.get_data(), stacked_out.get_data()
+                  + (std::size_t) _stack_offsets[m] * cols,
+                  (std::size_t) rows * cols * sizeof (float));
+      for (int l = 1; l < MLP_SIZE; ++l)
+      {
+        hidden = model.get_layer(l)(hidden);
+      }
+      outputs[m] = std::move(hidden);
+    }
+  });
+
+  const mat_index classes = outputs[0].get_rows();
+  const mat_index cols = outputs[0].get_cols();
+  Matrix combined (classes, cols);
+  float* dst = combined.get_data();
+  for (int m = 0; m < model_count; ++m)
+  {
+    float w = (combine == COMBINE_MEAN) ? 1.0f / model_count : _weights[m];
+    if (combine == COMBINE_VOTE)
+    {
+      std::vector<mat_index> votes = outputs[m].col_argmax();
+      for (mat_index k = 0; k < cols; ++k)
+      {
+        dst[votes[k] * cols + k] += w;
+      }
+      continue;
+    }
+    const float* src = outputs[m].get_data();
+    for (mat_index i = 0; i < classes * cols; ++i)
+    {
+      dst[i] += w * src[i];
+    }
+  }
+  return combined;
+}
+
+
+std::vector<digit> MlpEnsemble::predict_batch (const std::vector<Matrix>& imgs,
+                                               ensemble_combine combine) const
+{
+  std::vector<digit> results (imgs.size());
+  // chunks run one after the other; each one already spreads its models
+  // over the pool
+  for (std::size_t lo = 0; lo < imgs.size(); lo += BATCH_CHUNK)
+  {
+    std::size_t hi = std::min(imgs.size(), lo + BATCH_CHUNK);
+    Matrix scores = forward(MlpNetwork::pack_batch(imgs, lo, hi), combine);
+    std::vector<mat_index> classes = scores.col_argmax();
+    for (std::size_t k = 0; k < hi - lo; ++k)
+    {
+      results[lo + k].value = (unsigned int) classes[k];
+      results[lo + k].probability = scores(classes[k], (mat_index) k);
+    }
+  }
+  return results;
+}
+
+
+digit MlpEnsemble::operator() (const Matrix& img,
+                               ensemble_combine combine) const
+{
+  return predict_batch(std::vector<Matrix> {img}, combine)[0];
+}
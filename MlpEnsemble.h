@@ -0,0 +1,94 @@
+// MlpEnsemble.h
+#ifndef MLPENSEMBLE_H
+#define MLPENSEMBLE_H
+
+#include "MlpNetwork.h"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief How an MlpEnsemble combines the outputs of its models.
+ */
+enum ensemble_combine
+{
+  COMBINE_MEAN, /**< Average of the softmax outputs. */
+  COMBINE_WEIGHTED_MEAN, /**< Weighted average of the softmax outputs. */
+  COMBINE_VOTE /**< Fraction of (weighted) models whose top class it is. */
+};
+
+/**
+ * @class MlpEnsemble
+ * @brief Runs several independently trained networks on the same inputs and
+ * combines their outputs.
+ *
+ * The models may differ in their hidden widths. A batch is packed into one
+ * input matrix once and every model runs on it concurrently on the shared
+ * thread pool. With first-layer stacking enabled, the first layers of all
+ * models are concatenated into a single taller Dense, so the dominant
+ * 784-wide product runs as one large GEMM over the batch instead of one per
+ * model; its rows are then split back per model for the remaining layers.
+ * Stacking needs every first layer to use the same activation; otherwise
+ * each model runs its own first layer.
+ */
+class MlpEnsemble {
+
+ private:
+  std::vector<MlpNetwork> _models; /**< The members, sharing their buffers
+ * with the networks they were built from. */
+  std::vector<float> _weights; /**< Per-model weights, normalized to sum 1. */
+  std::unique_ptr<Dense> _stacked; /**< All first layers stacked, or null. */
+  std::vector<mat_index> _stack_offsets; /**< First row of model m in _stacked. */
+
+ public:
+/**
+ * @brief Builds an ensemble.
+ *
+ * @param models The member networks; their buffers are shared, not copied.
+ * @param weights Per-model weights for COMBINE_WEIGHTED_MEAN and
+ * COMBINE_VOTE; empty means equal weights.
+ * @param stack_first_layers Whether to run all first layers as one GEMM;
+ * ignored unless every first layer uses the same activation.
+ * @throw std::invalid_argument if models is empty, the weights are malformed,
+ * or the models disagree on input or output size.
+ */
+  explicit MlpEnsemble (const std::vector<MlpNetwork>& models,
+                        const std::vector<float>& weights = {},
+                        bool stack_first_layers = false);
+
+/**
+ * @brief Returns the number of member models.
+ */
+  int size () const;
+
+/**
+ * @brief Runs every model on a packed batch and combines the outputs.
+ *
+ * @param batch The vectorized images as the columns of a (784 x n) matrix.
+ * @param combine How to combine the models.
+ * @return One column of combined class scores per image.
+ */
+  Matrix forward (const Matrix& batch, ensemble_combine combine) const;
+
+/**
+ * @brief Classifies a batch of images.
+ *
+ * @param imgs The input images.
+ * @param combine How to combine the models.
+ * @return One digit per image; probability is the combined score.
+ */
+  std::vector<digit> predict_batch (const std::vector<Matrix>& imgs,
+                                    ensemble_combine combine = COMBINE_MEAN)
+                                    const;
+
+/**
+ * @brief Classifies one image.
+ *
+ * @param img The input image.
+ * @param combine How to combine the models.
+ * @return The classified digit.
+ */
+  digit operator() (const Matrix& img,
+                    ensemble_combine combine = COMBINE_MEAN) const;
+};
+
+#endif //MLPENSEMBLE_H
@@ -1,4 +1,27 @@
 #include "MlpNetwork.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#define LAYER_INDEX_ERROR "Error: MlpNetwork layer index out of range"
+#define IMAGE_SIZE_ERROR "Error: image size does not match the network input"
+#define LAYER_SHAPE_ERROR "Error: replacement layer shape does not match"
+#define ACTIVATION_COUNT_ERROR "Error: expected one activation per layer"
+#define BATCH_CONFIG_ERROR "Error: batch config needs a positive chunk and " \
+                           "a non-negative thread count"
+
+
+/**
+ * @brief Resolves the activation name of layer i.
+ */
+static Activation_Func layer_activation (const std::vector<std::string>& names,
+                                         int i)
+{
+  if (names.size() != MLP_SIZE)
+  {
+    throw std::invalid_argument (ACTIVATION_COUNT_ERROR);
+  }
+  return activation::find(names[i]);
+}
 
 
 MlpNetwork::MlpNetwork(Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE])
@@ -7,18 +30,295 @@ MlpNetwork::MlpNetwork(Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE])
       _layer2(weights[1], biases[1], activation::relu),
       _layer3(weights[2], biases[2], activation::relu),
       _layer4(weights[3], biases[3], activation::softmax)
-{}
+{
+  // image inputs are mostly background zeros, and layer 1 holds most of
+  // the network's multiply-adds
+  _layer1.enable_sparse_input();
+}
+
+
+MlpNetwork::MlpNetwork(const MatrixPtr weights[MLP_SIZE],
+                       const MatrixPtr biases[MLP_SIZE])
+    : MlpNetwork(weights, biases, {HIDDEN_ACTIVATION, HIDDEN_ACTIVATION,
+                                   HIDDEN_ACTIVATION, OUTPUT_ACTIVATION})
+{
+}
+
+
+MlpNetwork::MlpNetwork(const MatrixPtr weights[MLP_SIZE],
+                       const MatrixPtr biases[MLP_SIZE],
+                       const std::vector<std::string>& activations)
+    :
+      _layer1(weights[0], biases[0], layer_activation(activations, 0)),
+      _layer2(weights[1], biases[1], layer_activation(activations, 1)),
+      _layer3(weights[2], biases[2], layer_activation(activations, 2)),
+      _layer4(weights[3], biases[3], layer_activation(activations, 3))
+{
+  _layer1.enable_sparse_input();
+}
 
 
 digit MlpNetwork::operator() (Matrix& vec) const
 {
+  TRACE_SPAN("classify", "request");
   vec = vec.vectorize();
-  Matrix r1 = _layer1(vec);
-  Matrix r2 = _layer2(r1);
-  Matrix r3 = _layer3(r2);
-  Matrix r4 = _layer4(r3);
+  Matrix r4 = forward(vec);
   unsigned int max_ind = r4.argmax();
   float prob = r4[(int)max_ind];
   digit result{max_ind, prob};
   return result;
+}
+
+
+Matrix MlpNetwork::forward (const Matrix& img) const
+{
+  TRACE_SPAN("forward", "network");
+  const int input_size = img_dims.rows * img_dims.cols;
+  Matrix vec = img;
+  if (vec.get_rows() != input_size)
+  {
+    vec.vectorize();
+  }
+  Matrix r1 = _layer1(vec);
+  Matrix r2 = _layer2(r1);
+  Matrix r3 = _layer3(r2);
+  return _layer4(r3);
+}
+
+
+Matrix MlpNetwork::forward_to (int last, const Matrix& img) const
+{
+  const Dense& final_layer = get_layer(last);
+  const int input_size = img_dims.rows * img_dims.cols;
+  Matrix out = img;
+  if (out.get_rows() != input_size)
+  {
+    out.vectorize();
+  }
+  for (int i = 0; i < last; ++i)
+  {
+    out = get_layer(i)(out);
+  }
+  return final_layer(out);
+}
+
+
+Matrix MlpNetwork::forward_from (int first, const Matrix& activations) const
+{
+  Matrix out = get_layer(first)(activations);
+  for (int i = first + 1; i < MLP_SIZE; ++i)
+  {
+    out = get_layer(i)(out);
+  }
+  return out;
+}
+
+
+digit MlpNetwork::operator() (const byte_image& img) const
+{
+  TRACE_SPAN("classify", "request");
+  if (img.size() != (std::size_t) (img_dims.rows * img_dims.cols))
+  {
+    throw std::length_error (IMAGE_SIZE_ERROR);
+  }
+  Matrix r4 = forward(img.data(), 1);
+  mat_index max_ind = r4.argmax();
+  return digit{(unsigned int) max_ind, r4[max_ind]};
+}
+
+
+Matrix MlpNetwork::forward (const std::uint8_t* pixels, mat_index batch) const
+{
+  TRACE_SPAN("forward", "network");
+  Matrix r1 = _layer1(pixels, batch, _byte_norm);
+  Matrix r2 = _layer2(r1);
+  Matrix r3 = _layer3(r2);
+  return _layer4(r3);
+}
+
+
+Matrix MlpNetwork::pack_batch (const std::vector<Matrix>& imgs,
+                               std::size_t lo, std::size_t hi)
+{
+  TRACE_SPAN("pack_batch", "io");
+  // image k of the range becomes column k of the batch matrix
+  const int input_size = img_dims.rows * img_dims.cols;
+  int batch = (int) (hi - lo);
+  Matrix packed (input_size, batch);
+  float* dst = packed.get_data();
+  for (int k = 0; k < batch; ++k)
+  {
+    const Matrix& img = imgs[lo + k];
+    if (img.get_rows() * img.get_cols() != input_size)
+    {
+      throw std::length_error (IMAGE_SIZE_ERROR);
+    }
+    const float* src = img.get_data();
+    for (int i = 0; i < input_size; ++i)
+    {
+      dst[i * batch + k] = src[i];
+    }
+  }
+  return packed;
+}
+
+
+byte_image MlpNetwork::pack_batch (const std::vector<byte_image>& imgs,
+                                   std::size_t lo, std::size_t hi)
+{
+  TRACE_SPAN("pack_batch", "io");
+  const std::size_t input_size = img_dims.rows * img_dims.cols;
+  const std::size_t batch = hi - lo;
+  byte_image packed (input_size * batch);
+  for (std::size_t k = 0; k < batch; ++k)
+  {
+    const byte_image& img = imgs[lo + k];
+    if (img.size() != input_size)
+    {
+      throw std::length_error (IMAGE_SIZE_ERROR);
+    }
+    for (std::size_t i = 0; i < input_size; ++i)
+    {
+      packed[i * batch + k] = img[i];
+    }
+  }
+  return packed;
+}
+
+
+void MlpNetwork::store_classes (const Matrix& probs, std::size_t lo,
+                                std::vector<digit>& results)
+{
+  std::vector<mat_index> classes = probs.col_argmax();
+  for (mat_index k = 0; k < probs.get_cols(); ++k)
+  {
+    results[lo + k].value = (unsigned int) classes[k];
+    results[lo + k].probability = probs(classes[k], k);
+  }
+}
+
+
+std::vector<digit> MlpNetwork::predict_batch (const std::vector<Matrix>& imgs)
+const
+{
+  TRACE_SPAN("predict_batch", "batch");
+  std::vector<digit> results (imgs.size());
+  ThreadPool::shared().parallel_for (0, imgs.size(), _batch.chunk,
+      [this, &imgs, &results] (std::size_t lo, std::size_t hi)
+  {
+    TRACE_SPAN("batch chunk", "batch");
+    store_classes(forward(pack_batch(imgs, lo, hi)), lo, results);
+  }, _batch.threads);
+  return results;
+}
+
+
+std::vector<digit> MlpNetwork::predict_batch
+    (const std::vector<byte_image>& imgs) const
+{
+  TRACE_SPAN("predict_batch", "batch");
+  std::vector<digit> results (imgs.size());
+  ThreadPool::shared().parallel_for (0, imgs.size(), _batch.chunk,
+      [this, &imgs, &results] (std::size_t lo, std::size_t hi)
+  {
+    TRACE_SPAN("batch chunk", "batch");
+    store_classes(forward(pack_batch(imgs, lo, hi).data(), hi - lo), lo,
+                  results);
+  }, _batch.threads);
+  return results;
+}
+
+
+std::vector<digit> MlpNetwork::top_k (const Matrix& img, int k) const
+{
+  Matrix r4 = forward(img);
+  std::vector<digit> best;
+  for (int ind : r4.top_k(k))
+  {
+    best.push_back(digit{(unsigned int) ind, r4[ind]});
+  }
+  return best;
+}
+
+
+const Dense& MlpNetwork::get_layer (int i) const
+{
+  switch (i)
+  {
+    case 0: return _layer1;
+    case 1: return _layer2;
+    case 2: return _layer3;
+    case 3: return _layer4;
+    default: throw std::out_of_range (LAYER_INDEX_ERROR);
+  }
+}
+
+
+Dense& MlpNetwork::layer (int i)
+{
+  return const_cast<Dense&>(get_layer(i));
+}
+
+
+void MlpNetwork::set_layer (int i, const Dense& replacement)
+{
+  Dense& old = layer(i);
+  if (replacement.get_weights().get_rows() != old.get_weights().get_rows() ||
+      replacement.get_weights().get_cols() != old.get_weights().get_cols())
+  {
+    throw std::length_error (LAYER_SHAPE_ERROR);
+  }
+  old = replacement;
+}
+
+
+void MlpNetwork::set_kernel_config (int i, const dense_config& config)
+{
+  layer(i).set_kernel_config(config);
+}
+
+
+void MlpNetwork::set_batch_config (const batch_config& config)
+{
+  if (config.chunk <= 0 || config.threads < 0)
+  {
+    throw std::invalid_argument (BATCH_CONFIG_ERROR);
+  }
+  _batch = config;
+}
+
+
+batch_config MlpNetwork::get_batch_config () const
+{
+  return _batch;
+}
+
+
+void MlpNetwork::set_byte_normalization (const byte_normalization& norm)
+{
+  _byte_norm = norm;
+}
+
+
+byte_normalization MlpNetwork::get_byte_normalization () const
+{
+  return _byte_norm;
+}
+
+
+std::vector<MatrixPtr> MlpNetwork::get_buffers () const
+{
+  std::vector<MatrixPtr> buffers;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    std::vector<MatrixPtr> layer_buffers = get_layer(i).get_buffers();
+    buffers.insert(buffers.end(), layer_buffers.begin(), layer_buffers.end());
+  }
+  return buffers;
+}
+
+
+void MlpNetwork::register_memory (const std::string& name) const
+{
+  register_model(name, get_buffers());
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include "Dense.h"
 
 #define MLP_SIZE 4
+#define BATCH_CHUNK 64
+#define HIDDEN_ACTIVATION "relu"
+#define OUTPUT_ACTIVATION "softmax"
 
 /**
  * @struct digit
@@ -19,6 +22,20 @@ typedef struct digit {
 	float probability;
 } digit;
 
+/**
+ * @struct batch_config
+ * @brief Runtime parameters of MlpNetwork::predict_batch().
+ * @var chunk - images packed into each matrix product
+ * @var threads - most pool threads used, caller included; 0 for all
+ */
+typedef struct batch_config {
+	int chunk;
+	int threads;
+} batch_config;
+
+/**   typedefs  */
+typedef std::vector<std::uint8_t> byte_image;
+
 const matrix_dims img_dims = {28, 28};
 const matrix_dims weights_dims[] = {{128, 784},
 									{64,  128},
@@ -43,6 +60,21 @@ class MlpNetwork {
   Dense _layer2; /**< The second dense layer of the MLP network. */
   Dense _layer3; /**< The third dense layer of the MLP network. */
   Dense _layer4; /**< The forth dense layer of the MLP network. */
+  batch_config _batch = {BATCH_CHUNK, 0}; /**< predict_batch() parameters. */
+  byte_normalization _byte_norm = {BYTE_INPUT_SCALE, 0}; /**< How byte
+ * images map to the float inputs the first layer was trained on. */
+
+/**
+ * @brief Returns one of the network's dense layers for modification.
+ */
+  Dense& layer(int i);
+
+/**
+ * @brief Stores the most probable class of every column of a batch's
+ * output as results[lo + column].
+ */
+  static void store_classes(const Matrix& probs, std::size_t lo,
+                            std::vector<digit>& results);
 
 
  public:
@@ -55,6 +87,35 @@ class MlpNetwork {
  */
   MlpNetwork(Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE]);
 
+/**
+ * @brief Constructs an MLP network over shared, immutable weights and
+ * biases, without copying them.
+ *
+ * Any number of networks, in any threads, may be built over the same
+ * buffers. Copying an MlpNetwork shares its buffers as well.
+ *
+ * @param weights An array of weight buffers for each layer in the MLP
+ * network.
+ * @param biases An array of bias buffers for each layer in the MLP network.
+ */
+  MlpNetwork(const MatrixPtr weights[MLP_SIZE],
+             const MatrixPtr biases[MLP_SIZE]);
+
+/**
+ * @brief Constructs an MLP network over shared weights and biases with the
+ * activations a model file names for its layers.
+ *
+ * @param weights An array of weight buffers for each layer in the MLP
+ * network.
+ * @param biases An array of bias buffers for each layer in the MLP network.
+ * @param activations MLP_SIZE activation names, as accepted by
+ * activation::find(); the last layer normally uses "softmax".
+ * @throw std::invalid_argument if the count is wrong or a name is unknown.
+ */
+  MlpNetwork(const MatrixPtr weights[MLP_SIZE],
+             const MatrixPtr biases[MLP_SIZE],
+             const std::vector<std::string>& activations);
+
 /**
  * @brief Computes the output digit classification given an input image.
  *
@@ -62,6 +123,185 @@ class MlpNetwork {
  * @return The classified digit output.
  */
   digit operator()(Matrix& img)const;
+
+/**
+ * @brief Computes the output digit classification given a raw byte image.
+ *
+ * @param img The img_dims.rows * img_dims.cols pixels, row by row.
+ * @return The classified digit output.
+ * @throw std::length_error if the image has the wrong number of pixels.
+ */
+  digit operator()(const byte_image& img)const;
+
+/**
+ * @brief Runs the forward pass and returns the full output distribution.
+ *
+ * @param img One input image of any shape, or a batch of vectorized images
+ * stored as the columns of a (784 x batch) matrix.
+ * @return The softmax output, one column of class probabilities per image.
+ */
+  Matrix forward(const Matrix& img)const;
+
+/**
+ * @brief Runs the forward pass on raw byte images.
+ *
+ * The bytes are normalized with get_byte_normalization() inside the first
+ * layer's kernels, so no float copy of the input is made.
+ *
+ * @param pixels batch vectorized images stored as the columns of a
+ * (784 x batch) row-major byte buffer; for one image, simply its pixels.
+ * @param batch The number of images.
+ * @return The softmax output, one column of class probabilities per image.
+ */
+  Matrix forward(const std::uint8_t* pixels, mat_index batch)const;
+
+/**
+ * @brief Runs the layers up to and including last, e.g. to take the
+ * features a later layer sees.
+ *
+ * @param last The zero-based index of the last layer to run.
+ * @param img One input image of any shape, or a batch of vectorized images
+ * stored as columns.
+ * @return The output of layer last, one column per image.
+ * @throw std::out_of_range if last is not a valid layer index.
+ */
+  Matrix forward_to(int last, const Matrix& img)const;
+
+/**
+ * @brief Runs the layers from first onward on the output of the layer
+ * before it, e.g. from cached or incrementally updated activations.
+ *
+ * @param first The zero-based index of the first layer to run.
+ * @param activations The input of that layer, or a batch of them stored
+ * as columns.
+ * @return The softmax output, one column of class probabilities per input.
+ * @throw std::out_of_range if first is not a valid layer index.
+ */
+  Matrix forward_from(int first, const Matrix& activations)const;
+
+/**
+ * @brief Classifies a batch of images.
+ *
+ * Images are packed get_batch_config().chunk (BATCH_CHUNK by default) at a
+ * time into the columns of one matrix, so each layer runs as a single matrix
+ * product per chunk, and chunks run in parallel on the shared thread pool.
+ *
+ * @param imgs The input images, each of any shape holding
+ * img_dims.rows * img_dims.cols elements.
+ * @return One classified digit per image, in order.
+ */
+  std::vector<digit> predict_batch(const std::vector<Matrix>& imgs)const;
+
+/**
+ * @brief Classifies a batch of raw byte images, like predict_batch() on
+ * floats, reading a quarter of the input bytes.
+ *
+ * @param imgs The input images, each holding img_dims.rows * img_dims.cols
+ * pixels.
+ * @return One classified digit per image, in order.
+ */
+  std::vector<digit> predict_batch(const std::vector<byte_image>& imgs)const;
+
+/**
+ * @brief Packs a range of images into the columns of one input matrix.
+ *
+ * @param imgs The input images, each holding img_dims.rows * img_dims.cols
+ * elements.
+ * @param lo The first image of the range.
+ * @param hi One past the last image of the range.
+ * @return A (784 x (hi - lo)) matrix whose column k is image lo + k.
+ * @throw std::length_error if an image has the wrong number of elements.
+ */
+  static Matrix pack_batch(const std::vector<Matrix>& imgs,
+                           std::size_t lo, std::size_t hi);
+
+/**
+ * @brief Packs a range of byte images into the columns of one
+ * (784 x (hi - lo)) row-major byte buffer.
+ *
+ * @throw std::length_error if an image has the wrong number of pixels.
+ */
+  static byte_image pack_batch(const std::vector<byte_image>& imgs,
+                               std::size_t lo, std::size_t hi);
+
+/**
+ * @brief Returns the k most probable digits for an input image.
+ *
+ * @param img The input image matrix.
+ * @param k The number of candidates, in [1, 10].
+ * @return The k digits with their probabilities, most probable first.
+ */
+  std::vector<digit> top_k(const Matrix& img, int k)const;
+
+/**
+ * @brief Returns one of the network's dense layers.
+ *
+ * @param i The zero-based layer index, in [0, MLP_SIZE).
+ * @return A const reference to the i'th layer.
+ * @throw std::out_of_range if i is not a valid layer index.
+ */
+  const Dense& get_layer(int i)const;
+
+/**
+ * @brief Replaces one of the network's dense layers, e.g. with a factored
+ * approximation of it.
+ *
+ * @param i The zero-based layer index, in [0, MLP_SIZE).
+ * @param replacement The new layer; its weights must have the shape of the
+ * old one's.
+ * @throw std::out_of_range if i is not a valid layer index.
+ * @throw std::length_error if the shapes differ.
+ */
+  void set_layer(int i, const Dense& replacement);
+
+/**
+ * @brief Sets the kernel parameters of one layer.
+ *
+ * @param i The zero-based layer index, in [0, MLP_SIZE).
+ * @param config The parameters.
+ * @throw std::out_of_range if i is not a valid layer index.
+ * @throw std::invalid_argument if a parameter is out of range.
+ */
+  void set_kernel_config(int i, const dense_config& config);
+
+/**
+ * @brief Sets the chunk size and thread count of predict_batch().
+ *
+ * @param config The parameters.
+ * @throw std::invalid_argument if chunk is not positive or threads is
+ * negative.
+ */
+  void set_batch_config(const batch_config& config);
+
+/**
+ * @brief Returns the parameters of predict_batch().
+ */
+  batch_config get_batch_config()const;
+
+/**
+ * @brief Sets how byte images are normalized; the default,
+ * {BYTE_INPUT_SCALE, 0}, maps pixels to [0, 1] like the float inputs.
+ *
+ * @param norm The byte to float mapping.
+ */
+  void set_byte_normalization(const byte_normalization& norm);
+
+/**
+ * @brief Returns how byte images are normalized.
+ */
+  byte_normalization get_byte_normalization()const;
+
+/**
+ * @brief Returns every shared buffer the network's layers hold.
+ */
+  std::vector<MatrixPtr> get_buffers()const;
+
+/**
+ * @brief Lists the network in memory_report() under the given name.
+ *
+ * @param name The model name.
+ */
+  void register_memory(const std::string& name)const;
 };
 
 #endif // MLPNETWORK_H
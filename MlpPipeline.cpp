@@ -0,0 +1,318 @@
+#include "MlpPipeline.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#define STAGE_LAYERS_ERROR "Error: pipeline stage sizes must be positive and " \
+                           "sum to MLP_SIZE"
+#define STAGE_CORES_ERROR "Error: pipeline needs one core entry per stage"
+#define IMAGE_SIZE_ERROR "Error: image size does not match the network input"
+
+typedef std::chrono::steady_clock pipeline_clock;
+
+struct MlpPipeline::Stage
+{
+  std::thread thread;
+  int first_layer; // 0-based
+  int last_layer; // 0-based, inclusive
+  int core;
+  pipeline_clock::time_point start;
+  std::atomic<unsigned long long> items {0};
+  std::atomic<unsigned long long> busy_ns {0};
+  std::exception_ptr setup_error; // what copying the layers threw, if any
+};
+
+/**
+ * @brief Waits for a queue to change: yields PIPELINE_SPIN_LIMIT times, then
+ * sleeps, doubling the sleep up to PIPELINE_MAX_SLEEP_US.
+ */
+struct queue_backoff
+{
+  int _spins = 0;
+  int _sleep_us = 1;
+
+  void pause ()
+  {
+    if (_spins < PIPELINE_SPIN_LIMIT)
+    {
+      _spins++;
+      std::this_thread::yield ();
+      return;
+    }
+    std::this_thread::sleep_for (std::chrono::microseconds (_sleep_us));
+    _sleep_us = std::min (_sleep_us * 2, PIPELINE_MAX_SLEEP_US);
+  }
+
+  void reset ()
+  {
+    _spins = 0;
+    _sleep_us = 1;
+  }
+};
+
+MlpPipeline::MlpPipeline (const MlpNetwork& mlp,
+                          const std::vector<int>& stage_layers,
+                          const std::vector<int>& cores,
+                          std::size_t queue_capacity)
+    : _input_size (mlp.get_layer (0).get_weights ().get_cols ()), _stop (false)
+{
+  std::vector<int> sizes = stage_layers;
+  if (sizes.empty ())
+  {
+    sizes.assign (MLP_SIZE, 1);
+  }
+  int total = 0;
+  for (int size : sizes)
+  {
+    if (size <= 0)
+    {
+      throw std::invalid_argument (STAGE_LAYERS_ERROR);
+    }
+    total += size;
+  }
+  if (total != MLP_SIZE)
+  {
+    throw std::invalid_argument (STAGE_LAYERS_ERROR);
+  }
+  if (!cores.empty () && cores.size () != sizes.size ())
+  {
+    throw std::invalid_argument (STAGE_CORES_ERROR);
+  }
+
+  int hw_cores = (int) std::thread::hardware_concurrency ();
+  int layer = 0;
+  for (std::size_t s = 0; s < sizes.size (); ++s)
+  {
+    std::unique_ptr<Stage> stage (new Stage);
+    stage->first_layer = layer;
+    stage->last_layer = layer + sizes[s] - 1;
+    if (!cores.empty ())
+    {
+      stage->core = cores[s];
+    }
+    else
+    {
+      stage->core = ((int) s < hw_cores) ? (int) s : NO_CORE;
+    }
+    // the queue feeding this stage carries the first layer's input vector
+    int in_rows = mlp.get_layer (layer).get_weights ().get_cols ();
+    _queues.emplace_back (new SpscQueue<Item> (
+        queue_capacity, Item {Matrix (in_rows, 1), {0, 0}, nullptr}));
+    _stages.push_back (std::move (stage));
+    layer += sizes[s];
+  }
+  _results.reset (new SpscQueue<Item> (queue_capacity));
+
+  // stages copy their layers from mlp inside their own thread; wait for all
+  // of them so the caller may destroy mlp as soon as we return
+  std::mutex ready_mutex;
+  std::condition_variable ready_cv;
+  std::size_t ready = 0;
+  for (std::size_t s = 0; s < _stages.size (); ++s)
+  {
+    _stages[s]->thread = std::thread ([this, s, &mlp, &ready_mutex,
+                                       &ready_cv, &ready] ()
+    {
+      pin_current_thread (_stages[s]->core);
+      std::vector<Dense> layers;
+      try
+      {
+        for (int l = _stages[s]->first_layer; l <= _stages[s]->last_layer;
+             ++l)
+        {
+          layers.push_back (mlp.get_layer (l).clone ());
+        }
+      }
+      catch (...)
+      {
+        _stages[s]->setup_error = std::current_exception ();
+      }
+      _stages[s]->start = pipeline_clock::now ();
+      {
+        std::lock_guard<std::mutex> lock (ready_mutex);
+        ready++;
+      }
+      ready_cv.notify_one ();
+      if (_stages[s]->setup_error)
+      {
+        return;
+      }
+
+      SpscQueue<Item>& in_q = *_queues[s];
+      bool last = (s + 1 == _stages.size ());
+      SpscQueue<Item>& out_q = last ? *_results : *_queues[s + 1];
+      Item item {Matrix (layers.front ().get_weights ().get_cols (), 1),
+                 {0, 0}, nullptr};
+      queue_backoff backoff;
+      while (!_stop.load (std::memory_order_relaxed))
+      {
+        if (!in_q.try_pop (item))
+        {
+          backoff.pause ();
+          continue;
+        }
+        backoff.reset ();
+        // an input that failed upstream passes through untouched
+        if (!item.error)
+        {
+          pipeline_clock::time_point t0 = pipeline_clock::now ();
+          try
+          {
+            TRACE_SPAN("pipeline stage", "pipeline");
+            item.vec.vectorize ();
+            for (const Dense& dense : layers)
+            {
+              item.vec = dense (item.vec);
+            }
+            if (last)
+            {
+              item.result.value = item.vec.argmax ();
+              item.result.probability = item.vec[(int) item.result.value];
+            }
+          }
+          catch (...)
+          {
+            item.error = std::current_exception ();
+          }
+          _stages[s]->busy_ns.fetch_add (
+              std::chrono::duration_cast<std::chrono::nanoseconds> (
+                  pipeline_clock::now () - t0).count (),
+              std::memory_order_relaxed);
+          _stages[s]->items.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        while (!out_q.try_push (item)
+               && !_stop.load (std::memory_order_relaxed))
+        {
+          backoff.pause ();
+        }
+        backoff.reset ();
+        item.error = nullptr;
+      }
+    });
+  }
+  std::unique_lock<std::mutex> lock (ready_mutex);
+  ready_cv.wait (lock, [&ready, this] () { return ready == _stages.size (); });
+  lock.unlock ();
+  for (std::unique_ptr<Stage>& stage : _stages)
+  {
+    if (stage->setup_error)
+    {
+      // the destructor does not run for a failed constructor
+      stop ();
+      std::rethrow_exception (stage->setup_error);
+    }
+  }
+}
+
+
+MlpPipeline::~MlpPipeline ()
+{
+  stop ();
+}
+
+
+void MlpPipeline::stop ()
+{
+  _stop.store (true);
+  for (std::unique_ptr<Stage>& stage : _stages)
+  {
+    if (stage->thread.joinable ())
+    {
+      stage->thread.join ();
+    }
+  }
+}
+
+
+bool MlpPipeline::try_submit (const Matrix& img)
+{
+  if (img.get_rows () * img.get_cols () != _input_size)
+  {
+    throw std::length_error (IMAGE_SIZE_ERROR);
+  }
+  _submitted.vec = img;
+  return _queues.front ()->try_push (_submitted);
+}
+
+
+void MlpPipeline::submit (const Matrix& img)
+{
+  queue_backoff backoff;
+  while (!try_submit (img))
+  {
+    backoff.pause ();
+  }
+}
+
+
+bool MlpPipeline::try_get (digit& out)
+{
+  if (!_results->try_pop (_received))
+  {
+    return false;
+  }
+  if (_received.error)
+  {
+    std::exception_ptr error = _received.error;
+    _received.error = nullptr;
+    std::rethrow_exception (error);
+  }
+  out = _received.result;
+  return true;
+}
+
+
+digit MlpPipeline::get ()
+{
+  digit out {0, 0};
+  queue_backoff backoff;
+  while (!try_get (out))
+  {
+    backoff.pause ();
+  }
+  return out;
+}
+
+
+int MlpPipeline::stages () const
+{
+  return (int) _stages.size ();
+}
+
+
+std::vector<stage_stats> MlpPipeline::get_stats () const
+{
+  std::vector<stage_stats> stats;
+  pipeline_clock::time_point now = pipeline_clock::now ();
+  for (const std::unique_ptr<Stage>& stage : _stages)
+  {
+    stage_stats st;
+    st.first_layer = stage->first_layer + 1;
+    st.last_layer = stage->last_layer + 1;
+    st.core = stage->core;
+    st.items = stage->items.load (std::memory_order_relaxed);
+    st.busy_sec = stage->busy_ns.load (std::memory_order_relaxed) * 1e-9;
+    st.wall_sec = std::chrono::duration<double> (now - stage->start).count ();
+    st.utilization = (st.wall_sec > 0) ? st.busy_sec / st.wall_sec : 0;
+    stats.push_back (st);
+  }
+  return stats;
+}
+
+
+int MlpPipeline::bottleneck_stage () const
+{
+  std::vector<stage_stats> stats = get_stats ();
+  int worst = 0;
+  for (int s = 1; s < (int) stats.size (); ++s)
+  {
+    if (stats[s].busy_sec > stats[worst].busy_sec)
+    {
+      worst = s;
+    }
+  }
+  return worst;
+}
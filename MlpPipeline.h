@@ -0,0 +1,170 @@
+// MlpPipeline.h
+#ifndef MLPPIPELINE_H
+#define MLPPIPELINE_H
+
+#include "MlpNetwork.h"
+#include "Numa.h"
+#include "SpscQueue.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+#define PIPELINE_QUEUE_CAPACITY 64
+#define PIPELINE_SPIN_LIMIT 1024
+#define PIPELINE_MAX_SLEEP_US 200
+
+/**
+ * @struct stage_stats
+ * @brief Utilization snapshot of a single pipeline stage.
+ * @var first_layer - first layer (1-based) the stage runs
+ * @var last_layer - last layer (1-based, inclusive) the stage runs
+ * @var core - the core the stage is pinned to, or NO_CORE
+ * @var items - number of inputs the stage has completed
+ * @var busy_sec - seconds spent computing
+ * @var wall_sec - seconds since the pipeline started
+ * @var utilization - busy_sec / wall_sec, in [0, 1]
+ */
+typedef struct stage_stats {
+	int first_layer, last_layer;
+	int core;
+	unsigned long long items;
+	double busy_sec, wall_sec, utilization;
+} stage_stats;
+
+/**
+ * @class MlpPipeline
+ * @brief Layer-pipelined streaming execution of an MlpNetwork.
+ *
+ * Every stage runs one or more consecutive Dense layers on its own thread,
+ * optionally pinned to a core. Each stage deep-copies (Dense::clone) its
+ * layers from within its own thread, so the weights are first touched (and
+ * stay resident) on the core that uses them. Activations flow between stages through lock-free
+ * SpscQueue's, so for a stream of batch-size-1 inputs all stages work
+ * concurrently and throughput is bounded by the slowest stage rather than by
+ * the sum of all layers. get_stats() exposes per-stage utilization to find
+ * that stage and rebalance the grouping.
+ *
+ * submit() may be called from a single producer thread and get() from a
+ * single consumer thread (possibly the same one). Results come out in
+ * submission order; an exception a stage throws for an input travels down
+ * the pipeline in its place and is rethrown by get(). A thread waiting on an
+ * empty or full queue spins PIPELINE_SPIN_LIMIT times, then sleeps in
+ * growing steps of up to PIPELINE_MAX_SLEEP_US, so an idle pipeline does not
+ * keep its cores busy.
+ */
+class MlpPipeline {
+
+ private:
+  struct Stage; /**< Per-stage thread state, defined in MlpPipeline.cpp. */
+
+/**
+ * @struct Item
+ * @brief What flows between stages: an activation vector and, for the last
+ * stage's output, the result; or the exception raised for the input.
+ */
+  struct Item {
+    Matrix vec;
+    digit result;
+    std::exception_ptr error;
+  };
+
+  std::vector<std::unique_ptr<SpscQueue<Item> > > _queues; /**< _queues[s]
+ * feeds stage s. */
+  std::unique_ptr<SpscQueue<Item> > _results; /**< Output of the last
+ * stage. */
+  mat_index _input_size; /**< Elements of an input image. */
+  Item _submitted; /**< Producer-side scratch, reused by every submit. */
+  Item _received; /**< Consumer-side scratch, reused by every get. */
+  std::vector<std::unique_ptr<Stage> > _stages; /**< The pipeline stages. */
+  std::atomic<bool> _stop; /**< Set to ask every stage to exit. */
+
+/**
+ * @brief Asks every stage to exit and joins their threads.
+ */
+  void stop ();
+
+ public:
+/**
+ * @brief Builds the pipeline and starts one thread per stage.
+ *
+ * @param mlp The network to run. Its layers are copied, so it need not
+ * outlive the pipeline.
+ * @param stage_layers stage_layers[s] is the number of consecutive layers
+ * stage s runs; the entries must sum to MLP_SIZE. Empty means one layer per
+ * stage.
+ * @param cores cores[s] is the core stage s is pinned to, or NO_CORE. Empty
+ * means stage s is pinned to core s when that core exists.
+ * @param queue_capacity Maximal number of in-flight inputs between stages.
+ * @throw std::invalid_argument if stage_layers or cores are malformed.
+ * Whatever copying a layer throws is rethrown after all stages stopped.
+ */
+  explicit MlpPipeline (const MlpNetwork& mlp,
+                        const std::vector<int>& stage_layers = {},
+                        const std::vector<int>& cores = {},
+                        std::size_t queue_capacity = PIPELINE_QUEUE_CAPACITY);
+
+/**
+ * @brief Stops and joins all stage threads. In-flight inputs are dropped.
+ */
+  ~MlpPipeline ();
+
+  MlpPipeline (const MlpPipeline&) = delete;
+  MlpPipeline& operator= (const MlpPipeline&) = delete;
+
+/**
+ * @brief Feeds an image into the pipeline without blocking.
+ *
+ * @param img The input image, any shape with img_dims.rows * img_dims.cols
+ * elements.
+ * @return false if the first stage's queue is full.
+ * @throw std::length_error if the image size does not match the network
+ * input.
+ */
+  bool try_submit (const Matrix& img);
+
+/**
+ * @brief Feeds an image into the pipeline, waiting while it is full.
+ *
+ * @param img The input image.
+ * @throw std::length_error if the image size does not match the network
+ * input.
+ */
+  void submit (const Matrix& img);
+
+/**
+ * @brief Retrieves the next classification without blocking.
+ *
+ * @param out Receives the result.
+ * @return false if no result is ready.
+ * @throw Whatever a stage threw for that input; the input is consumed.
+ */
+  bool try_get (digit& out);
+
+/**
+ * @brief Retrieves the next classification, waiting until it is ready.
+ *
+ * @return The classified digit of the oldest outstanding input.
+ * @throw Whatever a stage threw for that input; the input is consumed.
+ */
+  digit get ();
+
+/**
+ * @brief Returns the number of stages.
+ */
+  int stages () const;
+
+/**
+ * @brief Returns a utilization snapshot of every stage.
+ */
+  std::vector<stage_stats> get_stats () const;
+
+/**
+ * @brief Returns the index of the most utilized stage, the one to split or
+ * give fewer layers when rebalancing.
+ */
+  int bottleneck_stage () const;
+};
+
+#endif //MLPPIPELINE_H
@@ -0,0 +1,323 @@
+#include "ModelCodegen.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define VALUES_PER_LINE 6
+#define UNSUPPORTED_ACTIVATION_ERROR "Error: codegen supports only relu and " \
+                                     "softmax activations, layer: "
+#define NON_FINITE_ERROR "Error: codegen found a non-finite parameter in layer: "
+
+/**
+ * @brief Formats a float as a C++ literal that parses back to the same
+ * value (9 significant digits round-trip every float).
+ */
+static std::string float_literal (float v)
+{
+  char buf[32];
+  std::snprintf (buf, sizeof (buf), "%.9g", (double) v);
+  std::string lit (buf);
+  if (lit.find_first_of (".e") == std::string::npos)
+  {
+    lit += ".0";
+  }
+  return lit + "f";
+}
+
+
+/**
+ * @brief Writes a constexpr float array definition.
+ */
+static void emit_array (std::ostream& out, const std::string& name,
+                        const std::vector<float>& values, int layer)
+{
+  out << "alignas(64) static constexpr float " << name << "["
+      << values.size () << "] = {";
+  for (std::size_t i = 0; i < values.size (); ++i)
+  {
+    if (!std::isfinite (values[i]))
+    {
+      throw std::invalid_argument (NON_FINITE_ERROR + std::to_string (layer));
+    }
+    out << ((i % VALUES_PER_LINE == 0) ? "\n  " : " ")
+        << float_literal (values[i]) << ",";
+  }
+  out << "\n};\n\n";
+}
+
+
+/**
+ * @brief The activations a kernel can apply: relu and softmax for the
+ * network's layers, identity for the inner factor of a factored layer.
+ */
+enum emitted_activation
+{
+  EMIT_IDENTITY,
+  EMIT_RELU,
+  EMIT_SOFTMAX
+};
+
+
+/**
+ * @brief Emits the statements that accumulate one panel of W * in into
+ * acc<u>_<r>, unroll input columns per step, and sum the accumulator sets
+ * into acc0_<r>: the order of Dense::packed_gemv<unroll>.
+ */
+static void emit_packed_accumulation (std::ostream& out, const std::string& w,
+                                      mat_index cols, int unroll)
+{
+  const std::string panel_col = w + " + (p * " + std::to_string (cols)
+                                + " + j";
+  const std::string stride = ") * " + std::to_string (DENSE_PANEL_ROWS);
+  for (int u = 0; u < unroll; ++u)
+  {
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "    float acc" << u << "_" << r << " = 0;\n";
+    }
+  }
+  if (unroll == 1)
+  {
+    out << "    for (int j = 0; j < " << cols << "; ++j)\n    {\n"
+        << "      const float x = in[j];\n"
+        << "      const float* col = " << panel_col << stride << ";\n";
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "      acc0_" << r << " += x * col[" << r << "];\n";
+    }
+    out << "    }\n";
+    return;
+  }
+  out << "    int j = 0;\n"
+      << "    for (; j + " << unroll << " <= " << cols << "; j += " << unroll
+      << ")\n    {\n";
+  for (int u = 0; u < unroll; ++u)
+  {
+    out << "      {\n"
+        << "        const float x = in[j + " << u << "];\n"
+        << "        const float* col = " << panel_col << " + " << u << stride
+        << ";\n";
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "        acc" << u << "_" << r << " += x * col[" << r << "];\n";
+    }
+    out << "      }\n";
+  }
+  out << "    }\n";
+  if (cols % unroll != 0)
+  {
+    out << "    for (; j < " << cols << "; ++j)\n    {\n"
+        << "      const float x = in[j];\n"
+        << "      const float* col = " << panel_col << stride << ";\n";
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "      acc0_" << r << " += x * col[" << r << "];\n";
+    }
+    out << "    }\n";
+  }
+  for (int u = 1; u < unroll; ++u)
+  {
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "    acc0_" << r << " += acc" << u << "_" << r << ";\n";
+    }
+  }
+}
+
+
+/**
+ * @brief Emits one panel kernel: weights and bias arrays W<id> and B<id>
+ * plus a function layer<id> computing out = activation(W * in + b) for one
+ * input vector, as Dense does with the given sparse cutoff and unroll.
+ */
+static void emit_kernel (std::ostream& out, const std::string& id,
+                         const Matrix& w, const Matrix& b,
+                         emitted_activation act, float cutoff, int unroll,
+                         int layer)
+{
+  const mat_index rows = w.get_rows ();
+  const mat_index cols = w.get_cols ();
+  const int panels = (rows + DENSE_PANEL_ROWS - 1) / DENSE_PANEL_ROWS;
+
+  // same layout as Dense::pack_weights; the bias is padded to whole panels
+  std::vector<float> packed ((std::size_t) panels * cols * DENSE_PANEL_ROWS,
+                             0);
+  std::vector<float> bias ((std::size_t) panels * DENSE_PANEL_ROWS, 0);
+  for (int i = 0; i < rows; ++i)
+  {
+    for (int j = 0; j < cols; ++j)
+    {
+      packed[((std::size_t) (i / DENSE_PANEL_ROWS) * cols + j) *
+             DENSE_PANEL_ROWS + i % DENSE_PANEL_ROWS] = w (i, j);
+    }
+    bias[i] = b[i];
+  }
+  static const char* const names[] = {"identity", "relu", "softmax"};
+  out << "// layer " << id << ": " << rows << " x " << cols << ", "
+      << names[act] << ", unroll " << unroll << "\n";
+  emit_array (out, "W" + id, packed, layer);
+  emit_array (out, "B" + id, bias, layer);
+
+  out << "static inline void layer" << id
+      << " (const float* in, float* out)\n{\n";
+  std::string panel_loop = "  for (int p = 0; p < " + std::to_string (panels)
+                           + "; ++p)\n  {\n";
+  std::string store =
+      "    const int count = (" + std::to_string (rows) + " - p * "
+      + std::to_string (DENSE_PANEL_ROWS) + " < "
+      + std::to_string (DENSE_PANEL_ROWS) + ") ? " + std::to_string (rows)
+      + " - p * " + std::to_string (DENSE_PANEL_ROWS) + " : "
+      + std::to_string (DENSE_PANEL_ROWS) + ";\n";
+  for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+  {
+    store += "    if (" + std::to_string (r) + " < count) out[p * "
+             + std::to_string (DENSE_PANEL_ROWS) + " + " + std::to_string (r)
+             + "] = acc0_" + std::to_string (r) + " + B" + id + "[p * "
+             + std::to_string (DENSE_PANEL_ROWS) + " + " + std::to_string (r)
+             + "];\n";
+  }
+  if (cutoff != SPARSE_DISABLED)
+  {
+    // Dense::sparse_gemv: add the nonzero columns from zero, then the bias
+    out << "  int nonzeros = 0;\n"
+        << "  for (int j = 0; j < " << cols << "; ++j)\n  {\n"
+        << "    nonzeros += (in[j] != 0);\n  }\n"
+        << "  if (nonzeros <= " << float_literal (cutoff) << " * " << cols
+        << ")\n  {\n" << panel_loop;
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "    float acc0_" << r << " = 0;\n";
+    }
+    out << "    for (int j = 0; j < " << cols << "; ++j)\n    {\n"
+        << "      const float x = in[j];\n"
+        << "      if (x == 0)\n      {\n        continue;\n      }\n"
+        << "      const float* col = W" << id << " + (p * " << cols
+        << " + j) * " << DENSE_PANEL_ROWS << ";\n";
+    for (int r = 0; r < DENSE_PANEL_ROWS; ++r)
+    {
+      out << "      acc0_" << r << " += x * col[" << r << "];\n";
+    }
+    out << "    }\n" << store << "  }\n  }\n  else\n  {\n";
+  }
+  // Dense::packed_gemv: accumulate from zero, add the bias at the end
+  out << panel_loop;
+  emit_packed_accumulation (out, "W" + id, cols, unroll);
+  out << store << "  }\n";
+  if (cutoff != SPARSE_DISABLED)
+  {
+    out << "  }\n";
+  }
+
+  if (act == EMIT_RELU)
+  {
+    out << "  for (int i = 0; i < " << rows << "; ++i)\n  {\n"
+        << "    out[i] = (out[i] >= 0) ? out[i] : 0;\n  }\n";
+  }
+  else if (act == EMIT_SOFTMAX)
+  {
+    // activation::softmax on one column: shift by the first maximum, sum
+    // the exponentials in row order, scale by the reciprocal
+    out << "  int max_ind = 0;\n"
+        << "  for (int i = 1; i < " << rows << "; ++i)\n  {\n"
+        << "    if (out[i] > out[max_ind])\n    {\n      max_ind = i;\n"
+        << "    }\n  }\n"
+        << "  const float max_val = out[max_ind];\n"
+        << "  float sum = 0;\n"
+        << "  for (int i = 0; i < " << rows << "; ++i)\n  {\n"
+        << "    out[i] = std::exp (out[i] - max_val);\n"
+        << "    sum += out[i];\n  }\n"
+        << "  const float scale = 1 / sum;\n"
+        << "  for (int i = 0; i < " << rows << "; ++i)\n  {\n"
+        << "    out[i] *= scale;\n  }\n";
+  }
+  out << "}\n\n";
+}
+
+
+/**
+ * @brief Emits the kernel of one layer with its kernel parameters; a
+ * factored layer becomes two kernels, its inner factor (with the sparse
+ * path) and then its outer one, as Dense runs them.
+ */
+static void emit_layer (std::ostream& out, const Dense& dense, int layer)
+{
+  const bool relu = dense.get_activation () == activation::relu;
+  const bool softmax = dense.get_activation () == activation::softmax;
+  if (!relu && !softmax)
+  {
+    throw std::invalid_argument (UNSUPPORTED_ACTIVATION_ERROR +
+                                 std::to_string (layer));
+  }
+  const emitted_activation act = relu ? EMIT_RELU : EMIT_SOFTMAX;
+  const int unroll = dense.get_kernel_config ().gemv_unroll;
+  const std::string id = std::to_string (layer);
+  std::shared_ptr<const Dense> projection = dense.get_projection ();
+  if (!projection)
+  {
+    emit_kernel (out, id, dense.get_weights (), dense.get_bias (), act,
+                 dense.get_sparse_cutoff (), unroll, layer);
+    return;
+  }
+  emit_kernel (out, id + "_inner", projection->get_weights (),
+               projection->get_bias (), EMIT_IDENTITY,
+               projection->get_sparse_cutoff (),
+               projection->get_kernel_config ().gemv_unroll, layer);
+  emit_kernel (out, id + "_outer", *dense.get_outer_factor (),
+               dense.get_bias (), act, SPARSE_DISABLED, unroll, layer);
+  out << "static inline void layer" << id
+      << " (const float* in, float* out)\n{\n"
+      << "  alignas(64) float inner[" << dense.get_rank () << "];\n"
+      << "  layer" << id << "_inner (in, inner);\n"
+      << "  layer" << id << "_outer (inner, out);\n}\n\n";
+}
+
+
+void generate_model_source (const MlpNetwork& mlp, std::ostream& out,
+                            const std::string& name)
+{
+  int widths[MLP_SIZE + 1];
+  widths[0] = mlp.get_layer (0).get_weights ().get_cols ();
+  for (int l = 0; l < MLP_SIZE; ++l)
+  {
+    widths[l + 1] = mlp.get_layer (l).get_weights ().get_rows ();
+  }
+
+  out << "// " << name << ".cpp\n"
+      << "// Generated by mlpcodegen from a trained MlpNetwork, do not edit.\n"
+      << "// Topology:";
+  for (int l = 0; l <= MLP_SIZE; ++l)
+  {
+    out << (l ? "-" : " ") << widths[l];
+  }
+  out << "\n#include <cmath>\n\n"
+      << "namespace " << name << "_detail\n{\n\n";
+  for (int l = 0; l < MLP_SIZE; ++l)
+  {
+    emit_layer (out, mlp.get_layer (l), l + 1);
+  }
+  out << "} // namespace " << name << "_detail\n\n";
+
+  out << "void " << name << "_forward (const float* input, float* probs)\n"
+      << "{\n  using namespace " << name << "_detail;\n";
+  for (int l = 1; l < MLP_SIZE; ++l)
+  {
+    out << "  alignas(64) float a" << l << "[" << widths[l] << "];\n";
+  }
+  out << "  layer1 (input, a1);\n";
+  for (int l = 2; l < MLP_SIZE; ++l)
+  {
+    out << "  layer" << l << " (a" << l - 1 << ", a" << l << ");\n";
+  }
+  out << "  layer" << MLP_SIZE << " (a" << MLP_SIZE - 1 << ", probs);\n}\n\n";
+
+  out << "unsigned int " << name
+      << "_predict (const float* input, float* probability)\n{\n"
+      << "  float probs[" << widths[MLP_SIZE] << "];\n"
+      << "  " << name << "_forward (input, probs);\n"
+      << "  unsigned int best = 0;\n"
+      << "  for (unsigned int i = 1; i < " << widths[MLP_SIZE] << "; ++i)\n"
+      << "  {\n    if (probs[i] > probs[best])\n    {\n      best = i;\n"
+      << "    }\n  }\n"
+      << "  *probability = probs[best];\n"
+      << "  return best;\n}\n";
+}
@@ -0,0 +1,45 @@
+// ModelCodegen.h
+#ifndef MODELCODEGEN_H
+#define MODELCODEGEN_H
+
+#include "MlpNetwork.h"
+#include <ostream>
+#include <string>
+
+#define CODEGEN_DEFAULT_NAME "mlp_model"
+
+/**
+ * @brief Emits a self-contained C++ source file that computes the same
+ * function as the given network, with no parameter files at run time.
+ *
+ * Every weight and bias becomes an alignas(64) static constexpr array, in
+ * the same panel-interleaved layout Dense packs its weights into, and every
+ * layer becomes a kernel whose shapes are literal constants and whose
+ * DENSE_PANEL_ROWS accumulators are unrolled by hand. Each kernel performs
+ * the same floating-point operations in the same order as Dense does for a
+ * single input vector under the layer's current configuration: its
+ * gemv_unroll accumulator sets, the sparse-input path and its density
+ * cutoff, and for a factored layer the inner and then the outer product.
+ * So with the same compiler flags the generated predictor reproduces
+ * MlpNetwork::forward on one image bit for bit, as the network is
+ * configured when it is baked (apply a tuning first to bake it in);
+ * predict_batch's batch kernel sums in another order and agrees only up to
+ * rounding.
+ *
+ * The emitted file has no includes other than <cmath> and defines:
+ *   void NAME_forward (const float* input, float* probs);
+ *   unsigned int NAME_predict (const float* input, float* probability);
+ * where input holds the img_dims.rows * img_dims.cols pixels and probs
+ * receives the output distribution.
+ *
+ * @param mlp The network to bake in.
+ * @param out The stream the source is written to.
+ * @param name Prefix of the emitted functions, a valid C++ identifier.
+ * @throw std::invalid_argument if a layer uses an activation function other
+ * than activation::relu or activation::softmax, or a parameter is not
+ * finite.
+ */
+void generate_model_source (const MlpNetwork& mlp, std::ostream& out,
+                            const std::string& name = CODEGEN_DEFAULT_NAME);
+
+#endif //MODELCODEGEN_H
@@ -0,0 +1,319 @@
+#include "ModelHandle.h"
+#include "ModelIO.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+#define HANDLE_NULL_ERROR "Error: ModelHandle needs a model"
+#define HANDLE_OUTPUT_ERROR "Error: candidate model gives a non-finite or " \
+                            "misshaped output"
+#define HANDLE_VALIDATION_ERROR "Error: candidate model rejected: "
+#define HANDLE_PATHS_ERROR "Error: reload needs the weights and biases of " \
+                           "every layer"
+
+
+/**
+ * @brief Throws unless a network maps an image to one finite output per
+ * class.
+ */
+static void check_outputs (const MlpNetwork& mlp)
+{
+  Matrix probe (img_dims.rows * img_dims.cols, 1);
+  Matrix out = mlp.forward (probe);
+  bool valid = out.get_rows () == weights_dims[MLP_SIZE - 1].rows &&
+               out.get_cols () == 1;
+  for (mat_index i = 0; valid && i < out.size (); ++i)
+  {
+    valid = std::isfinite (out[i]);
+  }
+  if (!valid)
+  {
+    throw std::invalid_argument (HANDLE_OUTPUT_ERROR);
+  }
+}
+
+
+ModelHandle::Reader::Reader (Slot* slot, const Version* version) :
+_slot (slot), _version (version)
+{
+}
+
+
+ModelHandle::Reader::Reader (Reader&& other) noexcept :
+_slot (other._slot), _version (other._version)
+{
+  other._slot = nullptr;
+}
+
+
+ModelHandle::Reader::~Reader ()
+{
+  if (_slot != nullptr)
+  {
+    _slot->held.store (nullptr, std::memory_order_release);
+  }
+}
+
+
+const MlpNetwork& ModelHandle::Reader::operator* () const
+{
+  return *_version->mlp;
+}
+
+
+const MlpNetwork* ModelHandle::Reader::operator-> () const
+{
+  return _version->mlp.get ();
+}
+
+
+std::uint64_t ModelHandle::Reader::version () const
+{
+  return _version->number;
+}
+
+
+ModelHandle::ModelHandle (std::shared_ptr<const MlpNetwork> mlp,
+                          model_validator validator) :
+_current (nullptr), _slots (new Slot[HANDLE_READER_SLOTS]),
+_validator (std::move (validator)), _cache (nullptr),
+_stats {0, 0, 0, 0, 0}
+{
+  for (int i = 0; i < HANDLE_READER_SLOTS; ++i)
+  {
+    _slots[i].held.store (nullptr);
+  }
+  publish (std::move (mlp));
+  _stats.publishes = 0;
+}
+
+
+ModelHandle::~ModelHandle ()
+{
+  for (const Version* version : _retired)
+  {
+    delete version;
+  }
+  delete _current.load ();
+}
+
+
+ModelHandle::Reader ModelHandle::read () const
+{
+  // each thread starts from the slot it last used, so threads spread over
+  // the slots and mostly find theirs free
+  thread_local std::size_t hint = std::hash<std::thread::id> () (
+      std::this_thread::get_id ());
+  for (std::size_t i = hint;; ++i)
+  {
+    if (i - hint == HANDLE_READER_SLOTS)
+    {
+      // every slot is taken: more concurrent readers than slots
+      std::this_thread::yield ();
+      hint = i;
+    }
+    Slot& slot = _slots[i % HANDLE_READER_SLOTS];
+    const Version* version = _current.load ();
+    const Version* empty = nullptr;
+    if (!slot.held.compare_exchange_strong (empty, version))
+    {
+      continue;
+    }
+    // the slot announced version before _current was read again; if it is
+    // still current, a publisher swapping it out afterwards will see the
+    // slot and keep it alive
+    const Version* current;
+    while ((current = _current.load ()) != version)
+    {
+      version = current;
+      slot.held.store (version);
+    }
+    hint = i % HANDLE_READER_SLOTS;
+    return Reader (&slot, version);
+  }
+}
+
+
+std::shared_ptr<const MlpNetwork> ModelHandle::snapshot () const
+{
+  return read ()._version->mlp;
+}
+
+
+digit ModelHandle::operator() (const Matrix& img) const
+{
+  TRACE_SPAN("ModelHandle classify", "request");
+  digit result;
+  // the generation is read before the model, so a result of a model that
+  // is replaced meanwhile carries a stale generation and is not cached
+  const std::uint64_t generation = _cache ? _cache->generation () : 0;
+  if (_cache != nullptr && _cache->lookup (img, result))
+  {
+    return result;
+  }
+  {
+    Matrix vec = img;
+    Reader reader = read ();
+    result = (*reader) (vec);
+  }
+  if (_cache != nullptr)
+  {
+    _cache->insert (img, result, generation);
+  }
+  return result;
+}
+
+
+std::vector<digit> ModelHandle::predict_batch
+    (const std::vector<Matrix>& imgs) const
+{
+  return read ()->predict_batch (imgs);
+}
+
+
+std::uint64_t ModelHandle::publish (std::shared_ptr<const MlpNetwork> mlp)
+{
+  TRACE_SPAN("ModelHandle publish", "reload");
+  if (!mlp)
+  {
+    throw std::invalid_argument (HANDLE_NULL_ERROR);
+  }
+  // validation runs before taking the mutex: it is the slow part, and a
+  // rejected candidate never touches the published state
+  try
+  {
+    check_outputs (*mlp);
+    if (_validator)
+    {
+      _validator (*mlp);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::lock_guard<std::mutex> lock (_publish_mutex);
+    _stats.rejected++;
+    throw std::invalid_argument (HANDLE_VALIDATION_ERROR +
+                                 std::string (e.what ()));
+  }
+
+  std::lock_guard<std::mutex> lock (_publish_mutex);
+  const Version* next = new Version {std::move (mlp), _stats.version + 1};
+  const Version* old = _current.exchange (next);
+  _stats.version = next->number;
+  _stats.publishes++;
+  if (old != nullptr)
+  {
+    _retired.push_back (old);
+  }
+  if (_cache != nullptr)
+  {
+    _cache->invalidate ();
+  }
+  reclaim ();
+  return next->number;
+}
+
+
+std::uint64_t ModelHandle::reload (const std::vector<std::string>& paths)
+{
+  TRACE_SPAN("ModelHandle reload", "reload");
+  if (paths.size () != 2 * MLP_SIZE)
+  {
+    throw std::invalid_argument (HANDLE_PATHS_ERROR);
+  }
+  std::vector<char*> args (ARGS_COUNT, nullptr);
+  for (int i = 0; i < 2 * MLP_SIZE; ++i)
+  {
+    args[ARGS_START_IDX + i] = const_cast<char*> (paths[i].c_str ());
+  }
+  std::shared_ptr<MlpNetwork> mlp;
+  try
+  {
+    MatrixPtr weights[MLP_SIZE];
+    MatrixPtr biases[MLP_SIZE];
+    loadSharedParameters (args.data (), weights, biases);
+    mlp = std::make_shared<MlpNetwork> (weights, biases);
+  }
+  catch (const std::exception& e)
+  {
+    std::lock_guard<std::mutex> lock (_publish_mutex);
+    _stats.rejected++;
+    throw std::invalid_argument (HANDLE_VALIDATION_ERROR +
+                                 std::string (e.what ()));
+  }
+  {
+    Reader current = read ();
+    for (int i = 0; i < MLP_SIZE; ++i)
+    {
+      mlp->set_kernel_config (i, current->get_layer (i).get_kernel_config ());
+    }
+    mlp->set_batch_config (current->get_batch_config ());
+    mlp->set_byte_normalization (current->get_byte_normalization ());
+  }
+  return publish (std::move (mlp));
+}
+
+
+std::future<std::uint64_t> ModelHandle::reload_async
+    (std::vector<std::string> paths)
+{
+  return std::async (std::launch::async, [this, paths] ()
+  {
+    return reload (paths);
+  });
+}
+
+
+void ModelHandle::attach_cache (PredictionCache* cache)
+{
+  std::lock_guard<std::mutex> lock (_publish_mutex);
+  _cache = cache;
+}
+
+
+void ModelHandle::reclaim ()
+{
+  if (_retired.empty ())
+  {
+    return;
+  }
+  std::vector<const Version*> held;
+  for (int i = 0; i < HANDLE_READER_SLOTS; ++i)
+  {
+    const Version* version = _slots[i].held.load ();
+    if (version != nullptr)
+    {
+      held.push_back (version);
+    }
+  }
+  std::sort (held.begin (), held.end ());
+  auto in_use = [&held] (const Version* version)
+  {
+    return std::binary_search (held.begin (), held.end (), version);
+  };
+  auto freed = std::partition (_retired.begin (), _retired.end (), in_use);
+  for (auto it = freed; it != _retired.end (); ++it)
+  {
+    delete *it;
+    _stats.reclaimed++;
+  }
+  _retired.erase (freed, _retired.end ());
+}
+
+
+void ModelHandle::collect ()
+{
+  std::lock_guard<std::mutex> lock (_publish_mutex);
+  reclaim ();
+}
+
+
+handle_stats ModelHandle::get_stats ()
+{
+  std::lock_guard<std::mutex> lock (_publish_mutex);
+  handle_stats stats = _stats;
+  stats.retired = _retired.size ();
+  return stats;
+}
@@ -0,0 +1,206 @@
+// ModelHandle.h
+#ifndef MODELHANDLE_H
+#define MODELHANDLE_H
+
+#include "MlpNetwork.h"
+#include "PredictionCache.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// readers that can hold a model at the same time; more spin for a free slot
+#define HANDLE_READER_SLOTS 256
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/**
+ * @brief Checks a candidate model before it is published; throws to reject
+ * it.
+ */
+typedef std::function<void (const MlpNetwork&)> model_validator;
+
+/**
+ * @struct handle_stats
+ * @brief Counters of a ModelHandle.
+ * @var version - number of the published model, 1 for the first
+ * @var publishes - models swapped in after the first
+ * @var rejected - candidates that failed to load or validate
+ * @var reclaimed - replaced models freed
+ * @var retired - replaced models still held by a reader
+ */
+typedef struct handle_stats {
+	std::uint64_t version;
+	unsigned long long publishes, rejected, reclaimed;
+	std::size_t retired;
+} handle_stats;
+
+/**
+ * @class ModelHandle
+ * @brief The model that serving threads classify with, replaceable under
+ * live traffic.
+ *
+ * Readers never lock. read() announces the model it is about to use in a
+ * reader slot (a hazard pointer) and confirms it is still the published
+ * one; that is a few atomic operations, with no reference count shared
+ * between threads. A publisher swaps the new model in with one atomic
+ * exchange and frees a replaced model only once no reader slot holds it,
+ * so a request in flight finishes on the model it started with and a new
+ * request sees the new model.
+ *
+ * Publishing is serialized, and candidates are validated before the swap:
+ * a failed load or validation leaves the serving model untouched.
+ */
+class ModelHandle {
+
+ private:
+  struct Version
+  {
+    std::shared_ptr<const MlpNetwork> mlp;
+    std::uint64_t number;
+  };
+  struct Slot
+  {
+    std::atomic<const Version*> held;
+    char pad[CACHE_LINE_SIZE]; // keeps readers off each other's lines
+  };
+
+  std::atomic<const Version*> _current; /**< The published model. */
+  std::unique_ptr<Slot[]> _slots; /**< The reader slots. */
+  std::mutex _publish_mutex; /**< Serializes publishers. */
+  std::vector<const Version*> _retired; /**< Replaced models not freed yet. */
+  model_validator _validator; /**< Extra checks of candidates. */
+  PredictionCache* _cache; /**< Invalidated on every publish, if set. */
+  handle_stats _stats; /**< Counters, guarded by _publish_mutex. */
+
+/**
+ * @brief Frees the retired models no reader slot holds. Called with the
+ * publish mutex held.
+ */
+  void reclaim ();
+
+ public:
+/**
+ * @class Reader
+ * @brief Keeps one model alive while it is used; release it promptly, as
+ * a replaced model is freed only after its last reader.
+ */
+  class Reader {
+    friend class ModelHandle;
+    Slot* _slot;
+    const Version* _version;
+    Reader (Slot* slot, const Version* version);
+
+   public:
+    Reader (Reader&& other) noexcept;
+    Reader (const Reader&) = delete;
+    Reader& operator= (const Reader&) = delete;
+    Reader& operator= (Reader&&) = delete;
+    ~Reader ();
+
+    const MlpNetwork& operator* () const;
+    const MlpNetwork* operator-> () const;
+
+/**
+ * @brief Returns the number of the model held, counting publishes from 1.
+ */
+    std::uint64_t version () const;
+  };
+
+/**
+ * @brief Constructs a handle serving a first model, which is validated
+ * like every later one.
+ *
+ * @throw std::invalid_argument if the model fails validation.
+ */
+  explicit ModelHandle (std::shared_ptr<const MlpNetwork> mlp,
+                        model_validator validator = nullptr);
+
+/**
+ * @brief Frees every model. No reader may still hold one.
+ */
+  ~ModelHandle ();
+
+  ModelHandle (const ModelHandle&) = delete;
+  ModelHandle& operator= (const ModelHandle&) = delete;
+
+/**
+ * @brief Pins the published model for a request. Lock-free.
+ */
+  Reader read () const;
+
+/**
+ * @brief Returns the published model as a shared pointer, for a caller
+ * that keeps it beyond one request.
+ */
+  std::shared_ptr<const MlpNetwork> snapshot () const;
+
+/**
+ * @brief Classifies an image with the published model, through the
+ * attached cache if there is one.
+ */
+  digit operator() (const Matrix& img) const;
+
+/**
+ * @brief Classifies a batch of images, all with the same model.
+ */
+  std::vector<digit> predict_batch (const std::vector<Matrix>& imgs) const;
+
+/**
+ * @brief Validates a model and swaps it in.
+ *
+ * The candidate must take an image and give one output per class, all
+ * finite, and pass the validator. Replaced models that no reader holds
+ * are freed before returning.
+ *
+ * @return The new model's version number.
+ * @throw std::invalid_argument if the candidate fails validation; the
+ * published model stays.
+ */
+  std::uint64_t publish (std::shared_ptr<const MlpNetwork> mlp);
+
+/**
+ * @brief Loads a model from weight and bias files, in loadParameters
+ * order (w1..w4 then b1..b4), and publishes it.
+ *
+ * The new network keeps the published one's kernel and batch configs and
+ * byte-input normalization, so tuning survives a reload.
+ *
+ * @return The new model's version number.
+ * @throw std::invalid_argument if the paths are not 2 * MLP_SIZE, or a
+ * file fails to load or the model to validate; the published model stays.
+ */
+  std::uint64_t reload (const std::vector<std::string>& paths);
+
+/**
+ * @brief Runs reload() on a background thread.
+ *
+ * @return The new version number, or the reason the reload failed.
+ */
+  std::future<std::uint64_t> reload_async (std::vector<std::string> paths);
+
+/**
+ * @brief Attaches a cache that is invalidated whenever a model is
+ * published, or detaches it with nullptr. Results computed by a replaced
+ * model are never cached afterwards. Not concurrent with classification.
+ */
+  void attach_cache (PredictionCache* cache);
+
+/**
+ * @brief Frees the replaced models that readers have released since the
+ * last publish.
+ */
+  void collect ();
+
+/**
+ * @brief Returns the handle's counters.
+ */
+  handle_stats get_stats ();
+};
+
+#endif //MODELHANDLE_H
@@ -0,0 +1,186 @@
+#include "ModelIO.h"
+#include "NpyIO.h"
+#include "Trace.h"
+#include <cstdio>
+#include <fstream>
+
+
+bool readFileToMatrix (const std::string &filePath, Matrix &mat)
+{
+  TRACE_SPAN("readFileToMatrix", "io");
+  if (has_extension(filePath, NPY_EXTENSION)) {
+    // .npy files carry their own shape, which must be the matrix's
+    Matrix loaded = load_npy(filePath);
+    if (loaded.get_rows() != mat.get_rows() ||
+        loaded.get_cols() != mat.get_cols()) {
+      throw std::runtime_error("Array shape does not match the expected "
+                               "matrix size.");
+    }
+    mat = std::move(loaded);
+    return true;
+  }
+  // Open the binary file
+  std::ifstream file(filePath, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open the file");
+  }
+  // Determine the size of the file
+  file.seekg(0, std::ios::end);
+  std::streampos fileSize = file.tellg();
+  file.seekg(0, std::ios::beg);
+
+  // Calculate the expected matrix size
+  std::streampos expectedSize = mat.get_rows() * mat.get_cols() * sizeof(float);
+
+  // Check if the file size matches the expected matrix size
+  if (fileSize != expectedSize) {
+    throw std::runtime_error("File size does not match the expected "
+                             "matrix size.");
+    file.close();
+    return false;
+  }
+
+  // Read the file content into the matrix
+  try {
+    file >> mat;
+  } catch (const std::exception& e) {
+    throw std::runtime_error("Error occurred while reading the file");
+  }
+  // Close the file
+  file.close();
+  return true;
+}
+
+
+/**
+ * Writes a matrix, in the format its final path calls for, to a staging
+ * file next to it.
+ */
+static void stageMatrix (const std::string &filePath,
+                         const std::string &stagedPath, const Matrix &mat)
+{
+  if (has_extension(filePath, NPY_EXTENSION)) {
+    // readFileToMatrix parses .npy paths by their header, so write one
+    save_npy(stagedPath, mat);
+    return;
+  }
+  std::ofstream file(stagedPath, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(mat.get_data()),
+             mat.size() * sizeof(float));
+  if (!file) {
+    throw std::runtime_error("Failed to write the file " + filePath);
+  }
+}
+
+
+/**
+ * Renames a staged file into place.
+ */
+static void commitMatrix (const std::string &stagedPath,
+                          const std::string &filePath)
+{
+  if (std::rename(stagedPath.c_str(), filePath.c_str()) != 0) {
+    std::remove(stagedPath.c_str());
+    throw std::runtime_error("Failed to write the file " + filePath);
+  }
+}
+
+
+void writeMatrixToFile (const std::string &filePath, const Matrix &mat)
+{
+  TRACE_SPAN("writeMatrixToFile", "io");
+  const std::string tmpPath = filePath + ".tmp";
+  stageMatrix(filePath, tmpPath, mat);
+  commitMatrix(tmpPath, filePath);
+}
+
+
+void writeMatricesToFiles (const std::vector<std::string> &filePaths,
+                           const std::vector<Matrix> &mats)
+{
+  TRACE_SPAN("writeMatricesToFiles", "io");
+  if (filePaths.size() != mats.size()) {
+    throw std::invalid_argument("Error: one file path per matrix is needed");
+  }
+  std::size_t staged = 0;
+  try {
+    for (; staged < mats.size(); ++staged) {
+      stageMatrix(filePaths[staged], filePaths[staged] + ".tmp",
+                  mats[staged]);
+    }
+  } catch (const std::exception&) {
+    // nothing was replaced yet; drop what was staged
+    for (std::size_t i = 0; i <= staged && i < mats.size(); ++i) {
+      std::remove((filePaths[i] + ".tmp").c_str());
+    }
+    throw;
+  }
+  for (std::size_t i = 0; i < mats.size(); ++i) {
+    commitMatrix(filePaths[i] + ".tmp", filePaths[i]);
+  }
+}
+
+
+bool isByteImageFile (const std::string &filePath)
+{
+  std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+  return file && file.tellg() == (std::streampos) (img_dims.rows *
+                                                   img_dims.cols);
+}
+
+
+bool readFileToBytes (const std::string &filePath, byte_image &img)
+{
+  TRACE_SPAN("readFileToBytes", "io");
+  std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw std::runtime_error("Failed to open the file");
+  }
+  const std::size_t size = img_dims.rows * img_dims.cols;
+  if (file.tellg() != (std::streampos) size) {
+    throw std::runtime_error("File size does not match the expected "
+                             "image size.");
+  }
+  file.seekg(0, std::ios::beg);
+  img.resize(size);
+  if (!file.read(reinterpret_cast<char*>(img.data()), size)) {
+    throw std::runtime_error("Error occurred while reading the file");
+  }
+  return true;
+}
+
+
+void loadParameters (char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
+					 Matrix biases[MLP_SIZE]) noexcept (false)
+{
+  for (int i = 0; i < MLP_SIZE; i++)
+  {
+	weights[i] = Matrix (weights_dims[i].rows, weights_dims[i].cols);
+	biases[i] = Matrix (bias_dims[i].rows, bias_dims[i].cols);
+
+	std::string weightsPath (paths[WEIGHTS_START_IDX + i]);
+	std::string biasPath (paths[BIAS_START_IDX + i]);
+
+	if (!(readFileToMatrix (weightsPath, weights[i]) &&
+		  readFileToMatrix (biasPath, biases[i])))
+	{
+	  auto msg = ERROR_INAVLID_PARAMETER + std::to_string (i + 1);
+	  throw std::invalid_argument (msg);
+	}
+
+  }
+}
+
+
+void loadSharedParameters (char *paths[ARGS_COUNT], MatrixPtr weights[MLP_SIZE],
+						   MatrixPtr biases[MLP_SIZE]) noexcept (false)
+{
+  Matrix loaded_weights[MLP_SIZE];
+  Matrix loaded_biases[MLP_SIZE];
+  loadParameters (paths, loaded_weights, loaded_biases);
+  for (int i = 0; i < MLP_SIZE; i++)
+  {
+	weights[i] = share_matrix (std::move (loaded_weights[i]));
+	biases[i] = share_matrix (std::move (loaded_biases[i]));
+  }
+}
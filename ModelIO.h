@@ -0,0 +1,96 @@
+// ModelIO.h
+#ifndef MODELIO_H
+#define MODELIO_H
+
+#include "MlpNetwork.h"
+#include <string>
+#include <vector>
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ARGS_START_IDX 1
+#define ARGS_COUNT (ARGS_START_IDX + (MLP_SIZE * 2))
+#define WEIGHTS_START_IDX ARGS_START_IDX
+#define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
+
+/**
+ * Given a binary file path and a matrix,
+ * reads the content of the file into the matrix.
+ * file must match matrix in size in order to read successfully.
+ * A path ending in .npy is read as a numpy array instead, whose shape
+ * (a vector being n x 1) must match the matrix.
+ * @param filePath - path of the binary file to read
+ * @param mat -  matrix to read the file into.
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool readFileToMatrix (const std::string &filePath, Matrix &mat);
+
+/**
+ * Writes a matrix to a binary file in the format readFileToMatrix reads
+ * (its floats, row by row; an .npy array when the path ends in .npy). The
+ * file is written under a temporary name and renamed into place, so a
+ * reader never sees a partial matrix.
+ * @param filePath - path of the binary file to write
+ * @param mat - the matrix to write
+ * @throw std::runtime_error if the file cannot be written
+ */
+void writeMatrixToFile (const std::string &filePath, const Matrix &mat);
+
+/**
+ * Writes several matrices as writeMatrixToFile does, but renames them into
+ * place only once every one of them was written in full, so a failed write
+ * replaces none of the files and the renames follow each other directly.
+ * @param filePaths - path of every file to write
+ * @param mats - the matrix to write to each path
+ * @throw std::invalid_argument if the counts differ
+ * @throw std::runtime_error if a file cannot be written
+ */
+void writeMatricesToFiles (const std::vector<std::string> &filePaths,
+                           const std::vector<Matrix> &mats);
+
+/**
+ * Tells whether a file holds one raw byte image: exactly
+ * img_dims.rows * img_dims.cols bytes, one uint8 per pixel.
+ * @param filePath - path of the file
+ * @return true if the file has the size of a byte image
+ */
+bool isByteImageFile (const std::string &filePath);
+
+/**
+ * Reads a raw byte image file (one uint8 per pixel, row by row).
+ * @param filePath - path of the binary file to read
+ * @param img - receives the img_dims.rows * img_dims.cols pixels
+ * @return true on success
+ * @throw std::runtime_error if the file cannot be opened or has the wrong
+ *        size
+ */
+bool readFileToBytes (const std::string &filePath, byte_image &img);
+
+/**
+ * Loads MLP parameters from weights & biases paths
+ * to Weights[] and Biases[].
+ * Throws an exception upon failures.
+ * @param paths array of programs arguments, expected to be mlp parameters
+ *        path.
+ * @param weights array of matrix, weigths[i] is the i'th layer weights matrix
+ * @param biases array of matrix, biases[i] is the i'th layer bias matrix
+ *          (which is actually a vector)
+ *  @throw std::invalid_argument in case of problem with a certain argument
+ */
+void loadParameters (char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
+					 Matrix biases[MLP_SIZE]) noexcept (false);
+
+/**
+ * Loads MLP parameters like loadParameters, straight into shared immutable
+ * buffers, so the loaded matrices are never copied again.
+ * @param paths array of programs arguments, expected to be mlp parameters
+ *        path.
+ * @param weights array of buffers, weigths[i] receives the i'th layer weights
+ * @param biases array of buffers, biases[i] receives the i'th layer bias
+ *  @throw std::invalid_argument in case of problem with a certain argument
+ */
+void loadSharedParameters (char *paths[ARGS_COUNT], MatrixPtr weights[MLP_SIZE],
+						   MatrixPtr biases[MLP_SIZE]) noexcept (false);
+
+#endif //MODELIO_H
@@ -0,0 +1,833 @@
+#include "NpyIO.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_SIZE 6
+#define NPY_ALIGNMENT 64
+#define NPY_FLOAT_DESCR "<f4"
+#define ZIP_LOCAL_SIGNATURE 0x04034b50u
+#define ZIP_CENTRAL_SIGNATURE 0x02014b50u
+#define ZIP_END_SIGNATURE 0x06054b50u
+#define ZIP64_END_SIGNATURE 0x06064b50u
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50u
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_END_SIZE 22
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_END_SIZE 56
+#define ZIP_MAX_COMMENT 0xFFFF
+#define ZIP_VERSION 20
+#define ZIP64_VERSION 45
+#define ZIP_STORED 0
+#define ZIP_ENCRYPTED_FLAG 0x1
+#define ZIP_DOS_DATE 0x21 // 1980-01-01
+#define ZIP64_EXTRA_ID 0x0001
+#define ZIP64_EXTRA_SIZE(values) (4 + 8 * (values))
+#define ZIP_ALIGN_EXTRA_ID 0xD935 // the zipalign padding field
+#define ZIP_LIMIT_16 0xFFFFu
+#define ZIP_LIMIT_32 0xFFFFFFFFu
+#define NPY_OPEN_ERROR "Error: failed to open array file: "
+#define NPY_FORMAT_ERROR "Error: malformed array file: "
+#define NPY_DTYPE_ERROR "Error: unsupported array dtype in: "
+#define NPY_MAP_ERROR "Error: array can't be mapped without a copy, " \
+                      "load it instead: "
+#define NPY_WRITE_ERROR "Error: failed to write array file: "
+#define NPZ_FORMAT_ERROR "Error: malformed npz archive: "
+#define NPZ_COMPRESSED_ERROR "Error: compressed npz member (save with " \
+                             "numpy.savez): "
+#define NPZ_MEMBER_ERROR "Error: npz archive has no array named: "
+
+
+/**
+ * @struct npy_dtype
+ * @brief A parsed numpy dtype.
+ */
+typedef struct npy_dtype {
+	char kind;
+	std::size_t size;
+	bool swap;
+} npy_dtype;
+
+/**
+ * @struct npz_member
+ * @brief An array stored in an npz archive.
+ */
+typedef struct npz_member {
+	std::string name;
+	std::uint16_t method;
+	std::uint64_t offset;
+} npz_member;
+
+
+static bool host_little_endian ()
+{
+  const std::uint16_t probe = 1;
+  unsigned char first = 0;
+  std::memcpy (&first, &probe, 1);
+  return first == 1;
+}
+
+
+static std::uint64_t read_le (const unsigned char* bytes, int size)
+{
+  std::uint64_t value = 0;
+  for (int i = size - 1; i >= 0; --i)
+  {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+
+static void write_le (std::ostream& out, std::uint64_t value, int size)
+{
+  for (int i = 0; i < size; ++i)
+  {
+    out.put ((char) ((value >> (8 * i)) & 0xFF));
+  }
+}
+
+
+/**
+ * @brief Continues a CRC-32 (the ZIP polynomial) over a block of bytes.
+ */
+static std::uint32_t crc32_update (std::uint32_t crc, const char* data,
+                                   std::size_t size)
+{
+  static const std::vector<std::uint32_t> table = []
+  {
+    std::vector<std::uint32_t> t (256);
+    for (std::uint32_t n = 0; n < 256; ++n)
+    {
+      std::uint32_t c = n;
+      for (int k = 0; k < 8; ++k)
+      {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[n] = c;
+    }
+    return t;
+  } ();
+  crc = ~crc;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    crc = table[(crc ^ (unsigned char) data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+
+bool has_extension (const std::string& path, const std::string& extension)
+{
+  return path.size () >= extension.size () &&
+         path.compare (path.size () - extension.size (), extension.size (),
+                       extension) == 0;
+}
+
+
+matrix_dims npy_matrix_dims (const std::vector<mat_index>& shape)
+{
+  if (shape.empty ())
+  {
+    return matrix_dims {1, 1};
+  }
+  mat_index cols = 1;
+  for (std::size_t k = 1; k < shape.size (); ++k)
+  {
+    cols *= shape[k];
+  }
+  return matrix_dims {shape[0], cols};
+}
+
+
+/**
+ * @brief Returns the text following a key of the header dictionary, with
+ * leading blanks skipped.
+ */
+static std::string dict_value (const std::string& dict, const std::string& key,
+                               const std::string& name)
+{
+  std::size_t at = dict.find ("'" + key + "'");
+  if (at == std::string::npos)
+  {
+    at = dict.find ("\"" + key + "\"");
+  }
+  if (at == std::string::npos)
+  {
+    throw std::runtime_error (NPY_FORMAT_ERROR + name);
+  }
+  at = dict.find (':', at + key.size () + 2);
+  at = dict.find_first_not_of (" \t", at == std::string::npos ? at : at + 1);
+  if (at == std::string::npos)
+  {
+    throw std::runtime_error (NPY_FORMAT_ERROR + name);
+  }
+  return dict.substr (at);
+}
+
+
+npy_header read_npy_header (std::istream& in, const std::string& name)
+{
+  char magic[NPY_MAGIC_SIZE] = {0};
+  unsigned char version[2] = {0};
+  in.read (magic, NPY_MAGIC_SIZE);
+  in.read ((char*) version, sizeof (version));
+  if (!in || std::memcmp (magic, NPY_MAGIC, NPY_MAGIC_SIZE) != 0 ||
+      version[0] < 1 || version[0] > 3)
+  {
+    throw std::runtime_error (NPY_FORMAT_ERROR + name);
+  }
+  // version 1 has a 16-bit header length, later versions a 32-bit one
+  const int length_size = (version[0] == 1) ? 2 : 4;
+  unsigned char length_bytes[4] = {0};
+  in.read ((char*) length_bytes, length_size);
+  const std::size_t length = (std::size_t) read_le (length_bytes, length_size);
+  std::string dict (length, '\0');
+  in.read (&dict[0], (std::streamsize) length);
+  if (!in)
+  {
+    throw std::runtime_error (NPY_FORMAT_ERROR + name);
+  }
+
+  npy_header header;
+  header.data_offset = NPY_MAGIC_SIZE + sizeof (version) + length_size +
+                       length;
+  // descr is a quoted string; structured dtypes (lists) are not supported
+  const std::string descr = dict_value (dict, "descr", name);
+  const std::size_t close = descr.find (descr[0], 1);
+  if ((descr[0] != '\'' && descr[0] != '"') || close == std::string::npos)
+  {
+    throw std::runtime_error (NPY_DTYPE_ERROR + name);
+  }
+  header.descr = descr.substr (1, close - 1);
+  header.fortran_order = dict_value (dict, "fortran_order", name)
+                             .compare (0, 4, "True") == 0;
+  const std::string shape = dict_value (dict, "shape", name);
+  const std::size_t end = shape.find (')');
+  if (shape[0] != '(' || end == std::string::npos)
+  {
+    throw std::runtime_error (NPY_FORMAT_ERROR + name);
+  }
+  const char* p = shape.c_str () + 1;
+  const char* stop = shape.c_str () + end;
+  while (p < stop)
+  {
+    char* next = nullptr;
+    const long long dim = std::strtoll (p, &next, 10);
+    if (next == p)
+    {
+      // a blank or the trailing comma of a one-element tuple
+      ++p;
+      continue;
+    }
+    if (dim < 0)
+    {
+      throw std::runtime_error (NPY_FORMAT_ERROR + name);
+    }
+    header.shape.push_back ((mat_index) dim);
+    p = next;
+  }
+  return header;
+}
+
+
+/**
+ * @brief Parses a dtype string into the kinds load_npy() converts.
+ */
+static npy_dtype parse_dtype (const std::string& descr, const std::string& name)
+{
+  if (descr.size () < 3 || std::string ("<>|=").find (descr[0]) ==
+                           std::string::npos)
+  {
+    throw std::runtime_error (NPY_DTYPE_ERROR + name);
+  }
+  npy_dtype type;
+  type.kind = descr[1];
+  type.size = (std::size_t) std::atoi (descr.c_str () + 2);
+  const bool little = host_little_endian ();
+  type.swap = type.size > 1 && ((descr[0] == '<' && !little) ||
+                                (descr[0] == '>' && little));
+  const bool supported =
+      (type.kind == 'f' && (type.size == 4 || type.size == 8)) ||
+      ((type.kind == 'i' || type.kind == 'u') &&
+       (type.size == 1 || type.size == 2 || type.size == 4 ||
+        type.size == 8)) ||
+      (type.kind == 'b' && type.size == 1);
+  if (!supported)
+  {
+    throw std::runtime_error (NPY_DTYPE_ERROR + name);
+  }
+  return type;
+}
+
+
+/**
+ * @brief Tells whether an array's elements are laid out in C order: it is
+ * not Fortran ordered, or has at most one dimension larger than 1.
+ */
+static bool c_layout (const npy_header& header)
+{
+  return !header.fortran_order ||
+         std::count_if (header.shape.begin (), header.shape.end (),
+                        [] (mat_index d) { return d > 1; }) <= 1;
+}
+
+
+/**
+ * @brief Tells whether an array can be used as floats in place.
+ */
+static bool native_float (const npy_dtype& type)
+{
+  return type.kind == 'f' && type.size == sizeof (float) && !type.swap;
+}
+
+
+template <typename T>
+static void convert (const unsigned char* src, std::size_t count, bool swap,
+                     float* dst)
+{
+  unsigned char bytes[sizeof (T)];
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::memcpy (bytes, src + i * sizeof (T), sizeof (T));
+    if (swap)
+    {
+      std::reverse (bytes, bytes + sizeof (T));
+    }
+    T value;
+    std::memcpy (&value, bytes, sizeof (T));
+    dst[i] = (float) value;
+  }
+}
+
+
+/**
+ * @brief Converts raw array elements to floats.
+ */
+static void convert_elements (const npy_dtype& type, const unsigned char* src,
+                              std::size_t count, float* dst)
+{
+  switch (type.kind == 'f' ? -(int) type.size :
+          type.kind == 'i' ? (int) type.size : 10 + (int) type.size)
+  {
+    case -4: convert<float> (src, count, type.swap, dst); break;
+    case -8: convert<double> (src, count, type.swap, dst); break;
+    case 1: convert<std::int8_t> (src, count, type.swap, dst); break;
+    case 2: convert<std::int16_t> (src, count, type.swap, dst); break;
+    case 4: convert<std::int32_t> (src, count, type.swap, dst); break;
+    case 8: convert<std::int64_t> (src, count, type.swap, dst); break;
+    case 11: convert<std::uint8_t> (src, count, type.swap, dst); break;
+    case 12: convert<std::uint16_t> (src, count, type.swap, dst); break;
+    case 14: convert<std::uint32_t> (src, count, type.swap, dst); break;
+    default: convert<std::uint64_t> (src, count, type.swap, dst); break;
+  }
+}
+
+
+/**
+ * @brief Reorders a Fortran-order array into C order.
+ */
+static void fortran_to_c (const float* src, std::size_t count,
+                          const std::vector<mat_index>& shape, float* dst)
+{
+  const std::size_t ndim = shape.size ();
+  std::vector<std::size_t> stride (ndim, 1);
+  for (std::size_t k = 1; k < ndim; ++k)
+  {
+    stride[k] = stride[k - 1] * (std::size_t) shape[k - 1];
+  }
+  // walk the output in C order, the last index fastest, tracking where each
+  // element sits in the column-major input
+  std::vector<mat_index> index (ndim);
+  std::size_t at = 0;
+  for (std::size_t out = 0; out < count; ++out)
+  {
+    dst[out] = src[at];
+    for (int k = (int) ndim - 1; k >= 0; --k)
+    {
+      if (++index[k] < shape[k])
+      {
+        at += stride[k];
+        break;
+      }
+      at -= (std::size_t) (shape[k] - 1) * stride[k];
+      index[k] = 0;
+    }
+  }
+}
+
+
+/**
+ * @brief Reads an array (header and elements) from the current position of
+ * a stream.
+ */
+static Matrix read_npy (std::istream& in, const std::string& name,
+                        npy_header* header)
+{
+  npy_header parsed = read_npy_header (in, name);
+  const npy_dtype type = parse_dtype (parsed.descr, name);
+  const matrix_dims dims = npy_matrix_dims (parsed.shape);
+  Matrix mat (dims.rows, dims.cols);
+  const std::size_t count = (std::size_t) mat.size ();
+  if (native_float (type) && c_layout (parsed))
+  {
+    in.read ((char*) mat.get_data (), (std::streamsize) (count *
+                                                        sizeof (float)));
+  }
+  else
+  {
+    std::vector<unsigned char> raw (count * type.size);
+    in.read ((char*) raw.data (), (std::streamsize) raw.size ());
+    if (c_layout (parsed))
+    {
+      convert_elements (type, raw.data (), count, mat.get_data ());
+    }
+    else
+    {
+      std::vector<float> column_major (count);
+      convert_elements (type, raw.data (), count, column_major.data ());
+      fortran_to_c (column_major.data (), count, parsed.shape,
+                    mat.get_data ());
+    }
+  }
+  if (!in)
+  {
+    throw std::runtime_error (NPY_FORMAT_ERROR + name);
+  }
+  if (header != nullptr)
+  {
+    *header = parsed;
+  }
+  return mat;
+}
+
+
+Matrix load_npy (const std::string& path, npy_header* header)
+{
+  TRACE_SPAN("load_npy", "io");
+  std::ifstream file (path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error (NPY_OPEN_ERROR + path);
+  }
+  return read_npy (file, path, header);
+}
+
+
+/**
+ * @brief Returns the .npy header save_npy() writes for a matrix, padded so
+ * the elements start on an NPY_ALIGNMENT boundary.
+ */
+static std::string npy_header_bytes (const Matrix& mat)
+{
+  std::string dict = "{'descr': '" NPY_FLOAT_DESCR "', 'fortran_order': "
+                     "False, 'shape': (" + std::to_string (mat.get_rows ()) +
+                     ", " + std::to_string (mat.get_cols ()) + "), }";
+  const std::size_t prefix = NPY_MAGIC_SIZE + 2 + 2;
+  const std::size_t total = (prefix + dict.size () + 1 + NPY_ALIGNMENT - 1) /
+                            NPY_ALIGNMENT * NPY_ALIGNMENT;
+  dict.append (total - prefix - dict.size () - 1, ' ');
+  dict.push_back ('\n');
+  std::string bytes (NPY_MAGIC, NPY_MAGIC_SIZE);
+  bytes.push_back ('\x01');
+  bytes.push_back ('\x00');
+  bytes.push_back ((char) (dict.size () & 0xFF));
+  bytes.push_back ((char) (dict.size () >> 8));
+  return bytes + dict;
+}
+
+
+/**
+ * @brief Returns the elements of a matrix as little-endian bytes, swapping
+ * them into scratch only on a big-endian host.
+ */
+static const char* little_endian_bytes (const Matrix& mat,
+                                        std::vector<char>& scratch)
+{
+  const char* data = (const char*) mat.get_data ();
+  if (host_little_endian ())
+  {
+    return data;
+  }
+  scratch.assign (data, data + (std::size_t) mat.size () * sizeof (float));
+  for (std::size_t i = 0; i < scratch.size (); i += sizeof (float))
+  {
+    std::reverse (scratch.begin () + i, scratch.begin () + i + sizeof (float));
+  }
+  return scratch.data ();
+}
+
+
+/**
+ * @brief Renames a fully written temporary file into place.
+ */
+static void commit_file (const std::string& tmp_path, const std::string& path)
+{
+  if (std::rename (tmp_path.c_str (), path.c_str ()) != 0)
+  {
+    std::remove (tmp_path.c_str ());
+    throw std::runtime_error (NPY_WRITE_ERROR + path);
+  }
+}
+
+
+void save_npy (const std::string& path, const Matrix& mat)
+{
+  TRACE_SPAN("save_npy", "io");
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file (tmp_path, std::ios::binary | std::ios::trunc);
+    const std::string header = npy_header_bytes (mat);
+    std::vector<char> scratch;
+    file.write (header.data (), (std::streamsize) header.size ());
+    file.write (little_endian_bytes (mat, scratch),
+                (std::streamsize) (mat.size () * sizeof (float)));
+    if (!file)
+    {
+      throw std::runtime_error (NPY_WRITE_ERROR + path);
+    }
+  }
+  commit_file (tmp_path, path);
+}
+
+
+/**
+ * @brief Checks that an array can be mapped and maps it.
+ *
+ * @param offset Bytes from the start of the file to the array header.
+ */
+static MappedMatrix map_array (const std::string& path, std::istream& in,
+                               std::size_t offset, mapped_mode mode)
+{
+  const npy_header header = read_npy_header (in, path);
+  const npy_dtype type = parse_dtype (header.descr, path);
+  const std::size_t data = offset + header.data_offset;
+  if (!native_float (type) || !c_layout (header) || data % sizeof (float))
+  {
+    throw std::runtime_error (NPY_MAP_ERROR + path);
+  }
+  const matrix_dims dims = npy_matrix_dims (header.shape);
+  return MappedMatrix (path, dims.rows, dims.cols, data, mode);
+}
+
+
+MappedMatrix map_npy (const std::string& path, mapped_mode mode)
+{
+  TRACE_SPAN("map_npy", "io");
+  std::ifstream file (path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error (NPY_OPEN_ERROR + path);
+  }
+  return map_array (path, file, 0, mode);
+}
+
+
+/**
+ * @brief Reads the central directory of a ZIP archive, resolving where each
+ * member's data starts.
+ */
+static std::vector<npz_member> read_npz_directory (std::ifstream& file,
+                                                   const std::string& path)
+{
+  file.seekg (0, std::ios::end);
+  const std::uint64_t file_size = (std::uint64_t) file.tellg ();
+  // the end record sits before an archive comment of up to 64 KiB
+  const std::size_t tail_size = (std::size_t) std::min<std::uint64_t> (
+      file_size, ZIP_END_SIZE + ZIP_MAX_COMMENT);
+  std::vector<unsigned char> tail (tail_size);
+  file.seekg ((std::streamoff) (file_size - tail_size));
+  file.read ((char*) tail.data (), (std::streamsize) tail_size);
+  std::size_t end = std::string::npos;
+  for (std::size_t at = tail_size; file && at >= ZIP_END_SIZE; --at)
+  {
+    if (read_le (&tail[at - ZIP_END_SIZE], 4) == ZIP_END_SIGNATURE)
+    {
+      end = at - ZIP_END_SIZE;
+      break;
+    }
+  }
+  if (end == std::string::npos)
+  {
+    throw std::runtime_error (NPZ_FORMAT_ERROR + path);
+  }
+  std::uint64_t entries = read_le (&tail[end + 10], 2);
+  std::uint64_t directory = read_le (&tail[end + 16], 4);
+  if (entries == ZIP_LIMIT_16 || directory == ZIP_LIMIT_32)
+  {
+    // a ZIP64 archive: the locator just before the end record points at
+    // the ZIP64 end record
+    const std::uint64_t end_pos = file_size - tail_size + end;
+    unsigned char record[ZIP64_END_SIZE] = {0};
+    file.seekg ((std::streamoff) (end_pos - ZIP64_LOCATOR_SIZE));
+    file.read ((char*) record, ZIP64_LOCATOR_SIZE);
+    if (end_pos < ZIP64_LOCATOR_SIZE ||
+        read_le (record, 4) != ZIP64_LOCATOR_SIGNATURE)
+    {
+      throw std::runtime_error (NPZ_FORMAT_ERROR + path);
+    }
+    file.seekg ((std::streamoff) read_le (record + 8, 8));
+    file.read ((char*) record, ZIP64_END_SIZE);
+    if (!file || read_le (record, 4) != ZIP64_END_SIGNATURE)
+    {
+      throw std::runtime_error (NPZ_FORMAT_ERROR + path);
+    }
+    entries = read_le (record + 32, 8);
+    directory = read_le (record + 48, 8);
+  }
+
+  std::vector<npz_member> members;
+  std::uint64_t at = directory;
+  for (std::uint64_t n = 0; n < entries; ++n)
+  {
+    unsigned char entry[ZIP_CENTRAL_SIZE] = {0};
+    file.seekg ((std::streamoff) at);
+    file.read ((char*) entry, ZIP_CENTRAL_SIZE);
+    if (!file || read_le (entry, 4) != ZIP_CENTRAL_SIGNATURE ||
+        (read_le (entry + 8, 2) & ZIP_ENCRYPTED_FLAG))
+    {
+      throw std::runtime_error (NPZ_FORMAT_ERROR + path);
+    }
+    const std::size_t name_size = (std::size_t) read_le (entry + 28, 2);
+    const std::size_t extra_size = (std::size_t) read_le (entry + 30, 2);
+    const std::size_t comment_size = (std::size_t) read_le (entry + 32, 2);
+    npz_member member;
+    member.method = (std::uint16_t) read_le (entry + 10, 2);
+    member.name.resize (name_size);
+    file.read (&member.name[0], (std::streamsize) name_size);
+    std::vector<unsigned char> extra (extra_size);
+    file.read ((char*) extra.data (), (std::streamsize) extra_size);
+    std::uint64_t local = read_le (entry + 42, 4);
+    if (local == ZIP_LIMIT_32)
+    {
+      // the ZIP64 field lists only the saturated values, in this order
+      int skip = (read_le (entry + 24, 4) == ZIP_LIMIT_32) +
+                 (read_le (entry + 20, 4) == ZIP_LIMIT_32);
+      for (std::size_t e = 0; e + 4 <= extra_size;
+           e += 4 + (std::size_t) read_le (&extra[e + 2], 2))
+      {
+        if (read_le (&extra[e], 2) == ZIP64_EXTRA_ID &&
+            e + 4 + 8 * (skip + 1) <= extra_size)
+        {
+          local = read_le (&extra[e + 4 + 8 * skip], 8);
+        }
+      }
+    }
+    // the local header repeats the name and has its own extra field
+    unsigned char local_header[ZIP_LOCAL_SIZE] = {0};
+    file.seekg ((std::streamoff) local);
+    file.read ((char*) local_header, ZIP_LOCAL_SIZE);
+    if (!file || read_le (local_header, 4) != ZIP_LOCAL_SIGNATURE)
+    {
+      throw std::runtime_error (NPZ_FORMAT_ERROR + path);
+    }
+    member.offset = local + ZIP_LOCAL_SIZE + read_le (local_header + 26, 2) +
+                    read_le (local_header + 28, 2);
+    members.push_back (member);
+    at += ZIP_CENTRAL_SIZE + name_size + extra_size + comment_size;
+  }
+  return members;
+}
+
+
+/**
+ * @brief Returns an archive member name without its ".npy" suffix.
+ */
+static std::string array_name (const std::string& member)
+{
+  return has_extension (member, NPY_EXTENSION)
+         ? member.substr (0, member.size () - std::strlen (NPY_EXTENSION))
+         : member;
+}
+
+
+std::map<std::string, Matrix> load_npz (const std::string& path)
+{
+  TRACE_SPAN("load_npz", "io");
+  std::ifstream file (path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error (NPY_OPEN_ERROR + path);
+  }
+  std::map<std::string, Matrix> arrays;
+  for (const npz_member& member : read_npz_directory (file, path))
+  {
+    if (member.method != ZIP_STORED)
+    {
+      throw std::runtime_error (NPZ_COMPRESSED_ERROR + path);
+    }
+    file.seekg ((std::streamoff) member.offset);
+    arrays[array_name (member.name)] = read_npy (file, path + ":" +
+                                                       member.name, nullptr);
+  }
+  return arrays;
+}
+
+
+MappedMatrix map_npz (const std::string& path, const std::string& name)
+{
+  TRACE_SPAN("map_npz", "io");
+  std::ifstream file (path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error (NPY_OPEN_ERROR + path);
+  }
+  for (const npz_member& member : read_npz_directory (file, path))
+  {
+    if (array_name (member.name) != name)
+    {
+      continue;
+    }
+    if (member.method != ZIP_STORED)
+    {
+      throw std::runtime_error (NPZ_COMPRESSED_ERROR + path);
+    }
+    file.seekg ((std::streamoff) member.offset);
+    return map_array (path, file, (std::size_t) member.offset,
+                      MAPPED_READ_ONLY);
+  }
+  throw std::runtime_error (NPZ_MEMBER_ERROR + name);
+}
+
+
+void save_npz (const std::string& path,
+               const std::map<std::string, Matrix>& arrays, bool zip64)
+{
+  TRACE_SPAN("save_npz", "io");
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file (tmp_path, std::ios::binary | std::ios::trunc);
+    std::string directory;
+    std::uint64_t offset = 0;
+    for (const auto& array : arrays)
+    {
+      const std::string name = array.first + NPY_EXTENSION;
+      const std::string header = npy_header_bytes (array.second);
+      std::vector<char> scratch;
+      const char* data = little_endian_bytes (array.second, scratch);
+      const std::size_t data_size = (std::size_t) array.second.size () *
+                                    sizeof (float);
+      const std::uint64_t size = header.size () + data_size;
+      std::uint32_t crc = crc32_update (0, header.data (), header.size ());
+      crc = crc32_update (crc, data, data_size);
+      // sizes and offsets that do not fit in 32 bits move to ZIP64 extra
+      // fields, which numpy.savez also writes for every member
+      const bool sizes64 = zip64 || size >= ZIP_LIMIT_32;
+      const bool offset64 = zip64 || offset >= ZIP_LIMIT_32;
+      const std::size_t local_extra = sizes64 ? ZIP64_EXTRA_SIZE (2) : 0;
+      // pad the local extra field so the member, and so the elements behind
+      // its aligned header, start on an NPY_ALIGNMENT boundary
+      std::size_t pad = (std::size_t) ((NPY_ALIGNMENT - (offset +
+                        ZIP_LOCAL_SIZE + name.size () + local_extra) %
+                        NPY_ALIGNMENT) % NPY_ALIGNMENT);
+      pad += (pad != 0 && pad < 4) ? NPY_ALIGNMENT : 0;
+
+      const int version = (sizes64 || offset64) ? ZIP64_VERSION : ZIP_VERSION;
+
+      std::ostringstream fields;
+      write_le (fields, version, 2);
+      write_le (fields, 0, 2); // flags
+      write_le (fields, ZIP_STORED, 2);
+      write_le (fields, 0, 2); // time
+      write_le (fields, ZIP_DOS_DATE, 2);
+      write_le (fields, crc, 4);
+      write_le (fields, sizes64 ? ZIP_LIMIT_32 : size, 4); // compressed
+      write_le (fields, sizes64 ? ZIP_LIMIT_32 : size, 4);
+      write_le (fields, name.size (), 2);
+
+      write_le (file, ZIP_LOCAL_SIGNATURE, 4);
+      file << fields.str ();
+      write_le (file, local_extra + pad, 2);
+      file << name;
+      if (sizes64)
+      {
+        write_le (file, ZIP64_EXTRA_ID, 2);
+        write_le (file, ZIP64_EXTRA_SIZE (2) - 4, 2);
+        write_le (file, size, 8);
+        write_le (file, size, 8); // compressed
+      }
+      if (pad != 0)
+      {
+        write_le (file, ZIP_ALIGN_EXTRA_ID, 2);
+        write_le (file, pad - 4, 2);
+        file << std::string (pad - 4, '\0');
+      }
+      file << header;
+      file.write (data, (std::streamsize) data_size);
+
+      // the central ZIP64 field lists only the saturated values
+      const int saturated = 2 * sizes64 + offset64;
+      std::ostringstream entry;
+      write_le (entry, ZIP_CENTRAL_SIGNATURE, 4);
+      write_le (entry, version, 2); // made by
+      entry << fields.str ();
+      write_le (entry, saturated ? ZIP64_EXTRA_SIZE (saturated) : 0, 2);
+      write_le (entry, 0, 2); // comment
+      write_le (entry, 0, 2); // disk
+      write_le (entry, 0, 2); // internal attributes
+      write_le (entry, 0, 4); // external attributes
+      write_le (entry, offset64 ? ZIP_LIMIT_32 : offset, 4);
+      entry << name;
+      if (saturated)
+      {
+        write_le (entry, ZIP64_EXTRA_ID, 2);
+        write_le (entry, ZIP64_EXTRA_SIZE (saturated) - 4, 2);
+        if (sizes64)
+        {
+          write_le (entry, size, 8);
+          write_le (entry, size, 8); // compressed
+        }
+        if (offset64)
+        {
+          write_le (entry, offset, 8);
+        }
+      }
+      directory += entry.str ();
+      offset += ZIP_LOCAL_SIZE + name.size () + local_extra + pad + size;
+    }
+    file << directory;
+    const bool end64 = zip64 || arrays.size () >= ZIP_LIMIT_16 ||
+                       directory.size () >= ZIP_LIMIT_32 ||
+                       offset >= ZIP_LIMIT_32;
+    if (end64)
+    {
+      // the ZIP64 end record, and the locator the plain end record is
+      // preceded by
+      const std::uint64_t end_offset = offset + directory.size ();
+      write_le (file, ZIP64_END_SIGNATURE, 4);
+      write_le (file, ZIP64_END_SIZE - 12, 8); // size of the rest
+      write_le (file, ZIP64_VERSION, 2); // made by
+      write_le (file, ZIP64_VERSION, 2);
+      write_le (file, 0, 4); // disk
+      write_le (file, 0, 4); // directory disk
+      write_le (file, arrays.size (), 8);
+      write_le (file, arrays.size (), 8);
+      write_le (file, directory.size (), 8);
+      write_le (file, offset, 8);
+      write_le (file, ZIP64_LOCATOR_SIGNATURE, 4);
+      write_le (file, 0, 4); // disk of the ZIP64 end record
+      write_le (file, end_offset, 8);
+      write_le (file, 1, 4); // disks
+    }
+    write_le (file, ZIP_END_SIGNATURE, 4);
+    write_le (file, 0, 2); // disk
+    write_le (file, 0, 2); // directory disk
+    write_le (file, end64 ? ZIP_LIMIT_16 : arrays.size (), 2);
+    write_le (file, end64 ? ZIP_LIMIT_16 : arrays.size (), 2);
+    write_le (file, end64 ? ZIP_LIMIT_32 : directory.size (), 4);
+    write_le (file, end64 ? ZIP_LIMIT_32 : offset, 4);
+    write_le (file, 0, 2); // comment
+    if (!file)
+    {
+      throw std::runtime_error (NPY_WRITE_ERROR + path);
+    }
+  }
+  commit_file (tmp_path, path);
+}
@@ -0,0 +1,137 @@
+// NpyIO.h
+#ifndef NPYIO_H
+#define NPYIO_H
+
+#include "Matrix.h"
+#include "MappedMatrix.h"
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define NPY_EXTENSION ".npy"
+#define NPZ_EXTENSION ".npz"
+
+/**
+ * @struct npy_header
+ * @brief The header of an .npy array.
+ * @var descr - the numpy dtype string, e.g. "<f4": byte order ('<', '>',
+ *      '|' or '='), kind ('f', 'i', 'u' or 'b') and element size
+ * @var fortran_order - whether the elements are stored column-major
+ * @var shape - the dimensions; empty for a scalar
+ * @var data_offset - bytes from the start of the array to its elements
+ */
+typedef struct npy_header {
+	std::string descr;
+	bool fortran_order;
+	std::vector<mat_index> shape;
+	std::size_t data_offset;
+} npy_header;
+
+/**
+ * @brief Tells whether a path ends with the given extension.
+ */
+bool has_extension (const std::string& path, const std::string& extension);
+
+/**
+ * @brief Returns the matrix dimensions of an array shape: (n) is an n x 1
+ * column, (r, c) is r x c, and (d0, d1, ...) is d0 x (d1 * ...), one row
+ * per leading index; a scalar is 1 x 1.
+ */
+matrix_dims npy_matrix_dims (const std::vector<mat_index>& shape);
+
+/**
+ * @brief Reads an .npy header (format versions 1 to 3) from the current
+ * position of a stream, leaving the stream at the elements.
+ *
+ * @param in The stream.
+ * @param name Names the array in error messages.
+ * @return The header; data_offset counts from where the stream started.
+ * @throw std::runtime_error if the header is malformed.
+ */
+npy_header read_npy_header (std::istream& in,
+                            const std::string& name = "");
+
+/**
+ * @brief Loads an .npy file into a matrix.
+ *
+ * Any float, signed, unsigned or boolean dtype of either byte order is
+ * converted to float; Fortran-order arrays are reordered, so the matrix
+ * always holds the array in C order with the dimensions of
+ * npy_matrix_dims(). Native float32 in C order is read in one block.
+ *
+ * @param path The file.
+ * @param header Receives the header when not null.
+ * @return The matrix.
+ * @throw std::runtime_error if the file cannot be read or is malformed, or
+ * the dtype is not supported.
+ */
+Matrix load_npy (const std::string& path, npy_header* header = nullptr);
+
+/**
+ * @brief Saves a matrix as a get_rows() x get_cols() little-endian float32
+ * C-order .npy file (format version 1.0), written under a temporary name
+ * and renamed into place.
+ *
+ * @throw std::runtime_error if the file cannot be written.
+ */
+void save_npy (const std::string& path, const Matrix& mat);
+
+/**
+ * @brief Maps the elements of an .npy file with no copy.
+ *
+ * @param path The file; it must hold native-endian float32 in C order (or
+ * with at most one dimension larger than 1).
+ * @param mode MAPPED_READ_ONLY, or MAPPED_READ_WRITE to change the file in
+ * place.
+ * @return The mapping, with the dimensions of npy_matrix_dims().
+ * @throw std::runtime_error if the file is malformed or its dtype or order
+ * cannot be mapped; load_npy() converts those.
+ */
+MappedMatrix map_npy (const std::string& path,
+                      mapped_mode mode = MAPPED_READ_ONLY);
+
+/**
+ * @brief Loads every array of an uncompressed .npz archive (numpy.savez).
+ *
+ * @param path The archive.
+ * @return The arrays, as load_npy() converts them, by name without the
+ * ".npy" suffix.
+ * @throw std::runtime_error if the archive cannot be read, is malformed or
+ * compressed (numpy.savez_compressed), or holds an unsupported array.
+ */
+std::map<std::string, Matrix> load_npz (const std::string& path);
+
+/**
+ * @brief Maps one array of an uncompressed .npz archive with no copy.
+ *
+ * Archives written by save_npz() align every array; others map when their
+ * array happens to be float aligned.
+ *
+ * @param path The archive.
+ * @param name The array name, without the ".npy" suffix.
+ * @return The read-only mapping.
+ * @throw std::runtime_error if the array is missing, compressed, or cannot
+ * be mapped (see map_npy()).
+ */
+MappedMatrix map_npz (const std::string& path, const std::string& name);
+
+/**
+ * @brief Saves matrices as an uncompressed .npz archive that numpy.load
+ * reads, each as save_npy() writes it, with its elements aligned to 64
+ * bytes in the file so map_npz() can map them.
+ *
+ * Sizes and offsets of 4 GiB or more, and 65535 or more arrays, are
+ * written as ZIP64 records.
+ *
+ * @param path The archive.
+ * @param arrays The matrices by name; ".npy" is appended to each name.
+ * @param zip64 Whether to write ZIP64 records for every member and the
+ * directory even when the values fit, as numpy.savez does.
+ * @throw std::runtime_error if the file cannot be written.
+ */
+void save_npz (const std::string& path,
+               const std::map<std::string, Matrix>& arrays,
+               bool zip64 = false);
+
+#endif //NPYIO_H
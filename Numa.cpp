@@ -0,0 +1,407 @@
+#include "Numa.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <dirent.h>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#define CPU_LIST_ERROR "Error: malformed CPU list: "
+#define NUMA_NODE_INDEX_ERROR "Error: NUMA node index out of range"
+#define NODE_DIR_PREFIX "node"
+
+struct NumaMlpNetwork::Node
+{
+  numa_node topology;
+  std::vector<int> cores; /**< Core of each worker. */
+  std::unique_ptr<MlpNetwork> replica;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::function<void ()> > tasks;
+  bool stop = false;
+};
+
+/**
+ * @brief Counts down finished tasks and keeps the first failure.
+ */
+struct task_latch
+{
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::size_t pending;
+  std::exception_ptr error;
+
+  explicit task_latch (std::size_t count) : pending (count) {}
+
+  void done (std::exception_ptr failure)
+  {
+    std::lock_guard<std::mutex> lock (mutex);
+    if (failure && !error)
+    {
+      error = failure;
+    }
+    if (--pending == 0)
+    {
+      cv.notify_all ();
+    }
+  }
+
+  void wait ()
+  {
+    std::unique_lock<std::mutex> lock (mutex);
+    cv.wait (lock, [this] () { return pending == 0; });
+    if (error)
+    {
+      std::rethrow_exception (error);
+    }
+  }
+};
+
+
+std::vector<int> parse_cpu_list (const std::string& list)
+{
+  std::vector<int> cpus;
+  std::stringstream ranges (list);
+  std::string range;
+  while (std::getline (ranges, range, ','))
+  {
+    // tolerate the trailing newline of a sysfs file
+    while (!range.empty () && (range.back () == '\n' || range.back () == ' '))
+    {
+      range.pop_back ();
+    }
+    if (range.empty ())
+    {
+      continue;
+    }
+    int first = 0, last = 0;
+    char extra = 0;
+    int fields = std::sscanf (range.c_str (), "%d-%d%c", &first, &last,
+                              &extra);
+    if (fields == 1)
+    {
+      last = first;
+    }
+    if (fields < 1 || fields > 2 || first < 0 || last < first)
+    {
+      throw std::invalid_argument (CPU_LIST_ERROR + list);
+    }
+    for (int cpu = first; cpu <= last; ++cpu)
+    {
+      cpus.push_back (cpu);
+    }
+  }
+  return cpus;
+}
+
+
+std::vector<numa_node> numa_topology (const std::string& sysfs_root)
+{
+  std::vector<numa_node> nodes;
+  DIR* dir = opendir (sysfs_root.c_str ());
+  if (dir != nullptr)
+  {
+    const std::string prefix = NODE_DIR_PREFIX;
+    for (dirent* entry = readdir (dir); entry != nullptr;
+         entry = readdir (dir))
+    {
+      std::string name = entry->d_name;
+      if (name.compare (0, prefix.size (), prefix) != 0 ||
+          name.size () == prefix.size () ||
+          name.find_first_not_of ("0123456789", prefix.size ()) !=
+          std::string::npos)
+      {
+        continue;
+      }
+      std::ifstream file (sysfs_root + "/" + name + "/cpulist");
+      std::string list;
+      if (!std::getline (file, list))
+      {
+        continue;
+      }
+      try
+      {
+        numa_node node {std::stoi (name.substr (prefix.size ())),
+                        parse_cpu_list (list)};
+        if (!node.cpus.empty ())
+        {
+          nodes.push_back (node);
+        }
+      }
+      catch (const std::invalid_argument&)
+      {
+        continue;
+      }
+    }
+    closedir (dir);
+  }
+  if (nodes.empty ())
+  {
+    numa_node all {0, {}};
+    int cpus = (int) std::thread::hardware_concurrency ();
+    for (int cpu = 0; cpu < (cpus > 0 ? cpus : 1); ++cpu)
+    {
+      all.cpus.push_back (cpu);
+    }
+    nodes.push_back (all);
+  }
+  std::sort (nodes.begin (), nodes.end (),
+             [] (const numa_node& a, const numa_node& b)
+             { return a.id < b.id; });
+  return nodes;
+}
+
+
+bool pin_current_thread (int core)
+{
+#ifdef __linux__
+  if (core == NO_CORE || core >= CPU_SETSIZE)
+  {
+    return false;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  return pthread_setaffinity_np (pthread_self (), sizeof (set), &set) == 0;
+#else
+  (void) core;
+  return false;
+#endif
+}
+
+
+/**
+ * @brief Copies a network into buffers allocated, and first touched, by the
+ * calling thread.
+ */
+static MlpNetwork local_copy (const MlpNetwork& mlp)
+{
+  // Dense::clone() keeps each layer's activation, factoring, kernel config
+  // and sparse path, so the replica runs exactly the caller's model
+  MlpNetwork copy (mlp);
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    copy.set_layer (i, mlp.get_layer (i).clone ());
+  }
+  return copy;
+}
+
+
+NumaMlpNetwork::NumaMlpNetwork (const MlpNetwork& mlp, int threads,
+                                const std::vector<numa_node>& topology)
+    : _workers (0)
+{
+  std::vector<numa_node> nodes = topology.empty () ? numa_topology ()
+                                                   : topology;
+  int cpus = 0;
+  for (const numa_node& node : nodes)
+  {
+    cpus += (int) node.cpus.size ();
+  }
+  if (threads <= 0)
+  {
+    threads = (cpus > 0) ? cpus : 1;
+  }
+
+  // worker t goes to node t % nodes, on that node's cores in turn
+  std::vector<std::unique_ptr<Node> > all;
+  for (const numa_node& topo : nodes)
+  {
+    std::unique_ptr<Node> node (new Node);
+    node->topology = topo;
+    all.emplace_back (std::move (node));
+  }
+  for (int t = 0; t < threads; ++t)
+  {
+    Node& node = *all[t % all.size ()];
+    const std::vector<int>& node_cpus = node.topology.cpus;
+    int slot = (int) node.cores.size ();
+    node.cores.push_back (node_cpus.empty () ? NO_CORE
+                          : node_cpus[slot % node_cpus.size ()]);
+  }
+  for (std::unique_ptr<Node>& node : all)
+  {
+    if (!node->cores.empty ())
+    {
+      _nodes.emplace_back (std::move (node));
+    }
+  }
+
+  for (std::unique_ptr<Node>& node_ptr : _nodes)
+  {
+    Node* node = node_ptr.get ();
+    for (int core : node->cores)
+    {
+      node->workers.emplace_back ([node, core] ()
+      {
+        pin_current_thread (core);
+        std::unique_lock<std::mutex> lock (node->mutex);
+        while (true)
+        {
+          node->cv.wait (lock, [node] ()
+          { return node->stop || !node->tasks.empty (); });
+          if (node->tasks.empty ())
+          {
+            return;
+          }
+          std::function<void ()> task = std::move (node->tasks.front ());
+          node->tasks.pop_front ();
+          lock.unlock ();
+          task ();
+          lock.lock ();
+        }
+      });
+      _workers++;
+    }
+  }
+
+  if (_nodes.size () == 1)
+  {
+    // nothing is remote: share the caller's buffers
+    _nodes[0]->replica.reset (new MlpNetwork (mlp));
+    return;
+  }
+  task_latch built (_nodes.size ());
+  for (std::unique_ptr<Node>& node_ptr : _nodes)
+  {
+    Node* node = node_ptr.get ();
+    post (*node, [node, &mlp, &built] ()
+    {
+      try
+      {
+        node->replica.reset (new MlpNetwork (local_copy (mlp)));
+        built.done (nullptr);
+      }
+      catch (...)
+      {
+        built.done (std::current_exception ());
+      }
+    });
+  }
+  try
+  {
+    built.wait ();
+  }
+  catch (...)
+  {
+    stop_workers ();
+    throw;
+  }
+}
+
+
+NumaMlpNetwork::~NumaMlpNetwork ()
+{
+  stop_workers ();
+}
+
+
+void NumaMlpNetwork::stop_workers ()
+{
+  for (std::unique_ptr<Node>& node : _nodes)
+  {
+    {
+      std::lock_guard<std::mutex> lock (node->mutex);
+      node->stop = true;
+    }
+    node->cv.notify_all ();
+  }
+  for (std::unique_ptr<Node>& node : _nodes)
+  {
+    for (std::thread& worker : node->workers)
+    {
+      if (worker.joinable ())
+      {
+        worker.join ();
+      }
+    }
+  }
+}
+
+
+void NumaMlpNetwork::post (Node& node, std::function<void ()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock (node.mutex);
+    node.tasks.push_back (std::move (task));
+  }
+  node.cv.notify_one ();
+}
+
+
+int NumaMlpNetwork::nodes () const
+{
+  return (int) _nodes.size ();
+}
+
+
+int NumaMlpNetwork::workers () const
+{
+  return _workers;
+}
+
+
+const MlpNetwork& NumaMlpNetwork::replica (int i) const
+{
+  if (i < 0 || i >= (int) _nodes.size ())
+  {
+    throw std::out_of_range (NUMA_NODE_INDEX_ERROR);
+  }
+  return *_nodes[i]->replica;
+}
+
+
+std::vector<digit> NumaMlpNetwork::predict_batch (
+    const std::vector<Matrix>& imgs) const
+{
+  TRACE_SPAN("numa predict_batch", "batch");
+  std::vector<digit> results (imgs.size ());
+  const std::size_t chunks = (imgs.size () + BATCH_CHUNK - 1) / BATCH_CHUNK;
+  if (chunks == 0)
+  {
+    return results;
+  }
+  task_latch finished (chunks);
+  // node n takes a contiguous run of chunks in proportion to its workers
+  std::size_t chunk = 0;
+  int workers_before = 0;
+  for (const std::unique_ptr<Node>& node_ptr : _nodes)
+  {
+    Node* node = node_ptr.get ();
+    workers_before += (int) node->cores.size ();
+    const std::size_t end = chunks * workers_before / _workers;
+    for (; chunk < end; ++chunk)
+    {
+      const std::size_t lo = chunk * BATCH_CHUNK;
+      const std::size_t hi = std::min (imgs.size (), lo + BATCH_CHUNK);
+      post (*node, [node, &imgs, &results, &finished, lo, hi] ()
+      {
+        try
+        {
+          TRACE_SPAN("numa chunk", "batch");
+          Matrix probs = node->replica->forward (
+              MlpNetwork::pack_batch (imgs, lo, hi));
+          std::vector<mat_index> classes = probs.col_argmax ();
+          for (std::size_t k = 0; k < hi - lo; ++k)
+          {
+            results[lo + k].value = (unsigned int) classes[k];
+            results[lo + k].probability = probs (classes[k], k);
+          }
+          finished.done (nullptr);
+        }
+        catch (...)
+        {
+          finished.done (std::current_exception ());
+        }
+      });
+    }
+  }
+  finished.wait ();
+  return results;
+}
@@ -0,0 +1,136 @@
+// Numa.h
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "MlpNetwork.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NO_CORE (-1)
+#define NUMA_SYSFS_ROOT "/sys/devices/system/node"
+
+/**
+ * @struct numa_node
+ * @brief One memory node and the CPUs attached to it.
+ * @var id - the node number
+ * @var cpus - the node's online CPU numbers, ascending
+ */
+typedef struct numa_node {
+	int id;
+	std::vector<int> cpus;
+} numa_node;
+
+/**
+ * @brief Parses a kernel CPU list such as "0-3,8,10-11".
+ *
+ * @param list The list text.
+ * @return The CPU numbers, ascending.
+ * @throw std::invalid_argument if the text is malformed.
+ */
+std::vector<int> parse_cpu_list (const std::string& list);
+
+/**
+ * @brief Reads the NUMA topology from sysfs.
+ *
+ * Nodes without CPUs are skipped. When sysfs has no node information (a
+ * kernel without NUMA, a container hiding it, another OS), a single node 0
+ * holding every CPU is returned, so callers need no special case.
+ *
+ * @param sysfs_root The node directory, for tests on a captured tree.
+ * @return The nodes, at least one.
+ */
+std::vector<numa_node> numa_topology (const std::string& sysfs_root =
+                                      NUMA_SYSFS_ROOT);
+
+/**
+ * @brief Pins the calling thread to a single core.
+ *
+ * @param core The core index; NO_CORE leaves the thread unpinned.
+ * @return true if the thread is now pinned.
+ */
+bool pin_current_thread (int core);
+
+/**
+ * @class NumaMlpNetwork
+ * @brief Batch inference with one weight replica per NUMA node and worker
+ * threads pinned to the cores of each node.
+ *
+ * Every replica is built by a worker of its node, so its buffers (weights,
+ * packed and transposed layouts) are first touched, and thus placed, on that
+ * node. predict_batch() splits the batch into BATCH_CHUNK-image chunks and
+ * hands each node a contiguous share proportional to its worker count; a
+ * node's workers only ever read their own replica. On a single-node machine
+ * the one replica shares the original network's buffers instead of copying
+ * them, and the workers are still pinned.
+ */
+class NumaMlpNetwork {
+
+ private:
+  struct Node; /**< Per-node replica, workers and queue, in Numa.cpp. */
+
+  std::vector<std::unique_ptr<Node> > _nodes; /**< Nodes with workers. */
+  int _workers; /**< Total worker threads. */
+
+/**
+ * @brief Queues a task on a node's workers.
+ */
+  static void post (Node& node, std::function<void ()> task);
+
+/**
+ * @brief Lets the workers finish their queued tasks, then joins them.
+ */
+  void stop_workers ();
+
+ public:
+/**
+ * @brief Builds the replicas and starts the workers.
+ *
+ * @param mlp The network; it need not outlive this object.
+ * @param threads Total worker threads, spread round-robin over the nodes
+ * and over the cores within each node; 0 means one per CPU.
+ * @param topology The nodes to use; empty means numa_topology().
+ */
+  explicit NumaMlpNetwork (const MlpNetwork& mlp, int threads = 0,
+                           const std::vector<numa_node>& topology = {});
+
+/**
+ * @brief Stops and joins the workers.
+ */
+  ~NumaMlpNetwork ();
+
+  NumaMlpNetwork (const NumaMlpNetwork&) = delete;
+  NumaMlpNetwork& operator= (const NumaMlpNetwork&) = delete;
+
+/**
+ * @brief Returns the number of nodes that hold a replica.
+ */
+  int nodes () const;
+
+/**
+ * @brief Returns the total number of worker threads.
+ */
+  int workers () const;
+
+/**
+ * @brief Returns the replica of a node.
+ *
+ * @param i The node index, in [0, nodes()).
+ */
+  const MlpNetwork& replica (int i) const;
+
+/**
+ * @brief Classifies a batch of images on the node-local workers.
+ *
+ * @param imgs The input images.
+ * @return One classified digit per image, in order.
+ */
+  std::vector<digit> predict_batch (const std::vector<Matrix>& imgs) const;
+};
+
+#endif //NUMA_H
@@ -0,0 +1,240 @@
+#include "OnlineLearner.h"
+#include "ModelIO.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+#define OUTPUT_KIND_ERROR "Error: online learning needs a softmax output layer"
+#define ONLINE_CONFIG_ERROR "Error: online learning needs a positive " \
+                            "learning rate, batch and sample count and a " \
+                            "non-negative checkpoint interval"
+#define LABEL_ERROR "Error: feedback label is not a class of the network"
+#define NO_CHECKPOINT_ERROR "Error: no checkpoint files are set"
+#define ONLINE_SEED 7
+
+
+OnlineLearner::OnlineLearner (const MlpNetwork& mlp,
+                              const online_config& config) :
+_handle (std::make_shared<const MlpNetwork> (mlp)), _config (config),
+_weights (mlp.get_layer (MLP_SIZE - 1).get_weights ()),
+_bias (mlp.get_layer (MLP_SIZE - 1).get_bias ()), _features (), _labels (),
+_next (0), _count (0), _gen (ONLINE_SEED), _weights_path (),
+_bias_path (), _checkpointed (0), _stats {0, 0, 0, 0}
+{
+  if (activation::kind_of (mlp.get_layer (MLP_SIZE - 1).get_activation ())
+      != activation::KIND_SOFTMAX)
+  {
+    throw std::invalid_argument (OUTPUT_KIND_ERROR);
+  }
+  if (!(config.learning_rate > 0) || config.batch <= 0 ||
+      config.max_samples == 0 || config.checkpoint_every < 0)
+  {
+    throw std::invalid_argument (ONLINE_CONFIG_ERROR);
+  }
+  _features.resize (config.max_samples * _weights.get_cols ());
+  _labels.resize (config.max_samples);
+}
+
+
+std::shared_ptr<const MlpNetwork> OnlineLearner::network () const
+{
+  return _handle.snapshot ();
+}
+
+
+digit OnlineLearner::operator() (const Matrix& img) const
+{
+  return _handle (img);
+}
+
+
+void OnlineLearner::add_feedback (const Matrix& img, unsigned int label)
+{
+  if (label >= (unsigned int) _weights.get_rows ())
+  {
+    throw std::out_of_range (LABEL_ERROR);
+  }
+  // the frozen layers are the same in every snapshot
+  Matrix features = _handle.read ()->forward_to (MLP_SIZE - 2, img);
+  const mat_index hidden = _weights.get_cols ();
+  std::lock_guard<std::mutex> lock (_mutex);
+  std::copy (features.get_data (), features.get_data () + hidden,
+             _features.begin () + _next * hidden);
+  _labels[_next] = label;
+  _next = (_next + 1) % _config.max_samples;
+  _count = std::min (_count + 1, _config.max_samples);
+  _stats.samples++;
+}
+
+
+double OnlineLearner::update (int steps)
+{
+  TRACE_SPAN("online update", "online");
+  Matrix checkpoint_weights;
+  Matrix checkpoint_bias;
+  unsigned long long checkpoint_update = 0;
+  bool checkpoint_due = false;
+  double loss = 0;
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    if (_count == 0)
+    {
+      return 0;
+    }
+    const mat_index classes = _weights.get_rows ();
+    const mat_index hidden = _weights.get_cols ();
+    std::uniform_int_distribution<std::size_t> pick (0, _count - 1);
+    std::vector<float> grad_w ((std::size_t) classes * hidden);
+    std::vector<float> grad_b (classes);
+    std::vector<float> p (classes);
+    for (int step = 0; step < steps; ++step)
+    {
+      std::fill (grad_w.begin (), grad_w.end (), 0.0f);
+      std::fill (grad_b.begin (), grad_b.end (), 0.0f);
+      loss = 0;
+      for (int k = 0; k < _config.batch; ++k)
+      {
+        const std::size_t sample = pick (_gen);
+        const float* h = _features.data () + sample * hidden;
+        const unsigned int label = _labels[sample];
+        // softmax of W h + b, shifted by the largest logit
+        float top = -INFINITY;
+        for (mat_index c = 0; c < classes; ++c)
+        {
+          float z = _bias[c];
+          for (mat_index j = 0; j < hidden; ++j)
+          {
+            z += _weights (c, j) * h[j];
+          }
+          p[c] = z;
+          top = std::max (top, z);
+        }
+        float total = 0;
+        for (mat_index c = 0; c < classes; ++c)
+        {
+          p[c] = std::exp (p[c] - top);
+          total += p[c];
+        }
+        loss -= std::log (std::max (p[label] / total, 1e-30f));
+        // d loss / d logits = softmax - one hot
+        for (mat_index c = 0; c < classes; ++c)
+        {
+          const float g = p[c] / total - (c == label ? 1.0f : 0.0f);
+          grad_b[c] += g;
+          for (mat_index j = 0; j < hidden; ++j)
+          {
+            grad_w[(std::size_t) c * hidden + j] += g * h[j];
+          }
+        }
+      }
+      const float scale = _config.learning_rate / _config.batch;
+      for (mat_index c = 0; c < classes; ++c)
+      {
+        _bias[c] -= scale * grad_b[c];
+        for (mat_index j = 0; j < hidden; ++j)
+        {
+          _weights (c, j) -= scale * grad_w[(std::size_t) c * hidden + j];
+        }
+      }
+      loss /= _config.batch;
+      _stats.updates++;
+      checkpoint_due |= _config.checkpoint_every > 0 &&
+                        !_weights_path.empty () &&
+                        _stats.updates % _config.checkpoint_every == 0;
+    }
+    _stats.last_loss = loss;
+    publish ();
+    if (checkpoint_due)
+    {
+      checkpoint_weights = _weights;
+      checkpoint_bias = _bias;
+      checkpoint_update = _stats.updates;
+    }
+  }
+  // the files are written outside the learner lock, so feedback and
+  // further updates never wait for the disk
+  if (checkpoint_due)
+  {
+    write_checkpoint (checkpoint_weights, checkpoint_bias, checkpoint_update,
+                      false);
+  }
+  return loss;
+}
+
+
+void OnlineLearner::publish ()
+{
+  const std::shared_ptr<const MlpNetwork> current = _handle.snapshot ();
+  const Dense& old = current->get_layer (MLP_SIZE - 1);
+  Dense adapted (share_matrix (_weights), share_matrix (_bias),
+                 old.get_activation ());
+  adapted.set_kernel_config (old.get_kernel_config ());
+  MlpNetwork next = *current;
+  next.set_layer (MLP_SIZE - 1, adapted);
+  _handle.publish (std::make_shared<const MlpNetwork> (std::move (next)));
+}
+
+
+void OnlineLearner::write_checkpoint (const Matrix& weights,
+                                      const Matrix& bias,
+                                      unsigned long long update, bool force)
+{
+  TRACE_SPAN("online checkpoint", "io");
+  std::lock_guard<std::mutex> lock (_checkpoint_mutex);
+  if (!force && update <= _checkpointed)
+  {
+    return; // a later update was written meanwhile
+  }
+  std::string weights_path;
+  std::string bias_path;
+  {
+    std::lock_guard<std::mutex> learner_lock (_mutex);
+    weights_path = _weights_path;
+    bias_path = _bias_path;
+  }
+  if (weights_path.empty ())
+  {
+    return;
+  }
+  // both files are written in full before either replaces the old one, so
+  // a failed write leaves the previous checkpoint intact
+  writeMatricesToFiles ({weights_path, bias_path}, {weights, bias});
+  _checkpointed = std::max (_checkpointed, update);
+  std::lock_guard<std::mutex> learner_lock (_mutex);
+  _stats.checkpoints++;
+}
+
+
+void OnlineLearner::set_checkpoint_files (const std::string& weights_path,
+                                          const std::string& bias_path)
+{
+  std::lock_guard<std::mutex> lock (_mutex);
+  _weights_path = bias_path.empty () ? std::string () : weights_path;
+  _bias_path = weights_path.empty () ? std::string () : bias_path;
+}
+
+
+void OnlineLearner::checkpoint ()
+{
+  Matrix weights;
+  Matrix bias;
+  unsigned long long update;
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    if (_weights_path.empty ())
+    {
+      throw std::logic_error (NO_CHECKPOINT_ERROR);
+    }
+    weights = _weights;
+    bias = _bias;
+    update = _stats.updates;
+  }
+  write_checkpoint (weights, bias, update, true);
+}
+
+
+online_stats OnlineLearner::get_stats () const
+{
+  std::lock_guard<std::mutex> lock (_mutex);
+  return _stats;
+}
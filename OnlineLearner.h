@@ -0,0 +1,172 @@
+// OnlineLearner.h
+#ifndef ONLINELEARNER_H
+#define ONLINELEARNER_H
+
+#include "MlpNetwork.h"
+#include "ModelHandle.h"
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#define ONLINE_LEARNING_RATE 0.05f
+#define ONLINE_BATCH 16
+// feedback samples kept; the oldest is dropped past this
+#define ONLINE_MAX_SAMPLES 4096
+// updates between checkpoints of the adapted layer; 0 disables them
+#define ONLINE_CHECKPOINT_UPDATES 100
+
+/**
+ * @struct online_config
+ * @brief Parameters of an OnlineLearner.
+ * @var learning_rate - SGD step size
+ * @var batch - feedback samples drawn per update
+ * @var max_samples - feedback samples kept, most recent first
+ * @var checkpoint_every - updates between checkpoints, 0 for none
+ */
+typedef struct online_config {
+	float learning_rate;
+	int batch;
+	std::size_t max_samples;
+	int checkpoint_every;
+} online_config;
+
+/**
+ * @struct online_stats
+ * @brief Counters of an OnlineLearner.
+ * @var samples - feedback samples received
+ * @var updates - SGD steps taken
+ * @var checkpoints - checkpoints written
+ * @var last_loss - mean cross-entropy of the last step's mini-batch
+ */
+typedef struct online_stats {
+	unsigned long long samples, updates, checkpoints;
+	double last_loss;
+} online_stats;
+
+/**
+ * @class OnlineLearner
+ * @brief Adapts the output layer of a network to labelled feedback while
+ * the network keeps serving.
+ *
+ * The first three layers stay frozen, so each feedback image is run
+ * through them once and only its 20 layer-3 features are kept. An update
+ * is a mini-batch SGD step on the softmax cross-entropy of the output
+ * layer alone (10 x 20 weights and 10 biases) over samples drawn from the
+ * kept features: a few thousand multiply-adds, i.e. microseconds.
+ *
+ * Serving reads network(), an immutable snapshot. Each update builds the
+ * next snapshot, which shares the frozen layers, and publishes it through a
+ * ModelHandle; serving threads never wait on a lock, and a request in
+ * flight finishes on the snapshot it started with. Feedback and updates
+ * are serialized among themselves.
+ *
+ * Every checkpoint_every updates the adapted weights and bias are written
+ * in the format of the model's w4 and b4 files, which every tool loads.
+ * Both files are written in full before either is renamed into place, so a
+ * failed write keeps the previous checkpoint.
+ */
+class OnlineLearner {
+
+ private:
+  ModelHandle _handle; /**< Publishes the snapshots to serving threads. */
+  mutable std::mutex _mutex; /**< Serializes feedback and updates. */
+  std::mutex _checkpoint_mutex; /**< Serializes checkpoint writes. */
+  online_config _config; /**< Parameters. */
+  Matrix _weights; /**< The output layer's weights being trained. */
+  Matrix _bias; /**< The output layer's bias being trained. */
+  std::vector<float> _features; /**< Ring of kept features, one sample
+ * of _weights.get_cols() floats after another. */
+  std::vector<unsigned int> _labels; /**< Label of every kept sample. */
+  std::size_t _next; /**< Ring slot of the next sample. */
+  std::size_t _count; /**< Samples kept. */
+  std::mt19937 _gen; /**< Draws the mini-batches. */
+  std::string _weights_path; /**< Checkpoint file of the weights. */
+  std::string _bias_path; /**< Checkpoint file of the bias. */
+  unsigned long long _checkpointed; /**< Update count last checkpointed. */
+  online_stats _stats; /**< Counters. */
+
+/**
+ * @brief Publishes a snapshot with the current output layer.
+ */
+  void publish ();
+
+/**
+ * @brief Writes the given output layer, as of the given update count, to
+ * the checkpoint files; unless forced, not if a later update was written
+ * already.
+ */
+  void write_checkpoint (const Matrix& weights, const Matrix& bias,
+                         unsigned long long update, bool force);
+
+ public:
+/**
+ * @brief Constructs a learner starting from a network.
+ *
+ * @param mlp The network; its last layer must use softmax. Copied, which
+ * shares its weights.
+ * @param config The parameters.
+ * @throw std::invalid_argument if the last layer is not softmax or a
+ * parameter is out of range.
+ */
+  OnlineLearner (const MlpNetwork& mlp,
+                 const online_config& config = {ONLINE_LEARNING_RATE,
+                                                ONLINE_BATCH,
+                                                ONLINE_MAX_SAMPLES,
+                                                ONLINE_CHECKPOINT_UPDATES});
+
+/**
+ * @brief Returns the current snapshot of the network, to serve from. It
+ * stays valid, unchanged, for as long as the caller holds it.
+ */
+  std::shared_ptr<const MlpNetwork> network () const;
+
+/**
+ * @brief Classifies an image with the current snapshot.
+ */
+  digit operator() (const Matrix& img) const;
+
+/**
+ * @brief Keeps the layer-3 features of a labelled image for later updates.
+ *
+ * @param img The image, e.g. one that was misclassified.
+ * @param label The correct digit.
+ * @throw std::out_of_range if label is not a class of the network.
+ */
+  void add_feedback (const Matrix& img, unsigned int label);
+
+/**
+ * @brief Takes SGD steps on the kept feedback and publishes the result.
+ *
+ * Writes a checkpoint, after releasing the learner, whenever the update
+ * count reaches a multiple of checkpoint_every and checkpoint files are
+ * set.
+ *
+ * @param steps The number of steps.
+ * @return The mean loss of the last step's mini-batch, 0 without feedback.
+ */
+  double update (int steps = 1);
+
+/**
+ * @brief Sets the files checkpoints are written to; empty paths disable
+ * checkpointing.
+ */
+  void set_checkpoint_files (const std::string& weights_path,
+                             const std::string& bias_path);
+
+/**
+ * @brief Writes a checkpoint of the output layer now.
+ *
+ * @throw std::logic_error if no checkpoint files are set.
+ * @throw std::runtime_error if a file cannot be written.
+ */
+  void checkpoint ();
+
+/**
+ * @brief Returns the learner's counters.
+ */
+  online_stats get_stats () const;
+};
+
+#endif //ONLINELEARNER_H
@@ -0,0 +1,220 @@
+#include "PredictionCache.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cstring>
+
+// rough cost of a list node plus a hash map node and bucket
+#define ENTRY_OVERHEAD_BYTES 96
+
+
+PredictionCache::PredictionCache (std::size_t max_bytes)
+    : _generation (0), _hits (0), _misses (0), _evictions (0),
+      _invalidations (0)
+{
+  for (int i = 0; i < CACHE_SHARDS; ++i)
+  {
+    _shards.emplace_back (new Shard);
+  }
+  _shard_bytes = max_bytes / CACHE_SHARDS;
+}
+
+
+std::size_t PredictionCache::entry_bytes (std::size_t image_elements)
+{
+  return sizeof (Entry) + image_elements * sizeof (float) +
+         ENTRY_OVERHEAD_BYTES;
+}
+
+
+PredictionCache::Shard& PredictionCache::shard_of (std::uint64_t key) const
+{
+  // the low bits pick the hash map bucket, use the high ones for the shard
+  return *_shards[(key >> 56) % CACHE_SHARDS];
+}
+
+
+std::uint64_t PredictionCache::key_of (const Matrix& img)
+{
+  return xxhash64 (img.get_data (), (std::size_t) img.get_rows () *
+                                    img.get_cols () * sizeof (float));
+}
+
+
+std::uint64_t PredictionCache::generation () const
+{
+  return _generation.load (std::memory_order_acquire);
+}
+
+
+bool PredictionCache::lookup (const Matrix& img, digit& out)
+{
+  std::uint64_t key = key_of (img);
+  std::size_t n = (std::size_t) img.get_rows () * img.get_cols ();
+  Shard& shard = shard_of (key);
+  {
+    std::lock_guard<std::mutex> lock (shard.mutex);
+    auto it = shard.index.find (key);
+    if (it != shard.index.end () && it->second->image.size () == n &&
+        std::memcmp (it->second->image.data (), img.get_data (),
+                     n * sizeof (float)) == 0)
+    {
+      shard.lru.splice (shard.lru.begin (), shard.lru, it->second);
+      out = it->second->result;
+      _hits.fetch_add (1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  _misses.fetch_add (1, std::memory_order_relaxed);
+  return false;
+}
+
+
+void PredictionCache::insert (const Matrix& img, const digit& result,
+                              std::uint64_t generation)
+{
+  std::size_t n = (std::size_t) img.get_rows () * img.get_cols ();
+  std::size_t bytes = entry_bytes (n);
+  if (bytes > _shard_bytes)
+  {
+    return;
+  }
+  std::uint64_t key = key_of (img);
+  Shard& shard = shard_of (key);
+  std::lock_guard<std::mutex> lock (shard.mutex);
+  // checked under the shard lock: invalidate() takes every shard lock after
+  // bumping the generation, so a stale result can't slip in behind it
+  if (generation != _generation.load (std::memory_order_acquire))
+  {
+    return;
+  }
+  auto it = shard.index.find (key);
+  if (it != shard.index.end ())
+  {
+    // same key: either the same image or a collision, newest wins
+    shard.bytes -= entry_bytes (it->second->image.size ());
+    shard.lru.erase (it->second);
+    shard.index.erase (it);
+  }
+  while (!shard.lru.empty () && shard.bytes + bytes > _shard_bytes)
+  {
+    const Entry& victim = shard.lru.back ();
+    shard.bytes -= entry_bytes (victim.image.size ());
+    shard.index.erase (victim.key);
+    shard.lru.pop_back ();
+    _evictions.fetch_add (1, std::memory_order_relaxed);
+  }
+  const float* data = img.get_data ();
+  shard.lru.push_front (Entry {key, std::vector<float> (data, data + n),
+                               result});
+  shard.index[key] = shard.lru.begin ();
+  shard.bytes += bytes;
+}
+
+
+void PredictionCache::invalidate ()
+{
+  _generation.fetch_add (1, std::memory_order_acq_rel);
+  for (std::unique_ptr<Shard>& shard : _shards)
+  {
+    std::lock_guard<std::mutex> lock (shard->mutex);
+    shard->lru.clear ();
+    shard->index.clear ();
+    shard->bytes = 0;
+  }
+  _invalidations.fetch_add (1, std::memory_order_relaxed);
+}
+
+
+cache_stats PredictionCache::get_stats () const
+{
+  cache_stats stats;
+  stats.hits = _hits.load (std::memory_order_relaxed);
+  stats.misses = _misses.load (std::memory_order_relaxed);
+  stats.evictions = _evictions.load (std::memory_order_relaxed);
+  stats.invalidations = _invalidations.load (std::memory_order_relaxed);
+  stats.entries = 0;
+  stats.bytes = 0;
+  for (const std::unique_ptr<Shard>& shard : _shards)
+  {
+    std::lock_guard<std::mutex> lock (shard->mutex);
+    stats.entries += shard->lru.size ();
+    stats.bytes += shard->bytes;
+  }
+  return stats;
+}
+
+
+CachedMlpNetwork::CachedMlpNetwork (const MlpNetwork& mlp,
+                                    PredictionCache& cache)
+    : _mlp (&mlp), _cache (cache) {}
+
+
+void CachedMlpNetwork::set_network (const MlpNetwork& mlp)
+{
+  _mlp = &mlp;
+  _cache.invalidate ();
+}
+
+
+digit CachedMlpNetwork::operator() (const Matrix& img) const
+{
+  digit result;
+  if (_cache.lookup (img, result))
+  {
+    return result;
+  }
+  std::uint64_t generation = _cache.generation ();
+  Matrix vec = img;
+  result = (*_mlp) (vec);
+  _cache.insert (img, result, generation);
+  return result;
+}
+
+
+std::vector<digit> CachedMlpNetwork::predict_batch (
+    const std::vector<Matrix>& imgs) const
+{
+  std::vector<digit> results (imgs.size ());
+  // misses[m] is computed once and answers every image in owners[m]:
+  // duplicates inside one batch only cost one forward pass
+  std::vector<Matrix> misses;
+  std::vector<std::vector<std::size_t> > owners;
+  std::unordered_map<std::uint64_t, std::size_t> first_miss;
+  for (std::size_t i = 0; i < imgs.size (); ++i)
+  {
+    if (_cache.lookup (imgs[i], results[i]))
+    {
+      continue;
+    }
+    std::uint64_t key = PredictionCache::key_of (imgs[i]);
+    auto it = first_miss.find (key);
+    std::size_t n = (std::size_t) imgs[i].get_rows () * imgs[i].get_cols ();
+    if (it != first_miss.end () &&
+        (std::size_t) misses[it->second].get_rows () *
+        misses[it->second].get_cols () == n &&
+        std::memcmp (misses[it->second].get_data (), imgs[i].get_data (),
+                     n * sizeof (float)) == 0)
+    {
+      owners[it->second].push_back (i);
+      continue;
+    }
+    first_miss[key] = misses.size ();
+    misses.push_back (imgs[i]);
+    owners.push_back (std::vector<std::size_t> (1, i));
+  }
+  if (misses.empty ())
+  {
+    return results;
+  }
+  std::uint64_t generation = _cache.generation ();
+  std::vector<digit> computed = _mlp->predict_batch (misses);
+  for (std::size_t m = 0; m < misses.size (); ++m)
+  {
+    for (std::size_t i : owners[m])
+    {
+      results[i] = computed[m];
+    }
+    _cache.insert (misses[m], computed[m], generation);
+  }
+  return results;
+}
@@ -0,0 +1,173 @@
+// PredictionCache.h
+#ifndef PREDICTIONCACHE_H
+#define PREDICTIONCACHE_H
+
+#include "MlpNetwork.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define DEFAULT_CACHE_BYTES (64u << 20)
+#define CACHE_SHARDS 16
+
+/**
+ * @struct cache_stats
+ * @brief Counters of a PredictionCache.
+ * @var hits - lookups answered from the cache
+ * @var misses - lookups that found nothing (or a hash collision)
+ * @var evictions - entries dropped to stay under the memory cap
+ * @var invalidations - calls to invalidate()
+ * @var entries - entries currently held
+ * @var bytes - estimated memory currently held
+ */
+typedef struct cache_stats {
+	unsigned long long hits, misses, evictions, invalidations;
+	std::size_t entries, bytes;
+} cache_stats;
+
+/**
+ * @class PredictionCache
+ * @brief Bounded, thread-safe LRU cache of classifications keyed by the
+ * content of the input image.
+ *
+ * Images are keyed by the xxhash64 of their bytes. Each entry also keeps a
+ * copy of the image, so a hash collision is detected and counted as a miss
+ * instead of returning another image's digit. The cache is split into
+ * CACHE_SHARDS independently locked LRU lists to keep concurrent serving
+ * threads from contending on one mutex; the memory cap is divided evenly
+ * between the shards.
+ *
+ * Results are only valid for the model that produced them. invalidate()
+ * drops every entry and bumps a generation number; an insert() carrying the
+ * generation of an earlier model is ignored, so a result that was computed
+ * while the model was being replaced never enters the cache.
+ */
+class PredictionCache {
+
+ private:
+  struct Entry
+  {
+    std::uint64_t key;
+    std::vector<float> image;
+    digit result;
+  };
+  struct Shard
+  {
+    std::mutex mutex;
+    std::list<Entry> lru; // most recently used first
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index;
+    std::size_t bytes = 0;
+  };
+
+  std::vector<std::unique_ptr<Shard> > _shards; /**< The cache shards. */
+  std::size_t _shard_bytes; /**< Memory cap of each shard. */
+  std::atomic<std::uint64_t> _generation; /**< Bumped by invalidate(). */
+  std::atomic<unsigned long long> _hits, _misses, _evictions, _invalidations;
+
+  static std::size_t entry_bytes (std::size_t image_elements);
+  Shard& shard_of (std::uint64_t key) const;
+
+ public:
+/**
+ * @brief Constructs an empty cache.
+ *
+ * @param max_bytes Upper bound of the memory held by the entries, including
+ * the per-entry bookkeeping.
+ */
+  explicit PredictionCache (std::size_t max_bytes = DEFAULT_CACHE_BYTES);
+
+  PredictionCache (const PredictionCache&) = delete;
+  PredictionCache& operator= (const PredictionCache&) = delete;
+
+/**
+ * @brief Returns the hash the cache keys an image by.
+ */
+  static std::uint64_t key_of (const Matrix& img);
+
+/**
+ * @brief Returns the current model generation; pass it back to insert().
+ */
+  std::uint64_t generation () const;
+
+/**
+ * @brief Looks up the classification of an image and marks it most
+ * recently used.
+ *
+ * @param img The input image.
+ * @param out Receives the cached digit on a hit.
+ * @return true on a hit.
+ */
+  bool lookup (const Matrix& img, digit& out);
+
+/**
+ * @brief Stores the classification of an image, evicting least recently
+ * used entries to stay within the memory cap.
+ *
+ * @param img The input image.
+ * @param result Its classification.
+ * @param generation The generation() read before computing result; a stale
+ * generation makes the call a no-op.
+ */
+  void insert (const Matrix& img, const digit& result,
+               std::uint64_t generation);
+
+/**
+ * @brief Drops every entry. Call whenever the model behind the cache
+ * changes.
+ */
+  void invalidate ();
+
+/**
+ * @brief Returns a snapshot of the cache counters.
+ */
+  cache_stats get_stats () const;
+};
+
+/**
+ * @class CachedMlpNetwork
+ * @brief Puts a PredictionCache in front of an MlpNetwork's single-image and
+ * batch paths.
+ *
+ * Thread-safe as long as set_network() is not called concurrently with
+ * classification.
+ */
+class CachedMlpNetwork {
+
+ private:
+  const MlpNetwork* _mlp; /**< The network answering cache misses. */
+  PredictionCache& _cache; /**< The cache, possibly shared. */
+
+ public:
+/**
+ * @brief Wraps a network with a cache. Both must outlive the wrapper.
+ */
+  CachedMlpNetwork (const MlpNetwork& mlp, PredictionCache& cache);
+
+/**
+ * @brief Replaces the network and invalidates the cache.
+ */
+  void set_network (const MlpNetwork& mlp);
+
+/**
+ * @brief Classifies an image, running the network only on a cache miss.
+ *
+ * @param img The input image.
+ * @return The classified digit.
+ */
+  digit operator() (const Matrix& img) const;
+
+/**
+ * @brief Classifies a batch of images. Cache hits are answered directly and
+ * only the misses go through MlpNetwork::predict_batch().
+ *
+ * @param imgs The input images.
+ * @return One classified digit per image, in order.
+ */
+  std::vector<digit> predict_batch (const std::vector<Matrix>& imgs) const;
+};
+
+#endif //PREDICTIONCACHE_H
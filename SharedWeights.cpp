@@ -0,0 +1,191 @@
+#include "SharedWeights.h"
+#include <iomanip>
+#include <map>
+#include <mutex>
+
+typedef std::weak_ptr<const Matrix> MatrixWeakPtr;
+
+/**
+ * @brief Process-wide bookkeeping of the shared buffers.
+ */
+struct weight_registry
+{
+  std::mutex mutex;
+  std::vector<MatrixWeakPtr> buffers;
+  // (source, kind) -> derived buffer; the source is kept weakly as well, so
+  // a new matrix allocated at a dead source's address never hits
+  std::map<std::pair<const Matrix*, int>,
+           std::pair<MatrixWeakPtr, MatrixWeakPtr> > derived;
+  std::map<std::string, std::vector<MatrixWeakPtr> > models;
+
+  static weight_registry& get ()
+  {
+    static weight_registry registry;
+    return registry;
+  }
+};
+
+
+/**
+ * @brief Returns the bytes of float data a matrix holds.
+ */
+static std::size_t matrix_bytes (const Matrix& mat)
+{
+  return (std::size_t) mat.get_rows () * mat.get_cols () * sizeof (float);
+}
+
+
+MatrixPtr share_matrix (Matrix&& mat)
+{
+  MatrixPtr ptr = std::make_shared<const Matrix> (std::move (mat));
+  weight_registry& registry = weight_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  // drop dead entries now and then so the list tracks the live set
+  if (registry.buffers.size () >= 64 &&
+      (registry.buffers.size () & (registry.buffers.size () - 1)) == 0)
+  {
+    std::vector<MatrixWeakPtr> live;
+    for (const MatrixWeakPtr& buffer : registry.buffers)
+    {
+      if (!buffer.expired ())
+      {
+        live.push_back (buffer);
+      }
+    }
+    registry.buffers.swap (live);
+  }
+  registry.buffers.push_back (ptr);
+  return ptr;
+}
+
+
+MatrixPtr share_matrix (const Matrix& mat)
+{
+  return share_matrix (Matrix (mat));
+}
+
+
+MatrixPtr derived_matrix (const MatrixPtr& source, derived_kind kind,
+                          const std::function<Matrix (const Matrix&)>& make)
+{
+  weight_registry& registry = weight_registry::get ();
+  std::pair<const Matrix*, int> key (source.get (), (int) kind);
+  {
+    std::lock_guard<std::mutex> lock (registry.mutex);
+    auto it = registry.derived.find (key);
+    if (it != registry.derived.end () && it->second.first.lock () == source)
+    {
+      MatrixPtr cached = it->second.second.lock ();
+      if (cached)
+      {
+        return cached;
+      }
+    }
+  }
+  // built outside the lock; if two threads race, the second one's buffer
+  // wins the slot and the first stays private to its caller
+  MatrixPtr built = share_matrix (make (*source));
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  // the weak references keep their control blocks, and so the matrices'
+  // make_shared blocks, allocated; drop the dead entries now and then like
+  // share_matrix does, so rebuilt layers don't grow the map forever
+  const std::size_t entries = registry.derived.size ();
+  if (entries >= 64 && (entries & (entries - 1)) == 0)
+  {
+    for (auto it = registry.derived.begin (); it != registry.derived.end ();)
+    {
+      if (it->second.first.expired () || it->second.second.expired ())
+      {
+        it = registry.derived.erase (it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+  registry.derived[key] = std::make_pair (MatrixWeakPtr (source),
+                                          MatrixWeakPtr (built));
+  return built;
+}
+
+
+void register_model (const std::string& name,
+                     const std::vector<MatrixPtr>& buffers)
+{
+  weight_registry& registry = weight_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  registry.models[name] = std::vector<MatrixWeakPtr> (buffers.begin (),
+                                                      buffers.end ());
+}
+
+
+void unregister_model (const std::string& name)
+{
+  weight_registry& registry = weight_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  registry.models.erase (name);
+}
+
+
+void memory_report (std::ostream& out)
+{
+  weight_registry& registry = weight_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+
+  std::size_t live = 0, live_bytes = 0;
+  for (const MatrixWeakPtr& weak : registry.buffers)
+  {
+    MatrixPtr buffer = weak.lock ();
+    if (buffer)
+    {
+      live++;
+      live_bytes += matrix_bytes (*buffer);
+    }
+  }
+  // how many registered models reference each live buffer
+  std::map<const Matrix*, int> users;
+  for (const auto& model : registry.models)
+  {
+    std::map<const Matrix*, bool> seen;
+    for (const MatrixWeakPtr& weak : model.second)
+    {
+      MatrixPtr buffer = weak.lock ();
+      if (buffer && !seen[buffer.get ()])
+      {
+        seen[buffer.get ()] = true;
+        users[buffer.get ()]++;
+      }
+    }
+  }
+
+  out << "shared parameter buffers: " << live << ", " << live_bytes
+      << " bytes\n"
+      << std::left << std::setw (20) << "model" << std::right
+      << std::setw (9) << "buffers" << std::setw (13) << "bytes"
+      << std::setw (13) << "unique" << std::setw (13) << "shared" << "\n";
+  for (const auto& model : registry.models)
+  {
+    std::size_t count = 0, bytes = 0, unique = 0;
+    std::map<const Matrix*, bool> seen;
+    for (const MatrixWeakPtr& weak : model.second)
+    {
+      MatrixPtr buffer = weak.lock ();
+      if (!buffer || seen[buffer.get ()])
+      {
+        continue;
+      }
+      seen[buffer.get ()] = true;
+      count++;
+      bytes += matrix_bytes (*buffer);
+      if (users[buffer.get ()] == 1)
+      {
+        unique += matrix_bytes (*buffer);
+      }
+    }
+    out << std::left << std::setw (20) << model.first << std::right
+        << std::setw (9) << count << std::setw (13) << bytes
+        << std::setw (13) << unique << std::setw (13) << bytes - unique
+        << "\n";
+  }
+}
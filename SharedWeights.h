@@ -0,0 +1,86 @@
+// SharedWeights.h
+#ifndef SHAREDWEIGHTS_H
+#define SHAREDWEIGHTS_H
+
+#include "Matrix.h"
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**   typedefs  */
+typedef std::shared_ptr<const Matrix> MatrixPtr;
+
+/**
+ * @brief Layouts derived from a weight matrix that may be cached per
+ * matrix and shared by every layer built on it.
+ */
+enum derived_kind
+{
+  DERIVED_PACKED, /**< Dense's panel-interleaved layout. */
+  DERIVED_TRANSPOSED, /**< Column-major copy for the sparse-input path. */
+  DERIVED_ROW_SUMS /**< Row sums, for Dense's byte input offset. */
+};
+
+/**
+ * @brief Moves a matrix into a reference-counted immutable buffer.
+ *
+ * Every buffer created here is tracked (weakly) for memory_report().
+ *
+ * @param mat The matrix; left empty.
+ * @return The shared buffer.
+ */
+MatrixPtr share_matrix (Matrix&& mat);
+
+/**
+ * @brief Copies a matrix into a reference-counted immutable buffer.
+ *
+ * @param mat The matrix to copy.
+ * @return The shared buffer.
+ */
+MatrixPtr share_matrix (const Matrix& mat);
+
+/**
+ * @brief Returns a layout derived from a shared matrix, building it only
+ * the first time.
+ *
+ * While any holder keeps the returned buffer alive, later calls with the same
+ * source and kind return that same buffer, so any number of layers over the
+ * same weights share a single packed copy.
+ *
+ * @param source The source matrix.
+ * @param kind Which derived layout.
+ * @param make Builds the derived matrix from the source on a cache miss.
+ * @return The shared derived buffer.
+ */
+MatrixPtr derived_matrix (const MatrixPtr& source, derived_kind kind,
+                          const std::function<Matrix (const Matrix&)>& make);
+
+/**
+ * @brief Names a set of buffers as a model for memory_report().
+ *
+ * Only weak references are kept: registering never extends a buffer's
+ * lifetime. Registering an existing name replaces it.
+ *
+ * @param name The model name.
+ * @param buffers Every buffer the model holds.
+ */
+void register_model (const std::string& name,
+                     const std::vector<MatrixPtr>& buffers);
+
+/**
+ * @brief Removes a model name from memory_report().
+ */
+void unregister_model (const std::string& name);
+
+/**
+ * @brief Prints the memory held by all live shared buffers of the process
+ * and, per registered model, the bytes it references, the bytes no other
+ * registered model references, and the bytes it shares.
+ *
+ * @param out The stream to print to.
+ */
+void memory_report (std::ostream& out);
+
+#endif //SHAREDWEIGHTS_H
@@ -0,0 +1,134 @@
+// SpscQueue.h
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <stdexcept>
+
+#define CACHE_LINE_SIZE 64
+#define QUEUE_CAPACITY_ERROR "Error: SpscQueue capacity must be positive"
+
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may call try_push() and exactly one (other) thread may
+ * call try_pop(). Slots are preallocated and reused: elements are copy
+ * assigned in and out, so a slot type whose assignment reuses its storage
+ * (like Matrix of a fixed size) passes through the queue without touching
+ * the allocator. The head and tail indices live on separate cache lines and
+ * each side keeps a cached copy of the other side's index, so in steady
+ * state a push or pop only touches shared memory when the cache is stale.
+ */
+template <typename T>
+class SpscQueue {
+
+ private:
+  std::vector<T> _slots; /**< The ring storage, a power-of-two size. */
+  std::size_t _mask; /**< _slots.size() - 1, for cheap wrap-around. */
+
+  // consumer-owned and producer-owned indices are padded apart so the two
+  // threads never write to the same cache line (padding rather than alignas,
+  // which operator new only honours from C++17 on)
+  char _pad0[CACHE_LINE_SIZE];
+  std::atomic<std::size_t> _head; /**< Next slot the consumer reads. Written
+ * by the consumer only. */
+  std::size_t _cached_tail; /**< Consumer's copy of _tail. */
+  char _pad1[CACHE_LINE_SIZE];
+  std::atomic<std::size_t> _tail; /**< Next slot the producer writes. Written
+ * by the producer only. */
+  std::size_t _cached_head; /**< Producer's copy of _head. */
+  char _pad2[CACHE_LINE_SIZE];
+
+  static std::size_t round_up_pow2 (std::size_t n)
+  {
+    std::size_t p = 1;
+    while (p < n)
+    {
+      p <<= 1;
+    }
+    return p;
+  }
+
+ public:
+/**
+ * @brief Constructs a queue holding at least capacity elements.
+ *
+ * @param capacity The minimal number of in-flight elements.
+ * @param prototype The value every slot is initialised with; pass a value of
+ * the steady-state shape so that later assignments reuse the slot storage.
+ */
+  explicit SpscQueue (std::size_t capacity, const T& prototype = T ())
+      : _head (0), _cached_tail (0), _tail (0), _cached_head (0)
+  {
+    if (capacity == 0)
+    {
+      throw std::length_error (QUEUE_CAPACITY_ERROR);
+    }
+    // one slot stays empty to tell "full" from "empty"
+    _slots.assign (round_up_pow2 (capacity + 1), prototype);
+    _mask = _slots.size () - 1;
+  }
+
+  SpscQueue (const SpscQueue&) = delete;
+  SpscQueue& operator= (const SpscQueue&) = delete;
+
+/**
+ * @brief Appends an element. Producer side only.
+ *
+ * @param value The element to copy into the queue.
+ * @return true on success, false if the queue is full.
+ */
+  bool try_push (const T& value)
+  {
+    const std::size_t tail = _tail.load (std::memory_order_relaxed);
+    const std::size_t next = (tail + 1) & _mask;
+    if (next == _cached_head)
+    {
+      _cached_head = _head.load (std::memory_order_acquire);
+      if (next == _cached_head)
+      {
+        return false;
+      }
+    }
+    _slots[tail] = value;
+    _tail.store (next, std::memory_order_release);
+    return true;
+  }
+
+/**
+ * @brief Removes the oldest element. Consumer side only.
+ *
+ * @param out Receives the element.
+ * @return true on success, false if the queue is empty.
+ */
+  bool try_pop (T& out)
+  {
+    const std::size_t head = _head.load (std::memory_order_relaxed);
+    if (head == _cached_tail)
+    {
+      _cached_tail = _tail.load (std::memory_order_acquire);
+      if (head == _cached_tail)
+      {
+        return false;
+      }
+    }
+    out = _slots[head];
+    _head.store ((head + 1) & _mask, std::memory_order_release);
+    return true;
+  }
+
+/**
+ * @brief Returns true if the queue held no elements at the time of the call.
+ * Safe from either side, but only a snapshot.
+ */
+  bool empty () const
+  {
+    return _head.load (std::memory_order_acquire) ==
+           _tail.load (std::memory_order_acquire);
+  }
+};
+
+#endif //SPSCQUEUE_H
@@ -0,0 +1,138 @@
+#include "StreamSession.h"
+#include "Trace.h"
+#include <cmath>
+
+#define FRAME_SIZE_ERROR "Error: frame size does not match the network input"
+#define THRESHOLD_ERROR "Error: stream threshold must be non-negative"
+#define REFRESH_ERROR "Error: stream refresh interval must be positive"
+
+
+StreamSession::StreamSession (const MlpNetwork& mlp, float threshold,
+                              int refresh_frames) :
+_mlp (mlp), _columns (mlp.get_layer (0).get_columns ()), _threshold (0),
+_refresh_frames (STREAM_REFRESH_FRAMES), _frame (), _pre (), _primed (false),
+_since_refresh (0), _stats {0, 0, 0, 0}, _changed ()
+{
+  set_threshold (threshold);
+  set_refresh_frames (refresh_frames);
+}
+
+
+void StreamSession::refresh (const Matrix& frame)
+{
+  TRACE_SPAN("stream refresh", "stream");
+  _frame = frame;
+  _pre = _mlp.get_layer (0).pre_activation (_frame);
+  _primed = true;
+  _since_refresh = 0;
+  _stats.full_updates++;
+}
+
+
+Matrix StreamSession::forward (const Matrix& frame)
+{
+  TRACE_SPAN("stream frame", "stream");
+  // _columns is the transposed weights: one row of outputs per input
+  if (frame.size () != _columns->get_rows ())
+  {
+    throw std::length_error (FRAME_SIZE_ERROR);
+  }
+  _stats.frames++;
+  Matrix vec = frame;
+  if (vec.get_cols () != 1)
+  {
+    vec.vectorize ();
+  }
+  if (!_primed || _since_refresh >= _refresh_frames)
+  {
+    refresh (vec);
+  }
+  else
+  {
+    const float* now = vec.get_data ();
+    const float* was = _frame.get_data ();
+    const mat_index pixels = vec.get_rows ();
+    _changed.clear ();
+    for (mat_index j = 0; j < pixels; ++j)
+    {
+      if (std::fabs (now[j] - was[j]) > _threshold)
+      {
+        _changed.push_back (j);
+      }
+    }
+    if (_changed.size () > STREAM_DENSE_FRACTION * pixels)
+    {
+      refresh (vec);
+    }
+    else
+    {
+      // rank-sparse update: pre += column j * (now[j] - was[j]) per
+      // changed pixel; the cached frame takes the new value of exactly
+      // those pixels
+      const mat_index rows = _pre.get_rows ();
+      float* pre = _pre.get_data ();
+      float* cached = _frame.get_data ();
+      for (mat_index j : _changed)
+      {
+        const float delta = now[j] - cached[j];
+        const float* col = _columns->get_data () + (std::size_t) j * rows;
+        for (mat_index i = 0; i < rows; ++i)
+        {
+          pre[i] += delta * col[i];
+        }
+        cached[j] = now[j];
+      }
+      _since_refresh++;
+      _stats.delta_updates++;
+      _stats.changed_pixels += _changed.size ();
+    }
+  }
+  const Dense& first = _mlp.get_layer (0);
+  return _mlp.forward_from (1, first.get_activation () (_pre));
+}
+
+
+digit StreamSession::operator() (const Matrix& frame)
+{
+  Matrix probs = forward (frame);
+  mat_index best = probs.argmax ();
+  return digit {(unsigned int) best, probs[best]};
+}
+
+
+void StreamSession::reset ()
+{
+  _primed = false;
+}
+
+
+void StreamSession::set_threshold (float threshold)
+{
+  if (!(threshold >= 0))
+  {
+    throw std::invalid_argument (THRESHOLD_ERROR);
+  }
+  _threshold = threshold;
+}
+
+
+float StreamSession::get_threshold () const
+{
+  return _threshold;
+}
+
+
+void StreamSession::set_refresh_frames (int refresh_frames)
+{
+  if (refresh_frames <= 0)
+  {
+    throw std::invalid_argument (REFRESH_ERROR);
+  }
+  _refresh_frames = refresh_frames;
+}
+
+
+stream_stats StreamSession::get_stats () const
+{
+  return _stats;
+}
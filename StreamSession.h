@@ -0,0 +1,136 @@
+// StreamSession.h
+#ifndef STREAMSESSION_H
+#define STREAMSESSION_H
+
+#include "MlpNetwork.h"
+#include <vector>
+
+// a pixel counts as changed when it moves by more than this
+#define STREAM_DELTA_THRESHOLD 0.0f
+// incremental frames between full recomputations, which clear the
+// rounding error the updates accumulate
+#define STREAM_REFRESH_FRAMES 256
+// past this fraction of changed pixels a full product is cheaper
+#define STREAM_DENSE_FRACTION 0.25f
+
+/**
+ * @struct stream_stats
+ * @brief Counters of a StreamSession.
+ * @var frames - frames classified
+ * @var full_updates - frames that recomputed the first layer in full
+ * @var delta_updates - frames that updated it from the changed pixels
+ * @var changed_pixels - changed pixels summed over the delta updates
+ */
+typedef struct stream_stats {
+	unsigned long long frames, full_updates, delta_updates, changed_pixels;
+} stream_stats;
+
+/**
+ * @class StreamSession
+ * @brief Classifies the frames of one stream, reusing the first layer's
+ * work between consecutive frames.
+ *
+ * The session keeps the first layer's pre-activations (weights * frame +
+ * bias) of the frame it last saw. For the next frame only the pixels that
+ * moved by more than the threshold are visited: each adds its weight
+ * column, scaled by its change, to the cached pre-activations, so a frame
+ * with c changed pixels costs c * 128 multiply-adds in the first layer
+ * instead of 784 * 128. The later layers are cheap and run in full.
+ *
+ * Pixels that moved by no more than the threshold are left at their old
+ * value in the cache, so the result is that of a frame within the threshold
+ * of the real one at every pixel; a threshold of 0 tracks every change.
+ * The first layer is recomputed from scratch every refresh_frames frames,
+ * and whenever more than STREAM_DENSE_FRACTION of the pixels changed.
+ *
+ * Use one session per stream; a session is not thread-safe, while any
+ * number of sessions may share one network.
+ */
+class StreamSession {
+
+ private:
+  MlpNetwork _mlp; /**< The network; shares the caller's weights. */
+  MatrixPtr _columns; /**< First-layer weights, one input per column. */
+  float _threshold; /**< Smallest change that counts. */
+  int _refresh_frames; /**< Delta updates between full recomputations. */
+  Matrix _frame; /**< The input the cached pre-activations belong to. */
+  Matrix _pre; /**< First-layer pre-activations of _frame. */
+  bool _primed; /**< Whether _frame and _pre hold a frame. */
+  int _since_refresh; /**< Delta updates since the last full one. */
+  stream_stats _stats; /**< Counters. */
+  std::vector<mat_index> _changed; /**< Scratch: changed pixel indices. */
+
+/**
+ * @brief Recomputes the cached pre-activations of a frame in full.
+ */
+  void refresh (const Matrix& frame);
+
+ public:
+/**
+ * @brief Constructs a session with no previous frame.
+ *
+ * @param mlp The network; copied, which shares its weights.
+ * @param threshold Smallest pixel change that updates the cache.
+ * @param refresh_frames Delta updates between full recomputations.
+ * @throw std::invalid_argument if threshold is negative or refresh_frames
+ * is not positive.
+ */
+  StreamSession (const MlpNetwork& mlp,
+                 float threshold = STREAM_DELTA_THRESHOLD,
+                 int refresh_frames = STREAM_REFRESH_FRAMES);
+
+/**
+ * @brief Classifies the next frame of the stream.
+ *
+ * @param frame The image, of any shape holding img_dims.rows *
+ * img_dims.cols elements.
+ * @return The classified digit.
+ * @throw std::length_error if the frame has the wrong number of pixels.
+ */
+  digit operator() (const Matrix& frame);
+
+/**
+ * @brief Runs the next frame of the stream and returns the full output
+ * distribution.
+ *
+ * @param frame The image.
+ * @return The softmax output, one column of class probabilities.
+ * @throw std::length_error if the frame has the wrong number of pixels.
+ */
+  Matrix forward (const Matrix& frame);
+
+/**
+ * @brief Forgets the previous frame; the next one is computed in full.
+ */
+  void reset ();
+
+/**
+ * @brief Sets the smallest pixel change that updates the cache.
+ *
+ * Raising it lets pixels lag by up to the new threshold; recomputing in
+ * full after a change keeps the guarantee for the stricter one.
+ *
+ * @param threshold The threshold, at least 0.
+ * @throw std::invalid_argument if threshold is negative.
+ */
+  void set_threshold (float threshold);
+
+/**
+ * @brief Returns the smallest pixel change that updates the cache.
+ */
+  float get_threshold () const;
+
+/**
+ * @brief Sets the number of delta updates between full recomputations.
+ *
+ * @throw std::invalid_argument if refresh_frames is not positive.
+ */
+  void set_refresh_frames (int refresh_frames);
+
+/**
+ * @brief Returns the session's counters.
+ */
+  stream_stats get_stats () const;
+};
+
+#endif //STREAMSESSION_H
@@ -0,0 +1,211 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <cstdlib>
+
+static thread_local bool is_pool_worker = false;
+
+/**
+ * @brief Shared state of one parallel_for() call. Helpers hold it through a
+ * shared_ptr, so a helper that starts after the caller returned only finds
+ * the chunk counter exhausted.
+ */
+struct parallel_job
+{
+  const std::function<void (std::size_t, std::size_t)>* fn;
+  std::size_t begin, end, grain, chunks;
+  std::atomic<std::size_t> next {0};
+  std::atomic<std::size_t> done {0};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  void run_chunks ()
+  {
+    std::size_t c;
+    while ((c = next.fetch_add (1, std::memory_order_relaxed)) < chunks)
+    {
+      std::size_t lo = begin + c * grain;
+      std::size_t hi = (end - lo < grain) ? end : lo + grain;
+      try
+      {
+        (*fn) (lo, hi);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock (error_mutex);
+        if (!error)
+        {
+          error = std::current_exception ();
+        }
+      }
+      done.fetch_add (1, std::memory_order_release);
+    }
+  }
+};
+
+
+ThreadPool::ThreadPool (int workers) : _stop (false)
+{
+  for (int i = 0; i < workers; ++i)
+  {
+    _workers.emplace_back (&ThreadPool::worker_loop, this);
+  }
+}
+
+
+ThreadPool::~ThreadPool ()
+{
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    _stop = true;
+  }
+  _cv.notify_all ();
+  for (std::thread& worker : _workers)
+  {
+    worker.join ();
+  }
+}
+
+
+ThreadPool& ThreadPool::shared ()
+{
+  static ThreadPool pool ([] ()
+  {
+    int threads = (int) std::thread::hardware_concurrency ();
+    const char* env = std::getenv (THREADS_ENV_VAR);
+    if (env != nullptr && std::atoi (env) > 0)
+    {
+      threads = std::atoi (env);
+    }
+    return (threads > 1) ? threads - 1 : 0;
+  } ());
+  return pool;
+}
+
+
+bool ThreadPool::in_worker ()
+{
+  return is_pool_worker;
+}
+
+
+int ThreadPool::concurrency () const
+{
+  return (int) _workers.size () + 1;
+}
+
+
+void ThreadPool::worker_loop ()
+{
+  is_pool_worker = true;
+  for (;;)
+  {
+    std::function<void ()> task;
+    {
+      std::unique_lock<std::mutex> lock (_mutex);
+      _cv.wait (lock, [this] () { return _stop || !_tasks.empty (); });
+      if (_tasks.empty ())
+      {
+        return; // stopping and drained
+      }
+      task = std::move (_tasks.front ());
+      _tasks.pop_front ();
+    }
+    task ();
+  }
+}
+
+
+void ThreadPool::submit (std::function<void ()> task)
+{
+  if (_workers.empty ())
+  {
+    task ();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    _tasks.push_back (std::move (task));
+  }
+  _cv.notify_one ();
+}
+
+
+void ThreadPool::parallel_for (std::size_t begin, std::size_t end,
+                               std::size_t grain,
+                               const std::function<void (std::size_t,
+                                                         std::size_t)>& fn,
+                               int max_threads)
+{
+  if (end <= begin)
+  {
+    return;
+  }
+  if (grain == 0)
+  {
+    grain = 1;
+  }
+  std::size_t chunks = (end - begin + grain - 1) / grain;
+  if (chunks == 1 || _workers.empty () || is_pool_worker ||
+      max_threads == 1)
+  {
+    for (std::size_t lo = begin; lo < end; lo += grain)
+    {
+      fn (lo, (end - lo < grain) ? end : lo + grain);
+    }
+    return;
+  }
+
+  std::shared_ptr<parallel_job> job = std::make_shared<parallel_job> ();
+  job->fn = &fn;
+  job->begin = begin;
+  job->end = end;
+  job->grain = grain;
+  job->chunks = chunks;
+
+  std::size_t helpers = std::min (chunks - 1, _workers.size ());
+  if (max_threads > 1)
+  {
+    helpers = std::min (helpers, (std::size_t) max_threads - 1);
+  }
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    for (std::size_t h = 0; h < helpers; ++h)
+    {
+      _tasks.push_back ([job] () { job->run_chunks (); });
+    }
+  }
+  _cv.notify_all ();
+
+  job->run_chunks ();
+  while (job->done.load (std::memory_order_acquire) < chunks)
+  {
+    std::this_thread::yield ();
+  }
+  if (job->error)
+  {
+    std::rethrow_exception (job->error);
+  }
+}
+
+
+void parallel_for_elements (std::size_t n,
+                            const std::function<void (std::size_t,
+                                                      std::size_t)>& fn)
+{
+  if (n < ELEMENTWISE_PARALLEL_THRESHOLD)
+  {
+    fn (0, n);
+    return;
+  }
+  ThreadPool& pool = ThreadPool::shared ();
+  // at least ELEMENTWISE_GRAIN per chunk, a few chunks per thread for load
+  // balance, always a whole number of cache lines
+  std::size_t grain = n / (4 * (std::size_t) pool.concurrency ());
+  grain = std::max (grain, (std::size_t) ELEMENTWISE_GRAIN);
+  grain = (grain + FLOATS_PER_CACHE_LINE - 1) / FLOATS_PER_CACHE_LINE
+          * FLOATS_PER_CACHE_LINE;
+  pool.parallel_for (0, n, grain, fn);
+}
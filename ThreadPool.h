@@ -0,0 +1,118 @@
+// ThreadPool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#define THREADS_ENV_VAR "MLP_NUM_THREADS"
+#define ELEMENTWISE_PARALLEL_THRESHOLD (1 << 16)
+#define ELEMENTWISE_GRAIN (1 << 13)
+#define FLOATS_PER_CACHE_LINE 16
+
+/**
+ * @class ThreadPool
+ * @brief Fixed-size pool of worker threads shared by the parallel kernels.
+ *
+ * parallel_for() splits an index range into chunks that the workers and the
+ * calling thread pull from a shared counter, so the caller never sits idle
+ * while the pool works. A parallel_for() issued from inside a pool worker
+ * runs inline on that worker: nested parallelism degrades to serial instead
+ * of deadlocking on a pool whose threads are all waiting.
+ */
+class ThreadPool {
+
+ private:
+  std::vector<std::thread> _workers; /**< The worker threads. */
+  std::deque<std::function<void ()> > _tasks; /**< Pending tasks. */
+  std::mutex _mutex; /**< Guards _tasks and _stop. */
+  std::condition_variable _cv; /**< Signalled when a task arrives. */
+  bool _stop; /**< Set to make the workers exit. */
+
+  void worker_loop ();
+
+ public:
+/**
+ * @brief Starts a pool with the given number of worker threads.
+ *
+ * @param workers Number of threads besides the caller; 0 runs everything
+ * inline on the calling thread.
+ */
+  explicit ThreadPool (int workers);
+
+/**
+ * @brief Finishes the queued tasks and joins the workers.
+ */
+  ~ThreadPool ();
+
+  ThreadPool (const ThreadPool&) = delete;
+  ThreadPool& operator= (const ThreadPool&) = delete;
+
+/**
+ * @brief Returns the process-wide pool.
+ *
+ * It has hardware_concurrency() - 1 workers, or MLP_NUM_THREADS - 1 when
+ * that environment variable is set, and is created on first use.
+ */
+  static ThreadPool& shared ();
+
+/**
+ * @brief Returns true if the calling thread is a worker of any ThreadPool.
+ */
+  static bool in_worker ();
+
+/**
+ * @brief Returns the number of threads that execute a parallel_for(),
+ * the workers plus the caller.
+ */
+  int concurrency () const;
+
+/**
+ * @brief Queues a task for asynchronous execution on a worker.
+ *
+ * @param task The task; with no workers it runs inline before returning.
+ */
+  void submit (std::function<void ()> task);
+
+/**
+ * @brief Runs fn over [begin, end) split into chunks of grain indices.
+ *
+ * fn(chunk_begin, chunk_end) is called once per chunk, concurrently from
+ * the workers and the caller; chunk boundaries are begin + k * grain.
+ * Returns once every chunk has completed. The first exception thrown by fn
+ * is rethrown in the caller.
+ *
+ * @param begin First index.
+ * @param end One past the last index.
+ * @param grain Chunk size, at least 1.
+ * @param fn The chunk body.
+ * @param max_threads Most threads (caller included) that run chunks; 0
+ * means concurrency().
+ */
+  void parallel_for (std::size_t begin, std::size_t end, std::size_t grain,
+                     const std::function<void (std::size_t,
+                                               std::size_t)>& fn,
+                     int max_threads = 0);
+};
+
+/**
+ * @brief Runs an element-wise kernel over n floats, in parallel on the shared
+ * pool once n reaches ELEMENTWISE_PARALLEL_THRESHOLD.
+ *
+ * Below the threshold fn(0, n) runs on the caller, since waking the pool
+ * costs more than a small loop. Above it the chunks are whole multiples of
+ * FLOATS_PER_CACHE_LINE, so no two threads write into the same cache line.
+ *
+ * @param n Number of elements.
+ * @param fn The kernel, called as fn(first, last) on disjoint ranges.
+ */
+void parallel_for_elements (std::size_t n,
+                            const std::function<void (std::size_t,
+                                                      std::size_t)>& fn);
+
+#endif //THREADPOOL_H
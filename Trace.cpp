@@ -0,0 +1,228 @@
+#include "Trace.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+std::atomic<bool> trace::recording (false);
+
+/**
+ * @brief One span in a ring. seq is the span's index in the ring plus one
+ * once it is complete and 0 while it is being written, so a reader can tell
+ * a stable slot from one the owner thread is overwriting.
+ */
+struct trace_slot
+{
+  std::atomic<std::uint64_t> seq;
+  std::atomic<const char*> name;
+  std::atomic<const char*> category;
+  std::atomic<std::uint64_t> start;
+  std::atomic<std::uint64_t> end;
+};
+
+/**
+ * @brief A thread's span ring; only its owner thread writes it.
+ */
+struct trace_ring
+{
+  int tid;
+  std::atomic<std::uint64_t> head; /**< Spans recorded so far. */
+  trace_slot slots[TRACE_RING_CAPACITY];
+};
+
+/**
+ * @brief Process-wide list of rings and interned names.
+ */
+struct trace_registry
+{
+  std::mutex mutex;
+  std::vector<std::shared_ptr<trace_ring> > rings;
+  std::set<std::string> names;
+  std::string exit_path;
+
+  static trace_registry& get ()
+  {
+    static trace_registry registry;
+    return registry;
+  }
+};
+
+static thread_local std::shared_ptr<trace_ring> local_ring;
+
+
+/**
+ * @brief Returns the calling thread's ring, creating it on first use.
+ */
+static trace_ring& thread_ring ()
+{
+  if (!local_ring)
+  {
+    // value-initialized, so every slot starts out empty
+    std::shared_ptr<trace_ring> ring = std::make_shared<trace_ring> ();
+    trace_registry& registry = trace_registry::get ();
+    std::lock_guard<std::mutex> lock (registry.mutex);
+    ring->tid = (int) registry.rings.size () + 1;
+    registry.rings.push_back (ring);
+    local_ring = ring;
+  }
+  return *local_ring;
+}
+
+
+static void dump_at_exit ()
+{
+  trace::dump (trace_registry::get ().exit_path);
+}
+
+
+/**
+ * @brief Turns tracing on at startup when TRACE_ENV_VAR names an output
+ * file, and writes that file at exit.
+ */
+static bool enable_from_env ()
+{
+  const char* path = std::getenv (TRACE_ENV_VAR);
+  if (path == nullptr || *path == '\0')
+  {
+    return false;
+  }
+  // the registry must exist before the handler is registered, so it is
+  // destroyed after the handler runs
+  trace_registry::get ().exit_path = path;
+  trace::now_ns ();
+  std::atexit (dump_at_exit);
+  trace::enable (true);
+  return true;
+}
+
+static const bool enabled_from_env = enable_from_env ();
+
+
+void trace::enable (bool on)
+{
+  recording.store (on, std::memory_order_relaxed);
+}
+
+
+std::uint64_t trace::now_ns ()
+{
+  static const std::chrono::steady_clock::time_point epoch =
+      std::chrono::steady_clock::now ();
+  return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now () - epoch).count ();
+}
+
+
+void trace::record (const char* name, const char* category,
+                    std::uint64_t start_ns, std::uint64_t end_ns)
+{
+  trace_ring& ring = thread_ring ();
+  const std::uint64_t index = ring.head.load (std::memory_order_relaxed);
+  trace_slot& slot = ring.slots[index % TRACE_RING_CAPACITY];
+  slot.seq.store (0, std::memory_order_relaxed);
+  std::atomic_thread_fence (std::memory_order_release);
+  slot.name.store (name, std::memory_order_relaxed);
+  slot.category.store (category, std::memory_order_relaxed);
+  slot.start.store (start_ns, std::memory_order_relaxed);
+  slot.end.store (end_ns, std::memory_order_relaxed);
+  slot.seq.store (index + 1, std::memory_order_release);
+  ring.head.store (index + 1, std::memory_order_release);
+}
+
+
+const char* trace::intern (const std::string& name)
+{
+  trace_registry& registry = trace_registry::get ();
+  std::lock_guard<std::mutex> lock (registry.mutex);
+  return registry.names.insert (name).first->c_str ();
+}
+
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ */
+static void write_json_string (std::ostream& out, const char* str)
+{
+  out << '"';
+  for (; *str != '\0'; ++str)
+  {
+    const unsigned char c = (unsigned char) *str;
+    if (c == '"' || c == '\\')
+    {
+      out << '\\' << (char) c;
+    }
+    else if (c < 0x20)
+    {
+      out << "\\u" << std::hex << std::setw (4) << std::setfill ('0')
+          << (int) c << std::dec << std::setfill (' ');
+    }
+    else
+    {
+      out << (char) c;
+    }
+  }
+  out << '"';
+}
+
+
+void trace::write_json (std::ostream& out)
+{
+  std::vector<std::shared_ptr<trace_ring> > rings;
+  {
+    trace_registry& registry = trace_registry::get ();
+    std::lock_guard<std::mutex> lock (registry.mutex);
+    rings = registry.rings;
+  }
+  const std::ios::fmtflags flags = out.flags ();
+  const std::streamsize precision = out.precision ();
+  out << std::fixed << std::setprecision (3) << "{\"traceEvents\":[";
+  bool first = true;
+  for (const std::shared_ptr<trace_ring>& ring : rings)
+  {
+    const std::uint64_t head = ring->head.load (std::memory_order_acquire);
+    const std::uint64_t oldest = (head > TRACE_RING_CAPACITY)
+                                 ? head - TRACE_RING_CAPACITY : 0;
+    for (std::uint64_t i = oldest; i < head; ++i)
+    {
+      const trace_slot& slot = ring->slots[i % TRACE_RING_CAPACITY];
+      const std::uint64_t seq = slot.seq.load (std::memory_order_acquire);
+      const char* name = slot.name.load (std::memory_order_relaxed);
+      const char* category = slot.category.load (std::memory_order_relaxed);
+      const std::uint64_t start = slot.start.load (std::memory_order_relaxed);
+      const std::uint64_t end = slot.end.load (std::memory_order_relaxed);
+      std::atomic_thread_fence (std::memory_order_acquire);
+      if (seq != i + 1 || slot.seq.load (std::memory_order_relaxed) != seq)
+      {
+        continue; // overwritten since head was read
+      }
+      out << (first ? "\n" : ",\n") << "{\"name\":";
+      write_json_string (out, name);
+      out << ",\"cat\":";
+      write_json_string (out, category);
+      // trace-event times are in microseconds
+      out << ",\"ph\":\"X\",\"ts\":" << start / 1000.0 << ",\"dur\":"
+          << (end - start) / 1000.0 << ",\"pid\":1,\"tid\":" << ring->tid
+          << "}";
+      first = false;
+    }
+  }
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+  out.flags (flags);
+  out.precision (precision);
+}
+
+
+bool trace::dump (const std::string& path)
+{
+  std::ofstream file (path);
+  if (!file)
+  {
+    return false;
+  }
+  write_json (file);
+  return (bool) file;
+}
@@ -0,0 +1,129 @@
+// Trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#define TRACE_RING_CAPACITY 8192
+#define TRACE_ENV_VAR "MLP_TRACE"
+
+/**
+ * @namespace trace
+ * @brief Opt-in span tracing written as Chrome trace-event JSON, which opens
+ * in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Spans are placed with TRACE_SPAN, which compiles to nothing unless the
+ * build defines MLP_TRACING. When compiled in, a span costs one relaxed
+ * atomic load until tracing is enabled, either with enable() or by setting
+ * MLP_TRACE to an output path, which also writes the trace at exit.
+ *
+ * Each thread records into its own fixed-size ring of the most recent
+ * TRACE_RING_CAPACITY spans without locks; older spans are overwritten.
+ * Rings stay readable after their thread exits, so write_json() sees every
+ * thread that has traced.
+ */
+namespace trace
+{
+/**
+ * @brief Whether spans are being recorded.
+ */
+extern std::atomic<bool> recording;
+
+/**
+ * @brief Returns whether spans are being recorded.
+ */
+inline bool enabled ()
+{
+  return recording.load (std::memory_order_relaxed);
+}
+
+/**
+ * @brief Starts or stops recording spans.
+ */
+void enable (bool on);
+
+/**
+ * @brief Returns monotonic nanoseconds since the process started tracing
+ * time.
+ */
+std::uint64_t now_ns ();
+
+/**
+ * @brief Records a finished span into the calling thread's ring.
+ *
+ * @param name The span name; must outlive the trace (a literal, or a
+ * string from intern()).
+ * @param category The span category, under the same rule.
+ * @param start_ns The start time from now_ns().
+ * @param end_ns The end time from now_ns().
+ */
+void record (const char* name, const char* category, std::uint64_t start_ns,
+             std::uint64_t end_ns);
+
+/**
+ * @brief Returns a copy of a string that lives until the process exits, for
+ * span names built at run time. Equal strings share one copy.
+ */
+const char* intern (const std::string& name);
+
+/**
+ * @brief Writes every recorded span, from all threads, as Chrome trace-event
+ * JSON. Safe while other threads keep tracing.
+ *
+ * @param out The stream to write to.
+ */
+void write_json (std::ostream& out);
+
+/**
+ * @brief Writes the trace to a file.
+ *
+ * @param path The output path.
+ * @return Whether the file was written.
+ */
+bool dump (const std::string& path);
+
+/**
+ * @class Span
+ * @brief Records the time between its construction and destruction.
+ */
+class Span {
+
+ private:
+  const char* _name;
+  const char* _category;
+  std::uint64_t _start; /**< 0 when tracing was off at construction. */
+
+ public:
+  Span (const char* name, const char* category)
+      : _name (name), _category (category),
+        _start (enabled () ? now_ns () + 1 : 0)
+  {
+  }
+
+  ~Span ()
+  {
+    if (_start != 0)
+    {
+      record (_name, _category, _start - 1, now_ns ());
+    }
+  }
+
+  Span (const Span&) = delete;
+  Span& operator= (const Span&) = delete;
+};
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef MLP_TRACING
+#define TRACE_SPAN(name, category) \
+  trace::Span TRACE_CONCAT(trace_span_, __LINE__) (name, category)
+#else
+#define TRACE_SPAN(name, category) ((void) 0)
+#endif
+
+#endif //TRACE_H
@@ -0,0 +1,235 @@
+#include "ModelIO.h"
+#include "OnlineLearner.h"
+#include "StreamSession.h"
+#include "MlpEnsemble.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpcheck w1 w2 w3 w4 b1 b2 b3 b4 dir\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tdir - an existing directory for the checkpoint files"
+#define DIR_IDX ARGS_COUNT
+#define CHECK_IMAGES 64
+#define CHECK_DENSITY 0.2
+#define CHECK_SEED 7
+#define ONLINE_STEPS 200
+#define STREAM_FRAMES 40
+#define STREAM_MOVED_PIXELS 12
+#define STREAM_TOLERANCE 1e-5f
+#define ENSEMBLE_TOLERANCE 1e-6f
+
+/**
+ * @brief Returns images with CHECK_DENSITY of their pixels lit.
+ */
+static std::vector<Matrix> random_images (std::mt19937& gen, int count)
+{
+  std::bernoulli_distribution lit (CHECK_DENSITY);
+  std::uniform_real_distribution<float> value (0.0f, 1.0f);
+  std::vector<Matrix> imgs;
+  for (int n = 0; n < count; ++n)
+  {
+    Matrix img (img_dims.rows, img_dims.cols);
+    for (mat_index i = 0; i < img.size (); ++i)
+    {
+      img[i] = lit (gen) ? value (gen) : 0.0f;
+    }
+    imgs.push_back (img);
+  }
+  return imgs;
+}
+
+/**
+ * @brief Returns the largest element-wise difference of two matrices.
+ */
+static float max_diff (const Matrix& a, const Matrix& b)
+{
+  float diff = 0;
+  for (mat_index i = 0; i < a.size (); ++i)
+  {
+    diff = std::max (diff, std::fabs (a[i] - b[i]));
+  }
+  return diff;
+}
+
+/**
+ * @brief Returns the digit a network predicts for an image.
+ */
+static unsigned int classify (const MlpNetwork& mlp, const Matrix& img)
+{
+  return (unsigned int) mlp.forward (img).argmax ();
+}
+
+/**
+ * @brief Prints one check and returns whether it passed.
+ */
+static bool report (const std::string& check, bool passed)
+{
+  std::cout << (passed ? "ok    " : "FAIL  ") << check << std::endl;
+  return passed;
+}
+
+/**
+ * @brief Trains an OnlineLearner towards labels the network gets wrong and
+ * checks that the published snapshot changes its predictions, that a held
+ * snapshot does not change, and that a checkpoint reloads into the same
+ * network.
+ */
+static bool check_online (const MlpNetwork& mlp,
+                          const std::vector<Matrix>& imgs,
+                          const std::string& dir)
+{
+  bool passed = true;
+  OnlineLearner learner (mlp);
+  std::shared_ptr<const MlpNetwork> before = learner.network ();
+  const unsigned int classes = (unsigned int) mlp.get_layer (MLP_SIZE - 1)
+      .get_weights ().get_rows ();
+  std::vector<unsigned int> targets;
+  int hits_before = 0;
+  for (const Matrix& img : imgs)
+  {
+    unsigned int target = (classify (*before, img) + 1) % classes;
+    targets.push_back (target);
+    learner.add_feedback (img, target);
+  }
+  learner.update (ONLINE_STEPS);
+
+  std::shared_ptr<const MlpNetwork> after = learner.network ();
+  int hits_after = 0;
+  bool held = true;
+  bool served = true;
+  for (std::size_t n = 0; n < imgs.size (); ++n)
+  {
+    hits_before += (classify (mlp, imgs[n]) == targets[n]);
+    hits_after += (classify (*after, imgs[n]) == targets[n]);
+    held = held && max_diff (before->forward (imgs[n]),
+                             mlp.forward (imgs[n])) == 0;
+    served = served && learner (imgs[n]).value == classify (*after, imgs[n]);
+  }
+  std::cout << "      feedback labels predicted: " << hits_before << " -> "
+            << hits_after << " of " << imgs.size () << std::endl;
+  passed &= report ("online update changes predictions",
+                    hits_after > hits_before);
+  passed &= report ("online held snapshot unchanged", held);
+  passed &= report ("online serves the published snapshot", served);
+
+  for (const std::string& ext : {std::string (), std::string (".npy")})
+  {
+    const std::string w_path = dir + "/w4" + ext;
+    const std::string b_path = dir + "/b4" + ext;
+    learner.set_checkpoint_files (w_path, b_path);
+    learner.checkpoint ();
+    const Dense& last = after->get_layer (MLP_SIZE - 1);
+    const Matrix& trained = last.get_weights ();
+    Matrix w (trained.get_rows (), trained.get_cols ());
+    Matrix b (last.get_bias ().get_rows (), 1);
+    readFileToMatrix (w_path, w);
+    readFileToMatrix (b_path, b);
+    MlpNetwork reloaded (*after);
+    reloaded.set_layer (MLP_SIZE - 1, Dense (w, b, last.get_activation ()));
+    float diff = 0;
+    for (const Matrix& img : imgs)
+    {
+      diff = std::max (diff, max_diff (reloaded.forward (img),
+                                       after->forward (img)));
+    }
+    const bool no_staging = !std::ifstream (w_path + ".tmp") &&
+                            !std::ifstream (b_path + ".tmp");
+    passed &= report ("online checkpoint reloads (" +
+                      (ext.empty () ? std::string ("raw") : ext) + ")",
+                      diff == 0 && no_staging);
+  }
+  return passed;
+}
+
+/**
+ * @brief Streams frames that each move a few pixels of the last one and
+ * checks the incremental outputs against full forward passes.
+ */
+static bool check_stream (const MlpNetwork& mlp, const Matrix& first,
+                          std::mt19937& gen)
+{
+  StreamSession session (mlp);
+  std::uniform_int_distribution<mat_index> pixel (0, first.size () - 1);
+  std::uniform_real_distribution<float> value (0.0f, 1.0f);
+  Matrix frame = first;
+  float diff = 0;
+  for (int f = 0; f < STREAM_FRAMES; ++f)
+  {
+    diff = std::max (diff, max_diff (session.forward (frame),
+                                     mlp.forward (frame)));
+    for (int k = 0; k < STREAM_MOVED_PIXELS; ++k)
+    {
+      frame[pixel (gen)] = value (gen);
+    }
+  }
+  std::cout << "      max difference from full passes: " << diff
+            << std::endl;
+  bool passed = report ("stream matches full passes",
+                        diff <= STREAM_TOLERANCE);
+  return passed & report ("stream took delta updates",
+                          session.get_stats ().delta_updates > 0);
+}
+
+/**
+ * @brief Checks that an ensemble of copies of one network gives that
+ * network's outputs, with and without stacked first layers.
+ */
+static bool check_ensemble (const MlpNetwork& mlp,
+                            const std::vector<Matrix>& imgs)
+{
+  Matrix batch = MlpNetwork::pack_batch (imgs, 0, imgs.size ());
+  Matrix expected = mlp.forward (batch);
+  bool passed = true;
+  for (bool stacked : {false, true})
+  {
+    MlpEnsemble ensemble ({mlp, mlp, mlp}, {}, stacked);
+    const float diff = max_diff (ensemble.forward (batch, COMBINE_MEAN),
+                                 expected);
+    passed &= report (stacked ? "ensemble of copies (stacked)"
+                              : "ensemble of copies",
+                      diff <= ENSEMBLE_TOLERANCE);
+  }
+  return passed;
+}
+
+/**
+ * Runs behaviour checks of the components that serve a model while it
+ * changes or that reuse work across inputs: OnlineLearner (a published
+ * update changes predictions; a checkpoint reloads), StreamSession
+ * (incremental frames match full passes) and MlpEnsemble (copies of one
+ * network combine to it).
+ * @param argc count of args
+ * @param argv args values
+ * @return EXIT_SUCCESS if every check passes
+ */
+int main (int argc, char **argv)
+{
+  if (argc != DIR_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  MatrixPtr weights[MLP_SIZE];
+  MatrixPtr biases[MLP_SIZE];
+  bool passed = true;
+  try
+  {
+	loadSharedParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	std::mt19937 gen (CHECK_SEED);
+	std::vector<Matrix> imgs = random_images (gen, CHECK_IMAGES);
+	passed &= check_online (mlp, imgs, argv[DIR_IDX]);
+	passed &= check_stream (mlp, imgs.front (), gen);
+	passed &= check_ensemble (mlp, imgs);
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,127 @@
+#include "ModelIO.h"
+#include "Cascade.h"
+#include "LowRank.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpcascade w1 w2 w3 w4 b1 b2 b3 b4 images labels " \
+                  "[max_loss] [rank]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\timages - IDX or .npy image file\n" \
+                  "\tlabels - IDX or .npy label file\n" \
+                  "\tmax_loss - top-1 accuracy the cascade may lose against " \
+                  "the full model (default 0.005)\n" \
+                  "\trank - rank of the fast model's first two layers " \
+                  "(default 16)"
+#define IMAGES_IDX ARGS_COUNT
+#define LABELS_IDX (ARGS_COUNT + 1)
+#define LOSS_IDX (ARGS_COUNT + 2)
+#define RANK_IDX (ARGS_COUNT + 3)
+
+static const std::vector<float> sweep_thresholds = {0.5f, 0.7f, 0.8f, 0.9f,
+                                                    0.95f, 0.99f};
+
+/**
+ * Prints a table row: a threshold's accuracy, accuracy loss, escalation
+ * rate and relative cost.
+ * @param outcome the threshold's outcome on the labelled set
+ */
+static void print_row (const cascade_calibration& outcome)
+{
+  std::cout << std::setw (10) << std::setprecision (4) << outcome.threshold
+            << std::setw (10) << outcome.accuracy << std::setw (10)
+            << outcome.full_accuracy - outcome.accuracy << std::setw (12)
+            << std::setprecision (1) << outcome.escalation_rate * 100 << "%"
+            << std::setw (9) << std::setprecision (3)
+            << outcome.relative_cost << "\n";
+}
+
+/**
+ * Runs a batch prediction of a whole dataset.
+ * @return the images per second
+ */
+template <typename Model>
+static double throughput (const Model& model, const IdxDataset& dataset)
+{
+  const auto start = std::chrono::steady_clock::now ();
+  model.predict_batch (dataset.images);
+  const std::chrono::duration<double> took =
+      std::chrono::steady_clock::now () - start;
+  return dataset.images.size () / took.count ();
+}
+
+/**
+ * Builds a cheap low-rank copy of a model, sweeps confidence thresholds of
+ * the fast-then-full cascade on a labelled set, calibrates the threshold
+ * for a target accuracy and reports the cascade's escalation rate and
+ * effective cost per image.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc < LOSS_IDX || argc > RANK_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  try
+  {
+	MatrixPtr weights[MLP_SIZE];
+	MatrixPtr biases[MLP_SIZE];
+	loadSharedParameters (argv, weights, biases);
+	auto full = std::make_shared<const MlpNetwork> (weights, biases);
+	IdxDataset dataset = loadIdxDataset (argv[IMAGES_IDX], argv[LABELS_IDX]);
+	const double max_loss = (argc > LOSS_IDX) ? std::stod (argv[LOSS_IDX])
+											  : CASCADE_ACCURACY_LOSS;
+	const mat_index rank = (argc > RANK_IDX) ? std::stol (argv[RANK_IDX])
+											 : CASCADE_FAST_RANK;
+	auto fast = std::make_shared<const MlpNetwork> (
+		cascade_fast_model (*full, rank));
+
+	std::vector<cascade_calibration> sweep =
+		cascade_sweep (*fast, *full, dataset, sweep_thresholds);
+	std::cout << std::fixed << "fast model (rank " << rank << "): "
+			  << network_multiply_adds (*fast) << " MACs, top-1 "
+			  << std::setprecision (4) << sweep[0].fast_accuracy
+			  << "\nfull model: " << network_multiply_adds (*full)
+			  << " MACs, top-1 " << sweep[0].full_accuracy << "\n\n"
+			  << std::setw (10) << "threshold" << std::setw (10) << "top-1"
+			  << std::setw (10) << "loss" << std::setw (13) << "escalated"
+			  << std::setw (9) << "cost" << "\n";
+	for (const cascade_calibration& outcome : sweep)
+	{
+	  print_row (outcome);
+	}
+
+	const double target = sweep[0].full_accuracy - max_loss;
+	cascade_calibration chosen = calibrate_cascade (*fast, *full, dataset,
+													target);
+	std::cout << "\ncalibrated for top-1 >= " << std::setprecision (4)
+			  << target << ":\n";
+	print_row (chosen);
+
+	CascadeNetwork cascade (fast, full, chosen.threshold);
+	const double full_rate = throughput (*full, dataset);
+	const double cascade_rate = throughput (cascade, dataset);
+	cascade_stats stats = cascade.get_stats ();
+	std::cout << "\ncascade counters: " << stats.images << " images, "
+			  << stats.escalations << " escalated ("
+			  << std::setprecision (1) << stats.escalation_rate * 100
+			  << "%), " << std::setprecision (0) << stats.mean_multiply_adds
+			  << " MACs/image (" << std::setprecision (3)
+			  << stats.relative_cost << " of full)\nthroughput: "
+			  << std::setprecision (0) << cascade_rate << " images/s vs "
+			  << full_rate << " for the full model" << std::endl;
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#include "ModelIO.h"
+#include "Autotune.h"
+#include "ModelCodegen.h"
+#include <fstream>
+#include <iostream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpcodegen out.cpp w1 w2 w3 w4 b1 b2 b3 b4 [name]\n" \
+                  "\tout.cpp - the generated predictor source\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tname - prefix of the generated functions (default " \
+                  CODEGEN_DEFAULT_NAME ")"
+#define OUT_IDX 1
+#define MIN_ARGS (OUT_IDX + ARGS_COUNT)
+#define OUTPUT_ERROR "Error: failed to write the generated source: "
+
+/**
+ * Bakes a trained model into a specialized C++ predictor source.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc != MIN_ARGS && argc != MIN_ARGS + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  std::string name = (argc == MIN_ARGS + 1) ? argv[MIN_ARGS]
+                                            : CODEGEN_DEFAULT_NAME;
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  try
+  {
+	// shift argv so the parameter paths start at ARGS_START_IDX
+	loadParameters (argv + OUT_IDX, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	tune_network (mlp);
+
+	std::ofstream out (argv[OUT_IDX]);
+	generate_model_source (mlp, out, name);
+	out.close ();
+	if (!out)
+	{
+	  throw std::runtime_error (OUTPUT_ERROR + std::string (argv[OUT_IDX]));
+	}
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+#include "ModelIO.h"
+#include "Autotune.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+// Link this file with a source emitted by mlpcodegen under the default name:
+//   mlpcodegen mlp_model.cpp w1 ... b4
+//   g++ codegen_verify_main.cpp mlp_model.cpp <library sources>
+void mlp_model_forward (const float* input, float* probs);
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./codegen_verify w1 w2 w3 w4 b1 b2 b3 b4 img...\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\timg - raw float images to compare predictions on"
+#define IMAGES_START_IDX ARGS_COUNT
+#define TOLERANCE 1e-6f
+
+/**
+ * Checks that the generated predictor matches MlpNetwork on a set of images.
+ * Exits with failure if any prediction differs or any probability is off by
+ * more than TOLERANCE.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc <= IMAGES_START_IDX)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  int exact = 0, mismatched = 0, images = 0;
+  float max_diff = 0;
+  try
+  {
+	loadParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	tune_network (mlp);
+	for (int a = IMAGES_START_IDX; a < argc; ++a)
+	{
+	  Matrix img (img_dims.rows, img_dims.cols);
+	  readFileToMatrix (argv[a], img);
+	  Matrix expected = mlp.forward (img);
+	  std::vector<float> probs (expected.get_rows ());
+	  mlp_model_forward (img.get_data (), probs.data ());
+
+	  bool bitwise = std::memcmp (probs.data (), expected.get_data (),
+	                              probs.size () * sizeof (float)) == 0;
+	  exact += bitwise;
+	  for (std::size_t i = 0; i < probs.size (); ++i)
+	  {
+	    max_diff = std::max (max_diff, std::fabs (probs[i] - expected[(int) i]));
+	  }
+	  int predicted = (int) (std::max_element (probs.begin (), probs.end ())
+	                         - probs.begin ());
+	  mismatched += (predicted != expected.argmax ());
+	  images++;
+	}
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  std::cout << "images: " << images << "\nbit-identical outputs: " << exact
+            << "\nclass mismatches: " << mismatched
+            << "\nmax probability difference: " << max_diff << std::endl;
+  return (mismatched == 0 && max_diff <= TOLERANCE) ? EXIT_SUCCESS
+                                                    : EXIT_FAILURE;
+}
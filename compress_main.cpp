@@ -0,0 +1,141 @@
+#include "ModelIO.h"
+#include "Evaluator.h"
+#include "LowRank.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpcompress w1 w2 w3 w4 b1 b2 b3 b4 images labels " \
+                  "[energy|accuracy] [target]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\timages - IDX image file (ubyte or float)\n" \
+                  "\tlabels - IDX label file\n" \
+                  "\tenergy - choose ranks keeping a fraction of each " \
+                  "layer's spectral energy (default, target 0.95)\n" \
+                  "\taccuracy - choose ranks losing at most target top-1 " \
+                  "accuracy (default 0.005)"
+#define IMAGES_IDX ARGS_COUNT
+#define LABELS_IDX (ARGS_COUNT + 1)
+#define MODE_IDX (ARGS_COUNT + 2)
+#define TARGET_IDX (ARGS_COUNT + 3)
+#define ENERGY_MODE "energy"
+#define ACCURACY_MODE "accuracy"
+#define MODE_ERROR "Error: mode must be energy or accuracy"
+
+static const double sweep_energies[] = {0.5, 0.75, 0.9, 0.95, 0.99, 0.999};
+
+/**
+ * Prints a table row: the ranks, the multiply-adds and their reduction, and
+ * the accuracy, accuracy loss and throughput of the compressed network.
+ * @param name the row label
+ * @param ranks one rank per layer
+ * @param mlp the compressed network
+ * @param dataset the labelled images
+ * @param base_macs multiply-adds of the uncompressed network
+ * @param base_accuracy accuracy of the uncompressed network
+ */
+static void print_row (const std::string& name,
+                       const std::vector<mat_index>& ranks,
+                       const MlpNetwork& mlp, const IdxDataset& dataset,
+                       mat_index base_macs, double base_accuracy)
+{
+  eval_report report = evaluate (mlp, dataset);
+  std::string shown;
+  for (int i = 0; i < MLP_SIZE; ++i)
+  {
+    shown += (i ? "/" : "") + (ranks[i] == FULL_RANK ? std::string ("-")
+                                                     : std::to_string
+                                                         (ranks[i]));
+  }
+  const mat_index macs = network_multiply_adds (mlp);
+  std::cout << std::left << std::setw (10) << name << std::setw (16) << shown
+            << std::right << std::setw (10) << macs << std::setw (9)
+            << std::setprecision (2) << (double) base_macs / macs << "x"
+            << std::setw (10) << std::setprecision (4)
+            << report.top1_accuracy << std::setw (10)
+            << base_accuracy - report.top1_accuracy << std::setw (12)
+            << std::setprecision (0) << report.images_per_sec << "\n";
+}
+
+/**
+ * Factors every layer of a model by truncated SVD and reports how far the
+ * multiply-adds per image fall against how much accuracy is lost on a
+ * labelled set, for a sweep of energy targets and for the chosen target.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc < MODE_IDX || argc > TARGET_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  try
+  {
+	MatrixPtr weights[MLP_SIZE];
+	MatrixPtr biases[MLP_SIZE];
+	loadSharedParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	IdxDataset dataset = loadIdxDataset (argv[IMAGES_IDX], argv[LABELS_IDX]);
+	const std::string mode = (argc > MODE_IDX) ? argv[MODE_IDX]
+											   : ENERGY_MODE;
+	if (mode != ENERGY_MODE && mode != ACCURACY_MODE)
+	{
+	  throw std::invalid_argument (MODE_ERROR);
+	}
+	const bool by_energy = (mode == ENERGY_MODE);
+	const double target = (argc > TARGET_IDX) ? std::stod (argv[TARGET_IDX])
+						  : by_energy ? LOW_RANK_ENERGY
+									  : LOW_RANK_ACCURACY_LOSS;
+
+	std::vector<svd_factors> spectra = layer_spectra (mlp);
+	std::cout << std::fixed << "layer  shape      useful rank  ranks at "
+			  << "90% / 99% energy\n";
+	for (int i = 0; i < MLP_SIZE; ++i)
+	{
+	  const Matrix& w = mlp.get_layer (i).get_weights ();
+	  std::cout << std::left << std::setw (7) << i << std::setw (11)
+				<< std::to_string (w.get_rows ()) + "x" +
+				   std::to_string (w.get_cols ())
+				<< std::setw (13) << max_useful_rank (w)
+				<< rank_for_energy (spectra[i], 0.9) << " / "
+				<< rank_for_energy (spectra[i], 0.99) << std::right << "\n";
+	}
+
+	const mat_index base_macs = network_multiply_adds (mlp);
+	const double base_accuracy = evaluate (mlp, dataset).top1_accuracy;
+	std::cout << "\n" << std::left << std::setw (10) << "target"
+			  << std::setw (16) << "ranks" << std::right << std::setw (10)
+			  << "MACs" << std::setw (10) << "saving" << std::setw (10)
+			  << "top-1" << std::setw (10) << "loss" << std::setw (12)
+			  << "images/s" << "\n";
+	const std::vector<mat_index> full (MLP_SIZE, FULL_RANK);
+	print_row ("none", full, mlp, dataset, base_macs, base_accuracy);
+	for (double energy : sweep_energies)
+	{
+	  std::vector<mat_index> ranks = ranks_for_energy (mlp, spectra, energy);
+	  std::ostringstream name;
+	  name << std::setprecision (1) << std::fixed << energy * 100 << "%";
+	  print_row (name.str (), ranks, low_rank_network (mlp, spectra, ranks),
+				 dataset, base_macs, base_accuracy);
+	}
+
+	std::cout << "\nchosen (" << mode << " " << std::setprecision (4)
+			  << target << "):\n";
+	std::vector<mat_index> ranks = by_energy
+		? ranks_for_energy (mlp, spectra, target)
+		: ranks_for_accuracy (mlp, spectra, dataset, target, &std::cout);
+	print_row (mode, ranks, low_rank_network (mlp, spectra, ranks), dataset,
+			   base_macs, base_accuracy);
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#include "ModelIO.h"
+#include "Autotune.h"
+#include "Evaluator.h"
+#include <iostream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpeval w1 w2 w3 w4 b1 b2 b3 b4 images labels [k]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\timages - IDX image file (ubyte or float)\n" \
+                  "\tlabels - IDX label file\n" \
+                  "\tk - the k of the top-k accuracy"
+#define IMAGES_IDX ARGS_COUNT
+#define LABELS_IDX (ARGS_COUNT + 1)
+#define TOP_K_IDX (ARGS_COUNT + 2)
+
+/**
+ * Evaluates a model on a labelled IDX dataset and prints accuracy, the
+ * confusion matrix, per-class precision/recall, calibration and throughput.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc != TOP_K_IDX && argc != TOP_K_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  try
+  {
+	loadParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	tune_network (mlp);
+	IdxDataset dataset = loadIdxDataset (argv[IMAGES_IDX], argv[LABELS_IDX]);
+	int k = (argc > TOP_K_IDX) ? std::stoi (argv[TOP_K_IDX]) : EVAL_TOP_K;
+	print_report (evaluate (mlp, dataset, k), std::cout);
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+#include "ModelIO.h"
+#include "NpyIO.h"
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpiocheck w1 w2 w3 w4 b1 b2 b3 b4 dir\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tdir - an existing directory for the scratch files"
+#define DIR_IDX ARGS_COUNT
+#define NPZ_PLAIN "model.npz"
+#define NPZ_ZIP64 "model64.npz"
+
+/**
+ * @brief Tells whether two matrices have the same shape and bits.
+ */
+static bool same_matrix (const Matrix& a, const Matrix& b)
+{
+  return a.get_rows () == b.get_rows () && a.get_cols () == b.get_cols () &&
+         std::memcmp (a.get_data (), b.get_data (),
+                      (std::size_t) a.size () * sizeof (float)) == 0;
+}
+
+/**
+ * @brief Prints one check and returns whether it passed.
+ */
+static bool report (const std::string& check, bool passed)
+{
+  std::cout << (passed ? "ok    " : "FAIL  ") << check << std::endl;
+  return passed;
+}
+
+/**
+ * @brief Writes a matrix with writeMatrixToFile and reads it back with
+ * readFileToMatrix.
+ */
+static bool file_round_trip (const std::string& path, const Matrix& mat)
+{
+  writeMatrixToFile (path, mat);
+  Matrix loaded (mat.get_rows (), mat.get_cols ());
+  readFileToMatrix (path, loaded);
+  return same_matrix (loaded, mat);
+}
+
+/**
+ * @brief Writes the arrays as an archive, then loads and maps every one of
+ * them back.
+ */
+static bool archive_round_trip (const std::string& path,
+                                const std::map<std::string, Matrix>& arrays,
+                                bool zip64)
+{
+  save_npz (path, arrays, zip64);
+  std::map<std::string, Matrix> loaded = load_npz (path);
+  bool passed = loaded.size () == arrays.size ();
+  for (const auto& array : arrays)
+  {
+    passed = passed && same_matrix (loaded[array.first], array.second);
+    const MappedMatrix mapped = map_npz (path, array.first);
+    passed = passed && mapped.get_rows () == array.second.get_rows () &&
+             mapped.get_cols () == array.second.get_cols () &&
+             std::memcmp (mapped.get_data (), array.second.get_data (),
+                          (std::size_t) array.second.size () * sizeof (float))
+             == 0;
+  }
+  return passed;
+}
+
+/**
+ * Checks that model parameters survive every format the library writes:
+ * raw float files, .npy files (through writeMatrixToFile and save_npy) and
+ * .npz archives, plain and ZIP64, both loaded and mapped.
+ * @param argc count of args
+ * @param argv args values
+ * @return EXIT_SUCCESS if every round trip is bit exact
+ */
+int main (int argc, char **argv)
+{
+  if (argc != DIR_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  Matrix weights[MLP_SIZE];
+  Matrix biases[MLP_SIZE];
+  bool passed = true;
+  try
+  {
+	loadParameters (argv, weights, biases);
+	const std::string dir = std::string (argv[DIR_IDX]) + "/";
+	std::map<std::string, Matrix> arrays;
+	for (int i = 0; i < MLP_SIZE; ++i)
+	{
+	  const std::string w = "w" + std::to_string (i + 1);
+	  const std::string b = "b" + std::to_string (i + 1);
+	  passed &= report ("raw " + w, file_round_trip (dir + w, weights[i]));
+	  passed &= report ("raw " + b, file_round_trip (dir + b, biases[i]));
+	  passed &= report (w + NPY_EXTENSION, file_round_trip (
+		  dir + w + NPY_EXTENSION, weights[i]));
+	  passed &= report (b + NPY_EXTENSION, file_round_trip (
+		  dir + b + NPY_EXTENSION, biases[i]));
+	  arrays[w] = weights[i];
+	  arrays[b] = biases[i];
+	}
+	passed &= report (NPZ_PLAIN, archive_round_trip (dir + NPZ_PLAIN, arrays,
+													 false));
+	passed &= report (NPZ_ZIP64, archive_round_trip (dir + NPZ_ZIP64, arrays,
+													 true));
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,313 @@
+#include "ModelIO.h"
+#include "Autotune.h"
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlplatency w1 w2 w3 w4 b1 b2 b3 b4 closed|open " \
+                  "[concurrency] [rate] [seconds] [warmup] [hgrm]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tclosed - each client sends its next request as soon " \
+                  "as the last one returns\n" \
+                  "\topen - requests arrive at a fixed total rate, whether " \
+                  "or not earlier ones finished\n" \
+                  "\tconcurrency - client threads (default 1)\n" \
+                  "\trate - open loop requests/sec (default 1000)\n" \
+                  "\tseconds - measured duration (default 10)\n" \
+                  "\twarmup - seconds run before measuring (default 2)\n" \
+                  "\thgrm - file for the full percentile distribution"
+#define MODE_IDX ARGS_COUNT
+#define CONCURRENCY_IDX (ARGS_COUNT + 1)
+#define RATE_IDX (ARGS_COUNT + 2)
+#define SECONDS_IDX (ARGS_COUNT + 3)
+#define WARMUP_IDX (ARGS_COUNT + 4)
+#define HGRM_IDX (ARGS_COUNT + 5)
+#define CLOSED_LOOP "closed"
+#define OPEN_LOOP "open"
+#define DEFAULT_RATE 1000
+#define DEFAULT_SECONDS 10
+#define DEFAULT_WARMUP 2
+#define BENCH_IMAGE_POOL 64
+#define BENCH_DENSITY 0.2
+// an open-loop client sleeps until this long before a request is due and
+// spins for the rest, since sleeps overshoot by tens of microseconds
+#define SPIN_BEFORE_NS 200000
+#define NS_PER_US 1000.0
+#define MODE_ERROR "Error: mode must be closed or open"
+#define CONCURRENCY_ERROR "Error: concurrency and rate must be positive"
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ * @struct client_stats
+ * @brief What one client thread measured in the steady state.
+ * @var service - from the actual send to the response
+ * @var response - from the intended send to the response (open loop)
+ * @var warmup - requests completed during the warm-up
+ */
+typedef struct client_stats {
+	LatencyHistogram service;
+	LatencyHistogram response;
+	std::uint64_t warmup = 0;
+} client_stats;
+
+/**
+ * Makes images with about BENCH_DENSITY nonzero pixels, like digit scans.
+ * @return the images, vectorized
+ */
+static std::vector<Matrix> make_images ()
+{
+  std::mt19937 gen (7);
+  std::uniform_real_distribution<float> pixel (0, 1);
+  std::bernoulli_distribution lit (BENCH_DENSITY);
+  std::vector<Matrix> imgs;
+  for (int i = 0; i < BENCH_IMAGE_POOL; ++i)
+  {
+    Matrix img (img_dims.rows * img_dims.cols, 1);
+    for (mat_index p = 0; p < img.size (); ++p)
+    {
+      img[p] = lit (gen) ? pixel (gen) : 0;
+    }
+    imgs.push_back (std::move (img));
+  }
+  return imgs;
+}
+
+/**
+ * Returns the nanoseconds from a to b.
+ */
+static std::uint64_t ns_between (bench_clock::time_point a,
+                                 bench_clock::time_point b)
+{
+  return (std::uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>
+      (b - a).count ();
+}
+
+/**
+ * One closed-loop client: sends requests back to back until the end.
+ * @param mlp the network
+ * @param imgs the image pool; this client's copy
+ * @param measure_from start of the steady state
+ * @param until end of the run
+ * @param stats receives the measurements
+ */
+static void closed_client (const MlpNetwork& mlp, std::vector<Matrix> imgs,
+                           bench_clock::time_point measure_from,
+                           bench_clock::time_point until, client_stats& stats)
+{
+  volatile unsigned int sink = 0;
+  for (std::size_t i = 0;; ++i)
+  {
+    bench_clock::time_point sent = bench_clock::now ();
+    if (sent >= until)
+    {
+      break;
+    }
+    sink = sink + mlp (imgs[i % imgs.size ()]).value;
+    bench_clock::time_point done = bench_clock::now ();
+    if (sent < measure_from)
+    {
+      stats.warmup++;
+    }
+    else
+    {
+      stats.service.record (ns_between (sent, done));
+    }
+  }
+}
+
+/**
+ * One open-loop client: takes the next due request from a shared schedule
+ * of one request every period, waits until it is due, and sends it.
+ * @param mlp the network
+ * @param imgs the image pool; this client's copy
+ * @param next the shared schedule position
+ * @param start time the first request is due
+ * @param period nanoseconds between due times over all clients
+ * @param measure_from start of the steady state
+ * @param until end of the run
+ * @param stats receives the measurements
+ */
+static void open_client (const MlpNetwork& mlp, std::vector<Matrix> imgs,
+                         std::atomic<std::uint64_t>& next,
+                         bench_clock::time_point start, double period,
+                         bench_clock::time_point measure_from,
+                         bench_clock::time_point until, client_stats& stats)
+{
+  volatile unsigned int sink = 0;
+  for (;;)
+  {
+    const std::uint64_t i = next.fetch_add (1);
+    const bench_clock::time_point due = start +
+        std::chrono::nanoseconds ((std::int64_t) (i * period));
+    if (due >= until)
+    {
+      break;
+    }
+    std::this_thread::sleep_until (due -
+                                   std::chrono::nanoseconds (SPIN_BEFORE_NS));
+    bench_clock::time_point sent;
+    while ((sent = bench_clock::now ()) < due)
+    {
+    }
+    sink = sink + mlp (imgs[i % imgs.size ()]).value;
+    bench_clock::time_point done = bench_clock::now ();
+    if (due < measure_from)
+    {
+      stats.warmup++;
+    }
+    else
+    {
+      stats.service.record (ns_between (sent, done));
+      // measuring from the due time charges queueing behind late requests
+      // to the requests that waited, which corrects coordinated omission
+      stats.response.record (ns_between (due, done));
+    }
+  }
+}
+
+/**
+ * Prints one line of latency percentiles in microseconds.
+ * @param name the line label
+ * @param hist the histogram
+ */
+static void print_latency (const std::string& name,
+                           const LatencyHistogram& hist)
+{
+  std::cout << std::left << std::setw (26) << name << std::right
+            << std::setw (10) << hist.count ();
+  for (std::uint64_t value : {hist.min (), hist.percentile (50),
+                              hist.percentile (90), hist.percentile (99),
+                              hist.percentile (99.9), hist.percentile (99.99),
+                              hist.max ()})
+  {
+    std::cout << std::setw (10) << value / NS_PER_US;
+  }
+  std::cout << std::setw (10) << hist.mean () / NS_PER_US << "\n";
+}
+
+/**
+ * Runs single-image inference under closed-loop or open-loop load and
+ * reports steady-state latency percentiles, raw and corrected for
+ * coordinated omission.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc < MODE_IDX + 1 || argc > HGRM_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  try
+  {
+	MatrixPtr weights[MLP_SIZE];
+	MatrixPtr biases[MLP_SIZE];
+	loadSharedParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	tune_network (mlp);
+	const std::string mode = argv[MODE_IDX];
+	if (mode != CLOSED_LOOP && mode != OPEN_LOOP)
+	{
+	  throw std::invalid_argument (MODE_ERROR);
+	}
+	const bool open = (mode == OPEN_LOOP);
+	int clients = (argc > CONCURRENCY_IDX) ? std::stoi (argv[CONCURRENCY_IDX])
+										   : 1;
+	double rate = (argc > RATE_IDX) ? std::stod (argv[RATE_IDX])
+									: DEFAULT_RATE;
+	double seconds = (argc > SECONDS_IDX) ? std::stod (argv[SECONDS_IDX])
+										  : DEFAULT_SECONDS;
+	double warmup = (argc > WARMUP_IDX) ? std::stod (argv[WARMUP_IDX])
+										: DEFAULT_WARMUP;
+	if (clients <= 0 || (open && rate <= 0))
+	{
+	  throw std::invalid_argument (CONCURRENCY_ERROR);
+	}
+
+	std::vector<Matrix> imgs = make_images ();
+	std::vector<client_stats> stats (clients);
+	std::vector<std::thread> threads;
+	std::atomic<std::uint64_t> next (0);
+	const bench_clock::time_point start = bench_clock::now ();
+	const bench_clock::time_point measure_from = start +
+		std::chrono::nanoseconds ((std::int64_t) (warmup * 1e9));
+	const bench_clock::time_point until = measure_from +
+		std::chrono::nanoseconds ((std::int64_t) (seconds * 1e9));
+	for (int c = 0; c < clients; ++c)
+	{
+	  if (open)
+	  {
+		threads.emplace_back (open_client, std::cref (mlp), imgs,
+							  std::ref (next), start, 1e9 / rate,
+							  measure_from, until, std::ref (stats[c]));
+	  }
+	  else
+	  {
+		threads.emplace_back (closed_client, std::cref (mlp), imgs,
+							  measure_from, until, std::ref (stats[c]));
+	  }
+	}
+	for (std::thread& thread : threads)
+	{
+	  thread.join ();
+	}
+
+	client_stats total;
+	for (const client_stats& s : stats)
+	{
+	  total.service.merge (s.service);
+	  total.response.merge (s.response);
+	  total.warmup += s.warmup;
+	}
+	std::cout << std::fixed << std::setprecision (1)
+			  << mode << " loop, " << clients << " client(s)";
+	if (open)
+	{
+	  std::cout << ", target " << rate << " req/s";
+	}
+	std::cout << "\nwarm-up: " << warmup << " s, " << total.warmup
+			  << " requests (not recorded)\nsteady state: " << seconds
+			  << " s, " << total.service.count () << " requests, "
+			  << total.service.count () / seconds << " req/s\n\n"
+			  << std::left << std::setw (26) << "latency (us)" << std::right
+			  << std::setw (10) << "count";
+	for (const char* column : {"min", "p50", "p90", "p99", "p99.9",
+							   "p99.99", "max", "mean"})
+	{
+	  std::cout << std::setw (10) << column;
+	}
+	std::cout << "\n" << std::setprecision (2);
+	print_latency ("service", total.service);
+	LatencyHistogram corrected = open ? total.response
+		: total.service.corrected (total.service.percentile (50));
+	print_latency (open ? "response (CO-corrected)"
+						: "CO-corrected (p50 pace)", corrected);
+
+	if (argc > HGRM_IDX)
+	{
+	  std::ofstream hgrm (argv[HGRM_IDX]);
+	  corrected.print_distribution (hgrm, NS_PER_US);
+	  if (!hgrm)
+	  {
+		throw std::runtime_error (std::string ("Error: Failed to write ") +
+								  argv[HGRM_IDX]);
+	  }
+	}
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -1,14 +1,16 @@
 #include "Matrix.h"
 #include "Activation.h"
+#include "Autotune.h"
 #include "Dense.h"
 #include "MlpNetwork.h"
+#include "ModelIO.h"
+#include "Trace.h"
 #include <fstream>
 #include <iostream>
 
 
 #define QUIT "q"
 #define INSERT_IMAGE_PATH "Please insert image path:"
-#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
 #define ERROR_INVALID_INPUT "Error: Failed to retrieve input. Exiting.."
 #define ERROR_INVALID_IMG "Error: invalid image path or size: "
 #define USAGE_MSG "Usage:\n" \
@@ -16,10 +18,6 @@
                   "\twi - the i'th layer's weights\n" \
                   "\tbi - the i'th layer's biases"
 #define USAGE_ERR "Error: wrong number of arguments."
-#define ARGS_START_IDX 1
-#define ARGS_COUNT (ARGS_START_IDX + (MLP_SIZE * 2))
-#define WEIGHTS_START_IDX ARGS_START_IDX
-#define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
 
 /**
  * Prints program usage to stdout.
@@ -35,82 +33,6 @@ void usage (int argc) noexcept (false)
   std::cout << USAGE_MSG << std::endl;
 }
 
-/**
- * Given a binary file path and a matrix,
- * reads the content of the file into the matrix.
- * file must match matrix in size in order to read successfully.
- * @param filePath - path of the binary file to read
- * @param mat -  matrix to read the file into.
- * @return boolean status
- *          true - success
- *          false - failure
- */
-bool readFileToMatrix (const std::string &filePath, Matrix &mat)
-{
-  // Open the binary file
-  std::ifstream file(filePath, std::ios::binary);
-  if (!file) {
-    throw std::runtime_error("Failed to open the file");
-  }
-  // Determine the size of the file
-  file.seekg(0, std::ios::end);
-  std::streampos fileSize = file.tellg();
-  file.seekg(0, std::ios::beg);
-
-  // Calculate the expected matrix size
-  std::streampos expectedSize = mat.get_rows() * mat.get_cols() * sizeof(float);
-
-  // Check if the file size matches the expected matrix size
-  if (fileSize != expectedSize) {
-    throw std::runtime_error("File size does not match the expected "
-                             "matrix size.");
-    file.close();
-    return false;
-  }
-
-  // Read the file content into the matrix
-  try {
-    file >> mat;
-  } catch (const std::exception& e) {
-    throw std::runtime_error("Error occurred while reading the file");
-  }
-  // Close the file
-  file.close();
-  return true;
-}
-
-/**
- * Loads MLP parameters from weights & biases paths
- * to Weights[] and Biases[].
- * Throws an exception upon failures.
- * @param paths array of programs arguments, expected to be mlp parameters
- *        path.
- * @param weights array of matrix, weigths[i] is the i'th layer weights matrix
- * @param biases array of matrix, biases[i] is the i'th layer bias matrix
- *          (which is actually a vector)
- *  @throw std::invalid_argument in case of problem with a certain argument
- */
-void loadParameters (char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE],
-					 Matrix biases[MLP_SIZE]) noexcept (false)
-{
-  for (int i = 0; i < MLP_SIZE; i++)
-  {
-	weights[i] = Matrix (weights_dims[i].rows, weights_dims[i].cols);
-	biases[i] = Matrix (bias_dims[i].rows, bias_dims[i].cols);
-
-	std::string weightsPath (paths[WEIGHTS_START_IDX + i]);
-	std::string biasPath (paths[BIAS_START_IDX + i]);
-
-	if (!(readFileToMatrix (weightsPath, weights[i]) &&
-		  readFileToMatrix (biasPath, biases[i])))
-	{
-	  auto msg = ERROR_INAVLID_PARAMETER + std::to_string (i + 1);
-	  throw std::invalid_argument (msg);
-	}
-
-  }
-}
-
 /**
  * This programs Command line interface for the mlp network.
  * Looping on: {
@@ -136,10 +58,30 @@ void mlpCli (MlpNetwork &mlp) noexcept (false)
 
   while (imgPath != QUIT)
   {
-	if (readFileToMatrix (imgPath, img))
+	TRACE_SPAN("cli request", "request");
+	if (isByteImageFile (imgPath))
+	{
+	  // raw pixels go to the network as they are; only the printed copy
+	  // is converted
+	  byte_image pixels;
+	  readFileToBytes (imgPath, pixels);
+	  digit output = mlp (pixels);
+	  const byte_normalization norm = mlp.get_byte_normalization ();
+	  for (mat_index i = 0; i < img.size (); ++i)
+	  {
+		img[i] = pixels[i] * norm.scale + norm.offset;
+	  }
+	  TRACE_SPAN("output", "io");
+	  std::cout << "Image processed:" << std::endl
+				<< img << std::endl;
+	  std::cout << "Mlp result: " << output.value <<
+				" at probability: " << output.probability << std::endl;
+	}
+	else if (readFileToMatrix (imgPath, img))
 	{
 	  Matrix imgVec = img;
 	  digit output = mlp (imgVec.vectorize ());
+	  TRACE_SPAN("output", "io");
 	  std::cout << "Image processed:" << std::endl
 				<< img << std::endl;
 	  std::cout << "Mlp result: " << output.value <<
@@ -178,12 +120,12 @@ int main (int argc, char **argv)
 
   }
 
-  Matrix weights[MLP_SIZE];
-  Matrix biases[MLP_SIZE];
+  MatrixPtr weights[MLP_SIZE];
+  MatrixPtr biases[MLP_SIZE];
 
   try
   {
-	loadParameters (argv, weights, biases);
+	loadSharedParameters (argv, weights, biases);
 
   }
   catch (const std::invalid_argument &invalidArgument)
@@ -196,6 +138,7 @@ int main (int argc, char **argv)
 
   try
   {
+	tune_network (mlp);
 	mlpCli (mlp);
   }
 
@@ -205,6 +148,11 @@ int main (int argc, char **argv)
 	return EXIT_FAILURE;
 
   }
+  catch (const std::runtime_error &runtimeError)
+  {
+	std::cerr << runtimeError.what () << std::endl;
+	return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 }
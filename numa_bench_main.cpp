@@ -0,0 +1,157 @@
+#include "ModelIO.h"
+#include "Numa.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpnumabench w1 w2 w3 w4 b1 b2 b3 b4 [images] " \
+                  "[max_threads]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\timages - synthetic images per batch (default 8192)\n" \
+                  "\tmax_threads - largest thread count (default: all CPUs)"
+#define IMAGES_IDX ARGS_COUNT
+#define THREADS_IDX (ARGS_COUNT + 1)
+#define BENCH_IMAGES 8192
+#define BENCH_REPEATS 5
+#define BENCH_DENSITY 0.2
+
+typedef std::chrono::steady_clock bench_clock;
+
+/**
+ * Makes images with about BENCH_DENSITY nonzero pixels, like digit scans.
+ * @param count number of images
+ * @return the images
+ */
+static std::vector<Matrix> make_images (int count)
+{
+  std::mt19937 gen (7);
+  std::uniform_real_distribution<float> pixel (0, 1);
+  std::bernoulli_distribution lit (BENCH_DENSITY);
+  std::vector<Matrix> imgs;
+  for (int i = 0; i < count; ++i)
+  {
+    Matrix img (img_dims.rows, img_dims.cols);
+    for (int p = 0; p < img_dims.rows * img_dims.cols; ++p)
+    {
+      img[p] = lit (gen) ? pixel (gen) : 0;
+    }
+    imgs.push_back (std::move (img));
+  }
+  return imgs;
+}
+
+/**
+ * Classifies the batch with unpinned threads that all read one copy of the
+ * weights, wherever the loader placed it.
+ * @param mlp the network
+ * @param imgs the batch
+ * @param threads number of threads
+ */
+static void run_shared (const MlpNetwork& mlp, const std::vector<Matrix>& imgs,
+                        int threads)
+{
+  std::atomic<std::size_t> next (0);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t)
+  {
+    pool.emplace_back ([&mlp, &imgs, &next] ()
+    {
+      std::size_t lo;
+      while ((lo = next.fetch_add (BATCH_CHUNK)) < imgs.size ())
+      {
+        std::size_t hi = std::min (imgs.size (), lo + BATCH_CHUNK);
+        mlp.forward (MlpNetwork::pack_batch (imgs, lo, hi)).col_argmax ();
+      }
+    });
+  }
+  for (std::thread& thread : pool)
+  {
+    thread.join ();
+  }
+}
+
+/**
+ * Returns the best images/sec of BENCH_REPEATS runs.
+ * @param run runs the whole batch once
+ * @param images batch size
+ */
+static double best_rate (const std::function<void ()>& run, std::size_t images)
+{
+  run (); // warm-up
+  double best = 0;
+  for (int r = 0; r < BENCH_REPEATS; ++r)
+  {
+    bench_clock::time_point t0 = bench_clock::now ();
+    run ();
+    double sec = std::chrono::duration<double> (bench_clock::now () - t0)
+        .count ();
+    best = std::max (best, images / sec);
+  }
+  return best;
+}
+
+/**
+ * Measures batch throughput against the thread count with one shared weight
+ * copy and unpinned threads, and with one replica per NUMA node and pinned,
+ * node-local workers.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc < ARGS_COUNT || argc > THREADS_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  try
+  {
+	MatrixPtr weights[MLP_SIZE];
+	MatrixPtr biases[MLP_SIZE];
+	loadSharedParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	int images = (argc > IMAGES_IDX) ? std::stoi (argv[IMAGES_IDX])
+									 : BENCH_IMAGES;
+	std::vector<numa_node> topology = numa_topology ();
+	int cpus = 0;
+	for (const numa_node& node : topology)
+	{
+	  cpus += (int) node.cpus.size ();
+	}
+	int max_threads = (argc > THREADS_IDX) ? std::stoi (argv[THREADS_IDX])
+										   : cpus;
+	std::vector<Matrix> imgs = make_images (images);
+
+	std::cout << "NUMA nodes: " << topology.size () << ", CPUs: " << cpus
+			  << ", images per batch: " << images << "\n"
+			  << std::setw (8) << "threads" << std::setw (14) << "shared/s"
+			  << std::setw (14) << "numa/s" << std::setw (10) << "gain"
+			  << "\n" << std::fixed << std::setprecision (0);
+	for (int threads = 1; threads <= max_threads;
+		 threads = (threads * 2 <= max_threads || threads == max_threads)
+				   ? threads * 2 : max_threads)
+	{
+	  double shared = best_rate ([&mlp, &imgs, threads] ()
+								 { run_shared (mlp, imgs, threads); },
+								 imgs.size ());
+	  NumaMlpNetwork numa (mlp, threads, topology);
+	  double local = best_rate ([&numa, &imgs] ()
+								{ numa.predict_batch (imgs); }, imgs.size ());
+	  std::cout << std::setw (8) << threads << std::setw (14) << shared
+				<< std::setw (14) << local << std::setw (9)
+				<< std::setprecision (2) << local / shared << "x\n"
+				<< std::setprecision (0);
+	}
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+#include "ModelIO.h"
+#include "ModelHandle.h"
+#include "LatencyHistogram.h"
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpreload w1 w2 w3 w4 b1 b2 b3 b4 [readers] " \
+                  "[seconds]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\treaders - inference threads (default: hardware " \
+                  "threads - 1)\n" \
+                  "\tseconds - duration (default 10)"
+#define READERS_IDX ARGS_COUNT
+#define SECONDS_IDX (ARGS_COUNT + 1)
+#define DEFAULT_SECONDS 10
+#define STRESS_IMAGE_POOL 64
+#define STRESS_DENSITY 0.2
+#define NS_PER_US 1000.0
+#define READERS_ERROR "Error: readers and seconds must be positive"
+
+typedef std::chrono::steady_clock stress_clock;
+
+/**
+ * @struct reader_stats
+ * @brief What one reader thread saw.
+ * @var latency - nanoseconds from read() to the classified digit
+ * @var wrong - results that differ from the pinned version's expected one
+ */
+typedef struct reader_stats {
+	LatencyHistogram latency;
+	std::uint64_t wrong = 0;
+} reader_stats;
+
+/**
+ * Makes images with about STRESS_DENSITY nonzero pixels, like digit scans.
+ * @return the images, vectorized
+ */
+static std::vector<Matrix> make_images ()
+{
+  std::mt19937 gen (7);
+  std::uniform_real_distribution<float> pixel (0, 1);
+  std::bernoulli_distribution lit (STRESS_DENSITY);
+  std::vector<Matrix> imgs;
+  for (int i = 0; i < STRESS_IMAGE_POOL; ++i)
+  {
+    Matrix img (img_dims.rows * img_dims.cols, 1);
+    for (mat_index p = 0; p < img.size (); ++p)
+    {
+      img[p] = lit (gen) ? pixel (gen) : 0;
+    }
+    imgs.push_back (std::move (img));
+  }
+  return imgs;
+}
+
+/**
+ * Makes the second model the test alternates with: the output layer's
+ * rows rotated by one, so every image is classified as the next digit.
+ * Its layers share the original's weights apart from that one.
+ * @param mlp the original
+ * @return the variant
+ */
+static std::shared_ptr<const MlpNetwork> rotated_model (const MlpNetwork& mlp)
+{
+  const Dense& last = mlp.get_layer (MLP_SIZE - 1);
+  const Matrix& weights = last.get_weights ();
+  const Matrix& bias = last.get_bias ();
+  const mat_index classes = weights.get_rows ();
+  Matrix rotated_weights (classes, weights.get_cols ());
+  Matrix rotated_bias (classes, 1);
+  for (mat_index i = 0; i < classes; ++i)
+  {
+    const mat_index from = (i + classes - 1) % classes;
+    for (mat_index j = 0; j < weights.get_cols (); ++j)
+    {
+      rotated_weights (i, j) = weights (from, j);
+    }
+    rotated_bias[i] = bias[from];
+  }
+  auto variant = std::make_shared<MlpNetwork> (mlp);
+  variant->set_layer (MLP_SIZE - 1,
+                      Dense (share_matrix (std::move (rotated_weights)),
+                             share_matrix (std::move (rotated_bias)),
+                             last.get_activation ()));
+  return variant;
+}
+
+/**
+ * One reader: classifies the pool over and over, each image with whatever
+ * model is published, and checks the digit against the one expected of
+ * the pinned version (odd versions are the files' model, even ones the
+ * rotated variant).
+ * @param handle the model handle
+ * @param imgs the image pool; this reader's copy
+ * @param expected expected[v % 2][k] is version v's digit for image k
+ * @param stop set when the run is over
+ * @param stats receives the measurements
+ */
+static void reader (const ModelHandle& handle, std::vector<Matrix> imgs,
+                    const std::vector<unsigned int> (&expected)[2],
+                    const std::atomic<bool>& stop, reader_stats& stats)
+{
+  for (std::size_t i = 0; !stop.load (std::memory_order_relaxed); ++i)
+  {
+    const std::size_t k = i % imgs.size ();
+    stress_clock::time_point start = stress_clock::now ();
+    ModelHandle::Reader model = handle.read ();
+    const digit result = (*model) (imgs[k]);
+    stats.latency.record ((std::uint64_t) std::chrono::duration_cast<
+        std::chrono::nanoseconds> (stress_clock::now () - start).count ());
+    if (result.value != expected[model.version () % 2][k])
+    {
+      stats.wrong++;
+    }
+  }
+}
+
+/**
+ * Serves inference on several threads while another thread swaps the
+ * model continuously, alternately reloading it from the files and
+ * publishing a variant, and checks that every request used one whole
+ * model and that every replaced model is freed.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc < ARGS_COUNT || argc > SECONDS_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  try
+  {
+	MatrixPtr weights[MLP_SIZE];
+	MatrixPtr biases[MLP_SIZE];
+	loadSharedParameters (argv, weights, biases);
+	auto original = std::make_shared<const MlpNetwork> (weights, biases);
+	std::shared_ptr<const MlpNetwork> variant = rotated_model (*original);
+	const int hardware = (int) std::thread::hardware_concurrency ();
+	int readers = (argc > READERS_IDX) ? std::stoi (argv[READERS_IDX])
+									   : std::max (1, hardware - 1);
+	double seconds = (argc > SECONDS_IDX) ? std::stod (argv[SECONDS_IDX])
+										  : DEFAULT_SECONDS;
+	if (readers <= 0 || seconds <= 0)
+	{
+	  throw std::invalid_argument (READERS_ERROR);
+	}
+	std::vector<std::string> paths (argv + ARGS_START_IDX,
+									argv + ARGS_COUNT);
+
+	std::vector<Matrix> imgs = make_images ();
+	std::vector<unsigned int> expected[2];
+	for (Matrix img : imgs)
+	{
+	  Matrix copy = img;
+	  expected[1].push_back ((*original) (img).value);
+	  expected[0].push_back ((*variant) (copy).value);
+	}
+
+	ModelHandle handle (original);
+	std::atomic<bool> stop (false);
+	std::vector<reader_stats> stats (readers);
+	std::vector<std::thread> threads;
+	for (int r = 0; r < readers; ++r)
+	{
+	  threads.emplace_back (reader, std::cref (handle), imgs,
+							std::cref (expected), std::cref (stop),
+							std::ref (stats[r]));
+	}
+	std::size_t retired_peak = 0;
+	unsigned long long reloads = 0;
+	const stress_clock::time_point start = stress_clock::now ();
+	const stress_clock::time_point until = start +
+		std::chrono::nanoseconds ((std::int64_t) (seconds * 1e9));
+	while (stress_clock::now () < until)
+	{
+	  // even versions are the variant, odd ones the files reloaded
+	  if (handle.get_stats ().version % 2 == 1)
+	  {
+		handle.publish (variant);
+	  }
+	  else
+	  {
+		handle.reload_async (paths).get ();
+		reloads++;
+	  }
+	  retired_peak = std::max (retired_peak, handle.get_stats ().retired);
+	}
+	stop = true;
+	for (std::thread& thread : threads)
+	{
+	  thread.join ();
+	}
+	handle.collect ();
+
+	reader_stats total;
+	for (const reader_stats& s : stats)
+	{
+	  total.latency.merge (s.latency);
+	  total.wrong += s.wrong;
+	}
+	const handle_stats swaps = handle.get_stats ();
+	std::cout << std::fixed << std::setprecision (1)
+			  << readers << " reader(s), " << seconds << " s\n"
+			  << "swaps: " << swaps.publishes << " ("
+			  << swaps.publishes / seconds << "/s), " << reloads
+			  << " reloaded from disk, " << swaps.rejected << " rejected\n"
+			  << "reads: " << total.latency.count () << " ("
+			  << total.latency.count () / seconds << "/s), "
+			  << total.wrong << " with a wrong model's result\n"
+			  << std::setprecision (2) << "read latency (us): p50 "
+			  << total.latency.percentile (50) / NS_PER_US << ", p99 "
+			  << total.latency.percentile (99) / NS_PER_US << ", p99.9 "
+			  << total.latency.percentile (99.9) / NS_PER_US << ", max "
+			  << total.latency.max () / NS_PER_US << "\n"
+			  << "replaced models: " << swaps.reclaimed << " freed, "
+			  << retired_peak << " held by readers at most, "
+			  << swaps.retired << " left after the readers finished"
+			  << std::endl;
+	if (total.wrong != 0 || swaps.retired != 0)
+	{
+	  return EXIT_FAILURE;
+	}
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#include "ModelIO.h"
+#include "Autotune.h"
+#include "ThreadPool.h"
+#include <iostream>
+
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlptune w1 w2 w3 w4 b1 b2 b3 b4 [cache]\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tcache - tuning cache file (default $" \
+                  TUNING_CACHE_ENV_VAR " or " TUNING_CACHE_FILE ")"
+#define CACHE_IDX ARGS_COUNT
+
+/**
+ * Tunes the kernel parameters of a model on this machine and stores them in
+ * the tuning cache, where mlpnetwork and mlpeval pick them up at startup.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main (int argc, char **argv)
+{
+  if (argc != ARGS_COUNT && argc != CACHE_IDX + 1)
+  {
+	std::cerr << USAGE_MSG << std::endl;
+	return EXIT_FAILURE;
+  }
+  try
+  {
+	MatrixPtr weights[MLP_SIZE];
+	MatrixPtr biases[MLP_SIZE];
+	loadSharedParameters (argv, weights, biases);
+	MlpNetwork mlp (weights, biases);
+	std::string path = (argc > CACHE_IDX) ? argv[CACHE_IDX]
+										  : tuning_cache_path ();
+	std::string cpu = cpu_model ();
+	std::string shape = model_shape (mlp);
+	int threads = ThreadPool::shared ().concurrency ();
+	std::cout << "CPU: " << cpu << "\nmodel: " << shape << "\nthreads: "
+			  << threads << std::endl;
+	model_tuning tuning = autotune (mlp, &std::cout);
+	store_tuning (path, cpu, shape, threads, tuning);
+	std::cout << "saved to " << path << std::endl;
+  }
+  catch (const std::exception &e)
+  {
+	std::cerr << e.what () << std::endl;
+	return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}